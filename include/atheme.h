@@ -44,8 +44,10 @@
 #include <atheme/inline.h>
 #include <atheme/instpaths.h>
 #include <atheme/linker.h>
+#include <atheme/listindex.h>
 #include <atheme/match.h>
 #include <atheme/memory.h>
+#include <atheme/metrics.h>
 #include <atheme/module.h>
 #include <atheme/object.h>
 #include <atheme/pbkdf2.h>
@@ -67,6 +69,7 @@
 #include <atheme/table.h>
 #include <atheme/taint.h>
 #include <atheme/template.h>
+#include <atheme/threadpool.h>
 #include <atheme/tools.h>
 #include <atheme/uid.h>
 #include <atheme/uplink.h>
@@ -76,6 +76,7 @@ struct myuser
 	struct soper *          soper;
 	unsigned int            flags;
 	mowgli_list_t           memos;                  // store memos
+	struct mymemo_cold *    memos_cold;             // where memos in cold storage are, if any (see memocold.c)
 	unsigned int            memoct_new;
 	unsigned int            memo_ratelimit_num;     // memos sent recently
 	time_t                  memo_ratelimit_time;    // last time a memo was sent
@@ -289,6 +290,19 @@ struct mymemo
 	unsigned int    status;
 };
 
+// location of an account's memos in cold storage
+struct mymemo_cold
+{
+	mowgli_node_t           node;                   // in the list of frozen or of thawed accounts
+	struct myuser *         mu;
+	off_t                   offset;
+	size_t                  len;
+	unsigned int            count;
+	bool                    frozen;                 // whether the memos are in the file rather than mu->memos
+};
+
+typedef void (*myuser_memo_cold_cb)(const struct mymemo *mz, void *priv);
+
 /* memo status flags */
 #define MEMO_READ          0x00000001U
 #define MEMO_CHANNEL       0x00000002U
@@ -305,7 +319,8 @@ enum db_save_strategy
 {
 	DB_SAVE_BLOCKING,
 	DB_SAVE_BG_REGULAR,
-	DB_SAVE_BG_IMPORTANT
+	DB_SAVE_BG_IMPORTANT,
+	DB_SAVE_BG_THREAD,              // serialise in event loop time slices, written out by a thread
 };
 
 extern void (*db_save)(void *arg, enum db_save_strategy strategy);
@@ -418,6 +433,15 @@ void expire_check(void *arg);
 /* Check the database for (version) problems common to all backends */
 void db_check(void);
 
+/* memocold.c */
+bool myuser_memo_add_cold(struct myuser *mu, const struct mymemo *mz);
+bool myuser_memo_append_cold(struct myuser *mu, const struct mymemo *mz);
+size_t myuser_memos_count(const struct myuser *mu);
+bool myuser_memos_cold_foreach(struct myuser *mu, myuser_memo_cold_cb cb, void *priv);
+void myuser_memos_thaw(struct myuser *mu);
+bool myuser_memos_freeze(struct myuser *mu);
+void myuser_memos_cold_drop(struct myuser *mu);
+
 /* svsignore.c */
 extern mowgli_list_t svs_ignore_list;
 
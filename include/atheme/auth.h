@@ -14,10 +14,22 @@
 #include <atheme/stdheaders.h>
 #include <atheme/structures.h>
 
+typedef void (*verify_password_cb)(struct myuser *mu, bool verified, void *priv);
+
 void set_password(struct myuser *mu, const char *newpassword);
 bool verify_password(struct myuser *mu, const char *password) ATHEME_FATTR_WUR;
+struct verify_password_req *verify_password_async(struct myuser *mu, const char *password, verify_password_cb cb,
+                                                  void *priv) ATHEME_FATTR_WUR;
+void verify_password_cancel(struct verify_password_req *req);
+void verify_password_complete(struct verify_password_req *req, bool verified);
+unsigned int verify_password_pending(void) ATHEME_FATTR_WUR;
 
 extern bool auth_module_loaded;
 extern bool (*auth_user_custom)(struct myuser *mu, const char *password) ATHEME_FATTR_WUR;
 
+/* Optional; used by verify_password_async() instead of auth_user_custom. The
+ * password is only valid for the duration of the call.
+ */
+extern void (*auth_user_custom_async)(struct myuser *mu, const char *password, struct verify_password_req *req);
+
 #endif /* !ATHEME_INC_AUTH_H */
@@ -20,11 +20,24 @@
 typedef const char *(*crypt_crypt_func)(const char *, const char *) ATHEME_FATTR_WUR;
 typedef bool (*crypt_verify_func)(const char *, const char *, unsigned int *) ATHEME_FATTR_WUR;
 
+// One password to check with a crypt_verify_batch_func
+struct crypt_verify_item
+{
+	const char *            password;
+	const char *            parameters;
+	unsigned int            flags;                  // PWVERIFY_FLAG_*, as set by crypt_verify_func
+	bool                    verified;               // what crypt_verify_func would have returned
+};
+
+typedef void (*crypt_verify_batch_func)(struct crypt_verify_item *, size_t);
+
 struct crypt_impl
 {
 	const char *            id;
 	crypt_crypt_func        crypt;
 	crypt_verify_func       verify;
+	crypt_verify_batch_func verify_batch;           // optional; verify() for several passwords at once
+	bool                    verify_threadsafe;      // verify() may run on a worker thread (see auth.c)
 };
 
 void crypt_register(const struct crypt_impl *impl);
@@ -17,6 +17,14 @@
 
 extern bool strict_mode;
 
+/* Bumped whenever an entity or a registered channel is created, destroyed or
+ * renamed. An incremental save compares it between slices to detect that the
+ * rows it has already serialised may now reference things that are gone.
+ */
+extern unsigned int db_generation;
+
+#define DB_ARENA_CHUNK_SIZE     1048576U
+
 enum database_transaction
 {
 	DB_READ,
@@ -53,6 +61,25 @@ struct database_handle
 	char *                          file;
 	unsigned int                    line;
 	unsigned int                    token;
+
+	// Profiling state for the row currently being written or processed
+	struct database_row_profile *   profile;
+	struct timeval                  profile_start;
+	size_t                          profile_bytes;
+};
+
+struct database_row_stats
+{
+	unsigned long long              rows;
+	unsigned long long              bytes;          // as encoded by the OpenSEX grammar
+	unsigned long long              usec;
+};
+
+// Per-row-type statistics, indexed by enum database_transaction
+struct database_row_profile
+{
+	char *                          type;
+	struct database_row_stats       stats[2];
 };
 
 struct database_module
@@ -60,11 +87,37 @@ struct database_module
 	struct database_handle *      (*db_open)(const char *filename, enum database_transaction txn);
 	void                          (*db_close)(struct database_handle *db);
 	void                          (*db_parse)(struct database_handle *db);
+
+	// Optional; opens a write handle that serialises into memory instead of a file
+	struct database_handle *      (*db_open_arena)(struct database_arena *arena);
+};
+
+struct database_arena_chunk
+{
+	mowgli_node_t                   node;
+	size_t                          len;
+	size_t                          size;
+	char *                          buf;
+};
+
+// Serialised database contents, built by the event loop and written out by a thread
+struct database_arena
+{
+	mowgli_list_t                   chunks;
+	size_t                          size;
 };
 
 struct database_handle *db_open(const char *filename, enum database_transaction txn);
 void db_close(struct database_handle *db);
 void db_parse(struct database_handle *db);
+struct database_handle *db_open_arena(struct database_arena *arena);
+
+struct database_arena *db_arena_create(void) ATHEME_FATTR_MALLOC;
+void db_arena_destroy(struct database_arena *arena);
+bool db_arena_append(struct database_arena *arena, const char *data, size_t len);
+bool db_arena_vprintf(struct database_arena *arena, const char *fmt, va_list ap) ATHEME_FATTR_PRINTF(2, 0);
+bool db_arena_printf(struct database_arena *arena, const char *fmt, ...) ATHEME_FATTR_PRINTF(2, 3);
+int db_arena_commit(const struct database_arena *arena, const char *path) ATHEME_FATTR_WUR;
 
 bool db_read_next_row(struct database_handle *db);
 
@@ -91,10 +144,22 @@ bool db_commit_row(struct database_handle *db);
 
 typedef void (*database_handler_fn)(struct database_handle *db, const char *type);
 
-void db_register_type_handler(const char *type, database_handler_fn fun);
+unsigned int db_register_type_handler(const char *type, database_handler_fn fun);
 void db_unregister_type_handler(const char *type);
+unsigned int db_type_id(const char *type);
 void db_process(struct database_handle *db, const char *type);
+void db_process_id(struct database_handle *db, unsigned int id);
 void db_init(void);
 extern const struct database_module *db_mod;
 
+/* Row type (as a string) => struct database_row_profile; the DB_READ stats
+ * cover the most recent load, and the DB_WRITE stats the most recent save
+ * performed by this process (saves done by a forked child are not seen).
+ */
+extern mowgli_patricia_t *db_profiles;
+extern time_t db_profile_ts[2];
+
+void db_profile_reset(enum database_transaction txn);
+struct database_row_profile **db_profile_sort(enum database_transaction txn, size_t *count) ATHEME_FATTR_WUR;
+
 #endif /* !ATHEME_INC_DATABASE_BACKEND_H */
@@ -83,4 +83,20 @@ void digest_direct_final_sha1(union digest_direct_ctx *, void *);
 void digest_direct_final_sha2_256(union digest_direct_ctx *, void *);
 void digest_direct_final_sha2_512(union digest_direct_ctx *, void *);
 
+/* Multi-buffer PBKDF2 iterations (see digest_direct_sha2_mb.c). Each lane has
+ * its own HMAC inner and outer midstate, and U(1) in 't' on entry; on return
+ * 't' holds T for that lane. All lanes use the same iteration count.
+ */
+size_t digest_direct_mb_kernel_count(void);
+const char *digest_direct_mb_kernel_name(size_t);
+bool digest_direct_mb_kernel_select(size_t) ATHEME_FATTR_WUR;
+void digest_direct_mb_kernel_select_best(void);
+const char *digest_direct_mb_kernel_current(void);
+size_t digest_direct_mb_lanes(bool);
+
+void digest_direct_mb_pbkdf2_sha2_256(size_t, const uint32_t (*)[DIGEST_IVLEN_SHA2_256],
+    const uint32_t (*)[DIGEST_IVLEN_SHA2_256], uint32_t (*)[DIGEST_IVLEN_SHA2_256], size_t);
+void digest_direct_mb_pbkdf2_sha2_512(size_t, const uint64_t (*)[DIGEST_IVLEN_SHA2_512],
+    const uint64_t (*)[DIGEST_IVLEN_SHA2_512], uint64_t (*)[DIGEST_IVLEN_SHA2_512], size_t);
+
 #endif /* !ATHEME_INC_DIGEST_DIRECT_H */
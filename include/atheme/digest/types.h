@@ -26,4 +26,15 @@ struct digest_vector
 	size_t          len;
 };
 
+// One derivation for digest_oneshot_pbkdf2_batch()
+struct digest_pbkdf2_job
+{
+	const void *    pass;
+	size_t          passLen;
+	const void *    salt;
+	size_t          saltLen;
+	void *          dk;
+	size_t          dkLen;
+};
+
 #endif /* !ATHEME_INC_DIGEST_TYPES_H */
@@ -31,6 +31,31 @@ struct email_canonicalizer_item
 	mowgli_node_t           node;
 };
 
+// Hidden argument that makes atheme-services run as the mailer helper (see libathemecore/mailer.c)
+#define MAILER_HELPER_ARG       "--mailer-helper"
+
+enum mailer_result
+{
+	MAILER_QUEUED           = 0,
+	MAILER_REJECTED         = 1,    // malformed or too large
+	MAILER_QUEUE_FULL       = 2,    // too many messages are waiting already
+	MAILER_RATELIMITED      = 3,    // too many messages to this recipient recently
+};
+
+struct mailer_stats
+{
+	unsigned long           queued;
+	unsigned long           sent;
+	unsigned long           failed;         // permanently, or after too many attempts
+	unsigned long           retried;
+	unsigned long           ratelimited;
+	unsigned long           rejected;
+	unsigned long           spawns;         // of the helper process
+	size_t                  pending;        // waiting to be handed to the helper
+	size_t                  inflight;       // handed to the helper and not finished yet
+	bool                    helper_running;
+};
+
 int sendemail(struct user *u, struct myuser *mu, const char *type, const char *email, const char *param);
 int validemail(const char *email);
 stringref canonicalize_email(const char *email);
@@ -39,4 +64,9 @@ void register_email_canonicalizer(email_canonicalizer_fn func, void *user_data);
 void unregister_email_canonicalizer(email_canonicalizer_fn func, void *user_data);
 bool email_within_limits(const char *email);
 
+enum mailer_result mailer_enqueue(const char *rcpt, const char *body, size_t len);
+void mailer_get_stats(struct mailer_stats *stats);
+void mailer_set_helper_path(const char *execname);
+int mailer_helper_main(void);
+
 #endif /* !ATHEME_INC_EMAIL_H */
@@ -39,6 +39,8 @@ void flags_make_bitmasks(const char *string, unsigned int *addflags, unsigned in
 unsigned int flags_to_bitmask(const char *, unsigned int flags);
 char *bitmask_to_flags(unsigned int);
 char *bitmask_to_flags2(unsigned int, unsigned int);
+const char *bitmask_to_flags_cached(unsigned int flags);
+unsigned int flags_to_bitmask_cached(const char *string);
 unsigned int allow_flags(struct mychan *mc, unsigned int flags);
 void update_chanacs_flags(void);
 
@@ -50,6 +52,8 @@ extern const struct gflags soper_flags[];
 
 char *gflags_tostr(const struct gflags *gflags, unsigned int flags);
 bool gflags_fromstr(const struct gflags *gflags, const char *f, unsigned int *res);
+const char *gflags_tostr_cached(const struct gflags *gflags, unsigned int flags);
+bool gflags_fromstr_cached(const struct gflags *gflags, const char *f, unsigned int *res);
 
 unsigned int xflag_lookup(const char *name);
 unsigned int xflag_apply(unsigned int in, const char *name);
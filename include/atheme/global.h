@@ -41,6 +41,7 @@ struct me
 	unsigned int    auth;                   // registration auth type
 	unsigned int    emaillimit;             // maximum number of emails sent
 	unsigned int    emailtime;              // ... in this amount of time
+	unsigned int    emailrcptlimit;         // ... and to any one address in that time
 	unsigned long   kline_id;               // unique ID for AKILLs
 	unsigned long   xline_id;               // unique ID for AKILLs
 	unsigned long   qline_id;               // unique ID for AKILLs
@@ -72,6 +73,11 @@ struct ConfOption
 	unsigned int    clone_time;             // default expire for clone exemptions
 	unsigned int    commit_interval;        // interval between commits
 	bool            db_save_blocking;       // whether to always use a blocking database commit
+	bool            db_save_thread;         // whether to save in time slices and a writer thread instead of forking
+	unsigned int    memo_cold_time;         // inactivity after which an account's memos are kept out of memory
+	unsigned int    memo_cold_budget;       // memory (KiB) that thawed cold memos may use before eviction
+	unsigned int    password_verify_threads; // worker threads for verifying passwords off the event loop
+	unsigned int    slow_command_time;      // milliseconds after which a command is logged as slow
 	bool            silent;                 // stop sending WALLOPS?
 	bool            join_chans;             // join registered channels?
 	bool            leave_chans;            // leave channels when empty?
@@ -123,8 +129,8 @@ struct cnt
 	unsigned int    mychan;
 	unsigned int    chanacs;
 	unsigned int    node;
-	unsigned int    bin;
-	unsigned int    bout;
+	unsigned long long bin;
+	unsigned long long bout;
 	unsigned int    uplink;
 	unsigned int    operclass;
 	unsigned int    myuser_access;
@@ -127,9 +127,10 @@ struct hook_info_noexist_req
 
 struct hook_metadata_change
 {
-	struct myuser * target;
+	void *          target;     // Any object that carries metadata (account, channel, group, ...)
 	const char *    name;
 	char *          value;
+	bool            deleted;    // If set, the entry is about to be deleted; 'value' is its last value
 };
 
 struct hook_module_load
@@ -194,6 +195,7 @@ struct hook_user_login_check
 	struct myuser *                     mu;
 	const enum hook_user_login_method   method;
 	bool                                allowed;
+	const bool                          recheck;    // checked again after the credentials were verified
 };
 
 struct hook_user_logout_check
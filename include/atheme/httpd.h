@@ -17,6 +17,19 @@ struct path_handler
 {
 	const char *    path;
 	void          (*handler)(struct connection *, void *);
+	bool            get;            // also handles GET requests, with a NULL request body
+};
+
+/* Something that will answer a request on a connection later, e.g. once a
+ * password has been verified. It is put on the connection's 'pending' list,
+ * with the node's data pointing at whatever the cancel function needs. If the
+ * connection is closed first, misc/httpd takes it off the list and calls the
+ * cancel function, after which the connection must not be used any more.
+ */
+struct httpd_pending
+{
+	mowgli_node_t   node;           // must be first
+	void          (*cancel)(void *data);
 };
 
 struct httpddata
@@ -31,6 +44,7 @@ struct httpddata
 	bool            correct_content_type;
 	bool            expect_100_continue;
 	bool            sent_reply;
+	mowgli_list_t   pending;        // of struct httpd_pending
 };
 
 #endif /* !ATHEME_INC_HTTPD_H */
@@ -0,0 +1,39 @@
+/*
+ * SPDX-License-Identifier: ISC
+ * SPDX-URL: https://spdx.org/licenses/ISC.html
+ *
+ * Copyright (C) 2026 Atheme Development Group (https://atheme.github.io/)
+ *
+ * Indexes shared by the NickServ and ChanServ LIST commands.
+ */
+
+#ifndef ATHEME_INC_LISTINDEX_H
+#define ATHEME_INC_LISTINDEX_H 1
+
+#include <atheme/stdheaders.h>
+
+/* A set of objects in one of the LIST indexes. The indexes are patricia trees
+ * of these, keyed by 'name'; the members are keyed by a string that the
+ * caller chooses and that must not change while the object is a member (an
+ * entity ID, or a channel name).
+ */
+struct list_set
+{
+	char *                  name;
+	unsigned long           day;                    // for the sets of a day index
+	mowgli_patricia_t *     members;
+};
+
+typedef void (*list_set_cb)(mowgli_patricia_t *members, void *priv);
+
+unsigned long list_day(time_t t);
+struct list_set *list_set_create(const char *name, unsigned long day);
+void list_set_destroy(struct list_set *set);
+void list_set_destroy_cb(const char *key, void *data, void *privdata);
+void list_set_insert(mowgli_patricia_t *tree, const char *name, unsigned long day, const char *key, void *member);
+void list_set_remove(mowgli_patricia_t *tree, const char *name, const char *key);
+void list_day_insert(mowgli_patricia_t *tree, unsigned long day, const char *key, void *member);
+void list_day_remove(mowgli_patricia_t *tree, unsigned long day, const char *key);
+size_t list_days_before(mowgli_patricia_t *tree, time_t age, list_set_cb cb, void *priv);
+
+#endif /* !ATHEME_INC_LISTINDEX_H */
@@ -24,6 +24,10 @@ enum atheme_regex_type
 	at_pcre = 2
 };
 
+#if defined(HAVE_LIBPCRE) && defined(PCRE_STUDY_JIT_COMPILE)
+#  define ATHEME_REGEX_PCRE_JIT 1
+#endif
+
 struct atheme_regex
 {
 	enum atheme_regex_type  type;
@@ -33,6 +37,15 @@ struct atheme_regex
 		pcre *          pcre;
 #endif
 	} un;
+#ifdef HAVE_LIBPCRE
+	pcre_extra *            pcre_extra;
+#endif
+#ifdef ATHEME_REGEX_PCRE_JIT
+	pcre_jit_stack *        pcre_jit_stack;
+#endif
+	char *                  cachekey;       // key in the compiled-regex cache
+	unsigned int            refcount;       // number of regex_create() callers holding this
+	mowgli_node_t           idle_node;      // in the idle list while refcount is 0
 };
 
 /* cidr.c */
@@ -78,16 +91,20 @@ void strcasecanon(char *);
 void noopcanon(char *);
 
 int match(const char *, const char *);
+bool match_is_literal(const char *);
 char *collapse(char *);
 
 /* regex_create() flags */
 #define AREGEX_ICASE	1 /* case insensitive */
 #define AREGEX_PCRE	2 /* use libpcre engine */
 #define AREGEX_KLINE	4 /* XXX for rwatch, match kline */
+#define AREGEX_NOJIT	8 /* don't JIT-compile libpcre patterns */
 
-struct atheme_regex *regex_create(char *pattern, int flags) ATHEME_FATTR_MALLOC;
+struct atheme_regex *regex_create(char *pattern, int flags);
 char *regex_extract(char *pattern, char **pend, int *pflags);
 bool regex_match(struct atheme_regex *preg, char *string);
+bool regex_match_len(struct atheme_regex *preg, const char *string, size_t len);
+bool regex_is_jit(const struct atheme_regex *preg);
 bool regex_destroy(struct atheme_regex *preg);
 
 #endif /* !ATHEME_INC_MATCH_H */
@@ -0,0 +1,67 @@
+/*
+ * SPDX-License-Identifier: ISC
+ * SPDX-URL: https://spdx.org/licenses/ISC.html
+ *
+ * Copyright (C) 2026 Atheme Development Group (https://atheme.github.io/)
+ *
+ * Counters and timing histograms kept by the core for monitoring.
+ */
+
+#ifndef ATHEME_INC_METRICS_H
+#define ATHEME_INC_METRICS_H 1
+
+#include <atheme/attributes.h>
+#include <atheme/stdheaders.h>
+#include <atheme/structures.h>
+
+/* Durations are counted in log-linear buckets, like HdrHistogram: every power
+ * of two microseconds is split into METRICS_SUB_BUCKETS equal buckets, so a
+ * bucket is never wider than 1/8 of the durations in it. Durations from
+ * 2^METRICS_MAX_SHIFT microseconds (about 4.5 minutes) on are only counted in
+ * 'count', 'usec' and 'max'.
+ */
+#define METRICS_SUB_SHIFT       3U
+#define METRICS_SUB_BUCKETS     (1U << METRICS_SUB_SHIFT)
+#define METRICS_MAX_SHIFT       28U
+#define METRICS_BUCKETS         ((METRICS_MAX_SHIFT - METRICS_SUB_SHIFT + 1U) * METRICS_SUB_BUCKETS)
+
+/* Everything here is only ever updated and read on the event loop, so no
+ * locking or atomics are needed, and recording a sample costs a handful of
+ * additions.
+ */
+struct metrics_timing
+{
+	unsigned long long      count;
+	unsigned long long      usec;                           // sum of all samples
+	unsigned long long      max;
+	unsigned long long      bucket[METRICS_BUCKETS];        // not cumulative
+};
+
+struct metrics_command
+{
+	char *                  service;
+	char *                  name;                           // with its parent commands, e.g. "CLONES LIST"
+	struct metrics_timing   timing;
+};
+
+struct metrics
+{
+	struct metrics_timing   loop;                           // I/O handling per event loop iteration
+	struct metrics_timing   db_save;                        // event loop time taken by each database save
+	unsigned long long      loop_wake;                      // when the current iteration started handling I/O
+};
+
+extern struct metrics metrics;
+
+typedef void (*metrics_command_cb)(const struct metrics_command *mc, void *priv);
+
+unsigned long long metrics_clock(void) ATHEME_FATTR_WUR;
+void metrics_timing_record(struct metrics_timing *timing, unsigned long long usec);
+unsigned long long metrics_bucket_bound(unsigned int bucket) ATHEME_FATTR_WUR;
+unsigned long long metrics_timing_quantile(const struct metrics_timing *timing, double quantile) ATHEME_FATTR_WUR;
+void metrics_loop_woken(void);
+void metrics_loop_done(void);
+struct metrics_command *metrics_command_find(const struct service *svs, const char *name);
+void metrics_command_foreach(metrics_command_cb cb, void *priv);
+
+#endif /* !ATHEME_INC_METRICS_H */
@@ -11,6 +11,7 @@
 #ifndef ATHEME_INC_PMODULE_H
 #define ATHEME_INC_PMODULE_H 1
 
+#include <atheme/metrics.h>
 #include <atheme/sourceinfo.h>
 #include <atheme/stdheaders.h>
 
@@ -20,6 +21,7 @@ struct proto_cmd
 	void  (*handler)(struct sourceinfo *si, int parc, char *parv[]);
 	int     minparc;
 	int     sourcetype;
+	struct metrics_timing timing;
 };
 
 /* values for sourcetype */
@@ -40,6 +42,7 @@ void pcommand_add(const char *token,
 	int minparc, int sourcetype);
 void pcommand_delete(const char *token);
 struct proto_cmd *pcommand_find(const char *token);
+void pcommand_exec(struct proto_cmd *pcmd, struct sourceinfo *si, int parc, char *parv[]);
 
 /* ptasks.c */
 const char *get_build_date(void);
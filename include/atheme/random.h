@@ -22,6 +22,10 @@ void atheme_random_buf(void *buf, size_t len)
     ATHEME_FATTR_DIAGNOSE_IF(!buf, "calling atheme_random_buf() with !buf", "error")
     ATHEME_FATTR_DIAGNOSE_IF(!len, "calling atheme_random_buf() with !len", "error");
 
+void atheme_random_buf_unbuffered(void *buf, size_t len)
+    ATHEME_FATTR_DIAGNOSE_IF(!buf, "calling atheme_random_buf_unbuffered() with !buf", "error")
+    ATHEME_FATTR_DIAGNOSE_IF(!len, "calling atheme_random_buf_unbuffered() with !len", "error");
+
 void atheme_random_str(char *buf, size_t len)
     ATHEME_FATTR_DIAGNOSE_IF(!buf, "calling atheme_random_str() with !buf", "error")
     ATHEME_FATTR_DIAGNOSE_IF(!len, "calling atheme_random_str() with !len", "error");
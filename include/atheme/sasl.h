@@ -32,10 +32,14 @@
 #define SASL_S2S_MAXLEN_TOTAL_RAW       3072U
 #define SASL_S2S_MAXLEN_TOTAL_B64       4096U
 
+// Maximum number of messages buffered for a session while its mechanism is busy (see ASASL_MRESULT_PENDING)
+#define SASL_PENDING_INPUT_MAX          16U
+
 // Flags for sasl_session->flags
 #define ASASL_SFLAG_NONE                0x00000000U // Nothing special
 #define ASASL_SFLAG_MARKED_FOR_DELETION 0x00000001U // See sasl_delete_stale() in modules/saslserv/main.c
 #define ASASL_SFLAG_CLIENT_SECURE       0x00000002U // The client is connected to the network securely
+#define ASASL_SFLAG_PENDING             0x00000004U // The mechanism is busy; see ASASL_MRESULT_PENDING
 
 // Flags for sasl_input_buf->flags
 #define ASASL_INFLAG_NONE               0x00000000U // Nothing special
@@ -58,6 +62,7 @@ struct sasl_session
 	char *                          ip;                     // IP address
 	char *                          buf;                    // Buffered Base-64 data from them (so far)
 	size_t                          len;                    // Length of buffered Base-64 data
+	mowgli_list_t                   pending_input;          // Messages received while the mechanism is busy
 	unsigned int                    flags;                  // Flags (described above)
 	char                            authcid[NICKLEN + 1];   // Authentication identity (user having credentials verified)
 	char                            authzid[NICKLEN + 1];   // Authorization identity (user being logged in)
@@ -102,6 +107,7 @@ enum sasl_mechanism_result
 	ASASL_MRESULT_FAILURE   = 2,    // Client supplied invalid credentials; run bad_password() on the target
 	ASASL_MRESULT_CONTINUE  = 3,    // Everything looks good so far, but we need more data from the client
 	ASASL_MRESULT_SUCCESS   = 4,    // The client has successfully authenticated
+	ASASL_MRESULT_PENDING   = 5,    // The result is not known yet; the mechanism will call mech_complete()
 };
 
 typedef enum sasl_mechanism_result (*sasl_mech_start_fn)(struct sasl_session *restrict,
@@ -130,6 +136,15 @@ struct sasl_core_functions
 	sasl_authxid_can_login_fn   authcid_can_login;
 	sasl_authxid_can_login_fn   authzid_can_login;
 	void                      (*recalc_mechlist)(const struct sasl_session *, const char **);
+
+	/* For a mechanism whose mech_start or mech_step returned ASASL_MRESULT_PENDING; carries
+	 * on as if it had returned this result and output instead. Must be called from the event
+	 * loop. The session may be destroyed in the meantime (e.g. the client gives up or times
+	 * out); the mechanism's mech_finish is called first, and must cancel any work that
+	 * would call this function later.
+	 */
+	void                      (*mech_complete)(struct sasl_session *, enum sasl_mechanism_result,
+	                                           struct sasl_output_buf *);
 };
 
 #endif /* !ATHEME_INC_SASL_H */
@@ -73,6 +73,11 @@
 #  include <netinet/in.h>
 #endif
 
+#ifdef HAVE_PTHREAD_H
+// pthread_t, pthread_create(), pthread_mutex_*(), pthread_cond_*(), ...
+#  include <pthread.h>
+#endif
+
 #ifdef HAVE_REGEX_H
 // regex_t, regcomp(), regexec(), regerror(), regfree()
 #  include <regex.h>
@@ -113,6 +118,11 @@
 #  include <sys/file.h>
 #endif
 
+#ifdef HAVE_SYS_MMAN_H
+// mmap(), munmap(), madvise(), PROT_*, MAP_*, ...
+#  include <sys/mman.h>
+#endif
+
 #ifdef HAVE_SYS_RESOURCE_H
 // getrlimit(), setrlimit(), RLIM_*, ...
 #  include <sys/resource.h>
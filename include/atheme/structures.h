@@ -15,10 +15,14 @@ struct chanacs;
 struct groupacs;
 struct mychan;
 struct mygroup;
+struct mymemo_cold;
 struct mynick;
 struct myuser;
 struct svsignore;
 
+// Defined in libathemecore/auth.c
+struct verify_password_req;
+
 // Defined in atheme/botserv.h
 struct botserv_bot;
 struct botserv_main_symbols;
@@ -39,8 +43,12 @@ struct language;
 struct translation;
 
 // Defined in atheme/database_backend.h
+struct database_arena;
+struct database_arena_chunk;
 struct database_handle;
 struct database_module;
+struct database_row_profile;
+struct database_row_stats;
 struct database_vtable;
 
 // Defined in atheme/digest*.h
@@ -128,6 +136,9 @@ struct taint_reason;
 // Defined in atheme/template.h
 struct default_template;
 
+// Defined in atheme/threadpool.h
+struct threadpool;
+
 // Defined in atheme/tools.h
 struct email_canonicalizer_item;
 struct logfile;
@@ -0,0 +1,36 @@
+/*
+ * SPDX-License-Identifier: ISC
+ * SPDX-URL: https://spdx.org/licenses/ISC.html
+ *
+ * Copyright (C) 2026 Atheme Development Group (https://atheme.github.io/)
+ *
+ * Worker thread pools with completion on the event loop.
+ */
+
+#ifndef ATHEME_INC_THREADPOOL_H
+#define ATHEME_INC_THREADPOOL_H 1
+
+#include <atheme/attributes.h>
+#include <atheme/stdheaders.h>
+#include <atheme/structures.h>
+
+/* Runs on a worker thread. It must not touch any services state that the
+ * event loop may be using concurrently; this includes the block allocators,
+ * and every object and list reachable from the core. slog() may be used; the
+ * message is held back and written out by the event loop.
+ */
+typedef void (*threadpool_work_fn)(void *priv);
+
+/* Runs on the event loop once the work function has returned. */
+typedef void (*threadpool_done_fn)(void *priv);
+
+struct threadpool *threadpool_create(const char *name, unsigned int nthreads) ATHEME_FATTR_WUR;
+void threadpool_destroy(struct threadpool *pool);
+bool threadpool_submit(struct threadpool *pool, threadpool_work_fn work, threadpool_done_fn done, void *priv);
+void threadpool_drain(struct threadpool *pool);
+void threadpool_wait(struct threadpool *pool);
+unsigned int threadpool_pending(const struct threadpool *pool) ATHEME_FATTR_WUR;
+bool threadpool_available(void) ATHEME_FATTR_WUR;
+bool threadpool_in_worker(void) ATHEME_FATTR_WUR;
+
+#endif /* !ATHEME_INC_THREADPOOL_H */
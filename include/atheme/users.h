@@ -36,6 +36,8 @@ struct user
 	time_t                  ts;
 	mowgli_node_t           snode;          // for struct server -> userlist
 	char *                  certfp;         // client certificate fingerprint
+	char *                  matchstr;       // "nick!user@host gecos", see user_matchstr()
+	size_t                  matchstr_len;
 };
 
 #define UF_AWAY        0x00000002U
@@ -80,6 +82,9 @@ void user_mode(struct user *user, const char *modes);
 void user_sethost(struct user *source, struct user *target, const char *host);
 const char *user_get_umodestr(struct user *u);
 struct chanuser *find_user_banned_channel(struct user *u, char ban_type);
+const char *user_matchstr(struct user *u, size_t *len);
+void user_matchstr_invalidate(struct user *u);
+struct user **user_regex_scan(struct atheme_regex *preg, size_t *count);
 
 /* uid.c */
 void init_uid(void);
@@ -165,6 +165,8 @@ myuser_add_id(const char *id, const char *name, const char *pass, const char *em
 
 	cnt.myuser++;
 
+	hook_call_myuser_add(mu);
+
 	return mu;
 }
 
@@ -269,6 +271,8 @@ myuser_delete(struct myuser *mu)
 	authcookie_destroy_all(mu);
 
 	/* delete memos */
+	myuser_memos_cold_drop(mu);
+
 	MOWGLI_ITER_FOREACH_SAFE(n, tn, mu->memos.head)
 	{
 		memo = (struct mymemo *)n->data;
@@ -412,6 +416,8 @@ myuser_set_email(struct myuser *mu, const char *newemail)
 
 	mu->email = strshare_get(newemail);
 	mu->email_canonical = canonicalize_email(newemail);
+
+	hook_call_myuser_changed_email(mu);
 }
 
 /*
@@ -986,6 +992,8 @@ mychan_delete(struct mychan *mc)
 	if (mc->chan != NULL)
 		mc->chan->mychan = NULL;
 
+	hook_call_mychan_delete(mc);
+
 	/* remove the chanacs shiz */
 	MOWGLI_ITER_FOREACH_SAFE(n, tn, mc->chanacs.head)
 		atheme_object_unref(n->data);
@@ -993,6 +1001,7 @@ mychan_delete(struct mychan *mc)
 	metadata_delete_all(mc);
 
 	mowgli_patricia_delete(mclist, mc->name);
+	db_generation++;
 
 	strshare_unref(mc->name);
 
@@ -1023,9 +1032,12 @@ mychan_add(char *name)
 		mc->chan->mychan = mc;
 
 	mowgli_patricia_add(mclist, mc->name, mc);
+	db_generation++;
 
 	cnt.mychan++;
 
+	hook_call_mychan_add(mc);
+
 	return mc;
 }
 
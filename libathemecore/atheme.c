@@ -406,6 +406,13 @@ atheme_main(int argc, char *argv[])
 		exit(EXIT_FAILURE);
 	}
 
+	// Started by ourselves to deliver e-mail; see mailer.c
+	if (argc == 2 && strcmp(argv[1], MAILER_HELPER_ARG) == 0)
+		return mailer_helper_main();
+
+	// The mailer helper is started from this executable, so find it before we change directory
+	(void) mailer_set_helper_path(argv[0]);
+
 	atheme_bootstrap();
 
 	/* do command-line options */
@@ -489,6 +496,7 @@ atheme_main(int argc, char *argv[])
 #endif
 
 	(void) slog(LG_INFO, "Using Digest API frontend: %s", digest_get_frontend_info());
+	(void) slog(LG_INFO, "Using batched PBKDF2 kernel: %s", digest_get_pbkdf2_batch_info());
 	(void) slog(LG_INFO, "Using Random API frontend: %s", random_get_frontend_info());
 
 	(void) slog(LG_INFO, "running digest testsuite...");
@@ -16,8 +16,54 @@
 #include <atheme.h>
 #include "internal.h"
 
+/* An asynchronous password verification; see verify_password_async(). The
+ * password and the hash it is checked against are copied, because the
+ * account may change or disappear while a worker thread is busy with them.
+ */
+struct verify_password_req
+{
+	mowgli_node_t                   node;           // in verify_password_queue, until it is batched
+	char                            entityid[IDLEN + 1];
+	char                            password[PASSLEN + 1];
+	char                            hash[PASSLEN + 1];
+	const struct crypt_impl *       ci;             // provider that verified the password (set by the worker)
+	unsigned int                    verify_flags;   // set by the worker
+	bool                            conclusive;     // the worker found the provider that made the hash
+	bool                            verified;
+	bool                            synchronous;    // verified on the event loop or by a module; 'verified' is final
+	bool                            cancelled;
+	verify_password_cb              cb;
+	void *                          priv;
+};
+
+// Most requests handed to a worker thread at once
+#define VERIFY_PASSWORD_BATCH_MAX       16U
+
+/* Requests that are verified together on one worker thread, so that providers
+ * that can verify several passwords at once (crypt_impl::verify_batch, e.g.
+ * PBKDF2 with the multi-buffer SHA2 kernels) get to do so.
+ */
+struct verify_password_batch
+{
+	const struct crypt_impl **      impls;          // providers the worker may try, in order
+	size_t                          nimpls;
+	struct verify_password_req *    reqs[VERIFY_PASSWORD_BATCH_MAX];
+	size_t                          count;
+};
+
 bool auth_module_loaded = false;
 bool (*auth_user_custom)(struct myuser *mu, const char *password) ATHEME_FATTR_WUR;
+void (*auth_user_custom_async)(struct myuser *mu, const char *password, struct verify_password_req *req);
+
+static struct threadpool *verify_password_pool = NULL;
+static unsigned int verify_password_pool_threads = 0;
+
+// Requests for the worker threads, collected until the event loop is next idle
+static mowgli_list_t verify_password_queue = { NULL, NULL, 0 };
+static bool verify_password_flush_pending = false;
+
+// Requests handed to the worker threads whose completion has not run yet
+static unsigned int verify_password_inflight = 0;
 
 void
 set_password(struct myuser *const restrict mu, const char *const restrict password)
@@ -47,6 +93,40 @@ set_password(struct myuser *const restrict mu, const char *const restrict passwo
 	(void) hook_call_myuser_changed_password_or_hash(mu);
 }
 
+// Called once 'password' has been verified by 'ci'; re-encrypts it if necessary
+static void
+verify_password_rehash(struct myuser *const restrict mu, const char *const restrict password,
+                       const struct crypt_impl *const restrict ci, const unsigned int verify_flags)
+{
+	const char *new_hash;
+	const struct crypt_impl *ci_default;
+
+	if (! (ci_default = crypt_get_default_provider()))
+		// Verification succeeded but we don't have a module that can create new password hashes
+		return;
+
+	if (ci != ci_default)
+		(void) slog(LG_INFO, "%s: transitioning from crypt scheme '%s' to '%s' for account '%s'",
+		                     MOWGLI_FUNC_NAME, ci->id, ci_default->id, entity(mu)->name);
+	else if (verify_flags & PWVERIFY_FLAG_RECRYPT)
+		(void) slog(LG_INFO, "%s: re-encrypting password for account '%s'",
+		                     MOWGLI_FUNC_NAME, entity(mu)->name);
+	else
+		// Verification succeeded and re-encrypting not required, nothing more to do
+		return;
+
+	if (! (new_hash = ci_default->crypt(password, NULL)))
+	{
+		(void) slog(LG_ERROR, "%s: hash generation failed", MOWGLI_FUNC_NAME);
+	}
+	else
+	{
+		(void) smemzero(mu->pass, sizeof mu->pass);
+		(void) mowgli_strlcpy(mu->pass, new_hash, sizeof mu->pass);
+		(void) hook_call_myuser_changed_password_or_hash(mu);
+	}
+}
+
 bool ATHEME_FATTR_WUR
 verify_password(struct myuser *const restrict mu, const char *const restrict password)
 {
@@ -64,39 +144,339 @@ verify_password(struct myuser *const restrict mu, const char *const restrict pas
 		return (strcmp(mu->pass, password) == 0);
 	}
 
-	const char *new_hash;
-	const struct crypt_impl *ci, *ci_default;
+	const struct crypt_impl *ci;
 	unsigned int verify_flags = PWVERIFY_FLAG_NONE;
 
 	if (! (ci = crypt_verify_password(password, mu->pass, &verify_flags)))
 		// Verification failure
 		return false;
 
-	if (! (ci_default = crypt_get_default_provider()))
-		// Verification succeeded but we don't have a module that can create new password hashes
-		return true;
+	(void) verify_password_rehash(mu, password, ci, verify_flags);
 
-	if (ci != ci_default)
-		(void) slog(LG_INFO, "%s: transitioning from crypt scheme '%s' to '%s' for account '%s'",
-		                     MOWGLI_FUNC_NAME, ci->id, ci_default->id, entity(mu)->name);
-	else if (verify_flags & PWVERIFY_FLAG_RECRYPT)
-		(void) slog(LG_INFO, "%s: re-encrypting password for account '%s'",
-		                     MOWGLI_FUNC_NAME, entity(mu)->name);
-	else
-		// Verification succeeded and re-encrypting not required, nothing more to do
-		return true;
+	// Verification succeeded and user's password (possibly) re-encrypted
+	return true;
+}
 
-	if (! (new_hash = ci_default->crypt(password, NULL)))
+static struct threadpool *
+verify_password_pool_get(void)
+{
+	const unsigned int nthreads = config_options.password_verify_threads;
+
+	if (verify_password_pool_threads == nthreads)
+		return verify_password_pool;
+
+	/* The thread count was changed by a rehash (or this is the first
+	 * verification). Destroying the old pool runs the completions of its
+	 * jobs, which may start verifications again and so come back here; the
+	 * new pool must already be in place by then.
+	 */
+	struct threadpool *const oldpool = verify_password_pool;
+
+	verify_password_pool = NULL;
+	verify_password_pool_threads = nthreads;
+
+	if (nthreads && threadpool_available())
+		verify_password_pool = threadpool_create("password verify", nthreads);
+
+	if (oldpool)
+		(void) threadpool_destroy(oldpool);
+
+	return verify_password_pool;
+}
+
+static void
+verify_password_req_free(struct verify_password_req *const restrict req)
+{
+	(void) smemzerofree(req, sizeof *req);
+}
+
+// Runs on a worker thread
+static void
+verify_password_work(void *const restrict vbatch)
+{
+	struct verify_password_batch *const batch = vbatch;
+	struct crypt_verify_item items[VERIFY_PASSWORD_BATCH_MAX];
+	size_t reqidx[VERIFY_PASSWORD_BATCH_MAX];
+
+	// This mirrors crypt_verify_password(), restricted to the providers in batch->impls
+	for (size_t i = 0; i < batch->nimpls; i++)
 	{
-		(void) slog(LG_ERROR, "%s: hash generation failed", MOWGLI_FUNC_NAME);
+		const struct crypt_impl *const ci = batch->impls[i];
+		size_t count = 0;
+
+		for (size_t j = 0; j < batch->count; j++)
+		{
+			const struct verify_password_req *const req = batch->reqs[j];
+
+			if (req->conclusive)
+				continue;
+
+			items[count].password = req->password;
+			items[count].parameters = req->hash;
+			items[count].flags = PWVERIFY_FLAG_NONE;
+			items[count].verified = false;
+			reqidx[count++] = j;
+		}
+
+		if (! count)
+			break;
+
+		if (ci->verify_batch && count > 1)
+			(void) ci->verify_batch(items, count);
+		else
+			for (size_t k = 0; k < count; k++)
+				items[k].verified = ci->verify(items[k].password, items[k].parameters, &items[k].flags);
+
+		for (size_t k = 0; k < count; k++)
+		{
+			struct verify_password_req *const req = batch->reqs[reqidx[k]];
+
+			if (items[k].verified)
+			{
+				req->ci = ci;
+				req->verify_flags = items[k].flags;
+				req->conclusive = true;
+				req->verified = true;
+			}
+			else if (items[k].flags & PWVERIFY_FLAG_MYMODULE)
+				req->conclusive = true;
+		}
 	}
-	else
+}
+
+static void verify_password_done(void *vreq);
+
+// Runs on the event loop
+static void
+verify_password_batch_done(void *const restrict vbatch)
+{
+	struct verify_password_batch *const batch = vbatch;
+
+	verify_password_inflight -= (unsigned int) batch->count;
+
+	for (size_t i = 0; i < batch->count; i++)
+		(void) verify_password_done(batch->reqs[i]);
+
+	(void) sfree(batch->impls);
+	(void) sfree(batch);
+}
+
+/* Hands the queued requests to the worker threads, spread evenly over them
+ * but at most VERIFY_PASSWORD_BATCH_MAX to a job.
+ */
+static void
+verify_password_flush(void ATHEME_VATTR_UNUSED *const restrict unused)
+{
+	struct threadpool *const pool = verify_password_pool_get();
+	const size_t queued = MOWGLI_LIST_LENGTH(&verify_password_queue);
+	size_t per_job = 1;
+
+	verify_password_flush_pending = false;
+
+	if (pool && verify_password_pool_threads)
+		per_job = MIN((queued + verify_password_pool_threads - 1U) / verify_password_pool_threads,
+		              VERIFY_PASSWORD_BATCH_MAX);
+
+	while (verify_password_queue.head)
 	{
-		(void) smemzero(mu->pass, sizeof mu->pass);
-		(void) mowgli_strlcpy(mu->pass, new_hash, sizeof mu->pass);
-		(void) hook_call_myuser_changed_password_or_hash(mu);
+		struct verify_password_batch *const batch = smalloc(sizeof *batch);
+
+		while (batch->count < per_job && verify_password_queue.head)
+		{
+			struct verify_password_req *const req = verify_password_queue.head->data;
+
+			(void) mowgli_node_delete(&req->node, &verify_password_queue);
+
+			if (req->cancelled)
+				(void) verify_password_req_free(req);
+			else
+				batch->reqs[batch->count++] = req;
+		}
+
+		if (! batch->count)
+		{
+			(void) sfree(batch);
+			continue;
+		}
+
+		if (pool && (batch->impls = crypt_threadsafe_providers(&batch->nimpls)) &&
+		    threadpool_submit(pool, &verify_password_work, &verify_password_batch_done, batch))
+		{
+			verify_password_inflight += (unsigned int) batch->count;
+			continue;
+		}
+
+		// The worker threads cannot be used after all (e.g. the providers were unloaded)
+		for (size_t i = 0; i < batch->count; i++)
+		{
+			struct verify_password_req *const req = batch->reqs[i];
+			struct myuser *const mu = myuser_find_uid(req->entityid);
+
+			req->synchronous = true;
+			req->verified = mu && verify_password(mu, req->password);
+
+			(void) verify_password_done(req);
+		}
+
+		(void) sfree(batch->impls);
+		(void) sfree(batch);
 	}
+}
 
-	// Verification succeeded and user's password (possibly) re-encrypted
-	return true;
+static void
+verify_password_start(struct verify_password_req *const restrict req, struct myuser *const restrict mu)
+{
+	const struct crypt_impl **impls = NULL;
+	size_t nimpls;
+
+	req->ci = NULL;
+	req->verify_flags = PWVERIFY_FLAG_NONE;
+	req->conclusive = false;
+	req->verified = false;
+	req->synchronous = true;
+
+	(void) mowgli_strlcpy(req->hash, mu->pass, sizeof req->hash);
+
+	// The authentication module will call verify_password_complete() when it knows
+	if (auth_module_loaded && auth_user_custom_async)
+	{
+		(void) auth_user_custom_async(mu, req->password, req);
+		return;
+	}
+
+	/* Custom authentication modules and plaintext passwords are handled on the
+	 * event loop, as is everything if no provider is safe to use elsewhere.
+	 */
+	if (! (auth_module_loaded && auth_user_custom) && (mu->flags & MU_CRYPTPASS) &&
+	    (impls = crypt_threadsafe_providers(&nimpls)) && verify_password_pool_get())
+	{
+		(void) sfree(impls);
+
+		req->synchronous = false;
+
+		// Requests that arrive together are batched by verify_password_flush()
+		(void) mowgli_node_add(req, &req->node, &verify_password_queue);
+
+		if (! verify_password_flush_pending)
+		{
+			(void) mowgli_timer_add_once(base_eventloop, "verify_password_flush", &verify_password_flush,
+			                             NULL, 0);
+
+			verify_password_flush_pending = true;
+		}
+
+		return;
+	}
+
+	(void) sfree(impls);
+
+	req->verified = verify_password(mu, req->password);
+
+	// The caller is never called back before verify_password_async() returns
+	(void) mowgli_timer_add_once(base_eventloop, "verify_password_done", &verify_password_done, req, 0);
+}
+
+// Runs on the event loop
+static void
+verify_password_done(void *const restrict vreq)
+{
+	struct verify_password_req *const req = vreq;
+
+	if (req->cancelled)
+	{
+		(void) verify_password_req_free(req);
+		return;
+	}
+
+	struct myuser *const mu = myuser_find_uid(req->entityid);
+
+	if (mu && ! req->synchronous)
+	{
+		if (strcmp(mu->pass, req->hash) != 0)
+		{
+			// The password was changed while it was being verified; verify against the new one
+			(void) verify_password_start(req, mu);
+			return;
+		}
+
+		if (! req->conclusive)
+			// None of the thread-safe providers recognised the hash; let the others have a go
+			req->verified = verify_password(mu, req->password);
+		else if (req->verified)
+			(void) verify_password_rehash(mu, req->password, req->ci, req->verify_flags);
+	}
+
+	(void) smemzero(req->password, sizeof req->password);
+	(void) req->cb(mu, mu && req->verified, req->priv);
+	(void) verify_password_req_free(req);
+}
+
+/* Verifies 'password' for 'mu' like verify_password(), but without making the
+ * event loop wait for slow password hashes: where possible, the hash is
+ * computed by a pool of worker threads (general::password_verify_threads).
+ *
+ * 'cb' is called later from the event loop, never before this function has
+ * returned. It is passed the account again, looked up afresh because it may
+ * have been dropped in the meantime (in which case it is NULL). Callers must
+ * keep the returned request handle, and cancel it with verify_password_cancel()
+ * if whatever is waiting for the result goes away first (e.g. the user quits).
+ */
+struct verify_password_req *
+verify_password_async(struct myuser *const restrict mu, const char *const restrict password,
+                      const verify_password_cb cb, void *const restrict priv)
+{
+	return_val_if_fail(mu != NULL, NULL);
+	return_val_if_fail(password != NULL, NULL);
+	return_val_if_fail(cb != NULL, NULL);
+
+	struct verify_password_req *const req = smalloc(sizeof *req);
+
+	(void) mowgli_strlcpy(req->entityid, entity(mu)->id, sizeof req->entityid);
+	(void) mowgli_strlcpy(req->password, password, sizeof req->password);
+
+	req->cb = cb;
+	req->priv = priv;
+
+	(void) verify_password_start(req, mu);
+
+	return req;
+}
+
+/* Called by an authentication module (see auth_user_custom_async) exactly once
+ * for every request it was given, even if the request has been cancelled.
+ */
+void
+verify_password_complete(struct verify_password_req *const restrict req, const bool verified)
+{
+	return_if_fail(req != NULL);
+
+	req->verified = verified;
+
+	(void) mowgli_timer_add_once(base_eventloop, "verify_password_done", &verify_password_done, req, 0);
+}
+
+/* The callback of a cancelled request is not called. A worker thread may still
+ * be reading the password, so it is only wiped once the request is freed.
+ */
+void
+verify_password_cancel(struct verify_password_req *const restrict req)
+{
+	return_if_fail(req != NULL);
+
+	req->cancelled = true;
+}
+
+// Password verifications that have been handed to the worker threads and not yet completed
+unsigned int
+verify_password_pending(void)
+{
+	return (unsigned int) MOWGLI_LIST_LENGTH(&verify_password_queue) + verify_password_inflight;
+}
+
+// Waits for every password verification that is running on a worker thread
+void
+verify_password_drain(void)
+{
+	if (verify_password_pool)
+		(void) threadpool_drain(verify_password_pool);
 }
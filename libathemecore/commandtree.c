@@ -18,6 +18,14 @@
 
 static bool permissive_mode_fallback = false;
 
+/* Subcommands (e.g. OperServ CLONES LIST) are run by their parent command
+ * through command_exec() again. Only the outermost call is timed, so that the
+ * time is not counted twice, and it is filed under the whole chain of command
+ * names that were run, so that e.g. CLONES LIST and AKILL LIST stay apart.
+ */
+static char command_exec_chain[BUFSIZE];
+static unsigned int command_exec_depth = 0;
+
 static int
 text_to_parv(char *text, int maxparc, char **parv)
 {
@@ -145,9 +153,49 @@ command_exec(struct service *svs, struct sourceinfo *si, struct command *c, int
 		if (si->force_language != NULL)
 			language_set_active(si->force_language);
 
+		if (command_exec_depth)
+		{
+			mowgli_strlcat(command_exec_chain, " ", sizeof command_exec_chain);
+			mowgli_strlcat(command_exec_chain, c->name, sizeof command_exec_chain);
+
+			command_exec_depth++;
+			si->command = c;
+			c->cmd(si, parc, parv);
+			language_set_active(NULL);
+			command_exec_depth--;
+			return;
+		}
+
+		const unsigned long long slow = config_options.slow_command_time * 1000ULL;
+		char source[BUFSIZE];
+
+		/* The command may take its source off the network (or unload its
+		 * own module), so anything logged afterwards is copied first.
+		 */
+		if (slow)
+			mowgli_strlcpy(source, get_source_name(si), sizeof source);
+
+		mowgli_strlcpy(command_exec_chain, c->name, sizeof command_exec_chain);
+
+		const unsigned long long start = metrics_clock();
+
+		command_exec_depth++;
 		si->command = c;
 		c->cmd(si, parc, parv);
 		language_set_active(NULL);
+		command_exec_depth--;
+
+		const unsigned long long elapsed = metrics_clock() - start;
+		struct metrics_command *const mc = metrics_command_find(svs, command_exec_chain);
+
+		if (mc == NULL)
+			return;
+
+		metrics_timing_record(&mc->timing, elapsed);
+
+		if (slow && elapsed >= slow)
+			slog(LG_INFO, "command_exec(): slow command: %s %s by %s took %llu ms",
+			     mc->service, mc->name, source, elapsed / 1000ULL);
 		return;
 	}
 
@@ -268,6 +268,7 @@ init_newconf(void)
 	add_uint_conf_item("MDLIMIT", &conf_si_table, 0, &me.mdlimit, 0, INT_MAX, 30);
 	add_uint_conf_item("EMAILLIMIT", &conf_si_table, 0, &me.emaillimit, 1, INT_MAX, 10);
 	add_duration_conf_item("EMAILTIME", &conf_si_table, 0, &me.emailtime, "s", 300);
+	add_uint_conf_item("EMAILRCPTLIMIT", &conf_si_table, 0, &me.emailrcptlimit, 0, INT_MAX, 3);
 	add_conf_item("AUTH", &conf_si_table, c_si_auth);
 	add_conf_item("CASEMAPPING", &conf_si_table, c_si_casemapping);
 	add_dupstr_conf_item("VHOST", &conf_si_table, CONF_NO_REHASH, &me.vhost, NULL);
@@ -295,6 +296,11 @@ init_newconf(void)
 	add_duration_conf_item("CLONE_TIME", &conf_gi_table, 0, &config_options.clone_time, "m", 0);
 	add_duration_conf_item("COMMIT_INTERVAL", &conf_gi_table, 0, &config_options.commit_interval, "m", 300);
 	add_bool_conf_item("DB_SAVE_BLOCKING", &conf_gi_table, 0, &config_options.db_save_blocking, false);
+	add_bool_conf_item("DB_SAVE_THREAD", &conf_gi_table, 0, &config_options.db_save_thread, false);
+	add_duration_conf_item("MEMO_COLD_TIME", &conf_gi_table, 0, &config_options.memo_cold_time, "d", 0);
+	add_uint_conf_item("MEMO_COLD_BUDGET", &conf_gi_table, 0, &config_options.memo_cold_budget, 0, INT_MAX, 4096);
+	add_uint_conf_item("PASSWORD_VERIFY_THREADS", &conf_gi_table, 0, &config_options.password_verify_threads, 0, 64, 2);
+	add_uint_conf_item("SLOW_COMMAND_TIME", &conf_gi_table, 0, &config_options.slow_command_time, 0, INT_MAX, 1000);
 	add_dupstr_conf_item("OPERSTRING", &conf_gi_table, 0, &config_options.operstring, "is an IRC Operator");
 	add_dupstr_conf_item("SERVICESTRING", &conf_gi_table, 0, &config_options.servicestring, "is a Network Service");
 	add_bool_conf_item("MATCH_MASKS_THROUGH_VHOST", &conf_gi_table, 0, &config_options.masks_through_vhost, true);
@@ -930,6 +936,7 @@ copy_me(struct me *src, struct me *dst)
 	dst->maxusers = src->maxusers;
 	dst->emaillimit = src->emaillimit;
 	dst->emailtime = src->emailtime;
+	dst->emailrcptlimit = src->emailrcptlimit;
 	dst->auth = src->auth;
 }
 
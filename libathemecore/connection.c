@@ -129,6 +129,8 @@ connection_trampoline(mowgli_eventloop_t *const restrict eventloop, mowgli_event
 {
 	struct connection *const cptr = userdata;
 
+	(void) metrics_loop_woken();
+
 	switch (dir)
 	{
 		case MOWGLI_EVENTLOOP_IO_READ:
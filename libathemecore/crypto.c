@@ -72,6 +72,10 @@ crypt_unregister(const struct crypt_impl *const restrict impl)
 
 	mowgli_node_t *n, *tn;
 
+	// Password verification jobs that are still running may be using this provider
+	if (impl->verify_threadsafe)
+		(void) verify_password_drain();
+
 	MOWGLI_ITER_FOREACH_SAFE(n, tn, crypt_impl_list.head)
 	{
 		if (n->data == impl)
@@ -168,6 +172,34 @@ crypt_verify_password(const char *const restrict password, const char *const res
 	return NULL;
 }
 
+/* Returns the providers that can verify passwords on a worker thread, in the
+ * order crypt_verify_password() would try them, or NULL if there are none.
+ * The array must be freed by the caller.
+ */
+const struct crypt_impl **
+crypt_threadsafe_providers(size_t *const restrict count)
+{
+	const struct crypt_impl **impls = NULL;
+	mowgli_node_t *n;
+
+	*count = 0;
+
+	MOWGLI_ITER_FOREACH(n, crypt_impl_list.head)
+	{
+		const struct crypt_impl *const ci = n->data;
+
+		if (! ci->verify || ! ci->verify_threadsafe)
+			continue;
+
+		if (! impls)
+			impls = smalloc(MOWGLI_LIST_LENGTH(&crypt_impl_list) * sizeof *impls);
+
+		impls[(*count)++] = ci;
+	}
+
+	return impls;
+}
+
 const char *
 crypt_password(const char *const restrict password)
 {
@@ -11,16 +11,228 @@
 #include <atheme.h>
 #include "internal.h"
 
+// Row types are given small integer IDs (indexes into db_type_table) when first seen
+struct database_type
+{
+	char *                          name;
+	unsigned int                    id;
+	database_handler_fn             fun;
+	struct database_row_profile *   profile;
+};
+
+/* Nearly every row token is one of a few dozen types of at most 8 bytes, so
+ * resolve those through a direct-mapped cache keyed by the exact bytes of the
+ * token before falling back to the case-insensitive tree. Type entries are
+ * never freed, so cached pointers never go stale.
+ */
+#define DB_TYPE_CACHE_SIZE      64U
+
+struct database_type_cache_entry
+{
+	uint64_t                        key;
+	struct database_type *          type;
+};
+
 static mowgli_patricia_t *db_types = NULL;
+static struct database_type **db_type_table = NULL;
+static unsigned int db_type_count = 0;
+static struct database_type *db_type_unknown = NULL;
+static struct database_type_cache_entry db_type_cache[DB_TYPE_CACHE_SIZE];
 
 const struct database_module *db_mod = NULL;
 
+unsigned int db_generation = 0;
+
+mowgli_patricia_t *db_profiles = NULL;
+time_t db_profile_ts[2] = { 0, 0 };
+
+static struct database_row_profile *
+db_profile_get(const char *const restrict type)
+{
+	struct database_row_profile *prof;
+
+	if ((prof = mowgli_patricia_retrieve(db_profiles, type)))
+		return prof;
+
+	prof = smalloc(sizeof *prof);
+	prof->type = sstrdup(type);
+
+	(void) mowgli_patricia_add(db_profiles, prof->type, prof);
+
+	return prof;
+}
+
+static void
+db_profile_begin(struct database_handle *const restrict db, struct database_row_profile *const restrict prof)
+{
+	db->profile = prof;
+	db->profile_bytes = strlen(prof->type) + 1;
+
+	s_time(&db->profile_start);
+}
+
+static void
+db_profile_end(struct database_handle *const restrict db)
+{
+	struct database_row_stats *const stats = &db->profile->stats[db->txn];
+	struct timeval elapsed;
+
+	e_time(db->profile_start, &elapsed);
+
+	stats->rows++;
+	stats->bytes += db->profile_bytes;
+	stats->usec += (unsigned long long) elapsed.tv_sec * 1000000ULL + (unsigned long long) elapsed.tv_usec;
+
+	db->profile = NULL;
+}
+
+// Length of a cell as the OpenSEX grammar writes it, including its separator
+static inline void
+db_profile_cell(struct database_handle *const restrict db, const size_t len)
+{
+	if (db->profile)
+		db->profile_bytes += len + 1;
+}
+
+static size_t
+db_profile_numlen(unsigned long long num, const bool negative)
+{
+	size_t len = negative ? 2 : 1;
+
+	while (num >= 10)
+	{
+		num /= 10;
+		len++;
+	}
+
+	return len;
+}
+
+void
+db_profile_reset(const enum database_transaction txn)
+{
+	struct database_row_profile *prof;
+	mowgli_patricia_iteration_state_t state;
+
+	return_if_fail(db_profiles != NULL);
+
+	MOWGLI_PATRICIA_FOREACH(prof, &state, db_profiles)
+		(void) memset(&prof->stats[txn], 0x00, sizeof prof->stats[txn]);
+
+	db_profile_ts[txn] = CURRTIME;
+}
+
+static enum database_transaction db_profile_sort_txn;
+
+static int
+db_profile_compare(const void *const restrict a, const void *const restrict b)
+{
+	const struct database_row_stats *const sa = &(*(struct database_row_profile *const *) a)->stats[db_profile_sort_txn];
+	const struct database_row_stats *const sb = &(*(struct database_row_profile *const *) b)->stats[db_profile_sort_txn];
+
+	if (sa->bytes != sb->bytes)
+		return (sa->bytes < sb->bytes) ? 1 : -1;
+
+	if (sa->usec != sb->usec)
+		return (sa->usec < sb->usec) ? 1 : -1;
+
+	return 0;
+}
+
+/* Returns the row types seen in the given direction, largest first, in an
+ * array the caller must sfree(). The profiles themselves belong to the core.
+ */
+struct database_row_profile **
+db_profile_sort(const enum database_transaction txn, size_t *const restrict count)
+{
+	struct database_row_profile **profs, *prof;
+	mowgli_patricia_iteration_state_t state;
+	size_t num = 0;
+
+	return_val_if_fail(db_profiles != NULL, NULL);
+	return_val_if_fail(count != NULL, NULL);
+
+	profs = smalloc((mowgli_patricia_size(db_profiles) + 1) * sizeof *profs);
+
+	MOWGLI_PATRICIA_FOREACH(prof, &state, db_profiles)
+		if (prof->stats[txn].rows)
+			profs[num++] = prof;
+
+	db_profile_sort_txn = txn;
+
+	(void) qsort(profs, num, sizeof *profs, &db_profile_compare);
+
+	*count = num;
+
+	return profs;
+}
+
+static struct database_type *
+db_type_get(const char *const restrict name)
+{
+	struct database_type *dt;
+
+	if ((dt = mowgli_patricia_retrieve(db_types, name)))
+		return dt;
+
+	dt = smalloc(sizeof *dt);
+	dt->name = sstrdup(name);
+	dt->id = db_type_count;
+	dt->profile = db_profile_get(name);
+
+	db_type_table = sreallocarray(db_type_table, db_type_count + 1, sizeof *db_type_table);
+	db_type_table[db_type_count++] = dt;
+
+	(void) mowgli_patricia_add(db_types, dt->name, dt);
+
+	return dt;
+}
+
+static struct database_type *
+db_type_resolve(const char *const restrict token)
+{
+	uint64_t key = 0;
+	size_t len;
+
+	for (len = 0; token[len] && len < sizeof key; len++)
+		key |= (uint64_t) (unsigned char) token[len] << (len * 8U);
+
+	if (token[len] || ! len)
+		return db_type_get(token);
+
+	struct database_type_cache_entry *const ent =
+	    &db_type_cache[(key * UINT64_C(0x9E3779B97F4A7C15)) >> 58U & (DB_TYPE_CACHE_SIZE - 1U)];
+
+	if (ent->key != key || ! ent->type)
+	{
+		ent->key = key;
+		ent->type = db_type_get(token);
+	}
+
+	return ent->type;
+}
+
+/* Returns the ID of a row type, assigning one if it has not been seen before.
+ * Backends for binary formats can resolve their type codes once with this,
+ * and then call db_process_id() for each row instead of db_process().
+ */
+unsigned int
+db_type_id(const char *const restrict type)
+{
+	return_val_if_fail(db_types != NULL, 0);
+	return_val_if_fail(type != NULL, 0);
+
+	return db_type_resolve(type)->id;
+}
+
 struct database_handle *
 db_open(const char *filename, enum database_transaction txn)
 {
 	return_val_if_fail(db_mod != NULL, NULL);
 	return_val_if_fail(db_mod->db_open != NULL, NULL);
 
+	(void) db_profile_reset(txn);
+
 	return db_mod->db_open(filename, txn);
 }
 
@@ -42,6 +254,207 @@ db_parse(struct database_handle *db)
 	return db_mod->db_parse(db);
 }
 
+struct database_handle *
+db_open_arena(struct database_arena *const restrict arena)
+{
+	return_val_if_fail(arena != NULL, NULL);
+	return_val_if_fail(db_mod != NULL, NULL);
+
+	if (! db_mod->db_open_arena)
+		return NULL;
+
+	(void) db_profile_reset(DB_WRITE);
+
+	return db_mod->db_open_arena(arena);
+}
+
+struct database_arena *
+db_arena_create(void)
+{
+	return smalloc(sizeof(struct database_arena));
+}
+
+void
+db_arena_destroy(struct database_arena *const restrict arena)
+{
+	mowgli_node_t *n, *tn;
+
+	return_if_fail(arena != NULL);
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, arena->chunks.head)
+	{
+		struct database_arena_chunk *const chunk = n->data;
+
+		(void) mowgli_node_delete(&chunk->node, &arena->chunks);
+		(void) sfree(chunk->buf);
+		(void) sfree(chunk);
+	}
+
+	(void) sfree(arena);
+}
+
+static struct database_arena_chunk *
+db_arena_reserve(struct database_arena *const restrict arena, const size_t len)
+{
+	if (arena->chunks.tail)
+	{
+		struct database_arena_chunk *const chunk = arena->chunks.tail->data;
+
+		if (chunk->size - chunk->len > len)
+			return chunk;
+	}
+
+	// Oversized cells get a chunk of their own
+	struct database_arena_chunk *const chunk = smalloc(sizeof *chunk);
+
+	chunk->size = MAX(DB_ARENA_CHUNK_SIZE, len + 1);
+	chunk->buf = smalloc(chunk->size);
+
+	(void) mowgli_node_add(chunk, &chunk->node, &arena->chunks);
+
+	return chunk;
+}
+
+bool
+db_arena_append(struct database_arena *const restrict arena, const char *const restrict data, const size_t len)
+{
+	return_val_if_fail(arena != NULL, false);
+	return_val_if_fail(data != NULL, false);
+
+	struct database_arena_chunk *const chunk = db_arena_reserve(arena, len);
+
+	(void) memcpy(chunk->buf + chunk->len, data, len);
+
+	chunk->len += len;
+	arena->size += len;
+
+	return true;
+}
+
+bool
+db_arena_vprintf(struct database_arena *const restrict arena, const char *const restrict fmt, va_list ap)
+{
+	struct database_arena_chunk *chunk = NULL;
+	va_list ap2;
+	int len;
+
+	return_val_if_fail(arena != NULL, false);
+	return_val_if_fail(fmt != NULL, false);
+
+	if (arena->chunks.tail)
+		chunk = arena->chunks.tail->data;
+
+	// Try to format straight into the free space at the end of the current chunk first
+	va_copy(ap2, ap);
+	len = vsnprintf(chunk ? (chunk->buf + chunk->len) : NULL, chunk ? (chunk->size - chunk->len) : 0, fmt, ap2);
+	va_end(ap2);
+
+	if (len < 0)
+		return false;
+
+	if (! chunk || (size_t) len >= (chunk->size - chunk->len))
+	{
+		chunk = db_arena_reserve(arena, (size_t) len);
+
+		if (vsnprintf(chunk->buf + chunk->len, chunk->size - chunk->len, fmt, ap) != len)
+			return false;
+	}
+
+	chunk->len += (size_t) len;
+	arena->size += (size_t) len;
+
+	return true;
+}
+
+bool
+db_arena_printf(struct database_arena *const restrict arena, const char *const restrict fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	const bool ret = db_arena_vprintf(arena, fmt, ap);
+	va_end(ap);
+
+	return ret;
+}
+
+/* Writes the arena out to '<path>.new' and atomically renames that over
+ * '<path>'. This is safe to call from a worker thread; it does not allocate
+ * memory, only logs (which is deferred on worker threads) if it is given a
+ * NULL argument, and returns 0 or an errno value for the caller to report.
+ */
+int
+db_arena_commit(const struct database_arena *const restrict arena, const char *const restrict path)
+{
+	const mowgli_node_t *n;
+	char newpath[BUFSIZE];
+	int fd, ret = 0;
+#ifdef HAVE_FLOCK
+	char lockpath[BUFSIZE];
+	int lockfd;
+#endif
+
+	return_val_if_fail(arena != NULL, EINVAL);
+	return_val_if_fail(path != NULL, EINVAL);
+
+	(void) snprintf(newpath, sizeof newpath, "%s.new", path);
+
+#ifdef HAVE_FLOCK
+	(void) snprintf(lockpath, sizeof lockpath, "%s.lock", path);
+
+	if ((lockfd = open(lockpath, O_RDONLY | O_CREAT, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP)) != -1)
+		(void) flock(lockfd, LOCK_EX);
+#endif
+
+	if ((fd = open(newpath, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP)) == -1)
+	{
+		ret = errno;
+		goto out;
+	}
+
+	MOWGLI_ITER_FOREACH(n, arena->chunks.head)
+	{
+		const struct database_arena_chunk *const chunk = n->data;
+		size_t written = 0;
+
+		while (written < chunk->len)
+		{
+			const ssize_t len = write(fd, chunk->buf + written, chunk->len - written);
+
+			if (len == -1 && errno == EINTR)
+				continue;
+
+			if (len == -1)
+			{
+				ret = errno;
+				(void) close(fd);
+				goto out;
+			}
+
+			written += (size_t) len;
+		}
+	}
+
+#ifdef HAVE_FSYNC
+	if (fsync(fd) == -1)
+		ret = errno;
+#endif
+
+	if (close(fd) == -1 && ! ret)
+		ret = errno;
+
+	if (! ret && srename(newpath, path) == -1)
+		ret = errno;
+
+out:
+#ifdef HAVE_FLOCK
+	if (lockfd != -1)
+		(void) close(lockfd);
+#endif
+
+	return ret;
+}
+
 bool
 db_read_next_row(struct database_handle *db)
 {
@@ -59,7 +472,12 @@ db_read_word(struct database_handle *db)
 	return_val_if_fail(db->vt != NULL, NULL);
 	return_val_if_fail(db->vt->read_word != NULL, NULL);
 
-	return db->vt->read_word(db);
+	const char *const word = db->vt->read_word(db);
+
+	if (word)
+		(void) db_profile_cell(db, strlen(word));
+
+	return word;
 }
 
 const char *
@@ -69,7 +487,12 @@ db_read_str(struct database_handle *db)
 	return_val_if_fail(db->vt != NULL, NULL);
 	return_val_if_fail(db->vt->read_str != NULL, NULL);
 
-	return db->vt->read_str(db);
+	const char *const str = db->vt->read_str(db);
+
+	if (str)
+		(void) db_profile_cell(db, strlen(str));
+
+	return str;
 }
 
 bool
@@ -179,6 +602,9 @@ db_start_row(struct database_handle *db, const char *type)
 	return_val_if_fail(db != NULL, false);
 	return_val_if_fail(db->vt != NULL, false);
 	return_val_if_fail(db->vt->start_row != NULL, false);
+	return_val_if_fail(type != NULL, false);
+
+	(void) db_profile_begin(db, db_type_resolve(type)->profile);
 
 	return db->vt->start_row(db, type);
 }
@@ -190,6 +616,8 @@ db_write_word(struct database_handle *db, const char *word)
 	return_val_if_fail(db->vt != NULL, false);
 	return_val_if_fail(db->vt->write_word != NULL, false);
 
+	(void) db_profile_cell(db, word ? strlen(word) : 1);
+
 	return db->vt->write_word(db, word);
 }
 
@@ -200,6 +628,9 @@ db_write_str(struct database_handle *db, const char *str)
 	return_val_if_fail(db->vt != NULL, false);
 	return_val_if_fail(db->vt->write_str != NULL, false);
 
+	// Multi-word cells are the last in a row, and are not followed by a separator
+	(void) db_profile_cell(db, (str ? strlen(str) : 1) - 1);
+
 	return db->vt->write_str(db, str);
 }
 
@@ -210,6 +641,8 @@ db_write_int(struct database_handle *db, int num)
 	return_val_if_fail(db->vt != NULL, false);
 	return_val_if_fail(db->vt->write_int != NULL, false);
 
+	(void) db_profile_cell(db, db_profile_numlen((num < 0) ? -(unsigned long long) num : (unsigned long long) num, num < 0));
+
 	return db->vt->write_int(db, num);
 }
 
@@ -220,6 +653,8 @@ db_write_uint(struct database_handle *db, unsigned int num)
 	return_val_if_fail(db->vt != NULL, false);
 	return_val_if_fail(db->vt->write_uint != NULL, false);
 
+	(void) db_profile_cell(db, db_profile_numlen(num, false));
+
 	return db->vt->write_uint(db, num);
 }
 
@@ -230,6 +665,8 @@ db_write_time(struct database_handle *db, time_t tm)
 	return_val_if_fail(db->vt != NULL, false);
 	return_val_if_fail(db->vt->write_time != NULL, false);
 
+	(void) db_profile_cell(db, db_profile_numlen((unsigned long) tm, false));
+
 	return db->vt->write_time(db, tm);
 }
 
@@ -240,45 +677,81 @@ db_commit_row(struct database_handle *db)
 	return_val_if_fail(db->vt != NULL, false);
 	return_val_if_fail(db->vt->commit_row != NULL, false);
 
-	return db->vt->commit_row(db);
+	const bool ret = db->vt->commit_row(db);
+
+	if (db->profile)
+	{
+		db->profile_bytes++;
+		(void) db_profile_end(db);
+	}
+
+	return ret;
 }
 
-void
+unsigned int
 db_register_type_handler(const char *type, database_handler_fn fun)
 {
-	return_if_fail(db_types != NULL);
-	return_if_fail(type != NULL);
-	return_if_fail(fun != NULL);
+	return_val_if_fail(db_types != NULL, 0);
+	return_val_if_fail(type != NULL, 0);
+	return_val_if_fail(fun != NULL, 0);
+
+	struct database_type *const dt = db_type_get(type);
 
-	mowgli_patricia_add(db_types, type, fun);
+	dt->fun = fun;
+
+	return dt->id;
 }
 
 void
 db_unregister_type_handler(const char *type)
 {
+	struct database_type *dt;
+
 	return_if_fail(db_types != NULL);
 	return_if_fail(type != NULL);
 
-	mowgli_patricia_delete(db_types, type);
+	if ((dt = mowgli_patricia_retrieve(db_types, type)))
+		dt->fun = NULL;
+}
+
+static void
+db_dispatch(struct database_handle *const restrict db, const struct database_type *const restrict dt,
+            const char *const restrict type)
+{
+	database_handler_fn fun = dt->fun;
+
+	if (!fun)
+	{
+		fun = db_type_unknown->fun;
+	}
+
+	return_if_fail(fun != NULL);
+
+	(void) db_profile_begin(db, dt->profile);
+
+	fun(db, type);
+
+	(void) db_profile_end(db);
 }
 
 void
 db_process(struct database_handle *db, const char *type)
 {
-	database_handler_fn fun;
-
 	return_if_fail(db_types != NULL);
 	return_if_fail(db != NULL);
 	return_if_fail(type != NULL);
 
-	fun = mowgli_patricia_retrieve(db_types, type);
+	(void) db_dispatch(db, db_type_resolve(type), type);
+}
 
-	if (!fun)
-	{
-		fun = mowgli_patricia_retrieve(db_types, "???");
-	}
+void
+db_process_id(struct database_handle *db, unsigned int id)
+{
+	return_if_fail(db_types != NULL);
+	return_if_fail(db != NULL);
+	return_if_fail(id < db_type_count);
 
-	fun(db, type);
+	(void) db_dispatch(db, db_type_table[id], db_type_table[id]->name);
 }
 
 bool ATHEME_FATTR_PRINTF(2, 3)
@@ -298,10 +771,13 @@ void
 db_init(void)
 {
 	db_types = mowgli_patricia_create(strcasecanon);
+	db_profiles = mowgli_patricia_create(strcasecanon);
 
-	if (db_types == NULL)
+	if (db_types == NULL || db_profiles == NULL)
 	{
 		slog(LG_ERROR, "db_init(): object allocator failure");
 		exit(EXIT_FAILURE);
 	}
+
+	db_type_unknown = db_type_get("???");
 }
@@ -188,6 +188,21 @@ sendq_set_limit(struct connection *cptr, size_t len)
 	cptr->sendq_limit = len;
 }
 
+size_t
+sendq_length(struct connection *cptr)
+{
+	size_t l = 0;
+	mowgli_node_t *n;
+	struct sendq *sq;
+
+	MOWGLI_ITER_FOREACH(n, cptr->sendq.head)
+	{
+		sq = n->data;
+		l += sq->firstfree - sq->firstused;
+	}
+	return l;
+}
+
 int
 recvq_length(struct connection *cptr)
 {
@@ -0,0 +1,332 @@
+/*
+ * SPDX-License-Identifier: ISC
+ * SPDX-URL: https://spdx.org/licenses/ISC.html
+ *
+ * Copyright (C) 2026 Atheme Development Group (https://atheme.github.io/)
+ *
+ * Multi-buffer SHA2-256 & SHA2-512 PBKDF2 backend for Atheme IRC Services.
+ *
+ * PBKDF2 spends nearly all of its time iterating HMAC over one digest-sized
+ * message, which is inherently serial within one derivation. These kernels
+ * instead run several independent derivations side by side, one per vector
+ * lane, using the compiler's generic vector extensions. Wider kernels (AVX2,
+ * AVX-512) are compiled in with target attributes and chosen at runtime
+ * according to what the CPU supports.
+ */
+
+#include <atheme/digest/direct.h>       // self-declarations
+#include <atheme/memory.h>              // smemzero()
+#include <atheme/stdheaders.h>          // size_t, uint32_t, uint64_t, memcpy(3), memset(3)
+
+#define ATHEME_LAC_DIGEST_DIRECT_SHA2_MB_C 1
+
+#if defined(__GNUC__) && ((__GNUC__ >= 5) || defined(__clang__))
+#  define DIGEST_MB_VECTOR 1
+#  if defined(__x86_64__) || defined(__i386__)
+#    define DIGEST_MB_X86 1
+#  endif
+#endif
+
+#ifdef DIGEST_MB_VECTOR
+
+#define DIGEST_MB_CAT_(a, b)            a ## b
+#define DIGEST_MB_CAT(a, b)             DIGEST_MB_CAT_(a, b)
+
+#define SHA2_SHR(b, x)                  ((x) >> (b))
+#define SHA2_256_S32(b, x)              (((x) >> (b)) | ((x) << (0x20U - (b))))
+#define SHA2_512_S64(b, x)              (((x) >> (b)) | ((x) << (0x40U - (b))))
+
+#define SHA2_256_Sigma0(x)              (SHA2_256_S32(0x02U, (x)) ^ SHA2_256_S32(0x0DU, (x)) ^ SHA2_256_S32(0x16U, (x)))
+#define SHA2_256_Sigma1(x)              (SHA2_256_S32(0x06U, (x)) ^ SHA2_256_S32(0x0BU, (x)) ^ SHA2_256_S32(0x19U, (x)))
+#define SHA2_256_sigma0(x)              (SHA2_256_S32(0x07U, (x)) ^ SHA2_256_S32(0x12U, (x)) ^ SHA2_SHR(0x03U, (x)))
+#define SHA2_256_sigma1(x)              (SHA2_256_S32(0x11U, (x)) ^ SHA2_256_S32(0x13U, (x)) ^ SHA2_SHR(0x0AU, (x)))
+
+#define SHA2_512_Sigma0(x)              (SHA2_512_S64(0x1CU, (x)) ^ SHA2_512_S64(0x22U, (x)) ^ SHA2_512_S64(0x27U, (x)))
+#define SHA2_512_Sigma1(x)              (SHA2_512_S64(0x0EU, (x)) ^ SHA2_512_S64(0x12U, (x)) ^ SHA2_512_S64(0x29U, (x)))
+#define SHA2_512_sigma0(x)              (SHA2_512_S64(0x01U, (x)) ^ SHA2_512_S64(0x08U, (x)) ^ SHA2_SHR(0x07U, (x)))
+#define SHA2_512_sigma1(x)              (SHA2_512_S64(0x13U, (x)) ^ SHA2_512_S64(0x3DU, (x)) ^ SHA2_SHR(0x06U, (x)))
+
+#define SHA2_Ch(x, y, z)                (((x) & (y)) ^ ((~(x)) & (z)))
+#define SHA2_Maj(x, y, z)               (((x) & (y)) ^ ((x) & (z)) ^ ((y) & (z)))
+
+static const uint32_t digest_mb_K256[] = {
+
+	UINT32_C(0x428A2F98), UINT32_C(0x71374491), UINT32_C(0xB5C0FBCF), UINT32_C(0xE9B5DBA5),
+	UINT32_C(0x3956C25B), UINT32_C(0x59F111F1), UINT32_C(0x923F82A4), UINT32_C(0xAB1C5ED5),
+	UINT32_C(0xD807AA98), UINT32_C(0x12835B01), UINT32_C(0x243185BE), UINT32_C(0x550C7DC3),
+	UINT32_C(0x72BE5D74), UINT32_C(0x80DEB1FE), UINT32_C(0x9BDC06A7), UINT32_C(0xC19BF174),
+	UINT32_C(0xE49B69C1), UINT32_C(0xEFBE4786), UINT32_C(0x0FC19DC6), UINT32_C(0x240CA1CC),
+	UINT32_C(0x2DE92C6F), UINT32_C(0x4A7484AA), UINT32_C(0x5CB0A9DC), UINT32_C(0x76F988DA),
+	UINT32_C(0x983E5152), UINT32_C(0xA831C66D), UINT32_C(0xB00327C8), UINT32_C(0xBF597FC7),
+	UINT32_C(0xC6E00BF3), UINT32_C(0xD5A79147), UINT32_C(0x06CA6351), UINT32_C(0x14292967),
+	UINT32_C(0x27B70A85), UINT32_C(0x2E1B2138), UINT32_C(0x4D2C6DFC), UINT32_C(0x53380D13),
+	UINT32_C(0x650A7354), UINT32_C(0x766A0ABB), UINT32_C(0x81C2C92E), UINT32_C(0x92722C85),
+	UINT32_C(0xA2BFE8A1), UINT32_C(0xA81A664B), UINT32_C(0xC24B8B70), UINT32_C(0xC76C51A3),
+	UINT32_C(0xD192E819), UINT32_C(0xD6990624), UINT32_C(0xF40E3585), UINT32_C(0x106AA070),
+	UINT32_C(0x19A4C116), UINT32_C(0x1E376C08), UINT32_C(0x2748774C), UINT32_C(0x34B0BCB5),
+	UINT32_C(0x391C0CB3), UINT32_C(0x4ED8AA4A), UINT32_C(0x5B9CCA4F), UINT32_C(0x682E6FF3),
+	UINT32_C(0x748F82EE), UINT32_C(0x78A5636F), UINT32_C(0x84C87814), UINT32_C(0x8CC70208),
+	UINT32_C(0x90BEFFFA), UINT32_C(0xA4506CEB), UINT32_C(0xBEF9A3F7), UINT32_C(0xC67178F2),
+};
+
+static const uint64_t digest_mb_K512[] = {
+
+	UINT64_C(0x428A2F98D728AE22), UINT64_C(0x7137449123EF65CD),
+	UINT64_C(0xB5C0FBCFEC4D3B2F), UINT64_C(0xE9B5DBA58189DBBC),
+	UINT64_C(0x3956C25BF348B538), UINT64_C(0x59F111F1B605D019),
+	UINT64_C(0x923F82A4AF194F9B), UINT64_C(0xAB1C5ED5DA6D8118),
+	UINT64_C(0xD807AA98A3030242), UINT64_C(0x12835B0145706FBE),
+	UINT64_C(0x243185BE4EE4B28C), UINT64_C(0x550C7DC3D5FFB4E2),
+	UINT64_C(0x72BE5D74F27B896F), UINT64_C(0x80DEB1FE3B1696B1),
+	UINT64_C(0x9BDC06A725C71235), UINT64_C(0xC19BF174CF692694),
+	UINT64_C(0xE49B69C19EF14AD2), UINT64_C(0xEFBE4786384F25E3),
+	UINT64_C(0x0FC19DC68B8CD5B5), UINT64_C(0x240CA1CC77AC9C65),
+	UINT64_C(0x2DE92C6F592B0275), UINT64_C(0x4A7484AA6EA6E483),
+	UINT64_C(0x5CB0A9DCBD41FBD4), UINT64_C(0x76F988DA831153B5),
+	UINT64_C(0x983E5152EE66DFAB), UINT64_C(0xA831C66D2DB43210),
+	UINT64_C(0xB00327C898FB213F), UINT64_C(0xBF597FC7BEEF0EE4),
+	UINT64_C(0xC6E00BF33DA88FC2), UINT64_C(0xD5A79147930AA725),
+	UINT64_C(0x06CA6351E003826F), UINT64_C(0x142929670A0E6E70),
+	UINT64_C(0x27B70A8546D22FFC), UINT64_C(0x2E1B21385C26C926),
+	UINT64_C(0x4D2C6DFC5AC42AED), UINT64_C(0x53380D139D95B3DF),
+	UINT64_C(0x650A73548BAF63DE), UINT64_C(0x766A0ABB3C77B2A8),
+	UINT64_C(0x81C2C92E47EDAEE6), UINT64_C(0x92722C851482353B),
+	UINT64_C(0xA2BFE8A14CF10364), UINT64_C(0xA81A664BBC423001),
+	UINT64_C(0xC24B8B70D0F89791), UINT64_C(0xC76C51A30654BE30),
+	UINT64_C(0xD192E819D6EF5218), UINT64_C(0xD69906245565A910),
+	UINT64_C(0xF40E35855771202A), UINT64_C(0x106AA07032BBD1B8),
+	UINT64_C(0x19A4C116B8D2D0C8), UINT64_C(0x1E376C085141AB53),
+	UINT64_C(0x2748774CDF8EEB99), UINT64_C(0x34B0BCB5E19B48A8),
+	UINT64_C(0x391C0CB3C5C95A63), UINT64_C(0x4ED8AA4AE3418ACB),
+	UINT64_C(0x5B9CCA4F7763E373), UINT64_C(0x682E6FF3D6B2B8A3),
+	UINT64_C(0x748F82EE5DEFB2FC), UINT64_C(0x78A5636F43172F60),
+	UINT64_C(0x84C87814A1F0AB72), UINT64_C(0x8CC702081A6439EC),
+	UINT64_C(0x90BEFFFA23631E28), UINT64_C(0xA4506CEBDE82BDE9),
+	UINT64_C(0xBEF9A3F7B2C67915), UINT64_C(0xC67178F2E372532B),
+	UINT64_C(0xCA273ECEEA26619C), UINT64_C(0xD186B8C721C0C207),
+	UINT64_C(0xEADA7DD6CDE0EB1E), UINT64_C(0xF57D4F7FEE6ED178),
+	UINT64_C(0x06F067AA72176FBA), UINT64_C(0x0A637DC5A2C898A6),
+	UINT64_C(0x113F9804BEF90DAE), UINT64_C(0x1B710B35131C471B),
+	UINT64_C(0x28DB77F523047D84), UINT64_C(0x32CAAB7B40C72493),
+	UINT64_C(0x3C9EBE0A15C9BEBC), UINT64_C(0x431D67C49C100D4C),
+	UINT64_C(0x4CC5D4BECB3E42B6), UINT64_C(0x597F299CFC657E2A),
+	UINT64_C(0x5FCB6FAB3AD6FAEC), UINT64_C(0x6C44198C4A475817),
+};
+
+// 128-bit vectors; SSE2 on x86-64, NEON on ARM, and so on
+#define DIGEST_MB_SUFFIX    _v128
+#define DIGEST_MB_BYTES     16
+#define DIGEST_MB_TARGET
+#include "digest_direct_sha2_mbk.c"
+
+#ifdef DIGEST_MB_X86
+
+#define DIGEST_MB_SUFFIX    _avx2
+#define DIGEST_MB_BYTES     32
+#define DIGEST_MB_TARGET    __attribute__((target("avx2")))
+#include "digest_direct_sha2_mbk.c"
+
+#define DIGEST_MB_SUFFIX    _avx512
+#define DIGEST_MB_BYTES     64
+#define DIGEST_MB_TARGET    __attribute__((target("avx512f")))
+#include "digest_direct_sha2_mbk.c"
+
+static bool
+digest_mb_have_avx2(void)
+{
+	(void) __builtin_cpu_init();
+
+	return __builtin_cpu_supports("avx2");
+}
+
+static bool
+digest_mb_have_avx512(void)
+{
+	(void) __builtin_cpu_init();
+
+	return __builtin_cpu_supports("avx512f");
+}
+
+#endif /* DIGEST_MB_X86 */
+
+struct digest_mb_kernel
+{
+	const char *    name;
+	size_t          lanes_256;
+	size_t          lanes_512;
+	bool          (*usable)(void);
+	void          (*pbkdf2_256)(size_t, const uint32_t (*)[DIGEST_IVLEN_SHA2_256],
+	                            const uint32_t (*)[DIGEST_IVLEN_SHA2_256], uint32_t (*)[DIGEST_IVLEN_SHA2_256],
+	                            size_t);
+	void          (*pbkdf2_512)(size_t, const uint64_t (*)[DIGEST_IVLEN_SHA2_512],
+	                            const uint64_t (*)[DIGEST_IVLEN_SHA2_512], uint64_t (*)[DIGEST_IVLEN_SHA2_512],
+	                            size_t);
+};
+
+// Narrowest first; the widest usable one is the default
+static const struct digest_mb_kernel digest_mb_kernels[] = {
+
+	{ "vector-128", 4, 2, NULL, &digest_mb_pbkdf2_sha2_256_v128, &digest_mb_pbkdf2_sha2_512_v128 },
+#ifdef DIGEST_MB_X86
+	{ "avx2", 8, 4, &digest_mb_have_avx2, &digest_mb_pbkdf2_sha2_256_avx2, &digest_mb_pbkdf2_sha2_512_avx2 },
+	{ "avx512", 16, 8, &digest_mb_have_avx512, &digest_mb_pbkdf2_sha2_256_avx512,
+	  &digest_mb_pbkdf2_sha2_512_avx512 },
+#endif
+};
+
+#define DIGEST_MB_KERNEL_COUNT          (sizeof digest_mb_kernels / sizeof digest_mb_kernels[0])
+
+/* Chosen once by the digest testsuite at startup (which also tries all of
+ * them), before any thread that could use it exists.
+ */
+static const struct digest_mb_kernel *digest_mb_kernel = NULL;
+
+size_t
+digest_direct_mb_kernel_count(void)
+{
+	return DIGEST_MB_KERNEL_COUNT;
+}
+
+const char *
+digest_direct_mb_kernel_name(const size_t idx)
+{
+	if (idx >= DIGEST_MB_KERNEL_COUNT)
+		return NULL;
+
+	return digest_mb_kernels[idx].name;
+}
+
+bool
+digest_direct_mb_kernel_select(const size_t idx)
+{
+	if (idx >= DIGEST_MB_KERNEL_COUNT)
+		return false;
+
+	if (digest_mb_kernels[idx].usable && ! digest_mb_kernels[idx].usable())
+		return false;
+
+	digest_mb_kernel = &digest_mb_kernels[idx];
+	return true;
+}
+
+void
+digest_direct_mb_kernel_select_best(void)
+{
+	for (size_t idx = DIGEST_MB_KERNEL_COUNT; idx--; /* No action */)
+		if (digest_direct_mb_kernel_select(idx))
+			return;
+}
+
+const char *
+digest_direct_mb_kernel_current(void)
+{
+	if (! digest_mb_kernel)
+		(void) digest_direct_mb_kernel_select_best();
+
+	return digest_mb_kernel->name;
+}
+
+size_t
+digest_direct_mb_lanes(const bool sha2_512)
+{
+	if (! digest_mb_kernel)
+		(void) digest_direct_mb_kernel_select_best();
+
+	return sha2_512 ? digest_mb_kernel->lanes_512 : digest_mb_kernel->lanes_256;
+}
+
+void
+digest_direct_mb_pbkdf2_sha2_256(const size_t lanes, const uint32_t (*const istate)[DIGEST_IVLEN_SHA2_256],
+                                 const uint32_t (*const ostate)[DIGEST_IVLEN_SHA2_256],
+                                 uint32_t (*const t)[DIGEST_IVLEN_SHA2_256], const size_t c)
+{
+	if (! digest_mb_kernel)
+		(void) digest_direct_mb_kernel_select_best();
+
+	const size_t width = digest_mb_kernel->lanes_256;
+
+	for (size_t off = 0; off < lanes; off += width)
+	{
+		const size_t n = ((lanes - off) < width) ? (lanes - off) : width;
+
+		(void) digest_mb_kernel->pbkdf2_256(n, istate + off, ostate + off, t + off, c);
+	}
+}
+
+void
+digest_direct_mb_pbkdf2_sha2_512(const size_t lanes, const uint64_t (*const istate)[DIGEST_IVLEN_SHA2_512],
+                                 const uint64_t (*const ostate)[DIGEST_IVLEN_SHA2_512],
+                                 uint64_t (*const t)[DIGEST_IVLEN_SHA2_512], const size_t c)
+{
+	if (! digest_mb_kernel)
+		(void) digest_direct_mb_kernel_select_best();
+
+	const size_t width = digest_mb_kernel->lanes_512;
+
+	for (size_t off = 0; off < lanes; off += width)
+	{
+		const size_t n = ((lanes - off) < width) ? (lanes - off) : width;
+
+		(void) digest_mb_kernel->pbkdf2_512(n, istate + off, ostate + off, t + off, c);
+	}
+}
+
+#else /* DIGEST_MB_VECTOR */
+
+size_t
+digest_direct_mb_kernel_count(void)
+{
+	return 0;
+}
+
+const char *
+digest_direct_mb_kernel_name(const size_t ATHEME_VATTR_UNUSED idx)
+{
+	return NULL;
+}
+
+bool
+digest_direct_mb_kernel_select(const size_t ATHEME_VATTR_UNUSED idx)
+{
+	return false;
+}
+
+void
+digest_direct_mb_kernel_select_best(void)
+{
+	return;
+}
+
+const char *
+digest_direct_mb_kernel_current(void)
+{
+	return NULL;
+}
+
+size_t
+digest_direct_mb_lanes(const bool ATHEME_VATTR_UNUSED sha2_512)
+{
+	return 0;
+}
+
+void
+digest_direct_mb_pbkdf2_sha2_256(const size_t ATHEME_VATTR_UNUSED lanes,
+                                 const uint32_t ATHEME_VATTR_UNUSED (*const istate)[DIGEST_IVLEN_SHA2_256],
+                                 const uint32_t ATHEME_VATTR_UNUSED (*const ostate)[DIGEST_IVLEN_SHA2_256],
+                                 uint32_t ATHEME_VATTR_UNUSED (*const t)[DIGEST_IVLEN_SHA2_256],
+                                 const size_t ATHEME_VATTR_UNUSED c)
+{
+	return;
+}
+
+void
+digest_direct_mb_pbkdf2_sha2_512(const size_t ATHEME_VATTR_UNUSED lanes,
+                                 const uint64_t ATHEME_VATTR_UNUSED (*const istate)[DIGEST_IVLEN_SHA2_512],
+                                 const uint64_t ATHEME_VATTR_UNUSED (*const ostate)[DIGEST_IVLEN_SHA2_512],
+                                 uint64_t ATHEME_VATTR_UNUSED (*const t)[DIGEST_IVLEN_SHA2_512],
+                                 const size_t ATHEME_VATTR_UNUSED c)
+{
+	return;
+}
+
+#endif /* !DIGEST_MB_VECTOR */
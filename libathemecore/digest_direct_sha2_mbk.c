@@ -0,0 +1,238 @@
+/*
+ * SPDX-License-Identifier: ISC
+ * SPDX-URL: https://spdx.org/licenses/ISC.html
+ *
+ * Copyright (C) 2026 Atheme Development Group (https://atheme.github.io/)
+ *
+ * Multi-buffer PBKDF2-HMAC-SHA2 iteration kernel, instantiated once for each
+ * vector width by digest_direct_sha2_mb.c. Each lane of a vector belongs to a
+ * different, independent PBKDF2 derivation (or output block of one).
+ *
+ * Expects DIGEST_MB_SUFFIX (name suffix), DIGEST_MB_BYTES (vector width) and
+ * DIGEST_MB_TARGET (function attributes, possibly empty) to be defined.
+ */
+
+#ifndef ATHEME_LAC_DIGEST_DIRECT_SHA2_MB_C
+#  error "Do not compile me directly; compile digest_direct_sha2_mb.c instead"
+#endif /* !ATHEME_LAC_DIGEST_DIRECT_SHA2_MB_C */
+
+#define DIGEST_MB_FN(name)              DIGEST_MB_CAT(name, DIGEST_MB_SUFFIX)
+#define DIGEST_MB_V32                   DIGEST_MB_FN(digest_mb_v32)
+#define DIGEST_MB_V64                   DIGEST_MB_FN(digest_mb_v64)
+
+typedef uint32_t DIGEST_MB_V32 __attribute__((vector_size(DIGEST_MB_BYTES)));
+typedef uint64_t DIGEST_MB_V64 __attribute__((vector_size(DIGEST_MB_BYTES)));
+
+DIGEST_MB_TARGET static inline void
+DIGEST_MB_FN(digest_mb_compress_sha2_256)(DIGEST_MB_V32 st[const restrict DIGEST_IVLEN_SHA2_256],
+                                          DIGEST_MB_V32 W[const restrict 0x10U])
+{
+	DIGEST_MB_V32 a = st[0], b = st[1], c = st[2], d = st[3], e = st[4], f = st[5], g = st[6], h = st[7];
+
+	for (size_t j = 0x00U; j < 0x40U; j++)
+	{
+		if (j >= 0x10U)
+			W[j & 0x0FU] += SHA2_256_sigma1(W[(j + 0x0EU) & 0x0FU]) + W[(j + 0x09U) & 0x0FU] +
+			                SHA2_256_sigma0(W[(j + 0x01U) & 0x0FU]);
+
+		const DIGEST_MB_V32 t1 = h + SHA2_256_Sigma1(e) + SHA2_Ch(e, f, g) + digest_mb_K256[j] + W[j & 0x0FU];
+		const DIGEST_MB_V32 t2 = SHA2_256_Sigma0(a) + SHA2_Maj(a, b, c);
+
+		h = g;
+		g = f;
+		f = e;
+		e = d + t1;
+		d = c;
+		c = b;
+		b = a;
+		a = t1 + t2;
+	}
+
+	st[0] += a; st[1] += b; st[2] += c; st[3] += d;
+	st[4] += e; st[5] += f; st[6] += g; st[7] += h;
+}
+
+DIGEST_MB_TARGET static inline void
+DIGEST_MB_FN(digest_mb_compress_sha2_512)(DIGEST_MB_V64 st[const restrict DIGEST_IVLEN_SHA2_512],
+                                          DIGEST_MB_V64 W[const restrict 0x10U])
+{
+	DIGEST_MB_V64 a = st[0], b = st[1], c = st[2], d = st[3], e = st[4], f = st[5], g = st[6], h = st[7];
+
+	for (size_t j = 0x00U; j < 0x50U; j++)
+	{
+		if (j >= 0x10U)
+			W[j & 0x0FU] += SHA2_512_sigma1(W[(j + 0x0EU) & 0x0FU]) + W[(j + 0x09U) & 0x0FU] +
+			                SHA2_512_sigma0(W[(j + 0x01U) & 0x0FU]);
+
+		const DIGEST_MB_V64 t1 = h + SHA2_512_Sigma1(e) + SHA2_Ch(e, f, g) + digest_mb_K512[j] + W[j & 0x0FU];
+		const DIGEST_MB_V64 t2 = SHA2_512_Sigma0(a) + SHA2_Maj(a, b, c);
+
+		h = g;
+		g = f;
+		f = e;
+		e = d + t1;
+		d = c;
+		c = b;
+		b = a;
+		a = t1 + t2;
+	}
+
+	st[0] += a; st[1] += b; st[2] += c; st[3] += d;
+	st[4] += e; st[5] += f; st[6] += g; st[7] += h;
+}
+
+/* For up to DIGEST_MB_BYTES / 4 lanes: t[] holds U(1) on entry, and T = U(1) ^
+ * U(2) ^ ... ^ U(c) on return. Every HMAC message here is a single digest, so
+ * each iteration is exactly one compression from each of the two midstates.
+ */
+DIGEST_MB_TARGET static void
+DIGEST_MB_FN(digest_mb_pbkdf2_sha2_256)(const size_t lanes,
+                                        const uint32_t (*const istate)[DIGEST_IVLEN_SHA2_256],
+                                        const uint32_t (*const ostate)[DIGEST_IVLEN_SHA2_256],
+                                        uint32_t (*const t)[DIGEST_IVLEN_SHA2_256], const size_t c)
+{
+	DIGEST_MB_V32 is[DIGEST_IVLEN_SHA2_256];
+	DIGEST_MB_V32 os[DIGEST_IVLEN_SHA2_256];
+	DIGEST_MB_V32 u[DIGEST_IVLEN_SHA2_256];
+	DIGEST_MB_V32 acc[DIGEST_IVLEN_SHA2_256];
+	DIGEST_MB_V32 W[0x10U];
+
+	(void) memset(is, 0x00U, sizeof is);
+	(void) memset(os, 0x00U, sizeof os);
+	(void) memset(u, 0x00U, sizeof u);
+
+	for (size_t w = 0x00U; w < DIGEST_IVLEN_SHA2_256; w++)
+	{
+		for (size_t l = 0x00U; l < lanes; l++)
+		{
+			is[w][l] = istate[l][w];
+			os[w][l] = ostate[l][w];
+			u[w][l] = t[l][w];
+		}
+
+		acc[w] = u[w];
+	}
+
+	for (size_t j = 0x01U; j < c; j++)
+	{
+		// Inner hash: U(j - 1) || padding, length = (block + digest) bits
+		for (size_t w = 0x00U; w < DIGEST_IVLEN_SHA2_256; w++)
+			W[w] = u[w];
+
+		W[0x08U] = (DIGEST_MB_V32) { 0 } + UINT32_C(0x80000000);
+
+		for (size_t w = 0x09U; w < 0x0FU; w++)
+			W[w] = (DIGEST_MB_V32) { 0 };
+
+		W[0x0FU] = (DIGEST_MB_V32) { 0 } + (uint32_t) ((DIGEST_BKLEN_SHA2_256 + DIGEST_MDLEN_SHA2_256) << 0x03U);
+
+		(void) memcpy(u, is, sizeof u);
+		(void) DIGEST_MB_FN(digest_mb_compress_sha2_256)(u, W);
+
+		// Outer hash: inner digest || padding
+		for (size_t w = 0x00U; w < DIGEST_IVLEN_SHA2_256; w++)
+			W[w] = u[w];
+
+		W[0x08U] = (DIGEST_MB_V32) { 0 } + UINT32_C(0x80000000);
+
+		for (size_t w = 0x09U; w < 0x0FU; w++)
+			W[w] = (DIGEST_MB_V32) { 0 };
+
+		W[0x0FU] = (DIGEST_MB_V32) { 0 } + (uint32_t) ((DIGEST_BKLEN_SHA2_256 + DIGEST_MDLEN_SHA2_256) << 0x03U);
+
+		(void) memcpy(u, os, sizeof u);
+		(void) DIGEST_MB_FN(digest_mb_compress_sha2_256)(u, W);
+
+		for (size_t w = 0x00U; w < DIGEST_IVLEN_SHA2_256; w++)
+			acc[w] ^= u[w];
+	}
+
+	for (size_t w = 0x00U; w < DIGEST_IVLEN_SHA2_256; w++)
+		for (size_t l = 0x00U; l < lanes; l++)
+			t[l][w] = acc[w][l];
+
+	(void) smemzero(is, sizeof is);
+	(void) smemzero(os, sizeof os);
+	(void) smemzero(u, sizeof u);
+	(void) smemzero(acc, sizeof acc);
+	(void) smemzero(W, sizeof W);
+}
+
+// As above, for up to DIGEST_MB_BYTES / 8 lanes
+DIGEST_MB_TARGET static void
+DIGEST_MB_FN(digest_mb_pbkdf2_sha2_512)(const size_t lanes,
+                                        const uint64_t (*const istate)[DIGEST_IVLEN_SHA2_512],
+                                        const uint64_t (*const ostate)[DIGEST_IVLEN_SHA2_512],
+                                        uint64_t (*const t)[DIGEST_IVLEN_SHA2_512], const size_t c)
+{
+	DIGEST_MB_V64 is[DIGEST_IVLEN_SHA2_512];
+	DIGEST_MB_V64 os[DIGEST_IVLEN_SHA2_512];
+	DIGEST_MB_V64 u[DIGEST_IVLEN_SHA2_512];
+	DIGEST_MB_V64 acc[DIGEST_IVLEN_SHA2_512];
+	DIGEST_MB_V64 W[0x10U];
+
+	(void) memset(is, 0x00U, sizeof is);
+	(void) memset(os, 0x00U, sizeof os);
+	(void) memset(u, 0x00U, sizeof u);
+
+	for (size_t w = 0x00U; w < DIGEST_IVLEN_SHA2_512; w++)
+	{
+		for (size_t l = 0x00U; l < lanes; l++)
+		{
+			is[w][l] = istate[l][w];
+			os[w][l] = ostate[l][w];
+			u[w][l] = t[l][w];
+		}
+
+		acc[w] = u[w];
+	}
+
+	for (size_t j = 0x01U; j < c; j++)
+	{
+		for (size_t w = 0x00U; w < DIGEST_IVLEN_SHA2_512; w++)
+			W[w] = u[w];
+
+		W[0x08U] = (DIGEST_MB_V64) { 0 } + UINT64_C(0x8000000000000000);
+
+		for (size_t w = 0x09U; w < 0x0FU; w++)
+			W[w] = (DIGEST_MB_V64) { 0 };
+
+		W[0x0FU] = (DIGEST_MB_V64) { 0 } + (uint64_t) ((DIGEST_BKLEN_SHA2_512 + DIGEST_MDLEN_SHA2_512) << 0x03U);
+
+		(void) memcpy(u, is, sizeof u);
+		(void) DIGEST_MB_FN(digest_mb_compress_sha2_512)(u, W);
+
+		for (size_t w = 0x00U; w < DIGEST_IVLEN_SHA2_512; w++)
+			W[w] = u[w];
+
+		W[0x08U] = (DIGEST_MB_V64) { 0 } + UINT64_C(0x8000000000000000);
+
+		for (size_t w = 0x09U; w < 0x0FU; w++)
+			W[w] = (DIGEST_MB_V64) { 0 };
+
+		W[0x0FU] = (DIGEST_MB_V64) { 0 } + (uint64_t) ((DIGEST_BKLEN_SHA2_512 + DIGEST_MDLEN_SHA2_512) << 0x03U);
+
+		(void) memcpy(u, os, sizeof u);
+		(void) DIGEST_MB_FN(digest_mb_compress_sha2_512)(u, W);
+
+		for (size_t w = 0x00U; w < DIGEST_IVLEN_SHA2_512; w++)
+			acc[w] ^= u[w];
+	}
+
+	for (size_t w = 0x00U; w < DIGEST_IVLEN_SHA2_512; w++)
+		for (size_t l = 0x00U; l < lanes; l++)
+			t[l][w] = acc[w][l];
+
+	(void) smemzero(is, sizeof is);
+	(void) smemzero(os, sizeof os);
+	(void) smemzero(u, sizeof u);
+	(void) smemzero(acc, sizeof acc);
+	(void) smemzero(W, sizeof W);
+}
+
+#undef DIGEST_MB_FN
+#undef DIGEST_MB_V32
+#undef DIGEST_MB_V64
+#undef DIGEST_MB_SUFFIX
+#undef DIGEST_MB_BYTES
+#undef DIGEST_MB_TARGET
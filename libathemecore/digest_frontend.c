@@ -28,6 +28,11 @@
 #  error "No Digest API frontend was selected by the build system"
 #endif
 
+#ifndef DIGEST_HMAC_INNER_XORVAL
+#  define DIGEST_HMAC_INNER_XORVAL  0x36U
+#  define DIGEST_HMAC_OUTER_XORVAL  0x5CU
+#endif
+
 static bool ATHEME_FATTR_WUR
 _digest_update_vector(struct digest_context *const restrict ctx, const struct digest_vector *const restrict vec,
                       const size_t vecLen)
@@ -117,6 +122,185 @@ _digest_oneshot_hmac_vector(const enum digest_algorithm alg, const void *const k
 	return true;
 }
 
+static bool
+digest_pbkdf2_mb_usable(const enum digest_algorithm alg)
+{
+	return (alg == DIGALG_SHA2_256 || alg == DIGALG_SHA2_512) && digest_direct_mb_kernel_count();
+}
+
+static inline uint64_t
+digest_pbkdf2_mb_load(const unsigned char *const restrict in, const size_t wordsz)
+{
+	uint64_t w = 0;
+
+	for (size_t i = 0; i < wordsz; i++)
+		w = (w << 0x08U) | in[i];
+
+	return w;
+}
+
+static inline void
+digest_pbkdf2_mb_store(unsigned char *const restrict out, uint64_t w, const size_t wordsz)
+{
+	for (size_t i = wordsz; i--; w >>= 0x08U)
+		out[i] = (unsigned char) (w & 0xFFU);
+}
+
+/* PBKDF2 for SHA2-256 or SHA2-512 on the multi-buffer kernels. Every output
+ * block T(i) of every job is a lane of its own, so that a single long dkLen
+ * also benefits. The HMAC midstates and U(1) are computed here with the
+ * direct (scalar) backend, whatever the frontend.
+ */
+static bool
+digest_pbkdf2_mb(const enum digest_algorithm alg, const size_t c, const struct digest_pbkdf2_job *const jobs,
+                 const size_t njobs)
+{
+	const bool sha2_512 = (alg == DIGALG_SHA2_512);
+
+	void (*const init)(union digest_direct_ctx *) =
+	    sha2_512 ? &digest_direct_init_sha2_512 : &digest_direct_init_sha2_256;
+	void (*const update)(union digest_direct_ctx *, const void *, size_t) =
+	    sha2_512 ? &digest_direct_update_sha2_512 : &digest_direct_update_sha2_256;
+	void (*const final)(union digest_direct_ctx *, void *) =
+	    sha2_512 ? &digest_direct_final_sha2_512 : &digest_direct_final_sha2_256;
+
+	const size_t blksz = sha2_512 ? DIGEST_BKLEN_SHA2_512 : DIGEST_BKLEN_SHA2_256;
+	const size_t hLen = sha2_512 ? DIGEST_MDLEN_SHA2_512 : DIGEST_MDLEN_SHA2_256;
+	const size_t wordsz = sha2_512 ? sizeof(uint64_t) : sizeof(uint32_t);
+	const size_t nwords = hLen / wordsz;
+
+	size_t lanes = 0;
+
+	for (size_t i = 0; i < njobs; i++)
+		lanes += (jobs[i].dkLen + hLen - 1) / hLen;
+
+	// Midstates and T, as host-order words; uint64_t is wide enough for either algorithm
+	uint64_t (*const is)[DIGEST_IVLEN_SHA2_512] = smalloc(lanes * sizeof *is);
+	uint64_t (*const os)[DIGEST_IVLEN_SHA2_512] = smalloc(lanes * sizeof *os);
+	uint64_t (*const t)[DIGEST_IVLEN_SHA2_512] = smalloc(lanes * sizeof *t);
+
+	unsigned char key[DIGEST_BKLEN_MAX];
+	unsigned char ipad[DIGEST_BKLEN_MAX];
+	unsigned char opad[DIGEST_BKLEN_MAX];
+	unsigned char tmp[DIGEST_MDLEN_MAX];
+	union digest_direct_ctx ictx;
+	union digest_direct_ctx octx;
+	union digest_direct_ctx ctx;
+	size_t lane = 0;
+
+	for (size_t i = 0; i < njobs; i++)
+	{
+		const struct digest_pbkdf2_job *const job = &jobs[i];
+		const size_t nblocks = (job->dkLen + hLen - 1) / hLen;
+
+		(void) memset(key, 0x00U, sizeof key);
+
+		if (job->passLen > blksz)
+		{
+			(void) init(&ctx);
+			(void) update(&ctx, job->pass, job->passLen);
+			(void) final(&ctx, key);
+		}
+		else
+			(void) memcpy(key, job->pass, job->passLen);
+
+		for (size_t j = 0; j < blksz; j++)
+		{
+			ipad[j] = key[j] ^ DIGEST_HMAC_INNER_XORVAL;
+			opad[j] = key[j] ^ DIGEST_HMAC_OUTER_XORVAL;
+		}
+
+		(void) init(&ictx);
+		(void) update(&ictx, ipad, blksz);
+		(void) init(&octx);
+		(void) update(&octx, opad, blksz);
+
+		for (uint32_t blk = 1; blk <= nblocks; blk++, lane++)
+		{
+			const uint32_t ibe = htonl(blk);
+
+			(void) memcpy(&ctx, &ictx, sizeof ctx);
+			(void) update(&ctx, job->salt, job->saltLen);
+			(void) update(&ctx, &ibe, sizeof ibe);
+			(void) final(&ctx, tmp);
+			(void) memcpy(&ctx, &octx, sizeof ctx);
+			(void) update(&ctx, tmp, hLen);
+			(void) final(&ctx, tmp);
+
+			for (size_t w = 0; w < nwords; w++)
+			{
+				is[lane][w] = sha2_512 ? ictx.sha2_512.state[w] : ictx.sha2_256.state[w];
+				os[lane][w] = sha2_512 ? octx.sha2_512.state[w] : octx.sha2_256.state[w];
+				t[lane][w] = digest_pbkdf2_mb_load(tmp + (w * wordsz), wordsz);
+			}
+		}
+	}
+
+	if (sha2_512)
+	{
+		(void) digest_direct_mb_pbkdf2_sha2_512(lanes, (const void *) is, (const void *) os, (void *) t, c);
+	}
+	else
+	{
+		uint32_t (*const is32)[DIGEST_IVLEN_SHA2_256] = smalloc(lanes * sizeof *is32);
+		uint32_t (*const os32)[DIGEST_IVLEN_SHA2_256] = smalloc(lanes * sizeof *os32);
+		uint32_t (*const t32)[DIGEST_IVLEN_SHA2_256] = smalloc(lanes * sizeof *t32);
+
+		for (size_t l = 0; l < lanes; l++)
+		{
+			for (size_t w = 0; w < nwords; w++)
+			{
+				is32[l][w] = (uint32_t) is[l][w];
+				os32[l][w] = (uint32_t) os[l][w];
+				t32[l][w] = (uint32_t) t[l][w];
+			}
+		}
+
+		(void) digest_direct_mb_pbkdf2_sha2_256(lanes, (const void *) is32, (const void *) os32, t32, c);
+
+		for (size_t l = 0; l < lanes; l++)
+			for (size_t w = 0; w < nwords; w++)
+				t[l][w] = t32[l][w];
+
+		(void) smemzerofree(is32, lanes * sizeof *is32);
+		(void) smemzerofree(os32, lanes * sizeof *os32);
+		(void) smemzerofree(t32, lanes * sizeof *t32);
+	}
+
+	lane = 0;
+
+	for (size_t i = 0; i < njobs; i++)
+	{
+		unsigned char *out = jobs[i].dk;
+		size_t rem = jobs[i].dkLen;
+
+		for (; rem; lane++)
+		{
+			const size_t cpLen = (rem > hLen) ? hLen : rem;
+
+			for (size_t w = 0; w < nwords; w++)
+				(void) digest_pbkdf2_mb_store(tmp + (w * wordsz), t[lane][w], wordsz);
+
+			(void) memcpy(out, tmp, cpLen);
+
+			out += cpLen;
+			rem -= cpLen;
+		}
+	}
+
+	(void) smemzero(key, sizeof key);
+	(void) smemzero(ipad, sizeof ipad);
+	(void) smemzero(opad, sizeof opad);
+	(void) smemzero(tmp, sizeof tmp);
+	(void) smemzero(&ictx, sizeof ictx);
+	(void) smemzero(&octx, sizeof octx);
+	(void) smemzero(&ctx, sizeof ctx);
+	(void) smemzerofree(is, lanes * sizeof *is);
+	(void) smemzerofree(os, lanes * sizeof *os);
+	(void) smemzerofree(t, lanes * sizeof *t);
+	return true;
+}
+
 size_t
 digest_size_alg(const enum digest_algorithm alg)
 {
@@ -616,3 +800,67 @@ digest_oneshot_pbkdf2(const enum digest_algorithm alg, const void *const restric
 
 	return _digest_oneshot_pbkdf2(alg, pass, passLen, salt, saltLen, c, dk, dkLen);
 }
+
+/* Performs several independent PBKDF2 derivations with the same digest and
+ * iteration count, several at a time where multi-buffer kernels exist for the
+ * digest. The results are the same as calling digest_oneshot_pbkdf2() on each.
+ */
+bool ATHEME_FATTR_WUR
+digest_oneshot_pbkdf2_batch(const enum digest_algorithm alg, const size_t c,
+                            const struct digest_pbkdf2_job *const restrict jobs, const size_t njobs)
+{
+	const size_t hLen = digest_size_alg(alg);
+
+	if (! hLen)
+	{
+		(void) slog(LG_ERROR, "%s: called with malformed/uninitialised 'alg' (BUG)", MOWGLI_FUNC_NAME);
+		return false;
+	}
+	if (! c)
+	{
+		(void) slog(LG_ERROR, "%s: called with zero 'c' (BUG)", MOWGLI_FUNC_NAME);
+		return false;
+	}
+	if (! (jobs && njobs))
+	{
+		(void) slog(LG_ERROR, "%s: called with no jobs (BUG)", MOWGLI_FUNC_NAME);
+		return false;
+	}
+	for (size_t i = 0; i < njobs; i++)
+	{
+		if (! (jobs[i].pass && jobs[i].passLen))
+		{
+			(void) slog(LG_ERROR, "%s: called with no password (BUG)", MOWGLI_FUNC_NAME);
+			return false;
+		}
+		if (! (jobs[i].salt && jobs[i].saltLen))
+		{
+			(void) slog(LG_ERROR, "%s: called with no salt (BUG)", MOWGLI_FUNC_NAME);
+			return false;
+		}
+		if (! (jobs[i].dk && jobs[i].dkLen))
+		{
+			(void) slog(LG_ERROR, "%s: called with no output buffer (BUG)", MOWGLI_FUNC_NAME);
+			return false;
+		}
+	}
+
+	if (digest_pbkdf2_mb_usable(alg))
+		return digest_pbkdf2_mb(alg, c, jobs, njobs);
+
+	for (size_t i = 0; i < njobs; i++)
+		if (! _digest_oneshot_pbkdf2(alg, jobs[i].pass, jobs[i].passLen, jobs[i].salt, jobs[i].saltLen, c,
+		                             jobs[i].dk, jobs[i].dkLen))
+			return false;
+
+	return true;
+}
+
+// The multi-buffer kernel used for SHA2 PBKDF2 batches
+const char *
+digest_get_pbkdf2_batch_info(void)
+{
+	const char *const kernel = digest_direct_mb_kernel_current();
+
+	return kernel ? kernel : "none (one at a time)";
+}
@@ -4742,6 +4742,57 @@ digest_testsuite_run_pbkdf2_sha1(void)
 	return true;
 }
 
+/* Checks a PBKDF2 vector through digest_oneshot_pbkdf2_batch() on every
+ * multi-buffer kernel this CPU can run. Several copies of the job are done at
+ * once so that the lanes (one per output block) do not fill a whole vector.
+ */
+static bool
+digest_testsuite_run_pbkdf2_batch(const enum digest_algorithm alg, const void *const restrict key,
+                                  const size_t keyLen, const void *const restrict salt, const size_t saltLen,
+                                  const size_t iter, const unsigned char *const restrict vector, const size_t vecLen)
+{
+	struct digest_pbkdf2_job jobs[3];
+	unsigned char results[3][DIGEST_MDLEN_MAX * 2];
+	bool ok = true;
+
+	if (vecLen > sizeof results[0])
+		return false;
+
+	for (size_t i = 0; i < 3; i++)
+	{
+		jobs[i].pass = key;
+		jobs[i].passLen = keyLen;
+		jobs[i].salt = salt;
+		jobs[i].saltLen = saltLen;
+		jobs[i].dk = results[i];
+		jobs[i].dkLen = vecLen;
+	}
+
+	for (size_t k = 0; ok && k < digest_direct_mb_kernel_count(); k++)
+	{
+		if (! digest_direct_mb_kernel_select(k))
+		{
+			(void) slog(LG_DEBUG, "%s: skipping kernel '%s' (unsupported by this CPU)", MOWGLI_FUNC_NAME,
+			            digest_direct_mb_kernel_name(k));
+			continue;
+		}
+
+		(void) slog(LG_DEBUG, "%s: kernel '%s'", MOWGLI_FUNC_NAME, digest_direct_mb_kernel_name(k));
+		(void) memset(results, 0x00U, sizeof results);
+
+		if (! digest_oneshot_pbkdf2_batch(alg, iter, jobs, 3))
+			ok = false;
+
+		for (size_t i = 0; ok && i < 3; i++)
+			if (memcmp(results[i], vector, vecLen) != 0)
+				ok = false;
+	}
+
+	(void) digest_direct_mb_kernel_select_best();
+
+	return ok;
+}
+
 static bool
 digest_testsuite_run_pbkdf2_sha2_256(void)
 {
@@ -4845,6 +4896,12 @@ digest_testsuite_run_pbkdf2_sha2_256(void)
 	if (memcmp(result, vector, sizeof vector) != 0)
 		return false;
 
+	(void) slog(LG_DEBUG, "%s: vector 1 (batched)", MOWGLI_FUNC_NAME);
+
+	if (! digest_testsuite_run_pbkdf2_batch(DIGALG_SHA2_256, key, sizeof key, salt, sizeof salt, iter, vector,
+	                                        sizeof vector))
+		return false;
+
 	return true;
 }
 
@@ -4951,6 +5008,12 @@ digest_testsuite_run_pbkdf2_sha2_512(void)
 	if (memcmp(result, vector, sizeof vector) != 0)
 		return false;
 
+	(void) slog(LG_DEBUG, "%s: vector 1 (batched)", MOWGLI_FUNC_NAME);
+
+	if (! digest_testsuite_run_pbkdf2_batch(DIGALG_SHA2_512, key, sizeof key, salt, sizeof salt, iter, vector,
+	                                        sizeof vector))
+		return false;
+
 	return true;
 }
 
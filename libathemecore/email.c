@@ -46,17 +46,6 @@ sendemail_urlencode(const char *const restrict src)
 	return result;
 }
 
-#ifndef MOWGLI_OS_WIN
-static void
-sendemail_waited(const pid_t pid, const int status, void *const restrict data)
-{
-	if (! WIFEXITED(status) || WEXITSTATUS(status) != 0)
-		(void) slog(LG_INFO, "%s: email for %s failed", MOWGLI_FUNC_NAME, (const char *) data);
-
-	(void) sfree(data);
-}
-#endif
-
 /* Re-canonicalize email addresses.
  * Call this after adding or removing an email_canonicalize hook.
  */
@@ -250,12 +239,11 @@ sendemail(struct user *u, struct myuser *mu, const char *type, const char *email
 #ifndef MOWGLI_OS_WIN
 	char *date = NULL;
 	char timebuf[BUFSIZE], to[BUFSIZE], from[BUFSIZE], buf[BUFSIZE], pathbuf[BUFSIZE], sourceinfo[BUFSIZE];
-	FILE *in, *out;
+	FILE *in;
+	mowgli_string_t *out;
 	time_t t;
 	struct tm *tm;
-	int pipfds[2];
-	pid_t pid;
-	int rc;
+	enum mailer_result rc;
 	static time_t period_start = 0, lastwallops = 0;
 	static unsigned int emailcount = 0;
 	struct service *svs;
@@ -331,28 +319,8 @@ sendemail(struct user *u, struct myuser *mu, const char *type, const char *email
 	replace(to, sizeof to, "\\", "\\\\");
 	snprintf(sourceinfo, sizeof sourceinfo, "%s[%s@%s]", u->nick, u->user, u->vhost);
 
-	/* now set up the email */
-	if (pipe(pipfds) < 0)
-	{
-		fclose(in);
-		return 0;
-	}
-	switch (pid = fork())
-	{
-		case -1:
-			fclose(in);
-			close(pipfds[0]);
-			close(pipfds[1]);
-			return 0;
-		case 0:
-			close(pipfds[1]);
-			dup2(pipfds[0], 0);
-			execl(me.mta, me.mta, "-t", "-f", me.register_email, NULL);
-			_exit(255);
-	}
-	close(pipfds[0]);
-	childproc_add(pid, "email", sendemail_waited, sstrdup(email));
-	out = fdopen(pipfds[1], "w");
+	/* now set up the email; the mailer hands it to the MTA later */
+	out = mowgli_string_create();
 
 	while (fgets(buf, BUFSIZE, in))
 	{
@@ -411,19 +379,43 @@ sendemail(struct user *u, struct myuser *mu, const char *type, const char *email
 		if ((svs = service_find("statserv")) != NULL)
 			replace(buf, sizeof buf, "&statsvs&", svs->me->nick);
 
-		fprintf(out, "%s\n", buf);
+		out->append(out, buf, strlen(buf));
+		out->append_char(out, '\n');
 	}
 
 	fclose(in);
 
-	rc = 1;
-	if (ferror(out))
-		rc = 0;
-	if (fclose(out) < 0)
-		rc = 0;
-	if (rc == 0)
-		slog(LG_ERROR, "sendemail(): mta failure");
-	return rc;
+	rc = mailer_enqueue(email, out->str, out->pos);
+
+	(void) smemzero(out->str, out->pos);
+	out->destroy(out);
+
+	switch (rc)
+	{
+		case MAILER_QUEUED:
+			return 1;
+
+		case MAILER_RATELIMITED:
+			slog(LG_INFO, "sendemail(): rejecting email for %s[%s@%s] (%s), too many recent emails to <%s>",
+			              u->nick, u->user, u->vhost, u->ip ? u->ip : u->host, email);
+
+			if (strcmp(type, EMAIL_MEMO) && !is_internal_client(u))
+			{
+				svs = service_find("operserv");
+				notice(svs ? svs->nick : me.name, u->nick, "Too many emails have been sent to that address recently; please try again later.");
+			}
+			return 0;
+
+		case MAILER_QUEUE_FULL:
+			slog(LG_ERROR, "sendemail(): rejecting email for %s[%s@%s] (%s), the mail queue is full",
+			               u->nick, u->user, u->vhost, u->ip ? u->ip : u->host);
+			return 0;
+
+		case MAILER_REJECTED:
+		default:
+			slog(LG_ERROR, "sendemail(): mta failure");
+			return 0;
+	}
 #else
 # warning implement me :(
 	return 0;
@@ -82,6 +82,8 @@ myentity_put(struct myentity *mt)
 
 	mowgli_patricia_add(entities, mt->name, mt);
 	mowgli_patricia_add(entities_by_id, mt->id, mt);
+
+	db_generation++;
 }
 
 void
@@ -89,6 +91,8 @@ myentity_del(struct myentity *mt)
 {
 	mowgli_patricia_delete(entities, mt->name);
 	mowgli_patricia_delete(entities_by_id, mt->id);
+
+	db_generation++;
 }
 
 struct myentity *
@@ -24,6 +24,31 @@ static unsigned int ca_all_enable = CA_ALL_ALL;
 
 static char flags_buf[128];
 
+/* Database saves and loads convert the same few hundred distinct flag sets
+ * to and from strings millions of times, so the *_cached() variants below
+ * remember recent conversions in small direct-mapped caches. An entry is
+ * keyed on the table it came from, and on flags_generation, which changes
+ * whenever the chanacs flags table or the flags that '*' grants change.
+ */
+#define FLAGS_CACHE_SIZE        256U
+#define FLAGS_CACHE_STRLEN      40U
+
+struct flags_cache_entry
+{
+	const void *    table;
+	unsigned int    generation;
+	unsigned int    flags;
+	bool            valid;
+	char            str[FLAGS_CACHE_STRLEN];
+};
+
+static struct flags_cache_entry flags_tostr_cache[FLAGS_CACHE_SIZE];
+static struct flags_cache_entry flags_fromstr_cache[FLAGS_CACHE_SIZE];
+static unsigned int flags_generation = 1;
+
+// chanacs flags are keyed on this instead of a struct gflags table
+static const char flags_chanacs_table = 0;
+
 struct flags_table chanacs_flags[256] = {
 	['v'] = {CA_VOICE, 0, true,      "voice"},
 	['V'] = {CA_AUTOVOICE, 0, true,  "autovoice"},
@@ -123,6 +148,7 @@ flags_associate(unsigned char flag, unsigned int restrictflags, bool def, const
 	chanacs_flags[flag].name = name;
 
 	update_chanacs_flags();
+	flags_generation++;
 
 	return chanacs_flags[flag].value;
 }
@@ -135,6 +161,8 @@ flags_clear(unsigned char flag)
 	chanacs_flags[flag].restrictflags = 0;
 	chanacs_flags[flag].def = false;
 	chanacs_flags[flag].name = NULL;
+
+	flags_generation++;
 }
 
 unsigned int
@@ -363,6 +391,8 @@ update_chanacs_flags(void)
 {
 	unsigned int i;
 
+	flags_generation++;
+
 	ca_all = ca_all_enable = 0;
 	for (i = 0; i < ARRAY_SIZE(chanacs_flags); i++)
 	{
@@ -492,6 +522,139 @@ gflags_fromstr(const struct gflags *gflags, const char *f, unsigned int *res)
 	return true;
 }
 
+static inline struct flags_cache_entry *
+flags_tostr_slot(const void *const restrict table, const unsigned int flags)
+{
+	const unsigned int hash = (flags * 2654435761U) ^ (unsigned int) ((uintptr_t) table >> 4);
+
+	return &flags_tostr_cache[hash & (FLAGS_CACHE_SIZE - 1U)];
+}
+
+static struct flags_cache_entry *
+flags_fromstr_slot(const void *const restrict table, const char *const restrict str, size_t *const restrict len)
+{
+	// FNV-1a
+	unsigned int hash = 2166136261U ^ (unsigned int) ((uintptr_t) table >> 4);
+	const char *p;
+
+	for (p = str; *p; p++)
+		hash = (hash ^ (unsigned char) *p) * 16777619U;
+
+	*len = (size_t) (p - str);
+
+	return &flags_fromstr_cache[hash & (FLAGS_CACHE_SIZE - 1U)];
+}
+
+static inline bool
+flags_cache_hit(const struct flags_cache_entry *const restrict ent, const void *const restrict table)
+{
+	return ent->valid && ent->table == table && ent->generation == flags_generation;
+}
+
+/* Like gflags_tostr(), but memoised; the result is valid until the next call
+ * of any *_cached() function in this file.
+ */
+const char *
+gflags_tostr_cached(const struct gflags *const restrict gflags, const unsigned int flags)
+{
+	struct flags_cache_entry *const ent = flags_tostr_slot(gflags, flags);
+
+	if (flags_cache_hit(ent, gflags) && ent->flags == flags)
+		return ent->str;
+
+	const char *const str = gflags_tostr(gflags, flags);
+
+	if (strlen(str) >= sizeof ent->str)
+		return str;
+
+	(void) mowgli_strlcpy(ent->str, str, sizeof ent->str);
+
+	ent->table = gflags;
+	ent->generation = flags_generation;
+	ent->flags = flags;
+	ent->valid = true;
+
+	return ent->str;
+}
+
+// Like bitmask_to_flags(), but memoised as above
+const char *
+bitmask_to_flags_cached(const unsigned int flags)
+{
+	struct flags_cache_entry *const ent = flags_tostr_slot(&flags_chanacs_table, flags);
+
+	if (flags_cache_hit(ent, &flags_chanacs_table) && ent->flags == flags)
+		return ent->str;
+
+	const char *const str = bitmask_to_flags(flags);
+
+	if (strlen(str) >= sizeof ent->str)
+		return str;
+
+	(void) mowgli_strlcpy(ent->str, str, sizeof ent->str);
+
+	ent->table = &flags_chanacs_table;
+	ent->generation = flags_generation;
+	ent->flags = flags;
+	ent->valid = true;
+
+	return ent->str;
+}
+
+// Like gflags_fromstr(), but parses each distinct string only once
+bool
+gflags_fromstr_cached(const struct gflags *const restrict gflags, const char *const restrict f,
+                      unsigned int *const restrict res)
+{
+	size_t len;
+	struct flags_cache_entry *const ent = flags_fromstr_slot(gflags, f, &len);
+
+	if (len >= sizeof ent->str)
+		return gflags_fromstr(gflags, f, res);
+
+	if (flags_cache_hit(ent, gflags) && strcmp(ent->str, f) == 0)
+	{
+		*res = ent->flags;
+		return true;
+	}
+
+	// Strings with unknown flags are not cached; callers log those
+	if (! gflags_fromstr(gflags, f, res))
+		return false;
+
+	(void) memcpy(ent->str, f, len + 1);
+
+	ent->table = gflags;
+	ent->generation = flags_generation;
+	ent->flags = *res;
+	ent->valid = true;
+
+	return true;
+}
+
+// Like flags_to_bitmask(string, 0), but parses each distinct string only once
+unsigned int
+flags_to_bitmask_cached(const char *const restrict string)
+{
+	size_t len;
+	struct flags_cache_entry *const ent = flags_fromstr_slot(&flags_chanacs_table, string, &len);
+
+	if (len >= sizeof ent->str)
+		return flags_to_bitmask(string, 0);
+
+	if (flags_cache_hit(ent, &flags_chanacs_table) && strcmp(ent->str, string) == 0)
+		return ent->flags;
+
+	(void) memcpy(ent->str, string, len + 1);
+
+	ent->table = &flags_chanacs_table;
+	ent->generation = flags_generation;
+	ent->flags = flags_to_bitmask(string, 0);
+	ent->valid = true;
+
+	return ent->flags;
+}
+
 /* vim:cinoptions=>s,e0,n0,f0,{0,}0,^0,=s,ps,t0,c3,+s,(2s,us,)20,*30,gs,hs
  * vim:ts=8
  * vim:sw=8
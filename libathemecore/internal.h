@@ -23,4 +23,8 @@ void init_signal_handlers(void);
 
 void language_init(void);
 
+void slog_flush_deferred(void);
+void verify_password_drain(void);
+const struct crypt_impl **crypt_threadsafe_providers(size_t *count);
+
 #endif /* !ATHEME_LAC_INTERNAL_H */
@@ -0,0 +1,154 @@
+/*
+ * SPDX-License-Identifier: ISC
+ * SPDX-URL: https://spdx.org/licenses/ISC.html
+ *
+ * Copyright (C) 2026 Atheme Development Group (https://atheme.github.io/)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * atheme-services: A collection of minimalist IRC services
+ * listindex.c: Indexes shared by the NickServ and ChanServ LIST commands
+ *
+ * A day index files objects under the day (since the epoch) of one of their
+ * timestamps, so that an age criterion only has to visit the days before its
+ * cutoff. The modules keep these current through hooks; see nickserv/list
+ * and chanserv/list.
+ */
+
+#include <atheme.h>
+#include "internal.h"
+
+unsigned long
+list_day(const time_t t)
+{
+	return (t > 0) ? (unsigned long) (t / SECONDS_PER_DAY) : 0;
+}
+
+struct list_set *
+list_set_create(const char *const restrict name, const unsigned long day)
+{
+	struct list_set *const set = smalloc(sizeof *set);
+
+	set->name = sstrdup(name);
+	set->day = day;
+	set->members = mowgli_patricia_create(&noopcanon);
+
+	return set;
+}
+
+void
+list_set_destroy(struct list_set *const restrict set)
+{
+	return_if_fail(set != NULL);
+
+	(void) mowgli_patricia_destroy(set->members, NULL, NULL);
+	(void) sfree(set->name);
+	(void) sfree(set);
+}
+
+// For mowgli_patricia_destroy() on an index
+void
+list_set_destroy_cb(const char ATHEME_VATTR_UNUSED *const restrict key, void *const restrict data,
+                    void ATHEME_VATTR_UNUSED *const restrict privdata)
+{
+	(void) list_set_destroy(data);
+}
+
+// Adds an object to the set 'name' of an index, creating the set if needed
+void
+list_set_insert(mowgli_patricia_t *const restrict tree, const char *const restrict name, const unsigned long day,
+                const char *const restrict key, void *const restrict member)
+{
+	struct list_set *set = mowgli_patricia_retrieve(tree, name);
+
+	if (! set)
+	{
+		set = list_set_create(name, day);
+		(void) mowgli_patricia_add(tree, set->name, set);
+	}
+
+	(void) mowgli_patricia_add(set->members, key, member);
+}
+
+// Removes an object from the set 'name' of an index, destroying the set once it is empty
+void
+list_set_remove(mowgli_patricia_t *const restrict tree, const char *const restrict name,
+                const char *const restrict key)
+{
+	struct list_set *const set = mowgli_patricia_retrieve(tree, name);
+
+	if (! set)
+		return;
+
+	(void) mowgli_patricia_delete(set->members, key);
+
+	if (mowgli_patricia_size(set->members))
+		return;
+
+	(void) mowgli_patricia_delete(tree, name);
+	(void) list_set_destroy(set);
+}
+
+void
+list_day_insert(mowgli_patricia_t *const restrict tree, const unsigned long day, const char *const restrict key,
+                void *const restrict member)
+{
+	char name[32];
+
+	(void) snprintf(name, sizeof name, "%lu", day);
+	(void) list_set_insert(tree, name, day, key, member);
+}
+
+void
+list_day_remove(mowgli_patricia_t *const restrict tree, const unsigned long day, const char *const restrict key)
+{
+	char name[32];
+
+	(void) snprintf(name, sizeof name, "%lu", day);
+	(void) list_set_remove(tree, name, key);
+}
+
+/*
+ * list_days_before(mowgli_patricia_t *tree, time_t age, list_set_cb cb, void *priv)
+ *
+ * Inputs:
+ *       - a day index, an age in seconds, and an optional callback
+ *
+ * Outputs:
+ *       - how many objects are filed under a day that may be at least 'age'
+ *         ago; this includes those of the cutoff day itself, so the caller
+ *         still has to check each of them
+ *
+ * Side Effects:
+ *       - if 'cb' is given, it is called with the members of each such day
+ */
+size_t
+list_days_before(mowgli_patricia_t *const restrict tree, const time_t age, const list_set_cb cb,
+                 void *const restrict priv)
+{
+	mowgli_patricia_iteration_state_t state;
+	struct list_set *set;
+	size_t count = 0;
+
+	const time_t cutoff = CURRTIME - age;
+
+	if (cutoff < 0)
+		return 0;
+
+	const unsigned long cutoffday = list_day(cutoff);
+
+	MOWGLI_PATRICIA_FOREACH(set, &state, tree)
+	{
+		if (set->day > cutoffday)
+			continue;
+
+		count += mowgli_patricia_size(set->members);
+
+		if (cb)
+			(void) cb(set->members, priv);
+	}
+
+	return count;
+}
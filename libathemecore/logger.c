@@ -21,6 +21,13 @@ int log_force;
 
 static mowgli_list_t log_files = { NULL, NULL, 0 };
 
+#ifdef HAVE_LIBPTHREAD
+static pthread_mutex_t deferred_log_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Every level that something would write, so that worker threads can drop the rest cheaply
+static unsigned int deferred_log_mask = 0;
+#endif /* HAVE_LIBPTHREAD */
+
 /* private destructor function for struct logfile. */
 static void
 logfile_delete_file(void *vdata)
@@ -312,6 +319,29 @@ logfile_write_snotices(struct logfile *lf, const char *buf)
 	wallops("%s", buf);
 }
 
+/* Recomputes deferred_log_mask from the log files (and the terminal, which
+ * gets errors and informational messages while there is no main log file).
+ * Must be called on the event loop whenever a log file or its mask changes.
+ */
+static void
+logfile_update_deferred_mask(void)
+{
+#ifdef HAVE_LIBPTHREAD
+	unsigned int mask = log_force ? ~0U : 0;
+	const mowgli_node_t *n;
+
+	if (log_file == NULL)
+		mask |= LG_ERROR | LG_INFO;
+
+	MOWGLI_ITER_FOREACH(n, log_files.head)
+		mask |= ((const struct logfile *) n->data)->log_mask;
+
+	(void) pthread_mutex_lock(&deferred_log_lock);
+	deferred_log_mask = mask;
+	(void) pthread_mutex_unlock(&deferred_log_lock);
+#endif /* HAVE_LIBPTHREAD */
+}
+
 /*
  * logfile_register(struct logfile *lf)
  *
@@ -330,6 +360,7 @@ void
 logfile_register(struct logfile *lf)
 {
 	mowgli_node_add(lf, &lf->node, &log_files);
+	logfile_update_deferred_mask();
 }
 
 /*
@@ -350,6 +381,7 @@ void
 logfile_unregister(struct logfile *lf)
 {
 	mowgli_node_delete(&lf->node, &log_files);
+	logfile_update_deferred_mask();
 }
 
 /*
@@ -482,6 +514,7 @@ void
 log_open(void)
 {
 	log_file = logfile_new(log_path, LG_ERROR | LG_INFO | LG_CMD_ADMIN);
+	logfile_update_deferred_mask();
 }
 
 /*
@@ -559,6 +592,7 @@ log_master_set_mask(unsigned int mask)
 	if (log_file == NULL)
 		return;
 	log_file->log_mask = mask;
+	logfile_update_deferred_mask();
 }
 
 /*
@@ -602,11 +636,61 @@ logfile_find_mask(unsigned int log_mask)
 	return NULL;
 }
 
+#ifdef HAVE_LIBPTHREAD
+
+/* Messages logged by worker threads; the log files (and log channels) belong
+ * to the event loop, so these are written out by slog_flush_deferred() when
+ * the thread pool next hands completed jobs back to it.
+ */
+struct deferred_log
+{
+	mowgli_node_t           node;
+	enum log_type           type;
+	unsigned int            level;
+	char                    buf[BUFSIZE];
+};
+
+static mowgli_list_t deferred_logs = { NULL, NULL, 0 };
+
+static void ATHEME_FATTR_PRINTF(3, 0)
+vslog_defer(const enum log_type type, const unsigned int level, const char *const restrict fmt, va_list args)
+{
+	(void) pthread_mutex_lock(&deferred_log_lock);
+
+	const bool wanted = (level & deferred_log_mask) != 0;
+
+	(void) pthread_mutex_unlock(&deferred_log_lock);
+
+	// Don't allocate and format what nothing would write anyway
+	if (! wanted)
+		return;
+
+	struct deferred_log *const dl = smalloc(sizeof *dl);
+
+	dl->type = type;
+	dl->level = level;
+
+	(void) vsnprintf(dl->buf, sizeof dl->buf, fmt, args);
+	(void) pthread_mutex_lock(&deferred_log_lock);
+	(void) mowgli_node_add(dl, &dl->node, &deferred_logs);
+	(void) pthread_mutex_unlock(&deferred_log_lock);
+}
+
+#endif /* HAVE_LIBPTHREAD */
+
 static void ATHEME_FATTR_PRINTF(3, 0)
 vslog_ext(enum log_type type, unsigned int level, const char *fmt, va_list args)
 {
 	static bool in_vslog_ext = false;
 
+#ifdef HAVE_LIBPTHREAD
+	if (threadpool_in_worker())
+	{
+		(void) vslog_defer(type, level, fmt, args);
+		return;
+	}
+#endif /* HAVE_LIBPTHREAD */
+
 	// Detect infinite logging recursion
 	if (in_vslog_ext)
 		return;
@@ -660,6 +744,32 @@ slog_ext(enum log_type type, unsigned int level, const char *fmt, ...)
 	va_end(args);
 }
 
+void
+slog_flush_deferred(void)
+{
+#ifdef HAVE_LIBPTHREAD
+	mowgli_node_t *n, *tn;
+
+	(void) pthread_mutex_lock(&deferred_log_lock);
+
+	mowgli_list_t logs = deferred_logs;
+
+	deferred_logs.head = NULL;
+	deferred_logs.tail = NULL;
+	deferred_logs.count = 0;
+
+	(void) pthread_mutex_unlock(&deferred_log_lock);
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, logs.head)
+	{
+		struct deferred_log *const dl = n->data;
+
+		(void) slog_ext(dl->type, dl->level, "%s", dl->buf);
+		(void) sfree(dl);
+	}
+#endif /* HAVE_LIBPTHREAD */
+}
+
 /*
  * slog(unsigned int level, const char *fmt, ...)
  *
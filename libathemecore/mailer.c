@@ -0,0 +1,686 @@
+/*
+ * SPDX-License-Identifier: ISC
+ * SPDX-URL: https://spdx.org/licenses/ISC.html
+ *
+ * Copyright (C) 2026 Atheme Development Group (https://atheme.github.io/)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * atheme-services: A collection of minimalist IRC services
+ * mailer.c: Delivery of e-mails through a long-lived helper process.
+ *
+ * Forking services once per e-mail gets expensive when the process is large
+ * and many e-mails are sent at once. Instead, services starts a copy of itself
+ * in a helper mode (with posix_spawn(3), which does not copy the address space)
+ * and passes it composed messages over a socket. The helper, which is small,
+ * runs the MTA for each of them in turn and reports back its exit status.
+ *
+ * Messages are queued here until the helper is ready for them; a failure the
+ * MTA reports as temporary is retried later, with an increasing delay, and the
+ * helper is started again if it exits.
+ *
+ * Parent to helper: "MAIL <id> <mtalen> <fromlen> <bodylen>\n", followed by
+ * the MTA path, the envelope sender and the message itself (without any
+ * separators). Helper to parent: "DONE <id> <status>\n", where the status is
+ * the exit status of the MTA, 256 plus the signal number if it was killed by
+ * a signal, or a negated errno value if it could not be run at all (or
+ * -ETIMEDOUT if it was killed for taking longer than MAILER_MTA_TIMEOUT).
+ */
+
+#include <atheme.h>
+#include "internal.h"
+
+#ifndef MOWGLI_OS_WIN
+
+#include <spawn.h>
+
+extern char **environ;
+
+#define MAILER_BODY_MAX         65536U  // Largest message accepted
+#define MAILER_QUEUE_MAX        1000U   // Messages waiting to be handed to the helper
+#define MAILER_WINDOW           4U      // Messages handed to the helper but not yet finished
+#define MAILER_ATTEMPTS_MAX     5U      // Deliveries of one message before giving up
+#define MAILER_RETRY_DELAY      30U     // Seconds before the first retry; doubles every time
+#define MAILER_RESPAWN_DELAY    10U     // Seconds between starts of the helper
+#define MAILER_TIMER_INTERVAL   5U      // Seconds between checks for due retries
+#define MAILER_MTA_TIMEOUT      60U     // Seconds the MTA may take for one message
+
+// sysexits.h
+#define MAILER_EX_TEMPFAIL      75
+
+struct mailer_msg
+{
+	mowgli_node_t           node;           // For entry into mailer_queue or mailer_inflight
+	unsigned int            id;
+	unsigned int            attempts;
+	time_t                  not_before;     // when it may be handed to the helper again
+	char                    rcpt[EMAILLEN + 1];
+	char *                  body;
+	size_t                  len;
+};
+
+// Number of messages sent to one recipient since 'period_start'
+struct mailer_rcpt
+{
+	time_t                  period_start;
+	unsigned int            count;
+};
+
+static mowgli_list_t mailer_queue;
+static mowgli_list_t mailer_inflight;
+static mowgli_patricia_t *mailer_rcpts = NULL;
+static mowgli_eventloop_timer_t *mailer_timer = NULL;
+static struct connection *mailer_conn = NULL;
+static pid_t mailer_pid = -1;
+static time_t mailer_last_spawn = 0;
+static unsigned int mailer_next_id = 0;
+static struct mailer_stats mailer_stats;
+
+/* How the helper is started: the path of the running executable, resolved
+ * before services changes directory, or its bare name to be searched for in
+ * PATH the way it was found when services was started.
+ */
+static char *mailer_helper_path = NULL;
+static bool mailer_helper_search = false;
+
+// Set in the helper when the MTA has taken too long
+static volatile sig_atomic_t mailer_mta_timed_out = 0;
+
+static void mailer_dispatch(void);
+
+static void
+mailer_msg_free(struct mailer_msg *const restrict msg)
+{
+	(void) smemzerofree(msg->body, msg->len);
+	(void) sfree(msg);
+}
+
+// A message could not be delivered this time; try it again later, or give up on it
+static void
+mailer_msg_retry(struct mailer_msg *const restrict msg, const char *const restrict reason)
+{
+	if (msg->attempts >= MAILER_ATTEMPTS_MAX)
+	{
+		(void) slog(LG_ERROR, "%s: giving up on email for %s after %u attempts (%s)",
+		                      MOWGLI_FUNC_NAME, msg->rcpt, msg->attempts, reason);
+
+		mailer_stats.failed++;
+
+		(void) mailer_msg_free(msg);
+		return;
+	}
+
+	const time_t delay = (time_t) MAILER_RETRY_DELAY << (msg->attempts - 1U);
+
+	(void) slog(LG_INFO, "%s: email for %s deferred for %lu seconds (%s)",
+	                     MOWGLI_FUNC_NAME, msg->rcpt, (unsigned long) delay, reason);
+
+	mailer_stats.retried++;
+	msg->not_before = CURRTIME + delay;
+
+	(void) mowgli_node_add(msg, &msg->node, &mailer_queue);
+}
+
+// The helper went away; everything it was still working on has to be handed to the next one
+static void
+mailer_helper_lost(void)
+{
+	mowgli_node_t *n, *tn;
+
+	mailer_conn = NULL;
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, mailer_inflight.head)
+	{
+		struct mailer_msg *const msg = n->data;
+
+		(void) mowgli_node_delete(&msg->node, &mailer_inflight);
+		(void) mailer_msg_retry(msg, "mailer helper exited");
+	}
+}
+
+static void
+mailer_helper_exited(const pid_t pid, const int status, void ATHEME_VATTR_UNUSED *const restrict data)
+{
+	if (pid == mailer_pid)
+		mailer_pid = -1;
+
+	if (! WIFEXITED(status) || WEXITSTATUS(status) != 0)
+		(void) slog(LG_ERROR, "%s: mailer helper (pid %d) exited abnormally (status %d)",
+		                      MOWGLI_FUNC_NAME, (int) pid, status);
+}
+
+static void
+mailer_conn_closed(struct connection ATHEME_VATTR_UNUSED *const restrict cptr)
+{
+	(void) mailer_helper_lost();
+}
+
+static void
+mailer_done(const unsigned int id, const int status)
+{
+	mowgli_node_t *n;
+
+	MOWGLI_ITER_FOREACH(n, mailer_inflight.head)
+	{
+		struct mailer_msg *const msg = n->data;
+
+		if (msg->id != id)
+			continue;
+
+		(void) mowgli_node_delete(&msg->node, &mailer_inflight);
+
+		if (status == 0)
+		{
+			mailer_stats.sent++;
+
+			(void) mailer_msg_free(msg);
+		}
+		else if (status == -ETIMEDOUT)
+		{
+			(void) slog(LG_ERROR, "%s: email for %s failed (MTA did not finish within %u seconds)",
+			                      MOWGLI_FUNC_NAME, msg->rcpt, MAILER_MTA_TIMEOUT);
+
+			mailer_stats.failed++;
+
+			(void) mailer_msg_free(msg);
+		}
+		else if (status == MAILER_EX_TEMPFAIL || status > 255 || status < 0)
+		{
+			char reason[BUFSIZE];
+
+			if (status < 0)
+				(void) snprintf(reason, sizeof reason, "cannot run MTA: %s", strerror(-status));
+			else if (status > 255)
+				(void) snprintf(reason, sizeof reason, "MTA killed by signal %d", status - 256);
+			else
+				(void) snprintf(reason, sizeof reason, "MTA reported a temporary failure");
+
+			(void) mailer_msg_retry(msg, reason);
+		}
+		else
+		{
+			(void) slog(LG_INFO, "%s: email for %s failed (MTA exit status %d)",
+			                     MOWGLI_FUNC_NAME, msg->rcpt, status);
+
+			mailer_stats.failed++;
+
+			(void) mailer_msg_free(msg);
+		}
+
+		return;
+	}
+
+	(void) slog(LG_DEBUG, "%s: mailer helper finished unknown message %u", MOWGLI_FUNC_NAME, id);
+}
+
+static void
+mailer_recvq_handler(struct connection *const restrict cptr)
+{
+	char line[BUFSIZE];
+	int len;
+
+	while ((len = recvq_getline(cptr, line, sizeof line - 1)) > 0)
+	{
+		unsigned int id;
+		int status;
+
+		line[len] = 0x00;
+
+		if (sscanf(line, "DONE %u %d", &id, &status) != 2)
+		{
+			(void) slog(LG_ERROR, "%s: malformed reply from mailer helper", MOWGLI_FUNC_NAME);
+			(void) connection_close_soon(cptr);
+			return;
+		}
+
+		(void) mailer_done(id, status);
+	}
+
+	(void) mailer_dispatch();
+}
+
+static bool
+mailer_helper_spawn(void)
+{
+	if (mailer_conn)
+		return true;
+
+	if (! mailer_helper_path)
+		return false;
+
+	if (mailer_last_spawn && (CURRTIME - mailer_last_spawn) < (time_t) MAILER_RESPAWN_DELAY)
+		// Don't keep starting a helper that keeps failing; the timer will try again
+		return false;
+
+	mailer_last_spawn = CURRTIME;
+
+	int fds[2];
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+	{
+		(void) slog(LG_ERROR, "%s: socketpair(2): %s", MOWGLI_FUNC_NAME, strerror(errno));
+		return false;
+	}
+
+	if (fcntl(fds[0], F_SETFD, FD_CLOEXEC) == -1)
+	{
+		(void) slog(LG_ERROR, "%s: fcntl(2): %s", MOWGLI_FUNC_NAME, strerror(errno));
+		(void) close(fds[0]);
+		(void) close(fds[1]);
+		return false;
+	}
+
+	char *const argv[] = { mailer_helper_path, (char *) MAILER_HELPER_ARG, NULL };
+	posix_spawn_file_actions_t actions;
+	pid_t pid;
+	int ret;
+
+	(void) posix_spawn_file_actions_init(&actions);
+	(void) posix_spawn_file_actions_adddup2(&actions, fds[1], STDIN_FILENO);
+	(void) posix_spawn_file_actions_adddup2(&actions, fds[1], STDOUT_FILENO);
+	(void) posix_spawn_file_actions_addclose(&actions, fds[1]);
+
+	if (mailer_helper_search)
+		ret = posix_spawnp(&pid, mailer_helper_path, &actions, NULL, argv, environ);
+	else
+		ret = posix_spawn(&pid, mailer_helper_path, &actions, NULL, argv, environ);
+
+	(void) posix_spawn_file_actions_destroy(&actions);
+	(void) close(fds[1]);
+
+	if (ret != 0)
+	{
+		(void) slog(LG_ERROR, "%s: posix_spawn(3) for %s: %s", MOWGLI_FUNC_NAME, mailer_helper_path,
+		                      strerror(ret));
+		(void) close(fds[0]);
+		return false;
+	}
+
+	if (! (mailer_conn = connection_add("mailer helper", fds[0], 0, &recvq_put, NULL)))
+	{
+		(void) close(fds[0]);
+		(void) kill(pid, SIGTERM);
+		(void) childproc_add(pid, "mailer", &mailer_helper_exited, NULL);
+		return false;
+	}
+
+	mailer_conn->recvq_handler = &mailer_recvq_handler;
+	mailer_conn->close_handler = &mailer_conn_closed;
+	mailer_pid = pid;
+	mailer_stats.spawns++;
+
+	(void) childproc_add(pid, "mailer", &mailer_helper_exited, NULL);
+	(void) slog(LG_DEBUG, "%s: started mailer helper (pid %d)", MOWGLI_FUNC_NAME, (int) pid);
+
+	return true;
+}
+
+// Hands queued messages that are due to the helper, as long as it has room for them
+static void
+mailer_dispatch(void)
+{
+	mowgli_node_t *n, *tn;
+
+	if (! MOWGLI_LIST_LENGTH(&mailer_queue) || MOWGLI_LIST_LENGTH(&mailer_inflight) >= MAILER_WINDOW)
+		return;
+
+	if (! me.mta)
+		return;
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, mailer_queue.head)
+	{
+		struct mailer_msg *const msg = n->data;
+
+		if (MOWGLI_LIST_LENGTH(&mailer_inflight) >= MAILER_WINDOW)
+			break;
+
+		if (msg->not_before > CURRTIME)
+			continue;
+
+		if (! mailer_helper_spawn())
+			break;
+
+		char header[BUFSIZE];
+		const int hlen = snprintf(header, sizeof header, "MAIL %u %zu %zu %zu\n", msg->id, strlen(me.mta),
+		                          strlen(me.register_email), msg->len);
+
+		(void) mowgli_node_delete(&msg->node, &mailer_queue);
+		(void) mowgli_node_add(msg, &msg->node, &mailer_inflight);
+
+		msg->attempts++;
+
+		(void) sendq_add(mailer_conn, header, (size_t) hlen);
+		(void) sendq_add(mailer_conn, me.mta, strlen(me.mta));
+		(void) sendq_add(mailer_conn, me.register_email, strlen(me.register_email));
+		(void) sendq_add(mailer_conn, msg->body, msg->len);
+	}
+}
+
+static int
+mailer_rcpt_expire_cb(const char *const restrict key, void *const restrict data, void ATHEME_VATTR_UNUSED *const priv)
+{
+	struct mailer_rcpt *const rc = data;
+
+	if ((unsigned int) (CURRTIME - rc->period_start) > me.emailtime)
+	{
+		(void) mowgli_patricia_delete(mailer_rcpts, key);
+		(void) sfree(rc);
+	}
+
+	return 0;
+}
+
+static void
+mailer_timer_cb(void ATHEME_VATTR_UNUSED *const restrict unused)
+{
+	(void) mowgli_patricia_foreach(mailer_rcpts, &mailer_rcpt_expire_cb, NULL);
+	(void) mailer_dispatch();
+}
+
+// Counts a message to 'rcpt' against its limit; false if it has had too many recently
+static bool
+mailer_rcpt_allow(const char *const restrict rcpt)
+{
+	if (! me.emailrcptlimit)
+		return true;
+
+	struct mailer_rcpt *rc = mowgli_patricia_retrieve(mailer_rcpts, rcpt);
+
+	if (! rc)
+	{
+		rc = smalloc(sizeof *rc);
+		rc->period_start = CURRTIME;
+
+		(void) mowgli_patricia_add(mailer_rcpts, rcpt, rc);
+	}
+	else if ((unsigned int) (CURRTIME - rc->period_start) > me.emailtime)
+	{
+		rc->period_start = CURRTIME;
+		rc->count = 0;
+	}
+
+	if (rc->count >= me.emailrcptlimit)
+		return false;
+
+	rc->count++;
+	return true;
+}
+
+/* Queues a composed message (headers and body) for delivery to 'rcpt' by the
+ * MTA. Returns MAILER_QUEUED, or why the message was not accepted; 'body' is
+ * copied in any case.
+ */
+enum mailer_result
+mailer_enqueue(const char *const restrict rcpt, const char *const restrict body, const size_t len)
+{
+	return_val_if_fail(rcpt != NULL, MAILER_REJECTED);
+	return_val_if_fail(body != NULL, MAILER_REJECTED);
+
+	if (! mailer_rcpts)
+	{
+		mailer_rcpts = mowgli_patricia_create(&strcasecanon);
+		mailer_timer = mowgli_timer_add(base_eventloop, "mailer_timer", &mailer_timer_cb, NULL,
+		                                MAILER_TIMER_INTERVAL);
+	}
+
+	if (! len || len > MAILER_BODY_MAX)
+	{
+		mailer_stats.rejected++;
+		return MAILER_REJECTED;
+	}
+
+	if (MOWGLI_LIST_LENGTH(&mailer_queue) >= MAILER_QUEUE_MAX)
+	{
+		mailer_stats.rejected++;
+		return MAILER_QUEUE_FULL;
+	}
+
+	if (! mailer_rcpt_allow(rcpt))
+	{
+		mailer_stats.ratelimited++;
+		return MAILER_RATELIMITED;
+	}
+
+	struct mailer_msg *const msg = smalloc(sizeof *msg);
+
+	msg->id = ++mailer_next_id;
+	msg->body = smalloc(len);
+	msg->len = len;
+
+	(void) mowgli_strlcpy(msg->rcpt, rcpt, sizeof msg->rcpt);
+	(void) memcpy(msg->body, body, len);
+	(void) mowgli_node_add(msg, &msg->node, &mailer_queue);
+
+	mailer_stats.queued++;
+
+	(void) mailer_dispatch();
+
+	return MAILER_QUEUED;
+}
+
+void
+mailer_get_stats(struct mailer_stats *const restrict stats)
+{
+	return_if_fail(stats != NULL);
+
+	(void) memcpy(stats, &mailer_stats, sizeof *stats);
+
+	stats->pending = MOWGLI_LIST_LENGTH(&mailer_queue);
+	stats->inflight = MOWGLI_LIST_LENGTH(&mailer_inflight);
+	stats->helper_running = (mailer_conn != NULL);
+}
+
+void
+mailer_set_helper_path(const char *const restrict execname)
+{
+	char path[PATH_MAX];
+
+	return_if_fail(execname != NULL);
+
+	(void) sfree(mailer_helper_path);
+
+	mailer_helper_search = (strchr(execname, '/') == NULL);
+
+	if (! mailer_helper_search && realpath(execname, path))
+		mailer_helper_path = sstrdup(path);
+	else
+		mailer_helper_path = sstrdup(execname);
+}
+
+static void
+mailer_helper_alarm(int ATHEME_VATTR_UNUSED signum)
+{
+	mailer_mta_timed_out = 1;
+}
+
+// Runs the MTA for one message, and returns its status as described at the top of this file
+static int
+mailer_helper_deliver(const char *const restrict mta, const char *const restrict from,
+                      const char *const restrict body, const size_t len)
+{
+	posix_spawn_file_actions_t actions;
+	int fds[2];
+	pid_t pid;
+	int ret;
+
+	if (pipe(fds) != 0)
+		return -errno;
+
+	char *const argv[] = { (char *) mta, (char *) "-t", (char *) "-f", (char *) from, NULL };
+
+	// The MTA's output must not end up in our reply stream
+	(void) posix_spawn_file_actions_init(&actions);
+	(void) posix_spawn_file_actions_adddup2(&actions, fds[0], STDIN_FILENO);
+	(void) posix_spawn_file_actions_addclose(&actions, fds[0]);
+	(void) posix_spawn_file_actions_addclose(&actions, fds[1]);
+	(void) posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+
+	ret = posix_spawn(&pid, mta, &actions, NULL, argv, environ);
+
+	(void) posix_spawn_file_actions_destroy(&actions);
+	(void) close(fds[0]);
+
+	if (ret != 0)
+	{
+		(void) close(fds[1]);
+		return -ret;
+	}
+
+	// Writing the message or waiting for the MTA is interrupted when it takes too long
+	mailer_mta_timed_out = 0;
+	(void) alarm(MAILER_MTA_TIMEOUT);
+
+	for (size_t done = 0; done < len && ! mailer_mta_timed_out; )
+	{
+		const ssize_t written = write(fds[1], body + done, len - done);
+
+		if (written < 0 && errno == EINTR)
+			continue;
+
+		// The MTA went away early; its exit status will say why
+		if (written <= 0)
+			break;
+
+		done += (size_t) written;
+	}
+
+	(void) close(fds[1]);
+
+	int status;
+	bool killed = false;
+
+	for (;;)
+	{
+		if (mailer_mta_timed_out && ! killed)
+		{
+			(void) kill(pid, SIGKILL);
+			killed = true;
+		}
+
+		if (waitpid(pid, &status, 0) >= 0)
+			break;
+
+		if (errno != EINTR)
+		{
+			(void) alarm(0);
+			return -errno;
+		}
+	}
+
+	(void) alarm(0);
+
+	if (killed)
+		return -ETIMEDOUT;
+
+	if (WIFEXITED(status))
+		return WEXITSTATUS(status);
+
+	if (WIFSIGNALED(status))
+		return 256 + WTERMSIG(status);
+
+	return -EIO;
+}
+
+/* The helper's main loop; see the top of this file. It reads messages from
+ * standard input and writes replies to standard output, which are both the
+ * socket to services, and exits when services closes it.
+ */
+int
+mailer_helper_main(void)
+{
+	char line[BUFSIZE];
+	FILE *const in = fdopen(STDIN_FILENO, "r");
+
+	if (! in)
+		return EXIT_FAILURE;
+
+	// Everything else services had open is of no use to us
+	const long maxfd = sysconf(_SC_OPEN_MAX);
+
+	for (int fd = STDERR_FILENO + 1; fd < ((maxfd > 0 && maxfd < 65536) ? (int) maxfd : 1024); fd++)
+		(void) close(fd);
+
+	(void) signal(SIGPIPE, SIG_IGN);
+
+	// Without SA_RESTART, so that the alarm interrupts a blocked write(2) or waitpid(2)
+	struct sigaction sa;
+
+	(void) memset(&sa, 0x00, sizeof sa);
+	(void) sigemptyset(&sa.sa_mask);
+	sa.sa_handler = &mailer_helper_alarm;
+	(void) sigaction(SIGALRM, &sa, NULL);
+
+	while (fgets(line, sizeof line, in))
+	{
+		unsigned int id;
+		size_t mtalen, fromlen, bodylen;
+
+		if (sscanf(line, "MAIL %u %zu %zu %zu", &id, &mtalen, &fromlen, &bodylen) != 4 ||
+		    ! mtalen || mtalen >= BUFSIZE || fromlen >= BUFSIZE || bodylen > MAILER_BODY_MAX)
+			return EXIT_FAILURE;
+
+		char *const buf = smalloc(mtalen + 1 + fromlen + 1 + bodylen);
+		char *const mta = buf;
+		char *const from = buf + mtalen + 1;
+		char *const body = from + fromlen + 1;
+
+		if (fread(mta, 1, mtalen, in) != mtalen || fread(from, 1, fromlen, in) != fromlen ||
+		    fread(body, 1, bodylen, in) != bodylen)
+		{
+			(void) sfree(buf);
+			return EXIT_FAILURE;
+		}
+
+		const int status = mailer_helper_deliver(mta, from, body, bodylen);
+		const int rlen = snprintf(line, sizeof line, "DONE %u %d\n", id, status);
+
+		(void) smemzerofree(buf, mtalen + 1 + fromlen + 1 + bodylen);
+
+		for (int done = 0; done < rlen; )
+		{
+			const ssize_t written = write(STDOUT_FILENO, line + done, (size_t) (rlen - done));
+
+			if (written < 0 && errno == EINTR)
+				continue;
+
+			if (written <= 0)
+				return EXIT_FAILURE;
+
+			done += (int) written;
+		}
+	}
+
+	return EXIT_SUCCESS;
+}
+
+#else /* !MOWGLI_OS_WIN */
+
+enum mailer_result
+mailer_enqueue(const char ATHEME_VATTR_UNUSED *const restrict rcpt,
+               const char ATHEME_VATTR_UNUSED *const restrict body, const size_t ATHEME_VATTR_UNUSED len)
+{
+	return MAILER_REJECTED;
+}
+
+void
+mailer_get_stats(struct mailer_stats *const restrict stats)
+{
+	return_if_fail(stats != NULL);
+
+	(void) memset(stats, 0x00, sizeof *stats);
+}
+
+void
+mailer_set_helper_path(const char ATHEME_VATTR_UNUSED *const restrict execname)
+{
+}
+
+int
+mailer_helper_main(void)
+{
+	return EXIT_FAILURE;
+}
+
+#endif /* MOWGLI_OS_WIN */
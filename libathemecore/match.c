@@ -206,6 +206,18 @@ match(const char *mask, const char *name)
 	return 1;
 }
 
+/*
+** match_is_literal()
+** Whether a mask has none of the characters that match() treats specially
+** ('*', '?', '&', '#', '%' and backslash escapes), so that it only matches
+** strings equal to it (ignoring case), and can be looked up directly.
+*/
+bool
+match_is_literal(const char *mask)
+{
+	return strpbrk(mask, "*?&#%\\") == NULL;
+}
+
 
 /*
 ** collapse a pattern string into minimal components.
@@ -581,14 +593,147 @@ const unsigned int charattrs[] = {
 	/* 0xFF */ 0,
 };
 
+/* Compiled patterns are shared between everything that asks for the same
+ * pattern with the same flags (RWATCH entries, repeated RMATCH / RAKILL
+ * queries, ...). Patterns nobody holds any more are kept on an idle list, up
+ * to REGEX_CACHE_IDLE_MAX of them, so that re-running a query doesn't have to
+ * compile (and possibly JIT-compile) it again.
+ */
+#define REGEX_CACHE_FLAGS       (AREGEX_ICASE | AREGEX_PCRE | AREGEX_NOJIT)
+#define REGEX_CACHE_IDLE_MAX    32U
+
+#ifdef ATHEME_REGEX_PCRE_JIT
+#  define REGEX_JIT_STACK_MIN   (32U * 1024U)
+#  define REGEX_JIT_STACK_MAX   (512U * 1024U)
+#endif
+
+static mowgli_patricia_t *regex_cache = NULL;
+static mowgli_list_t regex_cache_idle;
+
+#if defined(ATHEME_REGEX_PCRE_JIT) && defined(HAVE_LIBPTHREAD)
+/* A JIT stack must not be used by two threads at once, so worker threads
+ * (e.g. user_regex_scan()) each use a stack of their own instead of the one
+ * that belongs to the pattern.
+ */
+static pthread_key_t regex_jit_stack_key;
+static pthread_once_t regex_jit_stack_once = PTHREAD_ONCE_INIT;
+
+static void
+regex_jit_stack_key_free(void *const restrict stack)
+{
+	pcre_jit_stack_free(stack);
+}
+
+static void
+regex_jit_stack_key_create(void)
+{
+	(void) pthread_key_create(&regex_jit_stack_key, &regex_jit_stack_key_free);
+}
+
+static pcre_jit_stack *
+regex_jit_stack_get(void *const restrict own)
+{
+	if (! threadpool_in_worker())
+		return own;
+
+	(void) pthread_once(&regex_jit_stack_once, &regex_jit_stack_key_create);
+
+	pcre_jit_stack *stack = pthread_getspecific(regex_jit_stack_key);
+
+	if (! stack && (stack = pcre_jit_stack_alloc(REGEX_JIT_STACK_MIN, REGEX_JIT_STACK_MAX)))
+		(void) pthread_setspecific(regex_jit_stack_key, stack);
+
+	// If that failed, PCRE falls back to a small stack on the thread's own machine stack
+	return stack;
+}
+#endif
+
+static void
+regex_free(struct atheme_regex *const restrict preg)
+{
+	switch (preg->type)
+	{
+		case at_posix:
+			regfree(&preg->un.posix);
+			break;
+		case at_pcre:
+#ifdef HAVE_LIBPCRE
+#  ifdef ATHEME_REGEX_PCRE_JIT
+			if (preg->pcre_jit_stack)
+				pcre_jit_stack_free(preg->pcre_jit_stack);
+			if (preg->pcre_extra)
+				pcre_free_study(preg->pcre_extra);
+#  else
+			if (preg->pcre_extra)
+				pcre_free(preg->pcre_extra);
+#  endif
+			pcre_free(preg->un.pcre);
+#endif
+			break;
+	}
+
+	sfree(preg->cachekey);
+	sfree(preg);
+}
+
+#ifdef HAVE_LIBPCRE
+static bool
+regex_compile_pcre(struct atheme_regex *const restrict preg, const char *const restrict pattern, const int flags)
+{
+	const char *errptr;
+	int erroffset;
+
+	preg->un.pcre = pcre_compile(pattern, (flags & AREGEX_ICASE ? PCRE_CASELESS : 0) | PCRE_NO_AUTO_CAPTURE, &errptr, &erroffset, NULL);
+	if (preg->un.pcre == NULL)
+	{
+		slog(LG_ERROR, "regex_match(): %s at offset %d in %s",
+				errptr, erroffset, pattern);
+		return false;
+	}
+	preg->type = at_pcre;
+
+	int studyopts = 0;
+
+#ifdef ATHEME_REGEX_PCRE_JIT
+	if (! (flags & AREGEX_NOJIT))
+		studyopts |= PCRE_STUDY_JIT_COMPILE;
+#endif
+
+	/* Studying is only an optimisation; if it fails, pcre_exec() simply
+	 * works without it.
+	 */
+	preg->pcre_extra = pcre_study(preg->un.pcre, studyopts, &errptr);
+	if (errptr != NULL)
+		slog(LG_DEBUG, "regex_create(): pcre_study() failed for %s: %s", pattern, errptr);
+
+#ifdef ATHEME_REGEX_PCRE_JIT
+	/* The default JIT stack (32 KiB, on the machine stack) is too small for
+	 * some patterns; give every JIT-compiled pattern a stack of its own.
+	 */
+	if (regex_is_jit(preg) && (preg->pcre_jit_stack = pcre_jit_stack_alloc(REGEX_JIT_STACK_MIN, REGEX_JIT_STACK_MAX)))
+#  ifdef HAVE_LIBPTHREAD
+		pcre_assign_jit_stack(preg->pcre_extra, &regex_jit_stack_get, preg->pcre_jit_stack);
+#  else
+		pcre_assign_jit_stack(preg->pcre_extra, NULL, preg->pcre_jit_stack);
+#  endif
+#endif
+
+	return true;
+}
+#endif
+
 /*
- * regex_compile()
- *  Compile a regex of `pattern' and return it.
+ * regex_create()
+ *  Compile a regex of `pattern' and return it, or return a shared,
+ *  already-compiled copy. Every successful call must be paired with a
+ *  regex_destroy() call.
  */
-struct atheme_regex * ATHEME_FATTR_MALLOC
+struct atheme_regex *
 regex_create(char *pattern, int flags)
 {
 	static char errmsg[BUFSIZE];
+	char cachekey[BUFSIZE];
+	struct atheme_regex *preg;
 	int errnum;
 
 	if (pattern == NULL)
@@ -596,23 +741,31 @@ regex_create(char *pattern, int flags)
 		return NULL;
 	}
 
-	struct atheme_regex *const preg = smalloc(sizeof *preg);
+	flags &= REGEX_CACHE_FLAGS;
+
+	if (regex_cache == NULL)
+		regex_cache = mowgli_patricia_create(noopcanon);
+
+	const int keylen = snprintf(cachekey, sizeof cachekey, "%d:%s", flags, pattern);
+
+	if (keylen > 0 && (size_t) keylen < sizeof cachekey && (preg = mowgli_patricia_retrieve(regex_cache, cachekey)))
+	{
+		if (preg->refcount++ == 0)
+			mowgli_node_delete(&preg->idle_node, &regex_cache_idle);
+
+		return preg;
+	}
+
+	preg = smalloc(sizeof *preg);
 
 	if (flags & AREGEX_PCRE)
 	{
 #ifdef HAVE_LIBPCRE
-		const char *errptr;
-		int erroffset;
-
-		preg->un.pcre = pcre_compile(pattern, (flags & AREGEX_ICASE ? PCRE_CASELESS : 0) | PCRE_NO_AUTO_CAPTURE, &errptr, &erroffset, NULL);
-		if (preg->un.pcre == NULL)
+		if (! regex_compile_pcre(preg, pattern, flags))
 		{
-			slog(LG_ERROR, "regex_match(): %s at offset %d in %s",
-					errptr, erroffset, pattern);
 			sfree(preg);
 			return NULL;
 		}
-		preg->type = at_pcre;
 #else
 		slog(LG_ERROR, "regex_match(): PCRE support is not compiled in");
 		sfree(preg);
@@ -635,6 +788,15 @@ regex_create(char *pattern, int flags)
 		preg->type = at_posix;
 	}
 
+	preg->refcount = 1;
+
+	// Patterns too long for the key buffer are simply not shared
+	if (keylen > 0 && (size_t) keylen < sizeof cachekey)
+	{
+		preg->cachekey = sstrdup(cachekey);
+		mowgli_patricia_add(regex_cache, preg->cachekey, preg);
+	}
+
 	return preg;
 }
 
@@ -677,13 +839,14 @@ regex_extract(char *pattern, char **pend, int *pflags)
 }
 
 /*
- * regex_match()
+ * regex_match_len()
  *  Internal wrapper API for regex matching.
- *  `preg' is the regex to check with, `string' needs to be checked against.
+ *  `preg' is the regex to check with, `string' (of `len' bytes, excluding the
+ *  terminating NUL, which must be present) needs to be checked against.
  *  Returns `true' on match, `false' else.
  */
 bool
-regex_match(struct atheme_regex *preg, char *string)
+regex_match_len(struct atheme_regex *preg, const char *string, size_t len)
 {
 	if (preg == NULL || string == NULL)
 	{
@@ -694,39 +857,89 @@ regex_match(struct atheme_regex *preg, char *string)
 	switch (preg->type)
 	{
 		case at_posix:
+		{
+#ifdef REG_STARTEND
+			regmatch_t pmatch = { .rm_so = 0, .rm_eo = (regoff_t) len };
+
+			return regexec(&preg->un.posix, string, 1, &pmatch, REG_STARTEND) == 0;
+#else
 			return regexec(&preg->un.posix, string, 0, NULL, 0) == 0;
+#endif
+		}
 		case at_pcre:
 #ifdef HAVE_LIBPCRE
-			return pcre_exec(preg->un.pcre, NULL, string, strlen(string), 0, 0, NULL, 0) >= 0;
+			return pcre_exec(preg->un.pcre, preg->pcre_extra, string, (int) len, 0, 0, NULL, 0) >= 0;
 #else
 			slog(LG_ERROR, "regex_match(): we were given a PCRE pattern without PCRE support!");
 			return false;
 #endif
 	}
+
+	return false;
+}
+
+/*
+ * regex_match()
+ *  As regex_match_len(), for callers that don't know the length of `string'.
+ */
+bool
+regex_match(struct atheme_regex *preg, char *string)
+{
+	if (string == NULL)
+		return regex_match_len(preg, string, 0);
+
+	return regex_match_len(preg, string, strlen(string));
+}
+
+/*
+ * regex_is_jit()
+ *  Returns `true' if `preg' will be matched by JIT-compiled machine code.
+ */
+bool
+regex_is_jit(const struct atheme_regex *preg)
+{
+#ifdef ATHEME_REGEX_PCRE_JIT
+	int jit = 0;
+
+	if (preg->type == at_pcre && preg->pcre_extra != NULL &&
+	    pcre_fullinfo(preg->un.pcre, preg->pcre_extra, PCRE_INFO_JIT, &jit) == 0)
+		return jit != 0;
+#endif
+
+	return false;
 }
 
 /*
  * regex_destroy()
- *  Perform cleanup with regex `preg', free associated memory.
+ *  Release `preg'; once nothing holds it any more it stays in the cache
+ *  for a while, and is freed when it falls off the idle list.
  */
 bool
 regex_destroy(struct atheme_regex *preg)
 {
-	switch (preg->type)
+	return_val_if_fail(preg != NULL, false);
+	return_val_if_fail(preg->refcount != 0, false);
+
+	if (--preg->refcount != 0)
+		return true;
+
+	if (preg->cachekey == NULL)
 	{
-		case at_posix:
-			regfree(&preg->un.posix);
-			break;
-		case at_pcre:
-#ifdef HAVE_LIBPCRE
-			pcre_free(preg->un.pcre);
-			break;
-#else
-			slog(LG_ERROR, "regex_destroy(): we were given a PCRE pattern without PCRE support!");
-			return false;
-#endif
+		regex_free(preg);
+		return true;
 	}
-	sfree(preg);
+
+	mowgli_node_add_head(preg, &preg->idle_node, &regex_cache_idle);
+
+	while (MOWGLI_LIST_LENGTH(&regex_cache_idle) > REGEX_CACHE_IDLE_MAX)
+	{
+		struct atheme_regex *const oldest = regex_cache_idle.tail->data;
+
+		mowgli_node_delete(&oldest->idle_node, &regex_cache_idle);
+		(void) mowgli_patricia_delete(regex_cache, oldest->cachekey);
+		regex_free(oldest);
+	}
+
 	return true;
 }
 
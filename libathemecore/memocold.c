@@ -0,0 +1,606 @@
+/*
+ * SPDX-License-Identifier: ISC
+ * SPDX-URL: https://spdx.org/licenses/ISC.html
+ *
+ * Copyright (C) 2026 Atheme Development Group (https://atheme.github.io/)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * atheme-services: A collection of minimalist IRC services
+ * memocold.c: Cold storage for the memos of dormant accounts
+ *
+ * When enabled (general::memo_cold_time), the memos of accounts that have not
+ * logged in for a while are not kept in memory after loading the database.
+ * They are appended to a sidecar file in the data directory instead, and only
+ * their location is remembered. They are read back in ("thawed") when the
+ * account logs in or MemoServ needs them, and written out again ("frozen")
+ * when the memory used by thawed memos exceeds general::memo_cold_budget.
+ *
+ * The sidecar file is recreated on every start, and is only ever appended to;
+ * the memos that are thawed or dropped leave dead space behind, which is
+ * reclaimed by rewriting the file once it is at least half dead. The database
+ * itself remains the authoritative copy of every memo.
+ */
+
+#include <atheme.h>
+#include "internal.h"
+
+#define MEMOCOLD_FILENAME       "memos.cold"
+#define MEMOCOLD_EVICT_INTERVAL 60
+#define MEMOCOLD_COMPACT_MIN    (1024 * 1024)
+
+static int memocold_fd = -1;
+static off_t memocold_end = 0;
+
+// Bytes of the sidecar file that no struct mymemo_cold refers to any more
+static off_t memocold_dead = 0;
+
+// struct mymemo_cold's whose memos are currently in the file
+static mowgli_list_t memocold_frozen = { NULL, NULL, 0 };
+
+// struct mymemo_cold's whose memos are currently in memory, least recently thawed first
+static mowgli_list_t memocold_thawed = { NULL, NULL, 0 };
+
+static mowgli_eventloop_timer_t *memocold_evict_timer = NULL;
+
+static void memocold_evict(void *unused);
+
+static void
+memocold_timer_start(void)
+{
+	if (! memocold_evict_timer)
+		memocold_evict_timer = mowgli_timer_add(base_eventloop, "memocold_evict", &memocold_evict, NULL,
+		                                        MEMOCOLD_EVICT_INTERVAL);
+}
+
+static bool
+memocold_open(void)
+{
+	char path[BUFSIZE];
+
+	if (memocold_fd != -1)
+		return true;
+
+	(void) snprintf(path, sizeof path, "%s/%s", datadir, MEMOCOLD_FILENAME);
+
+	if ((memocold_fd = open(path, O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR)) == -1)
+	{
+		(void) slog(LG_ERROR, "%s: open('%s'): %s; memo cold storage disabled", MOWGLI_FUNC_NAME, path,
+		            strerror(errno));
+		return false;
+	}
+
+	(void) fcntl(memocold_fd, F_SETFD, FD_CLOEXEC);
+
+	memocold_end = 0;
+
+	return true;
+}
+
+static bool
+memocold_pwrite(const int fd, const char *const restrict buf, const size_t len, const off_t offset)
+{
+	size_t written = 0;
+
+	while (written < len)
+	{
+		const ssize_t ret = pwrite(fd, buf + written, len - written, offset + (off_t) written);
+
+		if (ret == -1 && errno == EINTR)
+			continue;
+
+		if (ret == -1)
+		{
+			(void) slog(LG_ERROR, "%s: pwrite(2): %s", MOWGLI_FUNC_NAME, strerror(errno));
+			return false;
+		}
+
+		written += (size_t) ret;
+	}
+
+	return true;
+}
+
+static bool
+memocold_append(const char *const restrict buf, const size_t len)
+{
+	if (! memocold_pwrite(memocold_fd, buf, len, memocold_end))
+		return false;
+
+	memocold_end += (off_t) len;
+
+	return true;
+}
+
+static bool
+memocold_pread(char *const restrict buf, const size_t len, const off_t offset)
+{
+	size_t done = 0;
+
+	while (done < len)
+	{
+		const ssize_t ret = pread(memocold_fd, buf + done, len - done, offset + (off_t) done);
+
+		if (ret == -1 && errno == EINTR)
+			continue;
+
+		if (ret <= 0)
+		{
+			(void) slog(LG_ERROR, "%s: pread(2): %s", MOWGLI_FUNC_NAME,
+			            (ret == -1) ? strerror(errno) : "unexpected end of file");
+			return false;
+		}
+
+		done += (size_t) ret;
+	}
+
+	return true;
+}
+
+/* Copies the memos of every frozen account into a new file, one account after
+ * the other, and replaces the old one with it. Nothing changes unless all of
+ * that worked; the old file is still intact and in use otherwise.
+ */
+static void
+memocold_compact(void)
+{
+	char path[BUFSIZE];
+	char newpath[BUFSIZE];
+	char *buf = NULL;
+	size_t bufsize = 0;
+	off_t end = 0;
+	mowgli_node_t *n;
+	int fd;
+
+	(void) snprintf(path, sizeof path, "%s/%s", datadir, MEMOCOLD_FILENAME);
+	(void) snprintf(newpath, sizeof newpath, "%s.new", path);
+
+	if ((fd = open(newpath, O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR)) == -1)
+	{
+		(void) slog(LG_ERROR, "%s: open('%s'): %s", MOWGLI_FUNC_NAME, newpath, strerror(errno));
+		return;
+	}
+
+	(void) fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+	MOWGLI_ITER_FOREACH(n, memocold_frozen.head)
+	{
+		const struct mymemo_cold *const mc = n->data;
+
+		if (mc->len > bufsize)
+		{
+			bufsize = mc->len;
+			buf = srealloc(buf, bufsize);
+		}
+
+		if (! memocold_pread(buf, mc->len, mc->offset) || ! memocold_pwrite(fd, buf, mc->len, end))
+			goto fail;
+
+		end += (off_t) mc->len;
+	}
+
+	if (rename(newpath, path) == -1)
+	{
+		(void) slog(LG_ERROR, "%s: rename('%s', '%s'): %s", MOWGLI_FUNC_NAME, newpath, path, strerror(errno));
+		goto fail;
+	}
+
+	(void) slog(LG_DEBUG, "%s: %lld of %lld bytes were dead", MOWGLI_FUNC_NAME, (long long) memocold_dead,
+	            (long long) memocold_end);
+
+	// Everything was copied in list order, so the new offsets follow from the lengths alone
+	end = 0;
+
+	MOWGLI_ITER_FOREACH(n, memocold_frozen.head)
+	{
+		struct mymemo_cold *const mc = n->data;
+
+		mc->offset = end;
+		end += (off_t) mc->len;
+	}
+
+	(void) close(memocold_fd);
+
+	memocold_fd = fd;
+	memocold_end = end;
+	memocold_dead = 0;
+
+	(void) sfree(buf);
+	return;
+
+fail:
+	(void) close(fd);
+	(void) unlink(newpath);
+	(void) sfree(buf);
+}
+
+static size_t
+memocold_format(char *const restrict buf, const size_t bufsize, const struct mymemo *const restrict mz)
+{
+	const int len = snprintf(buf, bufsize, "%lu %u %s %s\n", (unsigned long) mz->sent, mz->status, mz->sender,
+	                         mz->text);
+
+	if (len < 0 || (size_t) len >= bufsize)
+		return 0;
+
+	return (size_t) len;
+}
+
+// The text is everything after the third space, and may be empty
+static bool
+memocold_parse(char *const restrict line, struct mymemo *const restrict mz)
+{
+	char *const sent = line;
+	char *status, *sender, *text;
+
+	if (! (status = strchr(sent, ' ')))
+		return false;
+
+	*status++ = '\0';
+
+	if (! (sender = strchr(status, ' ')))
+		return false;
+
+	*sender++ = '\0';
+
+	if (! (text = strchr(sender, ' ')))
+		return false;
+
+	*text++ = '\0';
+
+	(void) memset(mz, 0x00, sizeof *mz);
+	(void) mowgli_strlcpy(mz->sender, sender, sizeof mz->sender);
+	(void) mowgli_strlcpy(mz->text, text, sizeof mz->text);
+
+	mz->sent = (time_t) strtoul(sent, NULL, 10);
+	mz->status = (unsigned int) strtoul(status, NULL, 10);
+
+	return true;
+}
+
+static bool
+memocold_dormant(const struct myuser *const restrict mu)
+{
+	if (! config_options.memo_cold_time || MOWGLI_LIST_LENGTH(&mu->logins))
+		return false;
+
+	return mu->lastlogin < CURRTIME - (time_t) config_options.memo_cold_time;
+}
+
+static void
+memocold_evict(void *const ATHEME_VATTR_UNUSED unused)
+{
+	const size_t budget = (size_t) config_options.memo_cold_budget * 1024U;
+	mowgli_node_t *n, *tn;
+	size_t used = 0;
+
+	MOWGLI_ITER_FOREACH(n, memocold_thawed.head)
+	{
+		const struct mymemo_cold *const mc = n->data;
+
+		used += MOWGLI_LIST_LENGTH(&mc->mu->memos) * sizeof(struct mymemo);
+	}
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, memocold_thawed.head)
+	{
+		if (used <= budget)
+			break;
+
+		struct mymemo_cold *const mc = n->data;
+		const size_t bytes = MOWGLI_LIST_LENGTH(&mc->mu->memos) * sizeof(struct mymemo);
+
+		if (MOWGLI_LIST_LENGTH(&mc->mu->logins))
+			continue;
+
+		if (myuser_memos_freeze(mc->mu))
+			used -= bytes;
+	}
+
+	if (memocold_dead >= MEMOCOLD_COMPACT_MIN && memocold_dead >= memocold_end - memocold_dead)
+		(void) memocold_compact();
+}
+
+/* Called by the database loader for each memo; returns true if the memo was
+ * put into cold storage, in which case the caller must not keep it itself.
+ * The memos of one account are contiguous in the database, so they end up
+ * contiguous in the sidecar file too.
+ */
+bool
+myuser_memo_add_cold(struct myuser *const restrict mu, const struct mymemo *const restrict mz)
+{
+	char buf[BUFSIZE + MEMOLEN];
+	size_t len;
+
+	return_val_if_fail(mu != NULL, false);
+	return_val_if_fail(mz != NULL, false);
+
+	if (! memocold_dormant(mu) || MOWGLI_LIST_LENGTH(&mu->memos))
+		return false;
+
+	if (mu->memos_cold && (! mu->memos_cold->frozen ||
+	                       mu->memos_cold->offset + (off_t) mu->memos_cold->len != memocold_end))
+		return false;
+
+	if (! memocold_open())
+		return false;
+
+	if (! (len = memocold_format(buf, sizeof buf, mz)))
+		return false;
+
+	const off_t offset = memocold_end;
+
+	if (! memocold_append(buf, len))
+		return false;
+
+	if (! mu->memos_cold)
+	{
+		mu->memos_cold = smalloc(sizeof *mu->memos_cold);
+		mu->memos_cold->mu = mu;
+		mu->memos_cold->offset = offset;
+		mu->memos_cold->frozen = true;
+
+		(void) mowgli_node_add(mu->memos_cold, &mu->memos_cold->node, &memocold_frozen);
+	}
+
+	mu->memos_cold->len += len;
+	mu->memos_cold->count++;
+
+	return true;
+}
+
+/* Adds a new memo to cold storage if that is where the memos of 'mu' are, so
+ * that a memo sent to many dormant accounts at once does not bring all of
+ * their memos back into memory. Returns false if the caller must add it to
+ * mu->memos itself, after thawing them.
+ */
+bool
+myuser_memo_append_cold(struct myuser *const restrict mu, const struct mymemo *const restrict mz)
+{
+	char buf[BUFSIZE + MEMOLEN];
+	size_t len;
+
+	return_val_if_fail(mu != NULL, false);
+	return_val_if_fail(mz != NULL, false);
+
+	struct mymemo_cold *const mc = mu->memos_cold;
+
+	if (! mc || ! mc->frozen || MOWGLI_LIST_LENGTH(&mu->memos))
+		return false;
+
+	if (! (len = memocold_format(buf, sizeof buf, mz)))
+		return false;
+
+	if (mc->offset + (off_t) mc->len == memocold_end)
+	{
+		if (! memocold_append(buf, len))
+			return false;
+
+		mc->len += len;
+		mc->count++;
+
+		return true;
+	}
+
+	// The memos of an account must stay contiguous, so move them to the end of the file first
+	char *const old = smalloc(mc->len);
+	const off_t offset = memocold_end;
+
+	if (! memocold_pread(old, mc->len, mc->offset) || ! memocold_append(old, mc->len) ||
+	    ! memocold_append(buf, len))
+	{
+		// Whatever was written is simply left unreferenced
+		memocold_dead += memocold_end - offset;
+
+		(void) sfree(old);
+		return false;
+	}
+
+	(void) sfree(old);
+
+	memocold_dead += (off_t) mc->len;
+
+	mc->offset = offset;
+	mc->len += len;
+	mc->count++;
+
+	(void) memocold_timer_start();
+
+	return true;
+}
+
+// Returns how many memos 'mu' has, including those in cold storage, without thawing them
+size_t
+myuser_memos_count(const struct myuser *const restrict mu)
+{
+	return_val_if_fail(mu != NULL, 0);
+
+	const struct mymemo_cold *const mc = mu->memos_cold;
+
+	if (mc && mc->frozen)
+		return MOWGLI_LIST_LENGTH(&mu->memos) + mc->count;
+
+	return MOWGLI_LIST_LENGTH(&mu->memos);
+}
+
+/* Calls 'cb' for every memo of 'mu' that is in cold storage, without bringing
+ * them back into memory; used to write them out to the database.
+ */
+bool
+myuser_memos_cold_foreach(struct myuser *const restrict mu, const myuser_memo_cold_cb cb, void *const restrict priv)
+{
+	return_val_if_fail(mu != NULL, false);
+	return_val_if_fail(cb != NULL, false);
+
+	const struct mymemo_cold *const mc = mu->memos_cold;
+
+	if (! mc || ! mc->frozen)
+		return true;
+
+	char *const buf = smalloc(mc->len + 1);
+
+	if (! memocold_pread(buf, mc->len, mc->offset))
+	{
+		(void) slog(LG_ERROR, "%s: cannot read cold memos of '%s'", MOWGLI_FUNC_NAME, entity(mu)->name);
+		(void) sfree(buf);
+		return false;
+	}
+
+	char *line = buf, *next;
+
+	for (; line < buf + mc->len; line = next + 1)
+	{
+		struct mymemo mz;
+
+		if (! (next = memchr(line, '\n', (size_t) (buf + mc->len - line))))
+			break;
+
+		*next = '\0';
+
+		if (memocold_parse(line, &mz))
+			(void) cb(&mz, priv);
+	}
+
+	(void) sfree(buf);
+
+	return true;
+}
+
+static void
+memocold_thaw_cb(const struct mymemo *const restrict mz, void *const restrict vlist)
+{
+	struct mymemo *const copy = smalloc(sizeof *copy);
+
+	(void) memcpy(copy, mz, sizeof *copy);
+	(void) mowgli_node_add(copy, mowgli_node_create(), vlist);
+}
+
+/* Brings the memos of 'mu' back into mu->memos. This must be called before
+ * anything looks at or modifies that list; it is cheap if they are already in
+ * memory or the account never had any in cold storage.
+ */
+void
+myuser_memos_thaw(struct myuser *const restrict mu)
+{
+	mowgli_list_t memos = { NULL, NULL, 0 };
+	mowgli_node_t *n, *tn;
+
+	return_if_fail(mu != NULL);
+
+	struct mymemo_cold *const mc = mu->memos_cold;
+
+	if (! mc || ! mc->frozen)
+		return;
+
+	if (! myuser_memos_cold_foreach(mu, &memocold_thaw_cb, &memos))
+	{
+		MOWGLI_ITER_FOREACH_SAFE(n, tn, memos.head)
+		{
+			(void) sfree(n->data);
+			(void) mowgli_node_delete(n, &memos);
+			(void) mowgli_node_free(n);
+		}
+
+		return;
+	}
+
+	// Cold memos are older than any that arrived while they were cold
+	MOWGLI_ITER_FOREACH_PREV(n, memos.tail)
+		(void) mowgli_node_add_head(n->data, mowgli_node_create(), &mu->memos);
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, memos.head)
+	{
+		(void) mowgli_node_delete(n, &memos);
+		(void) mowgli_node_free(n);
+	}
+
+	memocold_dead += (off_t) mc->len;
+
+	mc->frozen = false;
+	mc->len = 0;
+	mc->count = 0;
+
+	(void) mowgli_node_delete(&mc->node, &memocold_frozen);
+	(void) mowgli_node_add(mc, &mc->node, &memocold_thawed);
+	(void) memocold_timer_start();
+}
+
+// Moves the memos of a dormant account that were previously thawed back out of memory
+bool
+myuser_memos_freeze(struct myuser *const restrict mu)
+{
+	char buf[BUFSIZE + MEMOLEN];
+	mowgli_node_t *n, *tn;
+	size_t len, total = 0;
+
+	return_val_if_fail(mu != NULL, false);
+
+	struct mymemo_cold *const mc = mu->memos_cold;
+
+	if (! mc || mc->frozen)
+		return false;
+
+	if (! MOWGLI_LIST_LENGTH(&mu->memos))
+	{
+		(void) myuser_memos_cold_drop(mu);
+		return true;
+	}
+
+	const off_t offset = memocold_end;
+
+	MOWGLI_ITER_FOREACH(n, mu->memos.head)
+	{
+		if (! (len = memocold_format(buf, sizeof buf, n->data)) || ! memocold_append(buf, len))
+		{
+			// Whatever was written is simply left unreferenced
+			memocold_dead += memocold_end - offset;
+			return false;
+		}
+
+		total += len;
+	}
+
+	mc->offset = offset;
+	mc->len = total;
+	mc->count = MOWGLI_LIST_LENGTH(&mu->memos);
+	mc->frozen = true;
+
+	(void) mowgli_node_delete(&mc->node, &memocold_thawed);
+	(void) mowgli_node_add(mc, &mc->node, &memocold_frozen);
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, mu->memos.head)
+	{
+		(void) sfree(n->data);
+		(void) mowgli_node_delete(n, &mu->memos);
+		(void) mowgli_node_free(n);
+	}
+
+	return true;
+}
+
+// Forgets the cold memos of an account that is being dropped
+void
+myuser_memos_cold_drop(struct myuser *const restrict mu)
+{
+	return_if_fail(mu != NULL);
+
+	struct mymemo_cold *const mc = mu->memos_cold;
+
+	if (! mc)
+		return;
+
+	if (mc->frozen)
+	{
+		memocold_dead += (off_t) mc->len;
+
+		(void) mowgli_node_delete(&mc->node, &memocold_frozen);
+		(void) memocold_timer_start();
+	}
+	else
+		(void) mowgli_node_delete(&mc->node, &memocold_thawed);
+
+	(void) sfree(mc);
+
+	mu->memos_cold = NULL;
+}
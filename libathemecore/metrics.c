@@ -0,0 +1,234 @@
+/*
+ * SPDX-License-Identifier: ISC
+ * SPDX-URL: https://spdx.org/licenses/ISC.html
+ *
+ * Copyright (C) 2026 Atheme Development Group (https://atheme.github.io/)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * atheme-services: A collection of minimalist IRC services
+ * metrics.c: Counters and timing histograms kept by the core for monitoring
+ *
+ * These are always enabled, so recording has to stay cheap: a clock read on
+ * either side of the measured code and a few additions. They are exported by
+ * modules such as misc/metrics.
+ */
+
+#include <atheme.h>
+#include "internal.h"
+
+struct metrics metrics;
+
+// Service commands, by "<service> <command>"
+static mowgli_patricia_t *metrics_commands = NULL;
+
+/*
+ * metrics_clock()
+ *
+ * Inputs:
+ *       - none
+ *
+ * Outputs:
+ *       - microseconds from an arbitrary starting point; never goes backwards
+ *         where the system has a monotonic clock
+ *
+ * Side Effects:
+ *       - none
+ */
+unsigned long long
+metrics_clock(void)
+{
+#ifdef CLOCK_MONOTONIC
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0)
+		return ((unsigned long long) ts.tv_sec * 1000000ULL) + ((unsigned long long) ts.tv_nsec / 1000ULL);
+#endif
+
+	struct timeval tv;
+
+	(void) gettimeofday(&tv, NULL);
+
+	return ((unsigned long long) tv.tv_sec * 1000000ULL) + (unsigned long long) tv.tv_usec;
+}
+
+/*
+ * metrics_timing_record(struct metrics_timing *timing, unsigned long long usec)
+ *
+ * Inputs:
+ *       - a histogram and a duration in microseconds
+ *
+ * Outputs:
+ *       - none
+ *
+ * Side Effects:
+ *       - the duration is counted in the histogram
+ */
+void
+metrics_timing_record(struct metrics_timing *const restrict timing, const unsigned long long usec)
+{
+	timing->count++;
+	timing->usec += usec;
+
+	if (usec > timing->max)
+		timing->max = usec;
+
+	if (usec < METRICS_SUB_BUCKETS)
+	{
+		// The first buckets are one microsecond wide
+		timing->bucket[usec]++;
+		return;
+	}
+
+	if (usec >> METRICS_MAX_SHIFT)
+		return;
+
+	// Position of the highest set bit, which picks the power of two
+	unsigned int msb = METRICS_SUB_SHIFT;
+
+	while (usec >> (msb + 1U))
+		msb++;
+
+	const unsigned int shift = msb - METRICS_SUB_SHIFT;
+	const unsigned long long sub = (usec >> shift) & (METRICS_SUB_BUCKETS - 1U);
+
+	timing->bucket[((shift + 1U) * METRICS_SUB_BUCKETS) + sub]++;
+}
+
+// The exclusive upper bound of a bucket, in microseconds
+unsigned long long
+metrics_bucket_bound(const unsigned int bucket)
+{
+	return_val_if_fail(bucket < METRICS_BUCKETS, 0);
+
+	if (bucket < METRICS_SUB_BUCKETS)
+		return bucket + 1U;
+
+	const unsigned int shift = (bucket / METRICS_SUB_BUCKETS) - 1U;
+	const unsigned long long sub = bucket % METRICS_SUB_BUCKETS;
+
+	return (METRICS_SUB_BUCKETS + sub + 1U) << shift;
+}
+
+/*
+ * metrics_timing_quantile(const struct metrics_timing *timing, double quantile)
+ *
+ * Inputs:
+ *       - a histogram, and a quantile between 0 and 1 (e.g. 0.99)
+ *
+ * Outputs:
+ *       - a duration in microseconds that at least that fraction of the
+ *         samples did not exceed; this overestimates by at most 1/8, and is
+ *         never more than the longest sample
+ *
+ * Side Effects:
+ *       - none
+ */
+unsigned long long
+metrics_timing_quantile(const struct metrics_timing *const restrict timing, const double quantile)
+{
+	return_val_if_fail(timing != NULL, 0);
+
+	if (! timing->count)
+		return 0;
+
+	unsigned long long rank = (unsigned long long) (quantile * (double) timing->count + 0.5);
+	unsigned long long seen = 0;
+
+	if (rank < 1)
+		rank = 1;
+
+	for (unsigned int i = 0; i < METRICS_BUCKETS; i++)
+	{
+		seen += timing->bucket[i];
+
+		if (seen >= rank)
+		{
+			const unsigned long long bound = metrics_bucket_bound(i) - 1U;
+
+			return (bound < timing->max) ? bound : timing->max;
+		}
+	}
+
+	return timing->max;
+}
+
+/* The event loop gives us no way to tell how long it waited for I/O, so an
+ * iteration is timed from the first I/O callback it runs to its end; those
+ * that only wait (or only run timers) are not counted.
+ */
+void
+metrics_loop_woken(void)
+{
+	if (! metrics.loop_wake)
+		metrics.loop_wake = metrics_clock();
+}
+
+void
+metrics_loop_done(void)
+{
+	if (! metrics.loop_wake)
+		return;
+
+	(void) metrics_timing_record(&metrics.loop, metrics_clock() - metrics.loop_wake);
+
+	metrics.loop_wake = 0;
+}
+
+/*
+ * metrics_command_find(const struct service *svs, const char *name)
+ *
+ * Inputs:
+ *       - a service, and the name of one of its commands; for a subcommand,
+ *         this is preceded by the names of its parents (e.g. "CLONES LIST")
+ *
+ * Outputs:
+ *       - the statistics for the command as used on that service
+ *
+ * Side Effects:
+ *       - the statistics are created on first use, and are kept when the
+ *         command's module is unloaded, so that they carry on if it is
+ *         loaded again
+ */
+struct metrics_command *
+metrics_command_find(const struct service *const restrict svs, const char *const restrict name)
+{
+	char key[BUFSIZE];
+	struct metrics_command *mc;
+
+	return_val_if_fail(svs != NULL, NULL);
+	return_val_if_fail(name != NULL, NULL);
+
+	if (! metrics_commands)
+		metrics_commands = mowgli_patricia_create(NULL);
+
+	(void) snprintf(key, sizeof key, "%s %s", svs->internal_name, name);
+
+	if ((mc = mowgli_patricia_retrieve(metrics_commands, key)))
+		return mc;
+
+	mc = smalloc(sizeof *mc);
+	mc->service = sstrdup(svs->internal_name);
+	mc->name = sstrdup(name);
+
+	(void) mowgli_patricia_add(metrics_commands, key, mc);
+
+	return mc;
+}
+
+void
+metrics_command_foreach(const metrics_command_cb cb, void *const restrict priv)
+{
+	mowgli_patricia_iteration_state_t state;
+	const struct metrics_command *mc;
+
+	return_if_fail(cb != NULL);
+
+	if (! metrics_commands)
+		return;
+
+	MOWGLI_PATRICIA_FOREACH(mc, &state, metrics_commands)
+		(void) cb(mc, priv);
+}
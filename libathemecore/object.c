@@ -238,6 +238,15 @@ metadata_add(void *target, const char *name, const char *value)
 
 	mowgli_patricia_add(obj->metadata, md->name, md);
 
+	struct hook_metadata_change mdchange = {
+		.target  = target,
+		.name    = md->name,
+		.value   = md->value,
+		.deleted = false,
+	};
+
+	hook_call_metadata_change(&mdchange);
+
 	return md;
 }
 
@@ -256,6 +265,15 @@ metadata_delete(void *target, const char *name)
 
 	mowgli_patricia_delete(obj->metadata, name);
 
+	struct hook_metadata_change mdchange = {
+		.target  = target,
+		.name    = md->name,
+		.value   = md->value,
+		.deleted = true,
+	};
+
+	hook_call_metadata_change(&mdchange);
+
 	strshare_unref(md->name);
 	sfree(md->value);
 
@@ -60,6 +60,7 @@ pcommand_add(const char *token, void (*handler) (struct sourceinfo *si, int parc
 	pcmd->handler = handler;
 	pcmd->minparc = minparc;
 	pcmd->sourcetype = sourcetype;
+	(void) memset(&pcmd->timing, 0x00, sizeof pcmd->timing);
 
 	mowgli_patricia_add(pcommands, pcmd->token, pcmd);
 }
@@ -88,6 +89,36 @@ pcommand_find(const char *token)
 	return mowgli_patricia_retrieve(pcommands, token);
 }
 
+// Called by the transport once the command has passed its checks
+void
+pcommand_exec(struct proto_cmd *pcmd, struct sourceinfo *si, int parc, char *parv[])
+{
+	const unsigned long long slow = config_options.slow_command_time * 1000ULL;
+	char origin[HOSTLEN + 1];
+
+	return_if_fail(pcmd != NULL);
+
+	if (!pcmd->handler)
+		return;
+
+	// The source may be gone by the time the handler returns (QUIT, SQUIT, ...)
+	if (slow)
+		mowgli_strlcpy(origin, si->su != NULL ? si->su->nick : si->s != NULL ? si->s->name : "<unregistered>",
+		               sizeof origin);
+
+	const unsigned long long start = metrics_clock();
+
+	pcmd->handler(si, parc, parv);
+
+	const unsigned long long elapsed = metrics_clock() - start;
+
+	metrics_timing_record(&pcmd->timing, elapsed);
+
+	if (slow && elapsed >= slow)
+		slog(LG_INFO, "pcommand_exec(): slow protocol message: %s from %s took %llu ms",
+		     pcmd->token, origin, elapsed / 1000ULL);
+}
+
 /* vim:cinoptions=>s,e0,n0,f0,{0,}0,^0,=s,ps,t0,c3,+s,(2s,us,)20,*30,gs,hs
  * vim:ts=8
  * vim:sw=8
@@ -11,28 +11,16 @@
 #  error "Do not compile me directly; compile random_frontend.c instead"
 #endif /* !ATHEME_LAC_RANDOM_FRONTEND_C */
 
-uint32_t
-atheme_random(void)
-{
-	return arc4random();
-}
-
-uint32_t
-atheme_random_uniform(const uint32_t bound)
-{
-	return arc4random_uniform(bound);
-}
-
-void
-atheme_random_buf(void *const restrict out, const size_t len)
+static void
+random_fe_buf(void *const restrict out, const size_t len)
 {
 	(void) arc4random_buf(out, len);
 }
 
-bool ATHEME_FATTR_WUR
-libathemecore_random_early_init(void)
+static bool ATHEME_FATTR_WUR
+random_fe_early_init(void)
 {
-	(void) atheme_random();
+	(void) arc4random();
 
 	return true;
 }
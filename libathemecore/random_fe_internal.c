@@ -358,37 +358,8 @@ _rs_stir_if_needed(const size_t len)
 	return true;
 }
 
-uint32_t
-atheme_random(void)
-{
-	uint32_t val;
-
-	(void) atheme_random_buf(&val, sizeof val);
-
-	return val;
-}
-
-uint32_t
-atheme_random_uniform(const uint32_t bound)
-{
-	if (bound < 2)
-		return 0;
-
-	const uint32_t min = -bound % bound;
-
-	for (;;)
-	{
-		uint32_t candidate;
-
-		(void) atheme_random_buf(&candidate, sizeof candidate);
-
-		if (candidate >= min)
-			return candidate % bound;
-	}
-}
-
-void
-atheme_random_buf(void *const restrict out, size_t len)
+static void
+random_fe_buf(void *const restrict out, size_t len)
 {
 	uint8_t *buf = (uint8_t *) out;
 
@@ -414,8 +385,8 @@ atheme_random_buf(void *const restrict out, size_t len)
 	}
 }
 
-bool ATHEME_FATTR_WUR
-libathemecore_random_early_init(void)
+static bool ATHEME_FATTR_WUR
+random_fe_early_init(void)
 {
 	if (! _rs_stir_if_needed(0))
 		return false;
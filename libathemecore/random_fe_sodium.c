@@ -15,28 +15,16 @@
 #include <sodium/randombytes.h>
 #include <sodium/version.h>
 
-uint32_t
-atheme_random(void)
-{
-	return randombytes_random();
-}
-
-uint32_t
-atheme_random_uniform(const uint32_t bound)
-{
-	return randombytes_uniform(bound);
-}
-
-void
-atheme_random_buf(void *const restrict out, const size_t len)
+static void
+random_fe_buf(void *const restrict out, const size_t len)
 {
 	(void) randombytes_buf(out, len);
 }
 
-bool ATHEME_FATTR_WUR
-libathemecore_random_early_init(void)
+static bool ATHEME_FATTR_WUR
+random_fe_early_init(void)
 {
-	(void) atheme_random();
+	(void) randombytes_random();
 
 	return true;
 }
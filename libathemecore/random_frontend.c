@@ -18,6 +18,9 @@
 #define RANDSTR_ALPHABET_LEN            62U
 #define RANDSTR_REQUEST_LEN             128U
 
+#define RANDOM_BUFFER_LEN               4096U
+#define RANDOM_BUFFER_DIRECT_MIN        (RANDOM_BUFFER_LEN / 4U)    // Larger requests bypass the buffer
+
 #if (ATHEME_API_RANDOM_FRONTEND == ATHEME_API_RANDOM_FRONTEND_INTERNAL)
 #  include "random_fe_internal.c"
 #elif (ATHEME_API_RANDOM_FRONTEND == ATHEME_API_RANDOM_FRONTEND_ARC4RANDOM)
@@ -32,6 +35,205 @@
 #  error "No RNG API frontend was selected by the build system"
 #endif
 
+#ifdef HAVE_LIBPTHREAD
+#  include <pthread.h>
+#endif
+
+/* Most callers want a few bytes at a time (salts, nonces, cookies, UIDs), and
+ * every call into a frontend has a fixed cost (locking, syscalls, reseeding
+ * checks), so random data is generated in blocks of RANDOM_BUFFER_LEN bytes
+ * and handed out from a buffer. Bytes are wiped from the buffer as soon as
+ * they have been handed out.
+ *
+ * Every thread has its own buffer, so worker threads don't contend for one;
+ * the frontends themselves are not all thread-safe, so refills are serialised.
+ *
+ * A child process must never hand out the same bytes as its parent (or its
+ * siblings); a buffer filled before a fork(2) is discarded by the child.
+ */
+struct random_buffer
+{
+	unsigned char           data[RANDOM_BUFFER_LEN];
+	size_t                  avail;          // bytes not yet handed out, at the end of data[]
+	unsigned long           forkgen;        // random_forkgen when data[] was filled
+	pid_t                   pid;            // process that filled data[] (if !HAVE_LIBPTHREAD)
+};
+
+#ifdef HAVE_LIBPTHREAD
+
+static pthread_key_t random_buffer_key;
+static pthread_mutex_t random_fe_mtx = PTHREAD_MUTEX_INITIALIZER;
+static volatile unsigned long random_forkgen = 0;
+
+static void
+random_buffer_destroy(void *const restrict vbuf)
+{
+	(void) smemzerofree(vbuf, sizeof(struct random_buffer));
+}
+
+static void
+random_atfork_prepare(void)
+{
+	(void) pthread_mutex_lock(&random_fe_mtx);
+}
+
+static void
+random_atfork_parent(void)
+{
+	(void) pthread_mutex_unlock(&random_fe_mtx);
+}
+
+static void
+random_atfork_child(void)
+{
+	random_forkgen++;
+
+	(void) pthread_mutex_unlock(&random_fe_mtx);
+}
+
+static inline struct random_buffer *
+random_buffer_get(void)
+{
+	struct random_buffer *rb = pthread_getspecific(random_buffer_key);
+
+	if (! rb)
+	{
+		rb = smalloc(sizeof *rb);
+		rb->forkgen = random_forkgen;
+
+		(void) pthread_setspecific(random_buffer_key, rb);
+	}
+
+	if (rb->forkgen != random_forkgen)
+	{
+		(void) smemzero(rb->data, sizeof rb->data);
+
+		rb->forkgen = random_forkgen;
+		rb->avail = 0;
+	}
+
+	return rb;
+}
+
+#else /* HAVE_LIBPTHREAD */
+
+static struct random_buffer random_buffer_single;
+
+static inline struct random_buffer *
+random_buffer_get(void)
+{
+	struct random_buffer *const rb = &random_buffer_single;
+	const pid_t pid = getpid();
+
+	if (rb->pid != pid)
+	{
+		(void) smemzero(rb->data, sizeof rb->data);
+
+		rb->pid = pid;
+		rb->avail = 0;
+	}
+
+	return rb;
+}
+
+#endif /* !HAVE_LIBPTHREAD */
+
+// Random data straight from the frontend, bypassing the buffers
+void
+atheme_random_buf_unbuffered(void *const restrict out, const size_t len)
+{
+#ifdef HAVE_LIBPTHREAD
+	(void) pthread_mutex_lock(&random_fe_mtx);
+#endif
+
+	(void) random_fe_buf(out, len);
+
+#ifdef HAVE_LIBPTHREAD
+	(void) pthread_mutex_unlock(&random_fe_mtx);
+#endif
+}
+
+void
+atheme_random_buf(void *const restrict out, const size_t len)
+{
+	return_if_fail(out != NULL);
+
+	if (len >= RANDOM_BUFFER_DIRECT_MIN)
+	{
+		(void) atheme_random_buf_unbuffered(out, len);
+		return;
+	}
+
+	struct random_buffer *const rb = random_buffer_get();
+
+	if (rb->avail < len)
+	{
+		(void) atheme_random_buf_unbuffered(rb->data, sizeof rb->data);
+
+		rb->avail = sizeof rb->data;
+	}
+
+	unsigned char *const ptr = rb->data + rb->avail - len;
+
+	(void) memcpy(out, ptr, len);
+	(void) smemzero(ptr, len);
+
+	rb->avail -= len;
+}
+
+uint32_t
+atheme_random(void)
+{
+	uint32_t val;
+
+	(void) atheme_random_buf(&val, sizeof val);
+
+	return val;
+}
+
+uint32_t
+atheme_random_uniform(const uint32_t bound)
+{
+	if (bound < 2)
+		return 0;
+
+	const uint32_t min = -bound % bound;
+
+	for (;;)
+	{
+		uint32_t candidate;
+
+		(void) atheme_random_buf(&candidate, sizeof candidate);
+
+		if (candidate >= min)
+			return candidate % bound;
+	}
+}
+
+bool ATHEME_FATTR_WUR
+libathemecore_random_early_init(void)
+{
+	if (! random_fe_early_init())
+		return false;
+
+#ifdef HAVE_LIBPTHREAD
+	int ret;
+
+	if ((ret = pthread_key_create(&random_buffer_key, &random_buffer_destroy)) != 0)
+	{
+		(void) fprintf(stderr, "libathemecore: pthread_key_create(3): %s\n", strerror(ret));
+		return false;
+	}
+	if ((ret = pthread_atfork(&random_atfork_prepare, &random_atfork_parent, &random_atfork_child)) != 0)
+	{
+		(void) fprintf(stderr, "libathemecore: pthread_atfork(3): %s\n", strerror(ret));
+		return false;
+	}
+#endif
+
+	return true;
+}
+
 /* Note that this function generates a random printable string of length "len", and so it
  * actually requires a buffer of at least "len + 1" bytes, to write a terminating NULL
  * byte too. Thus, DO NOT use the size of the buffer as an argument to this function.    -- amdj
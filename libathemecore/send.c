@@ -67,6 +67,7 @@ io_loop(void)
 	{
 		CURRTIME = mowgli_eventloop_get_time(base_eventloop);
 		mowgli_eventloop_run_once(base_eventloop);
+		metrics_loop_done();
 		check_signals();
 	}
 }
@@ -676,6 +676,8 @@ myuser_login(struct service *svs, struct user *u, struct myuser *mu, bool sendac
 	mowgli_node_add(u, mowgli_node_create(), &mu->logins);
 	u->flags &= ~UF_SOPER_PASS;
 
+	myuser_memos_thaw(mu);
+
 	/* check for previous login and let them know, unless they have opt'd OUT */
 	if (metadata_find(mu, "private:host:actual") != NULL && metadata_find(mu, "private:showlast:optout") == NULL)
 	{
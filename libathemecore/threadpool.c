@@ -0,0 +1,421 @@
+/*
+ * SPDX-License-Identifier: ISC
+ * SPDX-URL: https://spdx.org/licenses/ISC.html
+ *
+ * Copyright (C) 2026 Atheme Development Group (https://atheme.github.io/)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * atheme-services: A collection of minimalist IRC services
+ * threadpool.c: Worker thread pools with completion on the event loop
+ *
+ * Jobs are queued by the event loop, run on one of the pool's threads, and
+ * then handed back to the event loop through a pipe so that their completion
+ * callback can safely touch services state again.
+ */
+
+#include <atheme.h>
+#include "internal.h"
+
+#ifdef HAVE_LIBPTHREAD
+
+struct threadpool_job
+{
+	mowgli_node_t           node;
+	struct threadpool *     pool;
+	threadpool_work_fn      work;
+	threadpool_done_fn      done;
+	void *                  priv;
+};
+
+struct threadpool
+{
+	char *                  name;
+	pthread_t *             threads;
+	unsigned int            nthreads;
+	pthread_mutex_t         lock;
+	pthread_cond_t          wakeup;         // a job was queued, or shutdown was requested
+	pthread_cond_t          idle;           // a job has finished running
+	mowgli_list_t           queue;          // jobs not yet picked up by a thread
+	unsigned int            running;        // jobs currently being run by a thread
+	unsigned int            pending;        // jobs whose completion has not run yet (event loop only)
+	bool                    shutdown;
+};
+
+static pthread_mutex_t threadpool_done_lock = PTHREAD_MUTEX_INITIALIZER;
+static mowgli_list_t threadpool_done_queue = { NULL, NULL, 0 };
+
+static struct connection *threadpool_notify_conn = NULL;
+static int threadpool_notify_fd = -1;
+
+// Set to the pool on each of its worker threads, and unset on the event loop
+static pthread_key_t threadpool_worker_key;
+static bool threadpool_worker_key_valid = false;
+
+static void
+threadpool_notify(void)
+{
+	static const char byte = 0;
+
+	// If this fails with EAGAIN, a wakeup is already pending, which is all we need
+	(void) write(threadpool_notify_fd, &byte, sizeof byte);
+}
+
+static void
+threadpool_dispatch(void)
+{
+	mowgli_node_t *n, *tn;
+
+	// Jobs log before they finish, so log their messages before running their completions
+	(void) slog_flush_deferred();
+
+	(void) pthread_mutex_lock(&threadpool_done_lock);
+
+	mowgli_list_t done = threadpool_done_queue;
+
+	threadpool_done_queue.head = NULL;
+	threadpool_done_queue.tail = NULL;
+	threadpool_done_queue.count = 0;
+
+	(void) pthread_mutex_unlock(&threadpool_done_lock);
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, done.head)
+	{
+		struct threadpool_job *const job = n->data;
+
+		job->pool->pending--;
+
+		if (job->done)
+			(void) job->done(job->priv);
+
+		(void) sfree(job);
+	}
+}
+
+static void
+threadpool_notify_read(struct connection *const restrict cptr)
+{
+	char buf[BUFSIZE];
+
+	while (read(cptr->fd, buf, sizeof buf) > 0)
+		continue;
+
+	(void) threadpool_dispatch();
+}
+
+static void
+threadpool_notify_closed(struct connection ATHEME_VATTR_UNUSED *const restrict cptr)
+{
+	threadpool_notify_conn = NULL;
+
+	(void) close(threadpool_notify_fd);
+
+	threadpool_notify_fd = -1;
+}
+
+static bool
+threadpool_notify_init(void)
+{
+	int fds[2];
+
+	if (threadpool_notify_conn)
+		return true;
+
+	if (! threadpool_worker_key_valid)
+	{
+		const int ret = pthread_key_create(&threadpool_worker_key, NULL);
+
+		if (ret != 0)
+		{
+			(void) slog(LG_ERROR, "%s: pthread_key_create(3): %s", MOWGLI_FUNC_NAME, strerror(ret));
+			return false;
+		}
+
+		threadpool_worker_key_valid = true;
+	}
+
+	if (pipe(fds) != 0)
+	{
+		(void) slog(LG_ERROR, "%s: pipe(2): %s", MOWGLI_FUNC_NAME, strerror(errno));
+		return false;
+	}
+
+	const int flags = fcntl(fds[1], F_GETFL, 0);
+
+	if (flags == -1 || fcntl(fds[1], F_SETFL, flags | O_NONBLOCK) == -1 || fcntl(fds[1], F_SETFD, FD_CLOEXEC) == -1)
+	{
+		(void) slog(LG_ERROR, "%s: fcntl(2): %s", MOWGLI_FUNC_NAME, strerror(errno));
+		(void) close(fds[0]);
+		(void) close(fds[1]);
+		return false;
+	}
+
+	if (! (threadpool_notify_conn = connection_add("threadpool completion pipe", fds[0], 0,
+	                                               &threadpool_notify_read, NULL)))
+	{
+		(void) close(fds[0]);
+		(void) close(fds[1]);
+		return false;
+	}
+
+	threadpool_notify_conn->close_handler = &threadpool_notify_closed;
+	threadpool_notify_fd = fds[1];
+
+	return true;
+}
+
+static void *
+threadpool_worker(void *const restrict vpool)
+{
+	struct threadpool *const pool = vpool;
+
+	(void) pthread_setspecific(threadpool_worker_key, pool);
+	(void) pthread_mutex_lock(&pool->lock);
+
+	for (;;)
+	{
+		while (! pool->shutdown && ! pool->queue.head)
+			(void) pthread_cond_wait(&pool->wakeup, &pool->lock);
+
+		// Queued jobs are still run to completion when shutting down
+		if (! pool->queue.head)
+			break;
+
+		struct threadpool_job *const job = pool->queue.head->data;
+
+		(void) mowgli_node_delete(&job->node, &pool->queue);
+
+		pool->running++;
+
+		(void) pthread_mutex_unlock(&pool->lock);
+		(void) job->work(job->priv);
+		(void) pthread_mutex_lock(&threadpool_done_lock);
+		(void) mowgli_node_add(job, &job->node, &threadpool_done_queue);
+		(void) pthread_mutex_unlock(&threadpool_done_lock);
+		(void) threadpool_notify();
+		(void) pthread_mutex_lock(&pool->lock);
+
+		pool->running--;
+
+		(void) pthread_cond_broadcast(&pool->idle);
+	}
+
+	(void) pthread_mutex_unlock(&pool->lock);
+
+	return NULL;
+}
+
+struct threadpool *
+threadpool_create(const char *const restrict name, const unsigned int nthreads)
+{
+	return_val_if_fail(name != NULL, NULL);
+	return_val_if_fail(nthreads != 0, NULL);
+
+	if (! threadpool_notify_init())
+		return NULL;
+
+	struct threadpool *const pool = smalloc(sizeof *pool);
+
+	pool->name = sstrdup(name);
+	pool->threads = smalloc(nthreads * sizeof *pool->threads);
+
+	(void) pthread_mutex_init(&pool->lock, NULL);
+	(void) pthread_cond_init(&pool->wakeup, NULL);
+	(void) pthread_cond_init(&pool->idle, NULL);
+
+	/* Worker threads must never run our signal handlers; they inherit the
+	 * signal mask of the thread that creates them, so block everything
+	 * while creating them and then restore it.
+	 */
+	sigset_t allsigs, oldsigs;
+
+	(void) sigfillset(&allsigs);
+	(void) pthread_sigmask(SIG_SETMASK, &allsigs, &oldsigs);
+
+	for (unsigned int i = 0; i < nthreads; i++)
+	{
+		const int ret = pthread_create(&pool->threads[i], NULL, &threadpool_worker, pool);
+
+		if (ret != 0)
+		{
+			(void) slog(LG_ERROR, "%s: pthread_create(3) for pool '%s': %s", MOWGLI_FUNC_NAME, name,
+			            strerror(ret));
+			break;
+		}
+
+		pool->nthreads++;
+	}
+
+	(void) pthread_sigmask(SIG_SETMASK, &oldsigs, NULL);
+
+	if (! pool->nthreads)
+	{
+		(void) threadpool_destroy(pool);
+		return NULL;
+	}
+
+	(void) slog(LG_DEBUG, "%s: created pool '%s' with %u thread(s)", MOWGLI_FUNC_NAME, name, pool->nthreads);
+
+	return pool;
+}
+
+void
+threadpool_destroy(struct threadpool *const restrict pool)
+{
+	return_if_fail(pool != NULL);
+
+	(void) pthread_mutex_lock(&pool->lock);
+
+	pool->shutdown = true;
+
+	(void) pthread_cond_broadcast(&pool->wakeup);
+	(void) pthread_mutex_unlock(&pool->lock);
+
+	for (unsigned int i = 0; i < pool->nthreads; i++)
+		(void) pthread_join(pool->threads[i], NULL);
+
+	// Every thread has exited, so every job this pool ever ran is on the completion queue now
+	(void) threadpool_dispatch();
+
+	(void) pthread_cond_destroy(&pool->idle);
+	(void) pthread_cond_destroy(&pool->wakeup);
+	(void) pthread_mutex_destroy(&pool->lock);
+
+	(void) slog(LG_DEBUG, "%s: destroyed pool '%s'", MOWGLI_FUNC_NAME, pool->name);
+
+	(void) sfree(pool->threads);
+	(void) sfree(pool->name);
+	(void) sfree(pool);
+}
+
+bool
+threadpool_submit(struct threadpool *const restrict pool, const threadpool_work_fn work,
+                  const threadpool_done_fn done, void *const restrict priv)
+{
+	return_val_if_fail(pool != NULL, false);
+	return_val_if_fail(work != NULL, false);
+
+	struct threadpool_job *const job = smalloc(sizeof *job);
+
+	job->pool = pool;
+	job->work = work;
+	job->done = done;
+	job->priv = priv;
+
+	pool->pending++;
+
+	(void) pthread_mutex_lock(&pool->lock);
+	(void) mowgli_node_add(job, &job->node, &pool->queue);
+	(void) pthread_cond_signal(&pool->wakeup);
+	(void) pthread_mutex_unlock(&pool->lock);
+
+	return true;
+}
+
+void
+threadpool_drain(struct threadpool *const restrict pool)
+{
+	return_if_fail(pool != NULL);
+
+	(void) pthread_mutex_lock(&pool->lock);
+
+	while (pool->queue.head || pool->running)
+		(void) pthread_cond_wait(&pool->idle, &pool->lock);
+
+	(void) pthread_mutex_unlock(&pool->lock);
+	(void) threadpool_dispatch();
+}
+
+/* Like threadpool_drain(), but leaves the completions to the event loop, so
+ * that no other work (of this or any other pool) runs while the caller waits.
+ */
+void
+threadpool_wait(struct threadpool *const restrict pool)
+{
+	return_if_fail(pool != NULL);
+
+	(void) pthread_mutex_lock(&pool->lock);
+
+	while (pool->queue.head || pool->running)
+		(void) pthread_cond_wait(&pool->idle, &pool->lock);
+
+	(void) pthread_mutex_unlock(&pool->lock);
+}
+
+unsigned int
+threadpool_pending(const struct threadpool *const restrict pool)
+{
+	return_val_if_fail(pool != NULL, 0);
+
+	return pool->pending;
+}
+
+bool
+threadpool_available(void)
+{
+	return true;
+}
+
+bool
+threadpool_in_worker(void)
+{
+	return threadpool_worker_key_valid && pthread_getspecific(threadpool_worker_key) != NULL;
+}
+
+#else /* HAVE_LIBPTHREAD */
+
+struct threadpool *
+threadpool_create(const char *const restrict name, const unsigned int ATHEME_VATTR_UNUSED nthreads)
+{
+	(void) slog(LG_DEBUG, "%s: cannot create pool '%s': built without thread support", MOWGLI_FUNC_NAME, name);
+
+	return NULL;
+}
+
+void
+threadpool_destroy(struct threadpool ATHEME_VATTR_UNUSED *const restrict pool)
+{
+	return;
+}
+
+bool
+threadpool_submit(struct threadpool ATHEME_VATTR_UNUSED *const restrict pool,
+                  const threadpool_work_fn ATHEME_VATTR_UNUSED work,
+                  const threadpool_done_fn ATHEME_VATTR_UNUSED done, void ATHEME_VATTR_UNUSED *const restrict priv)
+{
+	return false;
+}
+
+void
+threadpool_drain(struct threadpool ATHEME_VATTR_UNUSED *const restrict pool)
+{
+	return;
+}
+
+void
+threadpool_wait(struct threadpool ATHEME_VATTR_UNUSED *const restrict pool)
+{
+	return;
+}
+
+unsigned int
+threadpool_pending(const struct threadpool ATHEME_VATTR_UNUSED *const restrict pool)
+{
+	return 0;
+}
+
+bool
+threadpool_available(void)
+{
+	return false;
+}
+
+bool
+threadpool_in_worker(void)
+{
+	return false;
+}
+
+#endif /* !HAVE_LIBPTHREAD */
@@ -16,7 +16,30 @@
 #include <atheme.h>
 #include "internal.h"
 
+/* Regex scans over every user are split across this many threads, once
+ * there are enough users for it to be worth it.
+ */
+#define USER_SCAN_THREADS       4U
+#define USER_SCAN_PARALLEL_MIN  4096U
+
+struct user_scan_subject
+{
+	const char *            str;
+	size_t                  len;
+};
+
+struct user_scan_job
+{
+	struct atheme_regex *                   preg;
+	const struct user_scan_subject *        subjects;
+	bool *                                  hits;
+	size_t                                  start;
+	size_t                                  end;
+};
+
 static mowgli_heap_t *user_heap = NULL;
+static struct threadpool *user_scan_pool = NULL;
+static bool user_scan_pool_failed = false;
 
 mowgli_patricia_t *userlist;
 mowgli_patricia_t *uidlist;
@@ -277,6 +300,7 @@ user_delete(struct user *u, const char *comment)
 	strshare_unref(u->vhost);
 	strshare_unref(u->chost);
 	strshare_unref(u->ip);
+	sfree(u->matchstr);
 
 	mowgli_heap_free(user_heap, u);
 
@@ -497,6 +521,7 @@ user_changenick(struct user *u, const char *nick, time_t ts)
 
 	strshare_unref(u->nick);
 	u->nick = strshare_get(nick);
+	user_matchstr_invalidate(u);
 
 	u->ts = ts;
 
@@ -673,6 +698,163 @@ find_user_banned_channel(struct user *const restrict u, const char ban_type)
 	return NULL;
 }
 
+/*
+ * user_matchstr(struct user *u, size_t *len)
+ *
+ * Returns the "nick!user@host gecos" string that regexes are matched
+ * against (RMATCH, RAKILL, RWATCH, ...).
+ *
+ * Inputs:
+ *     - user
+ *     - where to store the length of the string (may be NULL)
+ *
+ * Outputs:
+ *     - the string, owned by the user
+ *
+ * Side Effects:
+ *     - the string is built and cached on the user if it was not already;
+ *       whatever changes the nick, user, host or gecos of a user must call
+ *       user_matchstr_invalidate()
+ */
+const char *
+user_matchstr(struct user *const restrict u, size_t *const restrict len)
+{
+	return_val_if_fail(u != NULL, NULL);
+
+	if (u->matchstr == NULL)
+	{
+		char buf[BUFSIZE];
+		const int ret = snprintf(buf, sizeof buf, "%s!%s@%s %s", u->nick, u->user, u->host, u->gecos);
+
+		u->matchstr_len = (ret < 0) ? 0 : MIN((size_t) ret, sizeof buf - 1);
+		u->matchstr = sstrndup(buf, u->matchstr_len);
+	}
+
+	if (len != NULL)
+		*len = u->matchstr_len;
+
+	return u->matchstr;
+}
+
+void
+user_matchstr_invalidate(struct user *const restrict u)
+{
+	return_if_fail(u != NULL);
+
+	sfree(u->matchstr);
+
+	u->matchstr = NULL;
+	u->matchstr_len = 0;
+}
+
+static void
+user_scan_work(void *const restrict vjob)
+{
+	const struct user_scan_job *const job = vjob;
+
+	for (size_t i = job->start; i < job->end; i++)
+		job->hits[i] = regex_match_len(job->preg, job->subjects[i].str, job->subjects[i].len);
+}
+
+/*
+ * user_regex_scan(struct atheme_regex *preg, size_t *count)
+ *
+ * Finds every user whose match string (see user_matchstr()) matches a regex.
+ *
+ * Inputs:
+ *     - regex
+ *     - where to store the number of users found
+ *
+ * Outputs:
+ *     - an array of the users found, in userlist order, which the caller
+ *       must sfree(); NULL if there are none
+ *
+ * Side Effects:
+ *     - on large networks, the regex is evaluated on several threads; this
+ *       function still only returns once all of them are done, and nothing
+ *       else runs on the event loop in the meantime
+ */
+struct user **
+user_regex_scan(struct atheme_regex *const restrict preg, size_t *const restrict count)
+{
+	mowgli_patricia_iteration_state_t state;
+	struct user *u;
+	size_t n = 0;
+
+	return_val_if_fail(preg != NULL, NULL);
+	return_val_if_fail(count != NULL, NULL);
+
+	*count = 0;
+
+	const size_t total = mowgli_patricia_size(userlist);
+
+	if (! total)
+		return NULL;
+
+	struct user **const users = smalloc(total * sizeof *users);
+	struct user_scan_subject *const subjects = smalloc(total * sizeof *subjects);
+	bool *const hits = smalloc(total * sizeof *hits);
+
+	// Workers only ever see these strings, never the users themselves
+	MOWGLI_PATRICIA_FOREACH(u, &state, userlist)
+	{
+		users[n] = u;
+		subjects[n].str = user_matchstr(u, &subjects[n].len);
+		n++;
+	}
+
+	unsigned int nthreads = 1;
+
+	if (n >= USER_SCAN_PARALLEL_MIN && ! user_scan_pool_failed && threadpool_available())
+	{
+		if (! user_scan_pool && ! (user_scan_pool = threadpool_create("user scan", USER_SCAN_THREADS)))
+			user_scan_pool_failed = true;
+
+		if (user_scan_pool)
+			nthreads = USER_SCAN_THREADS;
+	}
+
+	struct user_scan_job jobs[USER_SCAN_THREADS];
+	unsigned int submitted = 0;
+
+	for (unsigned int i = 0; i < nthreads; i++)
+	{
+		jobs[i] = (struct user_scan_job) {
+			.preg       = preg,
+			.subjects   = subjects,
+			.hits       = hits,
+			.start      = (n * i) / nthreads,
+			.end        = (n * (i + 1)) / nthreads,
+		};
+
+		if (nthreads > 1 && threadpool_submit(user_scan_pool, &user_scan_work, NULL, &jobs[i]))
+			submitted++;
+		else
+			(void) user_scan_work(&jobs[i]);
+	}
+
+	if (submitted)
+		(void) threadpool_wait(user_scan_pool);
+
+	size_t found = 0;
+
+	for (size_t i = 0; i < n; i++)
+		if (hits[i])
+			users[found++] = users[i];
+
+	sfree(subjects);
+	sfree(hits);
+
+	if (! found)
+	{
+		sfree(users);
+		return NULL;
+	}
+
+	*count = found;
+	return users;
+}
+
 /* vim:cinoptions=>s,e0,n0,f0,{0,}0,^0,=s,ps,t0,c3,+s,(2s,us,)20,*30,gs,hs
  * vim:ts=8
  * vim:sw=8
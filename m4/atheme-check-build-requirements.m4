@@ -40,6 +40,7 @@ AC_DEFUN([ATHEME_CHECK_BUILD_REQUIREMENTS], [
     AC_CHECK_HEADERS([string.h], [], [], [])
     AC_CHECK_HEADERS([strings.h], [], [], [])
     AC_CHECK_HEADERS([sys/file.h], [], [], [])
+    AC_CHECK_HEADERS([sys/mman.h], [], [], [])
     AC_CHECK_HEADERS([sys/param.h], [], [], [])
     AC_CHECK_HEADERS([sys/random.h], [], [], [])
     AC_CHECK_HEADERS([sys/resource.h], [], [], [])
@@ -69,6 +70,7 @@ AC_DEFUN([ATHEME_CHECK_BUILD_REQUIREMENTS], [
     AC_CHECK_FUNCS([memmove], [], [ATHEME_REQUIRED_FUNC_MISSING])
     AC_CHECK_FUNCS([memset], [], [ATHEME_REQUIRED_FUNC_MISSING])
     AC_CHECK_FUNCS([memset_s], [], [])
+    AC_CHECK_FUNCS([mmap], [], [])
     AC_CHECK_FUNCS([regcomp], [], [ATHEME_REQUIRED_FUNC_MISSING])
     AC_CHECK_FUNCS([regerror], [], [ATHEME_REQUIRED_FUNC_MISSING])
     AC_CHECK_FUNCS([regexec], [], [ATHEME_REQUIRED_FUNC_MISSING])
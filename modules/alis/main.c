@@ -57,6 +57,7 @@ struct alis_query
 	unsigned int            min;
 	unsigned int            max;
 	unsigned int            skip;
+	unsigned int            resume;         // -continue token; first channel ID to consider
 	unsigned int            match_limit;
 	unsigned int            mode;
 	enum alis_mode_cmp      mode_cmp;
@@ -75,6 +76,536 @@ struct alis_query
 static struct service *alissvs = NULL;
 static unsigned int alis_max_matches = ALIS_MAXMATCH_DEF;
 
+/* Index of live channels, so that LIST doesn't have to run match() against
+ * every channel on the network:
+ *
+ *  - every 3-byte sequence (trigram) of every case-folded channel name and
+ *    topic maps to a sorted list of the IDs of the channels containing it;
+ *    any literal run of 3 or more characters in a query pattern must occur
+ *    in every channel it matches, so intersecting those lists gives a
+ *    (usually small) set of candidates
+ *  - channels are bucketed by (the base-2 logarithm of) their member count,
+ *    so that -min queries without a usable pattern only look at channels
+ *    that are large enough
+ *
+ * Candidates are then checked exactly, as before, in ID order; the ID after
+ * the last channel shown is handed out as a continuation token for -continue.
+ * IDs are handed out in increasing order and not reused, so channels created
+ * since then come after the token rather than in the place of channels that
+ * have gone. Only when the ID space is full and at least half of it belongs
+ * to channels that have gone are the IDs renumbered (in the same order), after
+ * which older tokens may skip some channels.
+ */
+#define ALIS_GRAM_LEN           3U
+#define ALIS_GRAMS_MAX          (BUFSIZE * 2U)
+#define ALIS_BUCKETS            33U
+
+struct alis_posting
+{
+	unsigned int *          ids;
+	unsigned int            count;
+	unsigned int            alloc;
+};
+
+struct alis_entry
+{
+	struct channel *        chan;
+	char *                  topic;          // case-folded topic the topic trigrams were taken from
+	unsigned int            id;
+	unsigned int            bucket;
+	mowgli_node_t           bucket_node;
+};
+
+static mowgli_patricia_t *alis_entries = NULL;          // channel name -> struct alis_entry
+static mowgli_patricia_t *alis_name_grams = NULL;       // trigram -> struct alis_posting
+static mowgli_patricia_t *alis_topic_grams = NULL;      // trigram -> struct alis_posting
+static mowgli_list_t alis_buckets[ALIS_BUCKETS];
+
+static struct alis_entry **alis_slots = NULL;           // [id]
+static unsigned int alis_slots_alloc = 0;
+static unsigned int alis_slots_used = 0;
+static unsigned int alis_slots_live = 0;
+
+static unsigned int
+alis_bucket_of(unsigned int members)
+{
+	unsigned int bucket = 0;
+
+	while (members)
+	{
+		bucket++;
+		members >>= 1;
+	}
+
+	return bucket;
+}
+
+static void
+alis_fold(char *dst, const char *src)
+{
+	while (*src)
+		*dst++ = (char) ToLower((unsigned char) *src++);
+
+	*dst = '\0';
+}
+
+// Returns the position of `id' in `p', or where it would have to be inserted
+static unsigned int
+alis_posting_find(const struct alis_posting *const restrict p, const unsigned int id)
+{
+	unsigned int lo = 0;
+	unsigned int hi = p->count;
+
+	while (lo < hi)
+	{
+		const unsigned int mid = lo + ((hi - lo) / 2U);
+
+		if (p->ids[mid] < id)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+static void
+alis_grams_add(mowgli_patricia_t *const restrict grams, const char *const restrict str, const unsigned int id)
+{
+	const size_t len = strlen(str);
+	char key[ALIS_GRAM_LEN + 1];
+
+	for (size_t i = 0; i + ALIS_GRAM_LEN <= len; i++)
+	{
+		(void) memcpy(key, str + i, ALIS_GRAM_LEN);
+		key[ALIS_GRAM_LEN] = '\0';
+
+		struct alis_posting *p = mowgli_patricia_retrieve(grams, key);
+
+		if (! p)
+		{
+			p = smalloc(sizeof *p);
+			(void) mowgli_patricia_add(grams, key, p);
+		}
+
+		const unsigned int pos = alis_posting_find(p, id);
+
+		if (pos < p->count && p->ids[pos] == id)
+			continue;
+
+		if (p->count == p->alloc)
+		{
+			p->alloc = p->alloc ? (p->alloc * 2U) : 4U;
+			p->ids = sreallocarray(p->ids, p->alloc, sizeof *p->ids);
+		}
+
+		(void) memmove(p->ids + pos + 1, p->ids + pos, (p->count - pos) * sizeof *p->ids);
+
+		p->ids[pos] = id;
+		p->count++;
+	}
+}
+
+static void
+alis_grams_del(mowgli_patricia_t *const restrict grams, const char *const restrict str, const unsigned int id)
+{
+	const size_t len = strlen(str);
+	char key[ALIS_GRAM_LEN + 1];
+
+	for (size_t i = 0; i + ALIS_GRAM_LEN <= len; i++)
+	{
+		(void) memcpy(key, str + i, ALIS_GRAM_LEN);
+		key[ALIS_GRAM_LEN] = '\0';
+
+		struct alis_posting *const p = mowgli_patricia_retrieve(grams, key);
+
+		if (! p)
+			continue;
+
+		const unsigned int pos = alis_posting_find(p, id);
+
+		if (pos == p->count || p->ids[pos] != id)
+			continue;
+
+		(void) memmove(p->ids + pos, p->ids + pos + 1, (p->count - pos - 1) * sizeof *p->ids);
+
+		if (--p->count)
+			continue;
+
+		(void) mowgli_patricia_delete(grams, key);
+		(void) sfree(p->ids);
+		(void) sfree(p);
+	}
+}
+
+static void
+alis_index_set_topic(struct alis_entry *const restrict e)
+{
+	if (e->topic)
+	{
+		(void) alis_grams_del(alis_topic_grams, e->topic, e->id);
+		(void) sfree(e->topic);
+	}
+
+	if (! e->chan->topic || ! *e->chan->topic)
+		return;
+
+	e->topic = smalloc(strlen(e->chan->topic) + 1);
+
+	(void) alis_fold(e->topic, e->chan->topic);
+	(void) alis_grams_add(alis_topic_grams, e->topic, e->id);
+}
+
+static void
+alis_index_set_members(struct alis_entry *const restrict e, const unsigned int members)
+{
+	const unsigned int bucket = alis_bucket_of(members);
+
+	if (bucket == e->bucket)
+		return;
+
+	(void) mowgli_node_delete(&e->bucket_node, &alis_buckets[e->bucket]);
+	(void) mowgli_node_add(e, &e->bucket_node, &alis_buckets[bucket]);
+
+	e->bucket = bucket;
+}
+
+static void
+alis_posting_renumber(mowgli_patricia_t *const restrict grams, const unsigned int *const restrict newids)
+{
+	mowgli_patricia_iteration_state_t state;
+	struct alis_posting *p;
+
+	// Renumbering keeps the order, so the postings stay sorted
+	MOWGLI_PATRICIA_FOREACH(p, &state, grams)
+		for (unsigned int i = 0; i < p->count; i++)
+			p->ids[i] = newids[p->ids[i]];
+}
+
+// Gives the channels still indexed the lowest IDs, in the order they had
+static void
+alis_index_compact(void)
+{
+	unsigned int *const newids = smalloc(alis_slots_used * sizeof *newids);
+	unsigned int next = 0;
+
+	for (unsigned int id = 0; id < alis_slots_used; id++)
+	{
+		struct alis_entry *const e = alis_slots[id];
+
+		if (! e)
+			continue;
+
+		newids[id] = next;
+		e->id = next;
+		alis_slots[next++] = e;
+	}
+
+	(void) alis_posting_renumber(alis_name_grams, newids);
+	(void) alis_posting_renumber(alis_topic_grams, newids);
+	(void) sfree(newids);
+
+	alis_slots_used = next;
+}
+
+static void
+alis_index_add(struct channel *const restrict c)
+{
+	char name[BUFSIZE];
+
+	if (mowgli_patricia_retrieve(alis_entries, c->name))
+		return;
+
+	if (alis_slots_used && alis_slots_used == alis_slots_alloc && alis_slots_live <= (alis_slots_used / 2U))
+		(void) alis_index_compact();
+
+	if (alis_slots_used == alis_slots_alloc)
+	{
+		alis_slots_alloc = alis_slots_alloc ? (alis_slots_alloc * 2U) : 1024U;
+		alis_slots = sreallocarray(alis_slots, alis_slots_alloc, sizeof *alis_slots);
+	}
+
+	struct alis_entry *const e = smalloc(sizeof *e);
+
+	e->id = alis_slots_used++;
+	e->chan = c;
+	e->bucket = alis_bucket_of(MOWGLI_LIST_LENGTH(&c->members));
+	alis_slots[e->id] = e;
+	alis_slots_live++;
+
+	(void) mowgli_node_add(e, &e->bucket_node, &alis_buckets[e->bucket]);
+	(void) mowgli_patricia_add(alis_entries, c->name, e);
+
+	(void) mowgli_strlcpy(name, c->name, sizeof name);
+	(void) alis_fold(name, name);
+	(void) alis_grams_add(alis_name_grams, name, e->id);
+	(void) alis_index_set_topic(e);
+}
+
+static void
+alis_index_del(struct channel *const restrict c)
+{
+	char name[BUFSIZE];
+
+	struct alis_entry *const e = mowgli_patricia_delete(alis_entries, c->name);
+
+	if (! e)
+		return;
+
+	(void) mowgli_strlcpy(name, c->name, sizeof name);
+	(void) alis_fold(name, name);
+	(void) alis_grams_del(alis_name_grams, name, e->id);
+
+	if (e->topic)
+		(void) alis_grams_del(alis_topic_grams, e->topic, e->id);
+
+	(void) mowgli_node_delete(&e->bucket_node, &alis_buckets[e->bucket]);
+
+	alis_slots[e->id] = NULL;
+	alis_slots_live--;
+
+	(void) sfree(e->topic);
+	(void) sfree(e);
+}
+
+static void
+alis_hook_channel_add(struct channel *const restrict c)
+{
+	(void) alis_index_add(c);
+}
+
+static void
+alis_hook_channel_delete(struct channel *const restrict c)
+{
+	(void) alis_index_del(c);
+}
+
+static void
+alis_hook_channel_topic(struct channel *const restrict c)
+{
+	struct alis_entry *const e = mowgli_patricia_retrieve(alis_entries, c->name);
+
+	if (e)
+		(void) alis_index_set_topic(e);
+}
+
+static void
+alis_hook_channel_join(struct hook_channel_joinpart *const restrict hdata)
+{
+	// A previous hook function kicked the user; the part hook has seen that
+	if (! hdata->cu)
+		return;
+
+	struct alis_entry *const e = mowgli_patricia_retrieve(alis_entries, hdata->cu->chan->name);
+
+	if (e)
+		(void) alis_index_set_members(e, MOWGLI_LIST_LENGTH(&hdata->cu->chan->members));
+}
+
+static void
+alis_hook_channel_part(struct hook_channel_joinpart *const restrict hdata)
+{
+	if (! hdata->cu)
+		return;
+
+	struct alis_entry *const e = mowgli_patricia_retrieve(alis_entries, hdata->cu->chan->name);
+
+	// This is called before the user is removed
+	if (e)
+		(void) alis_index_set_members(e, MOWGLI_LIST_LENGTH(&hdata->cu->chan->members) - 1U);
+}
+
+static void
+alis_posting_free(const char ATHEME_VATTR_UNUSED *const restrict key, void *const restrict data,
+                  void ATHEME_VATTR_UNUSED *const restrict privdata)
+{
+	struct alis_posting *const p = data;
+
+	(void) sfree(p->ids);
+	(void) sfree(p);
+}
+
+static void
+alis_entry_free(const char ATHEME_VATTR_UNUSED *const restrict key, void *const restrict data,
+                void ATHEME_VATTR_UNUSED *const restrict privdata)
+{
+	struct alis_entry *const e = data;
+
+	(void) sfree(e->topic);
+	(void) sfree(e);
+}
+
+static void
+alis_index_init(void)
+{
+	struct channel *c;
+	mowgli_patricia_iteration_state_t state;
+
+	alis_entries = mowgli_patricia_create(&irccasecanon);
+	alis_name_grams = mowgli_patricia_create(&noopcanon);
+	alis_topic_grams = mowgli_patricia_create(&noopcanon);
+
+	MOWGLI_PATRICIA_FOREACH(c, &state, chanlist)
+		(void) alis_index_add(c);
+}
+
+static void
+alis_index_deinit(void)
+{
+	(void) mowgli_patricia_destroy(alis_entries, &alis_entry_free, NULL);
+	(void) mowgli_patricia_destroy(alis_name_grams, &alis_posting_free, NULL);
+	(void) mowgli_patricia_destroy(alis_topic_grams, &alis_posting_free, NULL);
+
+	(void) sfree(alis_slots);
+	(void) memset(alis_buckets, 0x00, sizeof alis_buckets);
+
+	alis_slots = NULL;
+	alis_slots_alloc = 0;
+	alis_slots_used = 0;
+	alis_slots_live = 0;
+}
+
+/* Adds the postings of every trigram in the literal runs of match() pattern
+ * `mask' to `lists'. Returns false if one of them occurs in no channel at
+ * all (so nothing can match).
+ */
+static bool
+alis_query_grams(mowgli_patricia_t *const restrict grams, const char *const restrict mask,
+                 const struct alis_posting **const restrict lists, unsigned int *const restrict nlists)
+{
+	char folded[BUFSIZE];
+	char key[ALIS_GRAM_LEN + 1];
+	size_t run = 0;
+
+	(void) mowgli_strlcpy(folded, mask, sizeof folded);
+	(void) alis_fold(folded, folded);
+
+	for (size_t i = 0; folded[i]; i++)
+	{
+		// Characters that match() may treat as something other than themselves
+		if (strchr("*?&#%\\", folded[i]))
+		{
+			run = 0;
+			continue;
+		}
+
+		if (++run < ALIS_GRAM_LEN)
+			continue;
+
+		(void) memcpy(key, folded + i + 1 - ALIS_GRAM_LEN, ALIS_GRAM_LEN);
+		key[ALIS_GRAM_LEN] = '\0';
+
+		const struct alis_posting *const p = mowgli_patricia_retrieve(grams, key);
+
+		if (! p)
+			return false;
+
+		if (*nlists < ALIS_GRAMS_MAX)
+			lists[(*nlists)++] = p;
+	}
+
+	return true;
+}
+
+static int
+alis_posting_compare(const void *const restrict a, const void *const restrict b)
+{
+	const struct alis_posting *const pa = *((const struct alis_posting *const *) a);
+	const struct alis_posting *const pb = *((const struct alis_posting *const *) b);
+
+	return (pa->count > pb->count) - (pa->count < pb->count);
+}
+
+static int
+alis_id_compare(const void *const restrict a, const void *const restrict b)
+{
+	const unsigned int ia = *((const unsigned int *) a);
+	const unsigned int ib = *((const unsigned int *) b);
+
+	return (ia > ib) - (ia < ib);
+}
+
+/* Works out which channels can possibly match `query', in ID order. Returns
+ * false if every channel has to be checked; otherwise `*ids' (to be freed by
+ * the caller, and possibly NULL) holds `*count' candidate IDs.
+ */
+static bool
+alis_query_candidates(const struct alis_query *const restrict query, unsigned int **const restrict ids,
+                      unsigned int *const restrict count)
+{
+	static const struct alis_posting *lists[ALIS_GRAMS_MAX];
+	unsigned int nlists = 0;
+
+	*ids = NULL;
+	*count = 0;
+
+	if (*query->mask && ! alis_query_grams(alis_name_grams, query->mask, lists, &nlists))
+		return true;
+
+	if (*query->topic && ! alis_query_grams(alis_topic_grams, query->topic, lists, &nlists))
+		return true;
+
+	if (nlists)
+	{
+		(void) qsort(lists, nlists, sizeof *lists, &alis_posting_compare);
+
+		unsigned int *const cand = smalloc(lists[0]->count * sizeof *cand);
+		unsigned int ncand = lists[0]->count;
+
+		(void) memcpy(cand, lists[0]->ids, ncand * sizeof *cand);
+
+		for (unsigned int l = 1; l < nlists && ncand; l++)
+		{
+			unsigned int kept = 0;
+
+			for (unsigned int i = 0; i < ncand; i++)
+			{
+				const unsigned int pos = alis_posting_find(lists[l], cand[i]);
+
+				if (pos < lists[l]->count && lists[l]->ids[pos] == cand[i])
+					cand[kept++] = cand[i];
+			}
+
+			ncand = kept;
+		}
+
+		*ids = cand;
+		*count = ncand;
+		return true;
+	}
+
+	if (query->min > 1U)
+	{
+		const unsigned int first = alis_bucket_of(query->min);
+		unsigned int ncand = 0;
+
+		for (unsigned int b = first; b < ALIS_BUCKETS; b++)
+			ncand += MOWGLI_LIST_LENGTH(&alis_buckets[b]);
+
+		if (! ncand)
+			return true;
+
+		unsigned int *const cand = smalloc(ncand * sizeof *cand);
+		unsigned int i = 0;
+
+		for (unsigned int b = first; b < ALIS_BUCKETS; b++)
+		{
+			mowgli_node_t *n;
+
+			MOWGLI_ITER_FOREACH(n, alis_buckets[b].head)
+				cand[i++] = ((const struct alis_entry *) n->data)->id;
+		}
+
+		(void) qsort(cand, ncand, sizeof *cand, &alis_id_compare);
+
+		*ids = cand;
+		*count = ncand;
+		return true;
+	}
+
+	return false;
+}
+
 static bool
 alis_parse_mode(struct sourceinfo *const restrict si, const char *restrict arg,
                 struct alis_query *const restrict query)
@@ -196,6 +727,14 @@ alis_parse_query(struct sourceinfo *const restrict si, const int parc, char **co
 				return false;
 			}
 		}
+		else if (strcasecmp(opt, "-continue") == 0)
+		{
+			if (! (arg = parv[i++]) || ! string_to_uint(arg, &query->resume))
+			{
+				(void) command_fail(si, fault_badparams, _("Invalid option for \2%s\2"), opt);
+				return false;
+			}
+		}
 		else if (strcasecmp(opt, "-topic") == 0)
 		{
 			if (! (arg = parv[i++]))
@@ -401,12 +940,22 @@ alis_cmd_list_func(struct sourceinfo *const restrict si, const int parc, char **
 		goto end;
 	}
 
-	struct channel *chptr;
-	mowgli_patricia_iteration_state_t state;
+	unsigned int *ids = NULL;
+	unsigned int count = 0;
+	const bool all = ! alis_query_candidates(&query, &ids, &count);
+
+	if (all)
+		count = alis_slots_used;
 
-	MOWGLI_PATRICIA_FOREACH(chptr, &state, chanlist)
+	for (unsigned int i = 0; i < count; i++)
 	{
-		if (! alis_show_channel(&query, chptr))
+		const unsigned int id = all ? i : ids[i];
+		const struct alis_entry *const e = alis_slots[id];
+
+		if (id < query.resume || ! e)
+			continue;
+
+		if (! alis_show_channel(&query, e->chan))
 			continue;
 
 		if (query.skip)
@@ -415,15 +964,18 @@ alis_cmd_list_func(struct sourceinfo *const restrict si, const int parc, char **
 			continue;
 		}
 
-		(void) alis_print_channel(si, &query, chptr);
+		(void) alis_print_channel(si, &query, e->chan);
 
 		if (--query.match_limit)
 			continue;
 
-		(void) command_success_nodata(si, _("Maximum channel output reached"));
+		(void) command_success_nodata(si, _("Maximum channel output reached; use \2-continue %u\2 to see more"),
+		                                    id + 1U);
 		break;
 	}
 
+	(void) sfree(ids);
+
 end:
 	(void) command_success_nodata(si, _("End of output."));
 
@@ -488,11 +1040,27 @@ mod_init(struct module *const restrict m)
 
 	(void) service_bind_command(alissvs, &alis_cmd_list);
 	(void) service_bind_command(alissvs, &alis_cmd_help);
+
+	(void) alis_index_init();
+
+	(void) hook_add_channel_add(&alis_hook_channel_add);
+	(void) hook_add_channel_delete(&alis_hook_channel_delete);
+	(void) hook_add_channel_topic(&alis_hook_channel_topic);
+	(void) hook_add_channel_join(&alis_hook_channel_join);
+	(void) hook_add_channel_part(&alis_hook_channel_part);
 }
 
 static void
 mod_deinit(const enum module_unload_intent ATHEME_VATTR_UNUSED intent)
 {
+	(void) hook_del_channel_add(&alis_hook_channel_add);
+	(void) hook_del_channel_delete(&alis_hook_channel_delete);
+	(void) hook_del_channel_topic(&alis_hook_channel_topic);
+	(void) hook_del_channel_join(&alis_hook_channel_join);
+	(void) hook_del_channel_part(&alis_hook_channel_part);
+
+	(void) alis_index_deinit();
+
 	(void) del_conf_item("MAXMATCHES", &alissvs->conf_table);
 	(void) service_delete(alissvs);
 }
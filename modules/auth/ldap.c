@@ -3,6 +3,7 @@
  * SPDX-URL: https://spdx.org/licenses/ISC.html
  *
  * Copyright (C) 2009 Atheme Project (http://atheme.org/)
+ * Copyright (C) 2026 Atheme Development Group (https://atheme.github.io/)
  *
  * LDAP authentication.
  */
@@ -23,6 +24,25 @@
  *   binddn    -- distinguished name to bind to for searching (optional)
  *   bindauth  -- password for the distinguished name
  *                (optional, must specify if binddn given)
+ *
+ * and optionally:
+ *
+ *   connections        -- number of connections to the server (default 2)
+ *   timeout            -- seconds to wait for the server (default 5; at most 1
+ *                         for the password checks that block services)
+ *   cache_time         -- seconds to remember a correct password (default 60)
+ *   negative_cache_time -- seconds to remember a wrong password (default 10)
+ *
+ * Logins (see verify_password_async()) are handled without blocking: each
+ * request is run as a series of asynchronous LDAP operations on one of the
+ * pooled connections, whose sockets are watched by the event loop; even
+ * connecting to the server does not wait. Other password checks still wait
+ * for the answer, on a connection of their own.
+ * Logins still waiting when services are rehashed are started again on the
+ * new connections.
+ *
+ * Results are cached by account name, with an HMAC of the password under a
+ * key that is generated at load time; passwords themselves are never kept.
  */
 
 #include <atheme.h>
@@ -31,6 +51,64 @@
 
 #include <ldap.h>
 
+#define LDAP_CONNECTIONS_DEF            2U
+#define LDAP_CONNECTIONS_MAX            16U
+#define LDAP_TIMEOUT_DEF                5U
+#define LDAP_SYNC_TIMEOUT_MAX           1U      // these stall services as a whole
+#define LDAP_CACHE_TIME_DEF             60U
+#define LDAP_NEGATIVE_CACHE_TIME_DEF    10U
+#define LDAP_CACHE_EXPIRE_INTERVAL      60
+
+enum ldap_auth_state
+{
+	LDAP_AUTH_BIND_SEARCH,  // binding as binddn (or anonymously) in order to search
+	LDAP_AUTH_SEARCH,       // searching for the entries of the user
+	LDAP_AUTH_BIND_USER,    // binding as the user to check their password
+};
+
+struct ldap_auth_req
+{
+	mowgli_node_t                   node;           // in ldap_queue while waiting for a connection
+	char                            name[NICKLEN + 1];
+	struct berval                   cred;
+	char **                         dns;            // entries found by the search
+	size_t                          ndns;
+	size_t                          curdn;
+	enum ldap_auth_state            state;
+	struct verify_password_req *    vreq;           // NULL if someone is blocking on this request
+	bool                            retried;        // already restarted after losing the connection
+	bool                            done;
+	bool                            verified;
+};
+
+struct ldap_pool_conn
+{
+	LDAP *                          ld;
+	mowgli_eventloop_pollable_t *   pollable;
+	struct ldap_auth_req *          req;            // request in progress, if any
+	int                             msgid;
+	time_t                          deadline;
+	bool                            blocking;       // driven by ldap_auth_user() rather than the event loop
+	bool                            connecting;     // waiting for the socket to become writable
+};
+
+// A connection that has been given up on, waiting for the event loop to let go of its socket
+struct ldap_dead_conn
+{
+	mowgli_node_t                   node;
+	LDAP *                          ld;
+	mowgli_eventloop_pollable_t *   pollable;
+	mowgli_eventloop_timer_t *      timer;
+};
+
+struct ldap_cache_entry
+{
+	char                            name[NICKLEN + 1];
+	unsigned char                   mac[DIGEST_MDLEN_SHA2_256];
+	time_t                          expires;
+	bool                            verified;
+};
+
 static struct
 {
 	char *url;
@@ -39,194 +117,872 @@ static struct
 	char *base;
 	char *binddn;
 	char *bindauth;
+	unsigned int connections;
+	unsigned int timeout;
+	unsigned int cache_time;
+	unsigned int negative_cache_time;
 	bool useDN;
+	bool valid;
 } ldap_config;
 
-static LDAP *ldap_conn;
+static struct ldap_pool_conn *ldap_pool = NULL;
+static unsigned int ldap_pool_size = 0;
+static struct ldap_pool_conn ldap_sync_conn;
+
+// Requests waiting for a pooled connection to become idle
+static mowgli_list_t ldap_queue = { NULL, NULL, 0 };
+static mowgli_list_t ldap_dead = { NULL, NULL, 0 };
+
+static mowgli_patricia_t *ldap_cache = NULL;
+static unsigned char ldap_cache_key[DIGEST_MDLEN_SHA2_256];
+
+static mowgli_eventloop_timer_t *ldap_timeout_timer = NULL;
+static mowgli_eventloop_timer_t *ldap_cache_timer = NULL;
 
 static mowgli_list_t conf_ldap_table;
 
+static void ldap_conn_start(struct ldap_pool_conn *conn, struct ldap_auth_req *req);
+
 static void
-ldap_config_ready(void *unused)
+ldap_warn(const char *const restrict what, const int res)
 {
-	int res;
-	char *p;
 	static time_t lastwarning;
 
-	if (ldap_conn != NULL)
-		ldap_unbind_ext_s(ldap_conn, NULL, NULL);
-	ldap_conn = NULL;
-	if (ldap_config.url == NULL)
+	(void) slog(LG_ERROR, "ldap: %s failed: %s", what, ldap_err2string(res));
+
+	if (CURRTIME > lastwarning + 300)
 	{
-		slog(LG_ERROR, "ldap_config_ready(): ldap {} missing url definition");
-		return;
+		(void) slog(LG_INFO, "LDAP:ERROR: \2%s\2", ldap_err2string(res));
+		(void) wallops("Problem with LDAP server: %s", ldap_err2string(res));
+
+		lastwarning = CURRTIME;
 	}
-	if ((ldap_config.dnformat == NULL) && ((ldap_config.base == NULL) || (ldap_config.attribute == NULL)))
+}
+
+static bool
+ldap_cache_mac(const char *const restrict password, unsigned char mac[const restrict DIGEST_MDLEN_SHA2_256])
+{
+	size_t maclen = DIGEST_MDLEN_SHA2_256;
+
+	return digest_oneshot_hmac(DIGALG_SHA2_256, ldap_cache_key, sizeof ldap_cache_key, password,
+	                           strlen(password), mac, &maclen);
+}
+
+// Returns true and sets *verified if there is a current answer for this account and password
+static bool
+ldap_cache_lookup(const char *const restrict name, const char *const restrict password, bool *const restrict verified)
+{
+	unsigned char mac[DIGEST_MDLEN_SHA2_256];
+	const struct ldap_cache_entry *const ce = mowgli_patricia_retrieve(ldap_cache, name);
+
+	if (! ce || ce->expires <= CURRTIME || ! ldap_cache_mac(password, mac))
+		return false;
+
+	const bool match = (smemcmp(mac, ce->mac, sizeof mac) == 0);
+
+	(void) smemzero(mac, sizeof mac);
+
+	if (! match)
+		return false;
+
+	*verified = ce->verified;
+
+	return true;
+}
+
+static void
+ldap_cache_store(const char *const restrict name, const char *const restrict password, const bool verified)
+{
+	const unsigned int ttl = verified ? ldap_config.cache_time : ldap_config.negative_cache_time;
+	struct ldap_cache_entry *ce = mowgli_patricia_retrieve(ldap_cache, name);
+
+	if (! ttl)
 	{
-		slog(LG_ERROR, "ldap_config_ready(): ldap {} block requires dnformat or base & attribute definition");
+		// A stale answer of the other kind must not outlive this one
+		if (ce)
+			(void) smemzerofree(mowgli_patricia_delete(ldap_cache, name), sizeof *ce);
+
 		return;
 	}
-	if (ldap_config.binddn != NULL && ldap_config.bindauth == NULL)
+
+	if (! ce)
 	{
-		slog(LG_ERROR, "ldap_config_ready(): ldap{} block requires bindauth to be defined if binddn is defined");
-		return;
+		ce = smalloc(sizeof *ce);
+
+		(void) mowgli_strlcpy(ce->name, name, sizeof ce->name);
+		(void) mowgli_patricia_add(ldap_cache, name, ce);
 	}
 
-	if (ldap_config.dnformat != NULL)
+	if (! ldap_cache_mac(password, ce->mac))
 	{
-		ldap_config.useDN = true;
-		p = strchr(ldap_config.dnformat, '%');
-		if (p == NULL || p[1] != 's' || strchr(p + 1, '%'))
-		{
-			slog(LG_ERROR, "ldap_config_ready(): dnformat must contain exactly one %%s and no other %%");
-			return;
-		}
+		(void) smemzerofree(mowgli_patricia_delete(ldap_cache, name), sizeof *ce);
+		return;
 	}
-	else
-		ldap_config.useDN = false;
 
-	ldap_set_option(NULL, LDAP_OPT_PROTOCOL_VERSION, &(const int)
-			{
-			3});
-	res = ldap_initialize(&ldap_conn, ldap_config.url);
-	if (res != LDAP_SUCCESS)
+	ce->expires = CURRTIME + (time_t) ttl;
+	ce->verified = verified;
+}
+
+static void
+ldap_cache_expire(void *const ATHEME_VATTR_UNUSED unused)
+{
+	mowgli_patricia_iteration_state_t state;
+	struct ldap_cache_entry *ce;
+
+	MOWGLI_PATRICIA_FOREACH(ce, &state, ldap_cache)
 	{
-		slog(LG_ERROR, "ldap_config_ready(): ldap_initialize(%s) failed: %s", ldap_config.url, ldap_err2string(res));
-		if (CURRTIME > lastwarning + 300)
-		{
-			slog(LG_INFO, "LDAP:ERROR: \2%s\2", ldap_err2string(res));
-			wallops("Problem with LDAP server: %s", ldap_err2string(res));
-			lastwarning = CURRTIME;
-		}
+		if (ce->expires > CURRTIME)
+			continue;
+
+		(void) mowgli_patricia_delete(ldap_cache, ce->name);
+		(void) smemzerofree(ce, sizeof *ce);
+	}
+}
+
+static void
+ldap_cache_free_cb(const char ATHEME_VATTR_UNUSED *const restrict key, void *const restrict data,
+                   void ATHEME_VATTR_UNUSED *const restrict privdata)
+{
+	(void) smemzerofree(data, sizeof(struct ldap_cache_entry));
+}
+
+static void
+ldap_cache_clear(void)
+{
+	(void) mowgli_patricia_destroy(ldap_cache, &ldap_cache_free_cb, NULL);
+
+	ldap_cache = mowgli_patricia_create(&irccasecanon);
+}
+
+static void
+ldap_req_free(struct ldap_auth_req *const restrict req)
+{
+	for (size_t i = 0; i < req->ndns; i++)
+		(void) sfree(req->dns[i]);
+
+	(void) sfree(req->dns);
+	(void) smemzerofree(req->cred.bv_val, req->cred.bv_len);
+	(void) sfree(req);
+}
+
+// Hands the answer to whoever asked; blocking requests are freed by ldap_auth_user()
+static void
+ldap_req_finish(struct ldap_auth_req *const restrict req, const bool verified, const bool cacheable)
+{
+	if (cacheable)
+		(void) ldap_cache_store(req->name, req->cred.bv_val, verified);
+
+	req->verified = verified;
+	req->done = true;
+
+	if (! req->vreq)
 		return;
+
+	(void) verify_password_complete(req->vreq, verified);
+	(void) ldap_req_free(req);
+}
+
+// The pollable must be gone before libldap closes the socket
+static void
+ldap_conn_reap(void *const restrict vdead)
+{
+	struct ldap_dead_conn *const dead = vdead;
+
+	(void) mowgli_node_delete(&dead->node, &ldap_dead);
+	(void) mowgli_pollable_destroy(base_eventloop, dead->pollable);
+	(void) ldap_unbind_ext(dead->ld, NULL, NULL);
+	(void) sfree(dead);
+}
+
+/* This may be called from the pollable's own callback, after which the event
+ * loop still looks at the pollable, so watched connections are closed from a
+ * timer instead.
+ */
+static void
+ldap_conn_close(struct ldap_pool_conn *const restrict conn)
+{
+	if (conn->pollable)
+	{
+		struct ldap_dead_conn *const dead = smalloc(sizeof *dead);
+
+		dead->ld = conn->ld;
+		dead->pollable = conn->pollable;
+		dead->timer = mowgli_timer_add_once(base_eventloop, "ldap_conn_reap", &ldap_conn_reap, dead, 0);
+
+		(void) mowgli_pollable_setselect(base_eventloop, conn->pollable, MOWGLI_EVENTLOOP_IO_READ, NULL);
+		(void) mowgli_pollable_setselect(base_eventloop, conn->pollable, MOWGLI_EVENTLOOP_IO_WRITE, NULL);
+		(void) mowgli_node_add(dead, &dead->node, &ldap_dead);
 	}
+	else if (conn->ld)
+		(void) ldap_unbind_ext(conn->ld, NULL, NULL);
+
+	conn->pollable = NULL;
+	conn->ld = NULL;
+	conn->connecting = false;
+}
 
-	// short timeouts, because this blocks atheme as a whole
-	ldap_set_option(ldap_conn, LDAP_OPT_TIMEOUT, &(const struct timeval){1, 0});
-	ldap_set_option(ldap_conn, LDAP_OPT_NETWORK_TIMEOUT, &(const struct timeval){1, 0});
-	ldap_set_option(ldap_conn, LDAP_OPT_DEREF, &(const int){false});
-	ldap_set_option(ldap_conn, LDAP_OPT_REFERRALS, &(const int){false});
+static unsigned int
+ldap_conn_timeout(const struct ldap_pool_conn *const restrict conn)
+{
+	if (conn->blocking)
+		return MIN(ldap_config.timeout, LDAP_SYNC_TIMEOUT_MAX);
+
+	return ldap_config.timeout;
 }
 
 static bool
-ldap_auth_user(struct myuser *mu, const char *password)
+ldap_conn_open(struct ldap_pool_conn *const restrict conn)
 {
+	if (conn->ld)
+		return true;
+
+	const struct timeval timeout = { (time_t) ldap_conn_timeout(conn), 0 };
 	int res;
-	struct berval cred;
-	LDAPMessage *message, *entry;
 
-	if (ldap_conn == NULL)
+	if ((res = ldap_initialize(&conn->ld, ldap_config.url)) != LDAP_SUCCESS)
 	{
-		ldap_config_ready(NULL);
-	}
-	if (ldap_conn == NULL)
-	{
-		slog(LG_INFO, "ldap_auth_user(): no connection");
+		(void) ldap_warn("ldap_initialize()", res);
+
+		conn->ld = NULL;
 		return false;
 	}
 
-	if (strchr(entity(mu)->name, ' '))
+	(void) ldap_set_option(conn->ld, LDAP_OPT_PROTOCOL_VERSION, &(const int){3});
+	(void) ldap_set_option(conn->ld, LDAP_OPT_TIMEOUT, &timeout);
+	(void) ldap_set_option(conn->ld, LDAP_OPT_NETWORK_TIMEOUT, &timeout);
+	(void) ldap_set_option(conn->ld, LDAP_OPT_DEREF, &(const int){false});
+	(void) ldap_set_option(conn->ld, LDAP_OPT_REFERRALS, &(const int){false});
+
+#ifdef LDAP_OPT_CONNECT_ASYNC
+	// Otherwise the first operation on the connection waits for connect() to finish
+	if (! conn->blocking)
+		(void) ldap_set_option(conn->ld, LDAP_OPT_CONNECT_ASYNC, LDAP_OPT_ON);
+#endif
+
+	return true;
+}
+
+static void ldap_conn_readable(mowgli_eventloop_t *, mowgli_eventloop_io_t *, mowgli_eventloop_io_dir_t, void *);
+static void ldap_conn_writable(mowgli_eventloop_t *, mowgli_eventloop_io_t *, mowgli_eventloop_io_dir_t, void *);
+
+/* libldap only has a socket once it has tried to send the first operation.
+ * While it is still connecting, only writability (connect() having finished,
+ * one way or the other) is of interest.
+ */
+static void
+ldap_conn_watch(struct ldap_pool_conn *const restrict conn)
+{
+	int fd = -1;
+
+	if (conn->blocking)
+		return;
+
+	if (! conn->pollable)
 	{
-		slog(LG_INFO, "ldap_auth_user(%s): bad name: found space", entity(mu)->name);
-		return false;
+		if (ldap_get_option(conn->ld, LDAP_OPT_DESC, &fd) != LDAP_OPT_SUCCESS || fd < 0)
+			return;
+
+		conn->pollable = mowgli_pollable_create(base_eventloop, fd, conn);
 	}
-	if (strchr(entity(mu)->name, ','))
+
+	if (conn->connecting)
 	{
-		slog(LG_INFO, "ldap_auth_user(%s): bad name: found comma", entity(mu)->name);
-		return false;
+		(void) mowgli_pollable_setselect(base_eventloop, conn->pollable, MOWGLI_EVENTLOOP_IO_READ, NULL);
+		(void) mowgli_pollable_setselect(base_eventloop, conn->pollable, MOWGLI_EVENTLOOP_IO_WRITE,
+		                                 &ldap_conn_writable);
 	}
-	if (strchr(entity(mu)->name, '/'))
+	else
 	{
-		slog(LG_INFO, "ldap_auth_user(%s): bad name: found /", entity(mu)->name);
-		return false;
+		(void) mowgli_pollable_setselect(base_eventloop, conn->pollable, MOWGLI_EVENTLOOP_IO_WRITE, NULL);
+		(void) mowgli_pollable_setselect(base_eventloop, conn->pollable, MOWGLI_EVENTLOOP_IO_READ,
+		                                 &ldap_conn_readable);
 	}
+}
 
-	if (ldap_config.useDN)
+// Sends the operation for the current state of the request
+static int
+ldap_conn_send(struct ldap_pool_conn *const restrict conn)
+{
+	struct ldap_auth_req *const req = conn->req;
+	struct timeval timeout = { (time_t) ldap_conn_timeout(conn), 0 };
+	char dn[512];
+	char filter[512];
+	int res = LDAP_SUCCESS;
+
+	switch (req->state)
 	{
-		// Use DN to find exact match
-		char dn[512];
-		cred.bv_len = strlen(password);
+		case LDAP_AUTH_BIND_SEARCH:
+		{
+			struct berval cred = { 0, NULL };
+
+			if (ldap_config.binddn)
+			{
+				cred.bv_val = ldap_config.bindauth;
+				cred.bv_len = strlen(ldap_config.bindauth);
+			}
 
-		// sstrdup it to remove the const
-		cred.bv_val = sstrdup(password);
+			res = ldap_sasl_bind(conn->ld, ldap_config.binddn, LDAP_SASL_SIMPLE, &cred, NULL, NULL,
+			                     &conn->msgid);
+			break;
+		}
 
-		snprintf(dn, sizeof dn, ldap_config.dnformat, entity(mu)->name);
-		res = ldap_sasl_bind_s(ldap_conn, dn, LDAP_SASL_SIMPLE, &cred, NULL, NULL, NULL);
-		if (res == LDAP_SERVER_DOWN)
+		case LDAP_AUTH_SEARCH:
 		{
-			ldap_config_ready(NULL);
-			res = ldap_sasl_bind_s(ldap_conn, dn, LDAP_SASL_SIMPLE, &cred, NULL, NULL, NULL);
+			char *attrs[] = { LDAP_NO_ATTRS, NULL };
+
+			(void) snprintf(filter, sizeof filter, "%s=%s", ldap_config.attribute, req->name);
+
+			res = ldap_search_ext(conn->ld, ldap_config.base, LDAP_SCOPE_SUBTREE, filter, attrs, 0, NULL,
+			                      NULL, &timeout, 0, &conn->msgid);
+			break;
 		}
-		if (res == LDAP_SUCCESS)
-			return true;
-		else if (res == LDAP_INVALID_CREDENTIALS)
+
+		case LDAP_AUTH_BIND_USER:
 		{
-			slog(LG_INFO, "ldap_auth_user(%s): ldap auth bind failed: %s", entity(mu)->name, ldap_err2string(res));
-			return false;
+			const char *userdn = dn;
+
+			if (ldap_config.useDN)
+				(void) snprintf(dn, sizeof dn, ldap_config.dnformat, req->name);
+			else
+				userdn = req->dns[req->curdn];
+
+			res = ldap_sasl_bind(conn->ld, userdn, LDAP_SASL_SIMPLE, &req->cred, NULL, NULL, &conn->msgid);
+			break;
 		}
-		slog(LG_INFO, "ldap_auth_user(): ldap_bind_s failed: %s", ldap_err2string(res));
-		return false;
 	}
+
+#ifdef LDAP_X_CONNECTING
+	// Nothing was sent; the operation is sent again once the connection is up
+	conn->connecting = (res == LDAP_X_CONNECTING);
+
+	if (conn->connecting)
+		res = LDAP_SUCCESS;
+#endif
+
+	if (res == LDAP_SUCCESS)
+	{
+		conn->deadline = CURRTIME + (time_t) ldap_conn_timeout(conn);
+
+		(void) ldap_conn_watch(conn);
+	}
+
+	return res;
+}
+
+// The server went away; the request is tried once more on a fresh connection
+static void
+ldap_conn_lost(struct ldap_pool_conn *const restrict conn, const int res)
+{
+	struct ldap_auth_req *const req = conn->req;
+
+	(void) ldap_warn("connection", res);
+	(void) ldap_conn_close(conn);
+
+	conn->req = NULL;
+
+	if (! req)
+		return;
+
+	if (req->retried)
+	{
+		(void) ldap_req_finish(req, false, false);
+		return;
+	}
+
+	req->retried = true;
+
+	(void) ldap_conn_start(conn, req);
+}
+
+// Moves the request on after an operation has succeeded; returns false when the request is over
+static bool
+ldap_conn_advance(struct ldap_pool_conn *const restrict conn)
+{
+	int res;
+
+	if ((res = ldap_conn_send(conn)) == LDAP_SUCCESS)
+		return true;
+
+	if (res == LDAP_SERVER_DOWN || res == LDAP_CONNECT_ERROR)
+		(void) ldap_conn_lost(conn, res);
 	else
 	{
-		// Use base + attribute search for Auth
-		char what[512];
-		char *binddn = NULL;
+		(void) slog(LG_INFO, "ldap_auth_user(%s): cannot send request: %s", conn->req->name,
+		            ldap_err2string(res));
+		(void) ldap_req_finish(conn->req, false, false);
 
-		cred.bv_len = 0;
+		conn->req = NULL;
+	}
 
-		if (ldap_config.binddn != NULL && ldap_config.bindauth != NULL)
-		{
-			binddn = ldap_config.binddn;
-			cred.bv_val = ldap_config.bindauth;
-			cred.bv_len = strlen(ldap_config.bindauth);
-		}
+	return false;
+}
 
-		res = ldap_sasl_bind_s(ldap_conn, binddn, LDAP_SASL_SIMPLE, &cred, NULL, NULL, NULL);
-		if (res == LDAP_SERVER_DOWN)
-		{
-			ldap_config_ready(NULL);
-			res = ldap_sasl_bind_s(ldap_conn, binddn, LDAP_SASL_SIMPLE, &cred, NULL, NULL, NULL);
-		}
-		if (res != LDAP_SUCCESS)
-		{
-			slog(LG_INFO, "ldap_auth_user(): ldap_bind_s failed: %s", ldap_err2string(res));
-			return false;
-		}
+static void
+ldap_conn_result(struct ldap_pool_conn *const restrict conn, LDAPMessage *const restrict msg)
+{
+	struct ldap_auth_req *const req = conn->req;
+	int res = LDAP_OTHER;
 
-		sprintf(what, "%s=%s", ldap_config.attribute, entity(mu)->name);
-		if ((res = ldap_search_ext_s(ldap_conn, ldap_config.base, LDAP_SCOPE_SUBTREE, what, NULL, 0, NULL, NULL, NULL, 0, &message)) != LDAP_SUCCESS)
+	if (req->state == LDAP_AUTH_SEARCH)
+	{
+		for (LDAPMessage *entry = ldap_first_entry(conn->ld, msg); entry; entry = ldap_next_entry(conn->ld, entry))
 		{
-			slog(LG_INFO, "ldap_auth_user(%s): ldap search failed: %s", entity(mu)->name, ldap_err2string(res));
-			return false;
+			char *const dn = ldap_get_dn(conn->ld, entry);
+
+			if (! dn)
+				continue;
+
+			req->dns = srealloc(req->dns, (req->ndns + 1) * sizeof *req->dns);
+			req->dns[req->ndns++] = sstrdup(dn);
+
+			(void) ldap_memfree(dn);
 		}
+	}
 
-		cred.bv_len = strlen(password);
+	if (ldap_parse_result(conn->ld, msg, &res, NULL, NULL, NULL, NULL, 1) != LDAP_SUCCESS)
+		res = LDAP_OTHER;
 
-		// sstrdup it to remove the const
-		cred.bv_val = sstrdup(password);
+	switch (req->state)
+	{
+		case LDAP_AUTH_BIND_SEARCH:
+			if (res != LDAP_SUCCESS)
+			{
+				(void) slog(LG_INFO, "ldap_auth_user(): ldap bind failed: %s", ldap_err2string(res));
+				break;
+			}
 
-		for (entry = ldap_first_message(ldap_conn, message); entry && ldap_msgtype(entry) == LDAP_RES_SEARCH_ENTRY; entry = ldap_next_message(ldap_conn, entry))
-		{
+			req->state = LDAP_AUTH_SEARCH;
+
+			(void) ldap_conn_advance(conn);
+			return;
 
-			res = ldap_sasl_bind_s(ldap_conn, ldap_get_dn(ldap_conn, entry), LDAP_SASL_SIMPLE, &cred, NULL, NULL, NULL);
+		case LDAP_AUTH_SEARCH:
+			if (res != LDAP_SUCCESS && ! req->ndns)
+			{
+				(void) slog(LG_INFO, "ldap_auth_user(%s): ldap search failed: %s", req->name,
+				            ldap_err2string(res));
+				break;
+			}
+
+			if (! req->ndns)
+			{
+				(void) slog(LG_INFO, "ldap_auth_user(%s): no such entry", req->name);
+				(void) ldap_req_finish(req, false, true);
+
+				conn->req = NULL;
+				return;
+			}
+
+			req->state = LDAP_AUTH_BIND_USER;
+			req->curdn = 0;
+
+			(void) ldap_conn_advance(conn);
+			return;
+
+		case LDAP_AUTH_BIND_USER:
 			if (res == LDAP_SUCCESS)
 			{
-				ldap_msgfree(message);
-				return true;
+				(void) ldap_req_finish(req, true, true);
+
+				conn->req = NULL;
+				return;
+			}
+
+			if (res == LDAP_INVALID_CREDENTIALS && ++req->curdn < req->ndns)
+			{
+				(void) ldap_conn_advance(conn);
+				return;
 			}
+
+			(void) slog(LG_INFO, "ldap_auth_user(%s): ldap auth bind failed: %s", req->name,
+			            ldap_err2string(res));
+
+			if (res == LDAP_INVALID_CREDENTIALS)
+			{
+				(void) ldap_req_finish(req, false, true);
+
+				conn->req = NULL;
+				return;
+			}
+
+			break;
+	}
+
+	(void) ldap_req_finish(req, false, false);
+
+	conn->req = NULL;
+}
+
+/* Collects whatever answers have arrived without waiting, or waits up to
+ * 'wait' for one. Returns false if the wait ran out without an answer.
+ */
+static bool
+ldap_conn_poll(struct ldap_pool_conn *const restrict conn, struct timeval *const restrict wait)
+{
+	struct timeval zero = { 0, 0 };
+
+	while (conn->req)
+	{
+		LDAPMessage *msg = NULL;
+		const int type = ldap_result(conn->ld, conn->msgid, LDAP_MSG_ALL, wait ? wait : &zero, &msg);
+
+		if (type == 0)
+			return false;
+
+		if (type == -1)
+		{
+			int res = LDAP_SERVER_DOWN;
+
+			(void) ldap_get_option(conn->ld, LDAP_OPT_RESULT_CODE, &res);
+			(void) ldap_conn_lost(conn, res);
 		}
+		else
+			(void) ldap_conn_result(conn, msg);
 
-		ldap_msgfree(message);
+		if (wait)
+			break;
 	}
 
-	slog(LG_INFO, "ldap_auth_user(%s): ldap auth bind failed: %s", entity(mu)->name, ldap_err2string(res));
-	return false;
+	return true;
+}
+
+static void
+ldap_dispatch(void)
+{
+	for (unsigned int i = 0; i < ldap_pool_size && ldap_queue.head; i++)
+	{
+		struct ldap_pool_conn *const conn = &ldap_pool[i];
+
+		if (conn->req)
+			continue;
+
+		struct ldap_auth_req *const req = ldap_queue.head->data;
+
+		(void) mowgli_node_delete(&req->node, &ldap_queue);
+		(void) ldap_conn_start(conn, req);
+	}
+}
+
+static void
+ldap_conn_readable(mowgli_eventloop_t ATHEME_VATTR_UNUSED *const restrict eventloop,
+                   mowgli_eventloop_io_t ATHEME_VATTR_UNUSED *const restrict io,
+                   const mowgli_eventloop_io_dir_t ATHEME_VATTR_UNUSED dir, void *const restrict userdata)
+{
+	struct ldap_pool_conn *const conn = userdata;
+
+	if (! conn->req)
+	{
+		// Nothing is outstanding, so this is the server closing an idle connection
+		(void) ldap_conn_close(conn);
+		return;
+	}
+
+	(void) ldap_conn_poll(conn, NULL);
+	(void) ldap_dispatch();
+}
+
+// connect() has finished; libldap tells whether it worked when the operation is sent again
+static void
+ldap_conn_writable(mowgli_eventloop_t ATHEME_VATTR_UNUSED *const restrict eventloop,
+                   mowgli_eventloop_io_t ATHEME_VATTR_UNUSED *const restrict io,
+                   const mowgli_eventloop_io_dir_t ATHEME_VATTR_UNUSED dir, void *const restrict userdata)
+{
+	struct ldap_pool_conn *const conn = userdata;
+
+	conn->connecting = false;
+
+	if (! conn->req)
+	{
+		(void) ldap_conn_watch(conn);
+		return;
+	}
+
+	(void) ldap_conn_advance(conn);
+	(void) ldap_dispatch();
+}
+
+static void
+ldap_conn_start(struct ldap_pool_conn *const restrict conn, struct ldap_auth_req *const restrict req)
+{
+	if (! ldap_conn_open(conn))
+	{
+		(void) ldap_req_finish(req, false, false);
+		return;
+	}
+
+	conn->req = req;
+
+	req->state = ldap_config.useDN ? LDAP_AUTH_BIND_USER : LDAP_AUTH_BIND_SEARCH;
+	req->curdn = 0;
+
+	(void) ldap_conn_advance(conn);
+}
+
+// Also collects answers that libldap had already read, which do not make the socket readable again
+static void
+ldap_timeout_check(void *const ATHEME_VATTR_UNUSED unused)
+{
+	for (unsigned int i = 0; i < ldap_pool_size; i++)
+	{
+		struct ldap_pool_conn *const conn = &ldap_pool[i];
+
+		if (! conn->req)
+			continue;
+
+		if (! conn->connecting)
+			(void) ldap_conn_poll(conn, NULL);
+
+		if (! conn->req || conn->deadline > CURRTIME)
+			continue;
+
+		(void) slog(LG_INFO, "ldap_auth_user(%s): no answer from the server after %u seconds",
+		            conn->req->name, ldap_config.timeout);
+
+		if (! conn->connecting)
+			(void) ldap_abandon_ext(conn->ld, conn->msgid, NULL, NULL);
+
+		(void) ldap_req_finish(conn->req, false, false);
+
+		conn->req = NULL;
+
+		// A server this slow may well be gone; start afresh for the next request
+		(void) ldap_conn_close(conn);
+	}
+
+	(void) ldap_dispatch();
+}
+
+static struct ldap_auth_req *
+ldap_req_create(const struct myuser *const restrict mu, const char *const restrict password)
+{
+	const char *const name = entity(mu)->name;
+
+	if (strchr(name, ' '))
+	{
+		(void) slog(LG_INFO, "ldap_auth_user(%s): bad name: found space", name);
+		return NULL;
+	}
+	if (strchr(name, ','))
+	{
+		(void) slog(LG_INFO, "ldap_auth_user(%s): bad name: found comma", name);
+		return NULL;
+	}
+	if (strchr(name, '/'))
+	{
+		(void) slog(LG_INFO, "ldap_auth_user(%s): bad name: found /", name);
+		return NULL;
+	}
+
+	struct ldap_auth_req *const req = smalloc(sizeof *req);
+
+	(void) mowgli_strlcpy(req->name, name, sizeof req->name);
+
+	req->cred.bv_len = strlen(password);
+	req->cred.bv_val = sstrdup(password);
+
+	return req;
+}
+
+/* Takes the requests in progress off their connections, puts them back at the
+ * front of the queue as if they had not been started, and closes every
+ * connection. Used when the configuration changes, so that those requests
+ * are sent again as it is now configured, rather than failed as if the
+ * password had been wrong.
+ */
+static void
+ldap_requeue_all(void)
+{
+	for (unsigned int i = ldap_pool_size; i--; )
+	{
+		struct ldap_pool_conn *const conn = &ldap_pool[i];
+		struct ldap_auth_req *const req = conn->req;
+
+		conn->req = NULL;
+
+		(void) ldap_conn_close(conn);
+
+		if (! req)
+			continue;
+
+		for (size_t j = 0; j < req->ndns; j++)
+			(void) sfree(req->dns[j]);
+
+		(void) sfree(req->dns);
+
+		req->dns = NULL;
+		req->ndns = 0;
+		req->retried = false;
+
+		(void) mowgli_node_add_head(req, &req->node, &ldap_queue);
+	}
+}
+
+// Fails every request, both queued and in progress; used when the configuration is unusable or on unload
+static void
+ldap_fail_all(void)
+{
+	mowgli_node_t *n, *tn;
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, ldap_queue.head)
+	{
+		struct ldap_auth_req *const req = n->data;
+
+		(void) mowgli_node_delete(&req->node, &ldap_queue);
+		(void) ldap_req_finish(req, false, false);
+	}
+
+	for (unsigned int i = 0; i < ldap_pool_size; i++)
+	{
+		struct ldap_pool_conn *const conn = &ldap_pool[i];
+
+		if (conn->req)
+			(void) ldap_req_finish(conn->req, false, false);
+
+		conn->req = NULL;
+
+		(void) ldap_conn_close(conn);
+	}
+}
+
+static void
+ldap_config_ready(void ATHEME_VATTR_UNUSED *const restrict unused)
+{
+	char *p;
+
+	(void) ldap_requeue_all();
+	(void) ldap_conn_close(&ldap_sync_conn);
+	(void) ldap_cache_clear();
+	(void) sfree(ldap_pool);
+
+	ldap_pool = NULL;
+	ldap_pool_size = 0;
+	ldap_config.valid = false;
+
+	if (ldap_config.url == NULL)
+	{
+		slog(LG_ERROR, "ldap_config_ready(): ldap {} missing url definition");
+		goto invalid;
+	}
+	if ((ldap_config.dnformat == NULL) && ((ldap_config.base == NULL) || (ldap_config.attribute == NULL)))
+	{
+		slog(LG_ERROR, "ldap_config_ready(): ldap {} block requires dnformat or base & attribute definition");
+		goto invalid;
+	}
+	if (ldap_config.binddn != NULL && ldap_config.bindauth == NULL)
+	{
+		slog(LG_ERROR, "ldap_config_ready(): ldap{} block requires bindauth to be defined if binddn is defined");
+		goto invalid;
+	}
+
+	if (ldap_config.dnformat != NULL)
+	{
+		ldap_config.useDN = true;
+		p = strchr(ldap_config.dnformat, '%');
+		if (p == NULL || p[1] != 's' || strchr(p + 1, '%'))
+		{
+			slog(LG_ERROR, "ldap_config_ready(): dnformat must contain exactly one %%s and no other %%");
+			goto invalid;
+		}
+	}
+	else
+		ldap_config.useDN = false;
+
+	ldap_pool_size = ldap_config.connections;
+	ldap_pool = smalloc(ldap_pool_size * sizeof *ldap_pool);
+	ldap_config.valid = true;
+
+	(void) ldap_conn_open(&ldap_sync_conn);
+	(void) ldap_dispatch();
+	return;
+
+invalid:
+	// Nothing can be verified with this configuration, so the requests that were waiting cannot be either
+	(void) ldap_fail_all();
+}
+
+static bool
+ldap_auth_user(struct myuser *mu, const char *password)
+{
+	struct ldap_auth_req *req;
+	bool verified = false;
+
+	if (! ldap_config.valid)
+	{
+		slog(LG_INFO, "ldap_auth_user(): no connection");
+		return false;
+	}
+
+	if (ldap_cache_lookup(entity(mu)->name, password, &verified))
+		return verified;
+
+	if (! (req = ldap_req_create(mu, password)))
+		return false;
+
+	(void) ldap_conn_start(&ldap_sync_conn, req);
+
+	while (! req->done)
+	{
+		struct timeval wait = { (time_t) ldap_conn_timeout(&ldap_sync_conn), 0 };
+
+		if (ldap_conn_poll(&ldap_sync_conn, &wait))
+			continue;
+
+		(void) slog(LG_INFO, "ldap_auth_user(%s): no answer from the server after %u seconds", req->name,
+		            ldap_conn_timeout(&ldap_sync_conn));
+		(void) ldap_abandon_ext(ldap_sync_conn.ld, ldap_sync_conn.msgid, NULL, NULL);
+		(void) ldap_req_finish(req, false, false);
+		(void) ldap_conn_close(&ldap_sync_conn);
+
+		ldap_sync_conn.req = NULL;
+	}
+
+	verified = req->verified;
+
+	(void) ldap_req_free(req);
+
+	return verified;
+}
+
+static void
+ldap_auth_user_async(struct myuser *const restrict mu, const char *const restrict password,
+                     struct verify_password_req *const restrict vreq)
+{
+	struct ldap_auth_req *req;
+	bool verified = false;
+
+	if (! ldap_config.valid)
+	{
+		(void) slog(LG_INFO, "ldap_auth_user(): no connection");
+		(void) verify_password_complete(vreq, false);
+		return;
+	}
+
+	if (ldap_cache_lookup(entity(mu)->name, password, &verified))
+	{
+		(void) verify_password_complete(vreq, verified);
+		return;
+	}
+
+	if (! (req = ldap_req_create(mu, password)))
+	{
+		(void) verify_password_complete(vreq, false);
+		return;
+	}
+
+	req->vreq = vreq;
+
+	(void) mowgli_node_add(req, &req->node, &ldap_queue);
+	(void) ldap_dispatch();
 }
 
 static void
 mod_init(struct module ATHEME_VATTR_UNUSED *const restrict m)
 {
+	(void) atheme_random_buf(ldap_cache_key, sizeof ldap_cache_key);
+
+	ldap_cache = mowgli_patricia_create(&irccasecanon);
+	ldap_sync_conn.blocking = true;
+
 	hook_add_config_ready(ldap_config_ready);
 
 	add_subblock_top_conf("LDAP", &conf_ldap_table);
@@ -236,8 +992,20 @@ mod_init(struct module ATHEME_VATTR_UNUSED *const restrict m)
 	add_dupstr_conf_item("ATTRIBUTE", &conf_ldap_table, 0, &ldap_config.attribute, NULL);
 	add_dupstr_conf_item("BINDDN", &conf_ldap_table, 0, &ldap_config.binddn, NULL);
 	add_dupstr_conf_item("BINDAUTH", &conf_ldap_table, 0, &ldap_config.bindauth, NULL);
+	add_uint_conf_item("CONNECTIONS", &conf_ldap_table, 0, &ldap_config.connections, 1, LDAP_CONNECTIONS_MAX,
+	                   LDAP_CONNECTIONS_DEF);
+	add_duration_conf_item("TIMEOUT", &conf_ldap_table, 0, &ldap_config.timeout, "s", LDAP_TIMEOUT_DEF);
+	add_duration_conf_item("CACHE_TIME", &conf_ldap_table, 0, &ldap_config.cache_time, "s",
+	                       LDAP_CACHE_TIME_DEF);
+	add_duration_conf_item("NEGATIVE_CACHE_TIME", &conf_ldap_table, 0, &ldap_config.negative_cache_time, "s",
+	                       LDAP_NEGATIVE_CACHE_TIME_DEF);
+
+	ldap_timeout_timer = mowgli_timer_add(base_eventloop, "ldap_timeout_check", &ldap_timeout_check, NULL, 1);
+	ldap_cache_timer = mowgli_timer_add(base_eventloop, "ldap_cache_expire", &ldap_cache_expire, NULL,
+	                                    LDAP_CACHE_EXPIRE_INTERVAL);
 
 	auth_user_custom = &ldap_auth_user;
+	auth_user_custom_async = &ldap_auth_user_async;
 
 	auth_module_loaded = true;
 }
@@ -246,11 +1014,29 @@ static void
 mod_deinit(const enum module_unload_intent ATHEME_VATTR_UNUSED intent)
 {
 	auth_user_custom = NULL;
+	auth_user_custom_async = NULL;
 
 	auth_module_loaded = false;
 
-	if (ldap_conn != NULL)
-		ldap_unbind_ext_s(ldap_conn, NULL, NULL);
+	(void) mowgli_timer_destroy(base_eventloop, ldap_timeout_timer);
+	(void) mowgli_timer_destroy(base_eventloop, ldap_cache_timer);
+
+	(void) ldap_fail_all();
+	(void) ldap_conn_close(&ldap_sync_conn);
+	(void) sfree(ldap_pool);
+
+	mowgli_node_t *n, *tn;
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, ldap_dead.head)
+	{
+		struct ldap_dead_conn *const dead = n->data;
+
+		(void) mowgli_timer_destroy(base_eventloop, dead->timer);
+		(void) ldap_conn_reap(dead);
+	}
+
+	(void) mowgli_patricia_destroy(ldap_cache, &ldap_cache_free_cb, NULL);
+	(void) smemzero(ldap_cache_key, sizeof ldap_cache_key);
 
 	hook_del_config_ready(ldap_config_ready);
 	del_conf_item("URL", &conf_ldap_table);
@@ -259,6 +1045,10 @@ mod_deinit(const enum module_unload_intent ATHEME_VATTR_UNUSED intent)
 	del_conf_item("ATTRIBUTE", &conf_ldap_table);
 	del_conf_item("BINDDN", &conf_ldap_table);
 	del_conf_item("BINDAUTH", &conf_ldap_table);
+	del_conf_item("CONNECTIONS", &conf_ldap_table);
+	del_conf_item("TIMEOUT", &conf_ldap_table);
+	del_conf_item("CACHE_TIME", &conf_ldap_table);
+	del_conf_item("NEGATIVE_CACHE_TIME", &conf_ldap_table);
 	del_top_conf("LDAP");
 }
 
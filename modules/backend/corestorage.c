@@ -34,24 +34,51 @@ static bool mdep_load_mdeps = true;
 static pid_t child_pid;
 #endif
 
-// write atheme.db (core fields)
+// Time the event loop may spend serialising per turn, and how often to check it
+#define BGSAVE_SLICE_MS         10
+#define BGSAVE_CHECK_INTERVAL   64
+
+/* Restarts caused by accounts or channels being added or removed mid-save,
+ * after which the save is handed to a child process instead
+ */
+#define BGSAVE_MAX_RESTARTS     3
+
+enum corestorage_bgsave_phase
+{
+	BGSAVE_MYUSERS,
+	BGSAVE_MYCHANS,
+	BGSAVE_TRAILER,
+	BGSAVE_DONE,
+};
+
+struct corestorage_bgsave
+{
+	struct database_arena *                 arena;
+	struct database_handle *                db;
+	mowgli_eventloop_timer_t *              timer;
+	struct myentity_iteration_state         mestate;
+	mowgli_patricia_iteration_state_t       mcstate;
+	enum corestorage_bgsave_phase           phase;
+	unsigned int                            generation;
+	unsigned int                            restarts;
+	unsigned int                            slices;
+	unsigned long long                      usec;   // event loop time taken by the slices
+	int                                     error;
+	char *                                  filename;       // as given to db_save(), or NULL
+	char                                    path[BUFSIZE];
+};
+
+static struct corestorage_bgsave *bgsave = NULL;
+static struct threadpool *bgsave_writer = NULL;
+
+#ifdef HAVE_FORK
+static void corestorage_db_write_fork(void *filename);
+#endif
+
 static void
-corestorage_db_save(struct database_handle *db)
+corestorage_db_save_header(struct database_handle *db)
 {
-	struct metadata *md;
-	struct myuser *mu;
-	struct myentity *ment;
-	struct myuser_name *mun;
-	struct mychan *mc;
-	struct chanacs *ca;
-	struct kline *k;
-	struct xline *x;
-	struct qline *q;
-	struct svsignore *svsignore;
-	struct soper *soper;
-	mowgli_node_t *n, *tn;
-	mowgli_patricia_iteration_state_t state;
-	struct myentity_iteration_state mestate;
+	mowgli_node_t *n;
 
 	errno = 0;
 
@@ -83,177 +110,194 @@ corestorage_db_save(struct database_handle *db)
 	db_start_row(db, "TS");
 	db_write_time(db, CURRTIME);
 	db_commit_row(db);
+}
 
-	slog(LG_DEBUG, "db_save(): saving myusers");
+struct corestorage_memo_writer
+{
+	struct database_handle *db;
+	struct myuser *mu;
+};
 
-	MYENTITY_FOREACH_T(ment, &mestate, ENT_USER)
-	{
-		mu = user(ment);
-		/* MU <name> <pass> <email> <registered> <lastlogin> <failnum*> <lastfail*>
-		 * <lastfailon*> <flags> <language>
-		 *
-		 *  * failnum, lastfail, and lastfailon are deprecated (moved to metadata)
-		 */
-		char *flags = gflags_tostr(mu_flags, MOWGLI_LIST_LENGTH(&mu->logins) ? mu->flags & ~MU_NOBURSTLOGIN : mu->flags);
-		db_start_row(db, "MU");
-		db_write_word(db, entity(mu)->id);
-		db_write_word(db, entity(mu)->name);
-		db_write_word(db, mu->pass);
-		db_write_word(db, mu->email);
-		db_write_time(db, mu->registered);
+static void
+corestorage_db_save_memo(const struct mymemo *mz, void *vmw)
+{
+	const struct corestorage_memo_writer *mw = vmw;
+	struct database_handle *db = mw->db;
+	struct myuser *mu = mw->mu;
+
+	db_start_row(db, "ME");
+	db_write_word(db, entity(mu)->name);
+	db_write_word(db, mz->sender);
+	db_write_time(db, mz->sent);
+	db_write_uint(db, mz->status);
+	db_write_str(db, mz->text);
+	db_commit_row(db);
+}
 
-		if (MOWGLI_LIST_LENGTH(&mu->logins))
-			db_write_time(db, 0);
-		else
-			db_write_time(db, mu->lastlogin);
+static void
+corestorage_db_save_myuser(struct database_handle *db, struct myuser *mu)
+{
+	struct metadata *md;
+	mowgli_node_t *tn;
+	mowgli_patricia_iteration_state_t state;
 
-		db_write_word(db, flags);
-		db_write_word(db, language_get_name(mu->language));
-		db_commit_row(db);
+	/* MU <name> <pass> <email> <registered> <lastlogin> <failnum*> <lastfail*>
+	 * <lastfailon*> <flags> <language>
+	 *
+	 *  * failnum, lastfail, and lastfailon are deprecated (moved to metadata)
+	 */
+	const char *flags = gflags_tostr_cached(mu_flags, MOWGLI_LIST_LENGTH(&mu->logins) ? mu->flags & ~MU_NOBURSTLOGIN : mu->flags);
+	db_start_row(db, "MU");
+	db_write_word(db, entity(mu)->id);
+	db_write_word(db, entity(mu)->name);
+	db_write_word(db, mu->pass);
+	db_write_word(db, mu->email);
+	db_write_time(db, mu->registered);
+
+	if (MOWGLI_LIST_LENGTH(&mu->logins))
+		db_write_time(db, 0);
+	else
+		db_write_time(db, mu->lastlogin);
 
-		if (atheme_object(mu)->metadata)
-		{
-			MOWGLI_PATRICIA_FOREACH(md, &state, atheme_object(mu)->metadata)
-			{
-				db_start_row(db, "MDU");
-				db_write_word(db, entity(mu)->name);
-				db_write_word(db, md->name);
-				db_write_str(db, md->value);
-				db_commit_row(db);
-			}
-		}
+	db_write_word(db, flags);
+	db_write_word(db, language_get_name(mu->language));
+	db_commit_row(db);
 
-		MOWGLI_ITER_FOREACH(tn, mu->memos.head)
+	if (atheme_object(mu)->metadata)
+	{
+		MOWGLI_PATRICIA_FOREACH(md, &state, atheme_object(mu)->metadata)
 		{
-			struct mymemo *mz = (struct mymemo *)tn->data;
-
-			db_start_row(db, "ME");
+			db_start_row(db, "MDU");
 			db_write_word(db, entity(mu)->name);
-			db_write_word(db, mz->sender);
-			db_write_time(db, mz->sent);
-			db_write_uint(db, mz->status);
-			db_write_str(db, mz->text);
+			db_write_word(db, md->name);
+			db_write_str(db, md->value);
 			db_commit_row(db);
 		}
+	}
 
-		MOWGLI_ITER_FOREACH(tn, mu->memo_ignores.head)
-		{
-			db_start_row(db, "MI");
-			db_write_word(db, entity(mu)->name);
-			db_write_word(db, (char *)tn->data);
-			db_commit_row(db);
-		}
+	// memos of dormant accounts may not be in memory; write those straight from cold storage
+	struct corestorage_memo_writer mw = { .db = db, .mu = mu };
 
-		MOWGLI_ITER_FOREACH(tn, mu->access_list.head)
-		{
-			db_start_row(db, "AC");
-			db_write_word(db, entity(mu)->name);
-			db_write_word(db, (char *)tn->data);
-			db_commit_row(db);
-		}
+	myuser_memos_cold_foreach(mu, &corestorage_db_save_memo, &mw);
 
-		MOWGLI_ITER_FOREACH(tn, mu->nicks.head)
-		{
-			struct mynick *mn = tn->data;
+	MOWGLI_ITER_FOREACH(tn, mu->memos.head)
+	{
+		struct mymemo *mz = (struct mymemo *)tn->data;
 
-			db_start_row(db, "MN");
-			db_write_word(db, entity(mu)->name);
-			db_write_word(db, mn->nick);
-			db_write_time(db, mn->registered);
+		db_start_row(db, "ME");
+		db_write_word(db, entity(mu)->name);
+		db_write_word(db, mz->sender);
+		db_write_time(db, mz->sent);
+		db_write_uint(db, mz->status);
+		db_write_str(db, mz->text);
+		db_commit_row(db);
+	}
 
-			struct user *u = user_find_named(mn->nick);
-			if (u != NULL && u->myuser == mn->owner)
-				db_write_time(db, 0);
-			else
-				db_write_time(db, mn->lastseen);
+	MOWGLI_ITER_FOREACH(tn, mu->memo_ignores.head)
+	{
+		db_start_row(db, "MI");
+		db_write_word(db, entity(mu)->name);
+		db_write_word(db, (char *)tn->data);
+		db_commit_row(db);
+	}
 
-			db_commit_row(db);
-		}
+	MOWGLI_ITER_FOREACH(tn, mu->access_list.head)
+	{
+		db_start_row(db, "AC");
+		db_write_word(db, entity(mu)->name);
+		db_write_word(db, (char *)tn->data);
+		db_commit_row(db);
+	}
 
-		MOWGLI_ITER_FOREACH(tn, mu->cert_fingerprints.head)
-		{
-			struct mycertfp *mcfp = tn->data;
+	MOWGLI_ITER_FOREACH(tn, mu->nicks.head)
+	{
+		struct mynick *mn = tn->data;
 
-			db_start_row(db, "MCFP");
-			db_write_word(db, entity(mu)->name);
-			db_write_word(db, mcfp->certfp);
-			db_commit_row(db);
-		}
-	}
+		db_start_row(db, "MN");
+		db_write_word(db, entity(mu)->name);
+		db_write_word(db, mn->nick);
+		db_write_time(db, mn->registered);
 
-	// XXX: groupserv hack.  remove when we have proper dependency resolution. --nenolod
-	hook_call_db_write_pre_ca(db);
+		struct user *u = user_find_named(mn->nick);
+		if (u != NULL && u->myuser == mn->owner)
+			db_write_time(db, 0);
+		else
+			db_write_time(db, mn->lastseen);
 
-	slog(LG_DEBUG, "db_save(): saving mychans");
+		db_commit_row(db);
+	}
 
-	MOWGLI_PATRICIA_FOREACH(mc, &state, mclist)
+	MOWGLI_ITER_FOREACH(tn, mu->cert_fingerprints.head)
 	{
-		mowgli_patricia_iteration_state_t state2;
+		struct mycertfp *mcfp = tn->data;
 
-		char *flags = gflags_tostr(mc_flags, mc->flags);
+		db_start_row(db, "MCFP");
+		db_write_word(db, entity(mu)->name);
+		db_write_word(db, mcfp->certfp);
+		db_commit_row(db);
+	}
+}
 
-		// find a founder
-		mu = NULL;
-		MOWGLI_ITER_FOREACH(tn, mc->chanacs.head)
-		{
-			ca = (struct chanacs *)tn->data;
-			if (ca->entity != NULL && ca->level & CA_FOUNDER)
-			{
-				mu = user(ca->entity);
-				break;
-			}
-		}
+static void
+corestorage_db_save_mychan(struct database_handle *db, struct mychan *mc)
+{
+	struct metadata *md;
+	struct myuser *mu;
+	struct chanacs *ca;
+	mowgli_node_t *tn;
+	mowgli_patricia_iteration_state_t state2;
 
-		// MC <name> <registered> <used> <flags> <mlock_on> <mlock_off> <mlock_limit> [mlock_key]
-		db_start_row(db, "MC");
-		db_write_word(db, mc->name);
-		db_write_time(db, mc->registered);
-		db_write_time(db, mc->used);
-		db_write_word(db, flags);
-		db_write_uint(db, mc->mlock_on);
-		db_write_uint(db, mc->mlock_off);
-		db_write_uint(db, mc->mlock_limit);
-		db_write_word(db, mc->mlock_key ? mc->mlock_key : "");
-		db_commit_row(db);
+	const char *flags = gflags_tostr_cached(mc_flags, mc->flags);
 
-		MOWGLI_ITER_FOREACH(tn, mc->chanacs.head)
+	// find a founder
+	mu = NULL;
+	MOWGLI_ITER_FOREACH(tn, mc->chanacs.head)
+	{
+		ca = (struct chanacs *)tn->data;
+		if (ca->entity != NULL && ca->level & CA_FOUNDER)
 		{
-			struct myentity *setter = NULL;
-			ca = (struct chanacs *)tn->data;
+			mu = user(ca->entity);
+			break;
+		}
+	}
 
-			db_start_row(db, "CA");
-			db_write_word(db, ca->mychan->name);
-			db_write_word(db, ca->entity ? ca->entity->name : ca->host);
-			db_write_word(db, bitmask_to_flags(ca->level));
-			db_write_time(db, ca->tmodified);
+	// MC <name> <registered> <used> <flags> <mlock_on> <mlock_off> <mlock_limit> [mlock_key]
+	db_start_row(db, "MC");
+	db_write_word(db, mc->name);
+	db_write_time(db, mc->registered);
+	db_write_time(db, mc->used);
+	db_write_word(db, flags);
+	db_write_uint(db, mc->mlock_on);
+	db_write_uint(db, mc->mlock_off);
+	db_write_uint(db, mc->mlock_limit);
+	db_write_word(db, mc->mlock_key ? mc->mlock_key : "");
+	db_commit_row(db);
 
-			if (*ca->setter_uid != '\0' && (setter = myentity_find_uid(ca->setter_uid)))
-				db_write_word(db, setter->name);
-			else
-				db_write_word(db, "*");
+	MOWGLI_ITER_FOREACH(tn, mc->chanacs.head)
+	{
+		struct myentity *setter = NULL;
+		ca = (struct chanacs *)tn->data;
 
-			db_commit_row(db);
+		db_start_row(db, "CA");
+		db_write_word(db, ca->mychan->name);
+		db_write_word(db, ca->entity ? ca->entity->name : ca->host);
+		db_write_word(db, bitmask_to_flags_cached(ca->level));
+		db_write_time(db, ca->tmodified);
 
-			if (atheme_object(ca)->metadata)
-			{
-				MOWGLI_PATRICIA_FOREACH(md, &state2, atheme_object(ca)->metadata)
-				{
-					db_start_row(db, "MDA");
-					db_write_word(db, ca->mychan->name);
-					db_write_word(db, (ca->entity) ? ca->entity->name : ca->host);
-					db_write_word(db, md->name);
-					db_write_str(db, md->value);
-					db_commit_row(db);
-				}
-			}
-		}
+		if (*ca->setter_uid != '\0' && (setter = myentity_find_uid(ca->setter_uid)))
+			db_write_word(db, setter->name);
+		else
+			db_write_word(db, "*");
+
+		db_commit_row(db);
 
-		if (atheme_object(mc)->metadata)
+		if (atheme_object(ca)->metadata)
 		{
-			MOWGLI_PATRICIA_FOREACH(md, &state2, atheme_object(mc)->metadata)
+			MOWGLI_PATRICIA_FOREACH(md, &state2, atheme_object(ca)->metadata)
 			{
-				db_start_row(db, "MDC");
-				db_write_word(db, mc->name);
+				db_start_row(db, "MDA");
+				db_write_word(db, ca->mychan->name);
+				db_write_word(db, (ca->entity) ? ca->entity->name : ca->host);
 				db_write_word(db, md->name);
 				db_write_str(db, md->value);
 				db_commit_row(db);
@@ -261,6 +305,32 @@ corestorage_db_save(struct database_handle *db)
 		}
 	}
 
+	if (atheme_object(mc)->metadata)
+	{
+		MOWGLI_PATRICIA_FOREACH(md, &state2, atheme_object(mc)->metadata)
+		{
+			db_start_row(db, "MDC");
+			db_write_word(db, mc->name);
+			db_write_word(db, md->name);
+			db_write_str(db, md->value);
+			db_commit_row(db);
+		}
+	}
+}
+
+static void
+corestorage_db_save_trailer(struct database_handle *db)
+{
+	struct metadata *md;
+	struct myuser_name *mun;
+	struct kline *k;
+	struct xline *x;
+	struct qline *q;
+	struct svsignore *svsignore;
+	struct soper *soper;
+	mowgli_node_t *n;
+	mowgli_patricia_iteration_state_t state;
+
 	// Old names
 	MOWGLI_PATRICIA_FOREACH(mun, &state, oldnameslist)
 	{
@@ -306,7 +376,7 @@ corestorage_db_save(struct database_handle *db)
 	{
 		const char *flags;
 		soper = n->data;
-		flags = gflags_tostr(soper_flags, soper->flags);
+		flags = gflags_tostr_cached(soper_flags, soper->flags);
 
 		if (soper->flags & SOPER_CONF || soper->myuser == NULL)
 			continue;
@@ -386,6 +456,34 @@ corestorage_db_save(struct database_handle *db)
 	}
 }
 
+
+// write atheme.db (core fields)
+static void
+corestorage_db_save(struct database_handle *db)
+{
+	struct myentity *ment;
+	struct mychan *mc;
+	mowgli_patricia_iteration_state_t state;
+	struct myentity_iteration_state mestate;
+
+	corestorage_db_save_header(db);
+
+	slog(LG_DEBUG, "db_save(): saving myusers");
+
+	MYENTITY_FOREACH_T(ment, &mestate, ENT_USER)
+		corestorage_db_save_myuser(db, user(ment));
+
+	// XXX: groupserv hack.  remove when we have proper dependency resolution. --nenolod
+	hook_call_db_write_pre_ca(db);
+
+	slog(LG_DEBUG, "db_save(): saving mychans");
+
+	MOWGLI_PATRICIA_FOREACH(mc, &state, mclist)
+		corestorage_db_save_mychan(db, mc);
+
+	corestorage_db_save_trailer(db);
+}
+
 static void ATHEME_FATTR_NORETURN
 corestorage_h_unknown(struct database_handle *db, const char *type)
 {
@@ -503,7 +601,7 @@ corestorage_h_mu(struct database_handle *db, const char *type)
 	login = db_sread_time(db);
 	if (dbv >= 8) {
 		sflags = db_sread_word(db);
-		if (!gflags_fromstr(mu_flags, sflags, &flags))
+		if (!gflags_fromstr_cached(mu_flags, sflags, &flags))
 			slog(LG_INFO, "db-h-mu: line %u: confused by flags: %s", db->line, sflags);
 	} else {
 		flags = db_sread_uint(db);
@@ -556,6 +654,12 @@ corestorage_h_me(struct database_handle *db, const char *type)
 	if (!(mz->status & MEMO_READ))
 		mu->memoct_new++;
 
+	if (myuser_memo_add_cold(mu, mz))
+	{
+		sfree(mz);
+		return;
+	}
+
 	mowgli_node_add(mz, mowgli_node_create(), &mu->memos);
 }
 
@@ -720,7 +824,7 @@ corestorage_h_mc(struct database_handle *db, const char *type)
 	mc->used = db_sread_time(db);
 	if (dbv >= 8) {
 		sflags = db_sread_word(db);
-		if (!gflags_fromstr(mc_flags, sflags, &flags))
+		if (!gflags_fromstr_cached(mc_flags, sflags, &flags))
 			slog(LG_INFO, "db-h-mc: line %u: confused by flags %s",
 			     db->line, sflags);
 	} else {
@@ -861,7 +965,7 @@ corestorage_h_ca(struct database_handle *db, const char *type)
 
 	chan = db_sread_word(db);
 	target = db_sread_word(db);
-	flags = flags_to_bitmask(db_sread_word(db), 0);
+	flags = flags_to_bitmask_cached(db_sread_word(db));
 
 	// UNBAN self and akick exempt have been split to +e per GitHub #75
 	if (!(their_ca_all & CA_EXEMPT) && (flags & CA_REMOVE))
@@ -1068,6 +1172,301 @@ corestorage_db_write_blocking(void *filename)
 	db_close(db);
 }
 
+// A save that the event loop waits for, as opposed to one done by the child process
+static void
+corestorage_db_write_sync(void *filename)
+{
+	const unsigned long long start = metrics_clock();
+
+	corestorage_db_write_blocking(filename);
+
+	metrics_timing_record(&metrics.db_save, metrics_clock() - start);
+}
+
+static bool
+corestorage_bgsave_begin(struct corestorage_bgsave *const restrict bs)
+{
+	if (! (bs->arena = db_arena_create()))
+		return false;
+
+	if (! (bs->db = db_open_arena(bs->arena)))
+	{
+		db_arena_destroy(bs->arena);
+		bs->arena = NULL;
+		return false;
+	}
+
+	corestorage_db_save_header(bs->db);
+
+	myentity_foreach_start(&bs->mestate, ENT_USER);
+
+	bs->phase = BGSAVE_MYUSERS;
+	bs->generation = db_generation;
+
+	return true;
+}
+
+static void
+corestorage_bgsave_reset(struct corestorage_bgsave *const restrict bs)
+{
+	if (bs->db)
+		db_close(bs->db);
+
+	if (bs->arena)
+		db_arena_destroy(bs->arena);
+
+	bs->db = NULL;
+	bs->arena = NULL;
+}
+
+static void
+corestorage_bgsave_abort(void)
+{
+	return_if_fail(bgsave != NULL);
+
+	if (bgsave->timer)
+		mowgli_timer_destroy(base_eventloop, bgsave->timer);
+
+	corestorage_bgsave_reset(bgsave);
+	sfree(bgsave->filename);
+	sfree(bgsave);
+
+	bgsave = NULL;
+}
+
+/* Serialises objects until everything has been written or until this slice
+ * has used up its time. Returns true when done.
+ *
+ * The iteration states are only valid for as long as the entity and channel
+ * trees are unchanged, which the caller verifies with db_generation before
+ * resuming. Each account or channel, with all of its rows, is written in one
+ * go, as are the rows written by other modules' db_write hooks.
+ */
+static bool
+corestorage_bgsave_step(struct corestorage_bgsave *const restrict bs)
+{
+	struct timeval start, elapsed;
+	struct myentity *ment;
+	struct mychan *mc;
+	unsigned int count = 0;
+
+	s_time(&start);
+
+	while (bs->phase != BGSAVE_DONE)
+	{
+		switch (bs->phase)
+		{
+			case BGSAVE_MYUSERS:
+				if (! (ment = myentity_foreach_cur(&bs->mestate)))
+				{
+					// XXX: groupserv hack.  remove when we have proper dependency resolution. --nenolod
+					hook_call_db_write_pre_ca(bs->db);
+
+					mowgli_patricia_foreach_start(mclist, &bs->mcstate);
+					bs->phase = BGSAVE_MYCHANS;
+					break;
+				}
+
+				corestorage_db_save_myuser(bs->db, user(ment));
+				myentity_foreach_next(&bs->mestate);
+				break;
+
+			case BGSAVE_MYCHANS:
+				if (! (mc = mowgli_patricia_foreach_cur(mclist, &bs->mcstate)))
+				{
+					bs->phase = BGSAVE_TRAILER;
+					break;
+				}
+
+				corestorage_db_save_mychan(bs->db, mc);
+				mowgli_patricia_foreach_next(mclist, &bs->mcstate);
+				break;
+
+			case BGSAVE_TRAILER:
+				corestorage_db_save_trailer(bs->db);
+				hook_call_db_write(bs->db);
+				bs->phase = BGSAVE_DONE;
+				break;
+
+			case BGSAVE_DONE:
+				break;
+		}
+
+		if (++count % BGSAVE_CHECK_INTERVAL)
+			continue;
+
+		e_time(start, &elapsed);
+
+		if (tv2ms(&elapsed) >= BGSAVE_SLICE_MS)
+			return bs->phase == BGSAVE_DONE;
+	}
+
+	return true;
+}
+
+static void
+corestorage_bgsave_write(void *const restrict vbs)
+{
+	struct corestorage_bgsave *const bs = vbs;
+
+	bs->error = db_arena_commit(bs->arena, bs->path);
+}
+
+static void
+corestorage_bgsave_written(void *const restrict vbs)
+{
+	struct corestorage_bgsave *const bs = vbs;
+
+	if (bs->error)
+	{
+		slog(LG_ERROR, "db_save(): cannot write '%s': %s", bs->path, strerror(bs->error));
+		wallops("\2DATABASE ERROR\2: db_save(): cannot write '%s': %s", bs->path, strerror(bs->error));
+	}
+	else
+	{
+		slog(LG_DEBUG, "db_save(): finished threaded DB write (%zu bytes)", bs->arena->size);
+		hook_call_db_saved();
+	}
+
+	db_arena_destroy(bs->arena);
+	sfree(bs->filename);
+	sfree(bs);
+}
+
+static void
+corestorage_bgsave_finish(struct corestorage_bgsave *const restrict bs)
+{
+	db_close(bs->db);
+
+	bs->db = NULL;
+	bgsave = NULL;
+
+	metrics_timing_record(&metrics.db_save, bs->usec);
+
+	slog(LG_DEBUG, "db_save(): serialised %zu bytes in %u slice(s) with %u restart(s); writing",
+	               bs->arena->size, bs->slices, bs->restarts);
+
+	if (threadpool_submit(bgsave_writer, &corestorage_bgsave_write, &corestorage_bgsave_written, bs))
+		return;
+
+	corestorage_bgsave_write(bs);
+	corestorage_bgsave_written(bs);
+}
+
+static void
+corestorage_bgsave_slice(void *const restrict vbs)
+{
+	struct corestorage_bgsave *const bs = vbs;
+	const unsigned long long start = metrics_clock();
+
+	bs->timer = NULL;
+	bs->slices++;
+
+	if (bs->generation != db_generation)
+	{
+		/* Rows already in the arena may now refer to accounts or channels
+		 * that are gone, and the saved iteration states may point into
+		 * freed tree nodes; start over. If this keeps happening, the
+		 * database changes faster than the slices can keep up with, so
+		 * let a child process write the copy of it that fork() gives it,
+		 * rather than stalling the event loop to finish in one go. Without
+		 * fork(), keep trying; the event loop is never held up for longer
+		 * than a slice either way.
+		 */
+#ifdef HAVE_FORK
+		if (++bs->restarts > BGSAVE_MAX_RESTARTS)
+		{
+			char *const filename = bs->filename;
+
+			bs->filename = NULL;
+			corestorage_bgsave_abort();
+
+			if (child_pid)
+				slog(LG_DEBUG, "db_save(): database keeps changing during threaded save, and a child "
+				               "process is already saving; skipping save");
+			else
+			{
+				slog(LG_DEBUG, "db_save(): database keeps changing during threaded save; "
+				               "saving in a child process instead");
+				corestorage_db_write_fork(filename);
+			}
+
+			sfree(filename);
+			return;
+		}
+#else
+		bs->restarts++;
+#endif
+
+		slog(LG_DEBUG, "db_save(): database changed during threaded save; restarting");
+
+		corestorage_bgsave_reset(bs);
+
+		if (! corestorage_bgsave_begin(bs))
+		{
+			slog(LG_ERROR, "db_save(): cannot restart threaded save; giving up until the next save");
+			corestorage_bgsave_abort();
+			return;
+		}
+	}
+
+	const bool done = corestorage_bgsave_step(bs);
+
+	bs->usec += metrics_clock() - start;
+
+	if (done)
+	{
+		corestorage_bgsave_finish(bs);
+		return;
+	}
+
+	bs->timer = mowgli_timer_add_once(base_eventloop, "corestorage_bgsave_slice", &corestorage_bgsave_slice, bs, 0);
+}
+
+static bool
+corestorage_db_write_thread(const char *const restrict filename, const bool important)
+{
+	if (! threadpool_available())
+		return false;
+
+	if (bgsave || (bgsave_writer && threadpool_pending(bgsave_writer)))
+	{
+		if (! important)
+		{
+			slog(LG_DEBUG, "db_save(): previous save unfinished, skipping save");
+			return true;
+		}
+
+		if (bgsave)
+		{
+			slog(LG_DEBUG, "db_save(): restarting unfinished previous save for forced save");
+			corestorage_bgsave_abort();
+		}
+	}
+
+	if (! bgsave_writer && ! (bgsave_writer = threadpool_create("db_save", 1)))
+		return false;
+
+	struct corestorage_bgsave *const bs = smalloc(sizeof *bs);
+
+	snprintf(bs->path, sizeof bs->path, "%s/%s", datadir, filename != NULL ? filename : "services.db");
+
+	if (! corestorage_bgsave_begin(bs))
+	{
+		slog(LG_DEBUG, "db_save(): database backend cannot serialise into memory");
+		sfree(bs);
+		return false;
+	}
+
+	slog(LG_DEBUG, "db_save(): starting threaded DB save");
+
+	bs->filename = filename ? sstrdup(filename) : NULL;
+	bgsave = bs;
+	corestorage_bgsave_slice(bs);
+
+	return true;
+}
+
 #ifdef HAVE_FORK
 static void
 corestorage_db_saved_cb(pid_t pid, int status, void *data)
@@ -1080,13 +1479,56 @@ corestorage_db_saved_cb(pid_t pid, int status, void *data)
 		slog(LG_DEBUG, "db_save(): finished asynchronous DB write");
 	}
 }
+
+// The caller has made sure that no other child process is saving
+static void
+corestorage_db_write_fork(void *filename)
+{
+	const unsigned long long start = metrics_clock();
+
+	pid_t pid = fork();
+	switch (pid)
+	{
+		case -1:
+			slog(LG_ERROR, "db_save(): fork() failed; writing database synchronously");
+			corestorage_db_write_sync(filename);
+			return;
+
+		case 0:
+			corestorage_db_write_blocking(filename);
+			exit(EXIT_SUCCESS);
+
+		default:
+			child_pid = pid;
+			childproc_add(pid, "db_save", corestorage_db_saved_cb, NULL);
+			metrics_timing_record(&metrics.db_save, metrics_clock() - start);
+			return;
+	}
+}
 #endif
 
 static void
 corestorage_db_write(void *filename, enum db_save_strategy strategy)
 {
+	if (strategy != DB_SAVE_BLOCKING && ! config_options.db_save_blocking &&
+	    (strategy == DB_SAVE_BG_THREAD || config_options.db_save_thread))
+	{
+		if (corestorage_db_write_thread(filename, strategy == DB_SAVE_BG_IMPORTANT))
+			return;
+
+		if (strategy == DB_SAVE_BG_THREAD)
+			strategy = DB_SAVE_BG_REGULAR;
+	}
+
+	// Any other kind of save supersedes an unfinished threaded one
+	if (bgsave)
+		corestorage_bgsave_abort();
+
+	if ((strategy == DB_SAVE_BLOCKING || config_options.db_save_blocking) && bgsave_writer)
+		threadpool_drain(bgsave_writer);
+
 #ifndef HAVE_FORK
-	corestorage_db_write_blocking(filename);
+	corestorage_db_write_sync(filename);
 #else
 	if (child_pid && strategy == DB_SAVE_BG_REGULAR)
 	{
@@ -1109,27 +1551,11 @@ corestorage_db_write(void *filename, enum db_save_strategy strategy)
 
 	if (strategy == DB_SAVE_BLOCKING)
 	{
-		corestorage_db_write_blocking(filename);
+		corestorage_db_write_sync(filename);
 		return;
 	}
 
-	pid_t pid = fork();
-	switch (pid)
-	{
-		case -1:
-			slog(LG_ERROR, "db_save(): fork() failed; writing database synchronously");
-			corestorage_db_write_blocking(filename);
-			return;
-
-		case 0:
-			corestorage_db_write_blocking(filename);
-			exit(EXIT_SUCCESS);
-
-		default:
-			child_pid = pid;
-			childproc_add(pid, "db_save", corestorage_db_saved_cb, NULL);
-			return;
-	}
+	corestorage_db_write_fork(filename);
 #endif
 }
 
@@ -19,6 +19,7 @@ struct opensex
 	unsigned int bufsize;
 	char *token;
 	FILE *f;
+	struct database_arena *arena;
 
 	// Interpreting state
 	unsigned int grver;
@@ -159,6 +160,21 @@ opensex_read_time(struct database_handle *db, time_t *res)
 	return *s && !*rp;
 }
 
+static void ATHEME_FATTR_PRINTF(2, 3)
+opensex_printf(struct opensex *const restrict rs, const char *const restrict fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+
+	if (rs->arena)
+		(void) db_arena_vprintf(rs->arena, fmt, ap);
+	else
+		(void) vfprintf(rs->f, fmt, ap);
+
+	va_end(ap);
+}
+
 static bool
 opensex_start_row(struct database_handle *db, const char *type)
 {
@@ -168,7 +184,7 @@ opensex_start_row(struct database_handle *db, const char *type)
 	return_val_if_fail(type != NULL, false);
 	rs = (struct opensex *)db->priv;
 
-	fprintf(rs->f, "%s ", type);
+	opensex_printf(rs, "%s ", type);
 
 	return true;
 }
@@ -183,7 +199,7 @@ opensex_write_cell(struct database_handle *db, const char *data, bool multiword)
 	return_val_if_fail(db != NULL, false);
 	rs = (struct opensex *)db->priv;
 
-	fprintf(rs->f, "%s%s", data != NULL ? data : "*", !multiword ? " " : "");
+	opensex_printf(rs, "%s%s", data != NULL ? data : "*", !multiword ? " " : "");
 
 	return true;
 }
@@ -232,7 +248,7 @@ opensex_commit_row(struct database_handle *db)
 	return_val_if_fail(db != NULL, false);
 	rs = (struct opensex *)db->priv;
 
-	fprintf(rs->f, "\n");
+	opensex_printf(rs, "\n");
 
 	return true;
 }
@@ -365,6 +381,29 @@ opensex_db_open_write(const char *filename)
 	return db;
 }
 
+static struct database_handle * ATHEME_FATTR_MALLOC
+opensex_db_open_arena(struct database_arena *const restrict arena)
+{
+	struct database_handle *db;
+	struct opensex *rs;
+
+	rs = smalloc(sizeof *rs);
+	rs->arena = arena;
+	rs->grver = 1;
+
+	db = smalloc(sizeof *db);
+	db->priv = rs;
+	db->vt = &opensex_vt;
+	db->txn = DB_WRITE;
+	db->file = sstrdup("<memory>");
+
+	db_start_row(db, "GRVER");
+	db_write_uint(db, rs->grver);
+	db_commit_row(db);
+
+	return db;
+}
+
 static struct database_handle *
 opensex_db_open(const char *filename, enum database_transaction txn)
 {
@@ -383,6 +422,17 @@ opensex_db_close(struct database_handle *db)
 	return_if_fail(db != NULL);
 	rs = db->priv;
 
+	/* The arena belongs to the caller, which writes it out and renames it
+	 * into place itself once serialisation is complete.
+	 */
+	if (rs->arena)
+	{
+		sfree(rs);
+		sfree(db->file);
+		sfree(db);
+		return;
+	}
+
 	mowgli_strlcpy(oldpath, db->file, sizeof oldpath);
 	mowgli_strlcat(oldpath, ".new", sizeof oldpath);
 
@@ -416,6 +466,7 @@ static const struct database_module opensex_mod = {
 	.db_open = opensex_db_open,
 	.db_close = opensex_db_close,
 	.db_parse = opensex_db_parse,
+	.db_open_arena = opensex_db_open_arena,
 };
 
 static void
@@ -24,6 +24,11 @@
 #define CHANFIX_GATHER_INTERVAL (5U * SECONDS_PER_MINUTE)
 #define CHANFIX_EXPIRE_INTERVAL SECONDS_PER_HOUR
 
+/* Expiry visits this many slices of the channels per CHANFIX_EXPIRE_INTERVAL
+ * instead of all of them at once.
+ */
+#define CHANFIX_EXPIRE_SLICES   12U
+
 /* This value has been chosen such that the maximum score is about 8064,
  * which is the number of CHANFIX_GATHER_INTERVALs in CHANFIX_RETENTION_TIME.
  * Higher scores would decay more than they can gain (12 per hour).
@@ -37,6 +42,8 @@ struct chanfix_channel
 	char *name;
 
 	mowgli_list_t oprecords;
+	mowgli_patricia_t *oprecords_by_entity;
+	mowgli_patricia_t *oprecords_by_host;
 	time_t ts;
 	time_t lastupdate;
 
@@ -44,6 +51,14 @@ struct chanfix_channel
 
 	time_t fix_started;
 	bool fix_requested;
+
+	/* Members that have been seen with ops; whether they still are is
+	 * checked when scores are gathered.
+	 */
+	mowgli_list_t opped;
+	mowgli_node_t oppednode;
+
+	mowgli_node_t expirenode;
 };
 
 struct chanfix_oprecord
@@ -78,6 +93,7 @@ extern mowgli_patricia_t *chanfix_channels;
 void chanfix_gather_init(struct chanfix_persist_record *);
 void chanfix_gather_deinit(struct chanfix_persist_record *);
 
+void chanfix_chanuser_opped(struct chanfix_channel *chan, struct chanuser *cu);
 void chanfix_oprecord_update(struct chanfix_channel *chan, struct user *u);
 void chanfix_oprecord_delete(struct chanfix_oprecord *orec);
 struct chanfix_oprecord *chanfix_oprecord_create(struct chanfix_channel *chan, struct user *u);
@@ -185,6 +185,7 @@ chanfix_fix_channel(struct chanfix_channel *chan)
 				join(chan->name, chanfix->me->nick);
 			modestack_mode_param(chanfix->me->nick, chan->chan, MTYPE_ADD, 'o', CLIENT_NAME(cu->user));
 			cu->modes |= CSTATUS_OP;
+			chanfix_chanuser_opped(chan, cu);
 			opped++;
 		}
 	}
@@ -19,8 +19,51 @@ static mowgli_heap_t *chanfix_oprecord_heap = NULL;
 static mowgli_eventloop_timer_t *chanfix_gather_timer = NULL;
 static mowgli_eventloop_timer_t *chanfix_expire_timer = NULL;
 
+// Channels in which at least one member has been seen with ops
+static mowgli_list_t chanfix_opped_channels = { NULL, NULL, 0 };
+
+// Every channel, in the order expiry will visit them
+static mowgli_list_t chanfix_expire_queue = { NULL, NULL, 0 };
+
 mowgli_patricia_t *chanfix_channels = NULL;
 
+static void
+chanfix_oprecord_hostkey(char *const restrict buf, const size_t bufsz, const char *const restrict user,
+                         const char *const restrict host)
+{
+	(void) snprintf(buf, bufsz, "%s@%s", user, host);
+}
+
+static void
+chanfix_oprecord_link(struct chanfix_oprecord *orec)
+{
+	struct chanfix_channel *chan = orec->chan;
+	char key[USERLEN + 1 + HOSTLEN + 1];
+
+	chanfix_oprecord_hostkey(key, sizeof key, orec->user, orec->host);
+
+	if (mowgli_patricia_retrieve(chan->oprecords_by_host, key) == NULL)
+		mowgli_patricia_add(chan->oprecords_by_host, key, orec);
+
+	if (orec->entity != NULL && mowgli_patricia_retrieve(chan->oprecords_by_entity, orec->entity->id) == NULL)
+		mowgli_patricia_add(chan->oprecords_by_entity, orec->entity->id, orec);
+}
+
+static void
+chanfix_oprecord_unlink(struct chanfix_oprecord *orec)
+{
+	struct chanfix_channel *chan = orec->chan;
+	char key[USERLEN + 1 + HOSTLEN + 1];
+
+	chanfix_oprecord_hostkey(key, sizeof key, orec->user, orec->host);
+
+	if (mowgli_patricia_retrieve(chan->oprecords_by_host, key) == orec)
+		mowgli_patricia_delete(chan->oprecords_by_host, key);
+
+	if (orec->entity != NULL && mowgli_patricia_retrieve(chan->oprecords_by_entity, orec->entity->id) == orec)
+		mowgli_patricia_delete(chan->oprecords_by_entity, orec->entity->id);
+}
+
 struct chanfix_oprecord *
 chanfix_oprecord_create(struct chanfix_channel *chan, struct user *u)
 {
@@ -48,6 +91,8 @@ chanfix_oprecord_create(struct chanfix_channel *chan, struct user *u)
 
 		mowgli_strlcpy(orec->user, u->user, sizeof orec->user);
 		mowgli_strlcpy(orec->host, u->vhost, sizeof orec->host);
+
+		chanfix_oprecord_link(orec);
 	}
 
 	mowgli_node_add(orec, &orec->node, &chan->oprecords);
@@ -58,23 +103,18 @@ chanfix_oprecord_create(struct chanfix_channel *chan, struct user *u)
 struct chanfix_oprecord *
 chanfix_oprecord_find(struct chanfix_channel *chan, struct user *u)
 {
-	mowgli_node_t *n;
+	struct chanfix_oprecord *orec;
+	char key[USERLEN + 1 + HOSTLEN + 1];
 
 	return_val_if_fail(chan != NULL, NULL);
 	return_val_if_fail(u != NULL, NULL);
 
-	MOWGLI_ITER_FOREACH(n, chan->oprecords.head)
-	{
-		struct chanfix_oprecord *orec = n->data;
-
-		if (orec->entity != NULL && orec->entity == entity(u->myuser))
-			return orec;
+	if (u->myuser != NULL && (orec = mowgli_patricia_retrieve(chan->oprecords_by_entity, entity(u->myuser)->id)) != NULL)
+		return orec;
 
-		if (!irccasecmp(orec->user, u->user) && !irccasecmp(orec->host, u->vhost))
-			return orec;
-	}
+	chanfix_oprecord_hostkey(key, sizeof key, u->user, u->vhost);
 
-	return NULL;
+	return mowgli_patricia_retrieve(chan->oprecords_by_host, key);
 }
 
 void
@@ -92,7 +132,10 @@ chanfix_oprecord_update(struct chanfix_channel *chan, struct user *u)
 		orec->lastevent = CURRTIME;
 
 		if (orec->entity == NULL && u->myuser != NULL)
+		{
 			orec->entity = entity(u->myuser);
+			chanfix_oprecord_link(orec);
+		}
 
 		return;
 	}
@@ -106,10 +149,91 @@ chanfix_oprecord_delete(struct chanfix_oprecord *orec)
 {
 	return_if_fail(orec != NULL);
 
+	chanfix_oprecord_unlink(orec);
+
 	mowgli_node_delete(&orec->node, &orec->chan->oprecords);
 	mowgli_heap_free(chanfix_oprecord_heap, orec);
 }
 
+static mowgli_node_t *
+chanfix_opped_find(struct chanfix_channel *chan, struct chanuser *cu)
+{
+	mowgli_node_t *n;
+
+	MOWGLI_ITER_FOREACH(n, chan->opped.head)
+	{
+		if (n->data == cu)
+			return n;
+	}
+
+	return NULL;
+}
+
+void
+chanfix_chanuser_opped(struct chanfix_channel *chan, struct chanuser *cu)
+{
+	return_if_fail(chan != NULL);
+	return_if_fail(cu != NULL);
+
+	if (chanfix_opped_find(chan, cu) != NULL)
+		return;
+
+	if (MOWGLI_LIST_LENGTH(&chan->opped) == 0)
+		mowgli_node_add(chan, &chan->oppednode, &chanfix_opped_channels);
+
+	mowgli_node_add(cu, mowgli_node_create(), &chan->opped);
+}
+
+static void
+chanfix_chanuser_gone(struct chanfix_channel *chan, struct chanuser *cu)
+{
+	mowgli_node_t *n;
+
+	if ((n = chanfix_opped_find(chan, cu)) == NULL)
+		return;
+
+	mowgli_node_delete(n, &chan->opped);
+	mowgli_node_free(n);
+
+	if (MOWGLI_LIST_LENGTH(&chan->opped) == 0)
+		mowgli_node_delete(&chan->oppednode, &chanfix_opped_channels);
+}
+
+static void
+chanfix_opped_clear(struct chanfix_channel *chan)
+{
+	mowgli_node_t *n, *tn;
+
+	if (MOWGLI_LIST_LENGTH(&chan->opped) == 0)
+		return;
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, chan->opped.head)
+	{
+		mowgli_node_delete(n, &chan->opped);
+		mowgli_node_free(n);
+	}
+
+	mowgli_node_delete(&chan->oppednode, &chanfix_opped_channels);
+}
+
+// Pick up members whose ops we were not told about, e.g. from a netjoin
+static void
+chanfix_opped_sync(struct chanfix_channel *chan)
+{
+	mowgli_node_t *n;
+
+	if (chan->chan == NULL)
+		return;
+
+	MOWGLI_ITER_FOREACH(n, chan->chan->members.head)
+	{
+		struct chanuser *cu = n->data;
+
+		if (cu->modes & CSTATUS_OP)
+			chanfix_chanuser_opped(chan, cu);
+	}
+}
+
 static void
 chanfix_channel_delete(struct chanfix_channel *c)
 {
@@ -118,6 +242,9 @@ chanfix_channel_delete(struct chanfix_channel *c)
 	return_if_fail(c != NULL);
 
 	mowgli_patricia_delete(chanfix_channels, c->name);
+	mowgli_node_delete(&c->expirenode, &chanfix_expire_queue);
+
+	chanfix_opped_clear(c);
 
 	MOWGLI_ITER_FOREACH_SAFE(n, tn, c->oprecords.head)
 	{
@@ -126,6 +253,9 @@ chanfix_channel_delete(struct chanfix_channel *c)
 		chanfix_oprecord_delete(orec);
 	}
 
+	mowgli_patricia_destroy(c->oprecords_by_entity, NULL, NULL);
+	mowgli_patricia_destroy(c->oprecords_by_host, NULL, NULL);
+
 	sfree(c->name);
 	mowgli_heap_free(chanfix_channel_heap, c);
 }
@@ -144,10 +274,14 @@ chanfix_channel_create(const char *name, struct channel *chan)
 	c->chan = chan;
 	c->fix_started = 0;
 
+	c->oprecords_by_entity = mowgli_patricia_create(noopcanon);
+	c->oprecords_by_host = mowgli_patricia_create(irccasecanon);
+
 	if (c->chan != NULL)
 		c->ts = c->chan->ts;
 
 	mowgli_patricia_add(chanfix_channels, c->name, c);
+	mowgli_node_add(c, &c->expirenode, &chanfix_expire_queue);
 
 	return c;
 }
@@ -166,6 +300,17 @@ chanfix_channel_get(struct channel *chan)
 	return mowgli_patricia_retrieve(chanfix_channels, chan->name);
 }
 
+static struct chanfix_channel *
+chanfix_channel_get_or_create(struct channel *ch)
+{
+	struct chanfix_channel *chan;
+
+	if ((chan = chanfix_channel_get(ch)) == NULL)
+		chan = chanfix_channel_create(ch->name, ch);
+
+	return chan;
+}
+
 static void
 chanfix_channel_add_ev(struct channel *ch)
 {
@@ -191,6 +336,7 @@ chanfix_channel_delete_ev(struct channel *ch)
 
 	if ((chan = chanfix_channel_get(ch)) != NULL)
 	{
+		chanfix_opped_clear(chan);
 		chan->chan = NULL;
 		return;
 	}
@@ -198,29 +344,60 @@ chanfix_channel_delete_ev(struct channel *ch)
 	chanfix_channel_create(ch->name, NULL);
 }
 
+static void
+chanfix_channel_join_ev(struct hook_channel_joinpart *hdata)
+{
+	struct chanuser *cu = hdata->cu;
+
+	if (cu == NULL || !(cu->modes & CSTATUS_OP))
+		return;
+
+	chanfix_chanuser_opped(chanfix_channel_get_or_create(cu->chan), cu);
+}
+
+static void
+chanfix_channel_part_ev(struct hook_channel_joinpart *hdata)
+{
+	struct chanfix_channel *chan;
+
+	if (hdata->cu == NULL || (chan = chanfix_channel_get(hdata->cu->chan)) == NULL)
+		return;
+
+	chanfix_chanuser_gone(chan, hdata->cu);
+}
+
+static void
+chanfix_channel_mode_change_ev(struct hook_channel_mode_change *hdata)
+{
+	struct chanuser *cu = hdata->cu;
+
+	if (cu == NULL || !(hdata->mvalue & CSTATUS_OP))
+		return;
+
+	chanfix_chanuser_opped(chanfix_channel_get_or_create(cu->chan), cu);
+}
+
+/* Credit every member that is opped right now. Only the channels in which
+ * someone has been seen with ops are visited; members that were deopped
+ * since stay in the set until they leave, and are skipped here.
+ */
 void
 chanfix_gather(void *unused)
 {
-	struct channel *ch;
-	mowgli_patricia_iteration_state_t state;
+	mowgli_node_t *n;
 	unsigned int chans = 0, oprecords = 0;
 
-	MOWGLI_PATRICIA_FOREACH(ch, &state, chanlist)
+	MOWGLI_ITER_FOREACH(n, chanfix_opped_channels.head)
 	{
-		struct mychan *mc;
-		mowgli_node_t *n;
-		struct chanfix_channel *chan;
+		struct chanfix_channel *chan = n->data;
+		mowgli_node_t *n2;
 
-		if ((mc = mychan_find(ch->name)) != NULL)
+		if (chan->chan == NULL || mychan_find(chan->name) != NULL)
 			continue;
 
-		chan = chanfix_channel_get(ch);
-		if (chan == NULL)
-			chan = chanfix_channel_create(ch->name, ch);
-
-		MOWGLI_ITER_FOREACH(n, ch->members.head)
+		MOWGLI_ITER_FOREACH(n2, chan->opped.head)
 		{
-			struct chanuser *cu = n->data;
+			struct chanuser *cu = n2->data;
 
 			if (cu->modes & CSTATUS_OP)
 			{
@@ -235,16 +412,21 @@ chanfix_gather(void *unused)
 	slog(LG_DEBUG, "chanfix_gather(): gathered %u channels and %u oprecords.", chans, oprecords);
 }
 
+/* Each run handles the next CHANFIX_EXPIRE_SLICES'th of the channels, so
+ * every channel is still visited once per CHANFIX_EXPIRE_INTERVAL.
+ */
 void
 chanfix_expire(void *unused)
 {
-	struct chanfix_channel *chan;
-	mowgli_patricia_iteration_state_t state;
+	unsigned int count = (MOWGLI_LIST_LENGTH(&chanfix_expire_queue) + CHANFIX_EXPIRE_SLICES - 1) / CHANFIX_EXPIRE_SLICES;
 
-	MOWGLI_PATRICIA_FOREACH(chan, &state, chanfix_channels)
+	while (count-- > 0 && chanfix_expire_queue.head != NULL)
 	{
+		struct chanfix_channel *chan = chanfix_expire_queue.head->data;
 		mowgli_node_t *n, *tn;
 
+		chanfix_opped_sync(chan);
+
 		MOWGLI_ITER_FOREACH_SAFE(n, tn, chan->oprecords.head)
 		{
 			struct chanfix_oprecord *orec = n->data;
@@ -261,9 +443,14 @@ chanfix_expire(void *unused)
 			chanfix_oprecord_delete(orec);
 		}
 
-		if (MOWGLI_LIST_LENGTH(&chan->oprecords) > 0 &&
-				CURRTIME - chan->lastupdate < CHANFIX_RETENTION_TIME)
+		if ((MOWGLI_LIST_LENGTH(&chan->oprecords) > 0 &&
+				CURRTIME - chan->lastupdate < CHANFIX_RETENTION_TIME) ||
+				MOWGLI_LIST_LENGTH(&chan->opped) > 0)
+		{
+			mowgli_node_delete(&chan->expirenode, &chanfix_expire_queue);
+			mowgli_node_add(chan, &chan->expirenode, &chanfix_expire_queue);
 			continue;
+		}
 
 		atheme_object_unref(chan);
 	}
@@ -384,6 +571,8 @@ db_h_cfop(struct database_handle *db, const char *type)
 	orec->lastevent = lastevent;
 
 	orec->age = age;
+
+	chanfix_oprecord_link(orec);
 }
 
 static void
@@ -400,19 +589,42 @@ db_h_cfmd(struct database_handle *db, const char *type)
 	metadata_add(chan, key, value);
 }
 
+// Rebuild the state that does not survive a reload from the channels we kept
+static void
+chanfix_gather_resync(void)
+{
+	struct chanfix_channel *chan;
+	struct channel *ch;
+	mowgli_patricia_iteration_state_t state;
+
+	MOWGLI_PATRICIA_FOREACH(chan, &state, chanfix_channels)
+		mowgli_node_add(chan, &chan->expirenode, &chanfix_expire_queue);
+
+	MOWGLI_PATRICIA_FOREACH(ch, &state, chanlist)
+	{
+		chan = chanfix_channel_get_or_create(ch);
+		chan->chan = ch;
+
+		chanfix_opped_sync(chan);
+	}
+}
+
 void
 chanfix_gather_init(struct chanfix_persist_record *rec)
 {
 	hook_add_db_write(write_chanfixdb);
 	hook_add_channel_add(chanfix_channel_add_ev);
 	hook_add_channel_delete(chanfix_channel_delete_ev);
+	hook_add_channel_join(chanfix_channel_join_ev);
+	hook_add_channel_part(chanfix_channel_part_ev);
+	hook_add_channel_mode_change(chanfix_channel_mode_change_ev);
 
 	db_register_type_handler("CFDBV", db_h_cfdbv);
 	db_register_type_handler("CFCHAN", db_h_cfchan);
 	db_register_type_handler("CFOP", db_h_cfop);
 	db_register_type_handler("CFMD", db_h_cfmd);
 
-	chanfix_expire_timer = mowgli_timer_add(base_eventloop, "chanfix_expire", chanfix_expire, NULL, CHANFIX_EXPIRE_INTERVAL);
+	chanfix_expire_timer = mowgli_timer_add(base_eventloop, "chanfix_expire", chanfix_expire, NULL, CHANFIX_EXPIRE_INTERVAL / CHANFIX_EXPIRE_SLICES);
 	chanfix_gather_timer = mowgli_timer_add(base_eventloop, "chanfix_gather", chanfix_gather, NULL, CHANFIX_GATHER_INTERVAL);
 
 	if (rec != NULL)
@@ -421,6 +633,8 @@ chanfix_gather_init(struct chanfix_persist_record *rec)
 		chanfix_oprecord_heap = rec->chanfix_oprecord_heap;
 
 		chanfix_channels = rec->chanfix_channels;
+
+		chanfix_gather_resync();
 		return;
 	}
 
@@ -428,14 +642,22 @@ chanfix_gather_init(struct chanfix_persist_record *rec)
 	chanfix_oprecord_heap = mowgli_heap_create(sizeof(struct chanfix_oprecord), 32, BH_LAZY);
 
 	chanfix_channels = mowgli_patricia_create(irccasecanon);
+
+	chanfix_gather_resync();
 }
 
 void
 chanfix_gather_deinit(struct chanfix_persist_record *rec)
 {
+	struct chanfix_channel *chan;
+	mowgli_patricia_iteration_state_t state;
+
 	hook_del_db_write(write_chanfixdb);
 	hook_del_channel_add(chanfix_channel_add_ev);
 	hook_del_channel_delete(chanfix_channel_delete_ev);
+	hook_del_channel_join(chanfix_channel_join_ev);
+	hook_del_channel_part(chanfix_channel_part_ev);
+	hook_del_channel_mode_change(chanfix_channel_mode_change_ev);
 
 	db_unregister_type_handler("CFDBV");
 	db_unregister_type_handler("CFCHAN");
@@ -445,6 +667,10 @@ chanfix_gather_deinit(struct chanfix_persist_record *rec)
 	mowgli_timer_destroy(base_eventloop, chanfix_expire_timer);
 	mowgli_timer_destroy(base_eventloop, chanfix_gather_timer);
 
+	// The member sets and the expiry order are rebuilt when the module is loaded again
+	MOWGLI_PATRICIA_FOREACH(chan, &state, chanfix_channels)
+		chanfix_opped_clear(chan);
+
 	rec->chanfix_channel_heap  = chanfix_channel_heap;
 	rec->chanfix_oprecord_heap = chanfix_oprecord_heap;
 	rec->chanfix_channels      = chanfix_channels;
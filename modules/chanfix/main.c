@@ -12,7 +12,7 @@
 #include "chanfix.h"
 
 #define CHANFIX_PERSIST_STORAGE_NAME "atheme.chanfix.main.persist"
-#define CHANFIX_PERSIST_VERSION      2
+#define CHANFIX_PERSIST_VERSION      3
 
 static mowgli_eventloop_timer_t *chanfix_autofix_timer = NULL;
 
@@ -34,6 +34,17 @@ mod_init(struct module *const restrict m)
 		return;
 	}
 
+	if (rec && rec->version < CHANFIX_PERSIST_VERSION)
+	{
+		slog(LG_ERROR, "chanfix/main: the channel records from version %d cannot be reused by version %d; restart services instead", rec->version, CHANFIX_PERSIST_VERSION);
+		m->mflags = MODFLAG_FAIL;
+
+		sfree(rec);
+		mowgli_global_storage_free(CHANFIX_PERSIST_STORAGE_NAME);
+
+		return;
+	}
+
 	chanfix_gather_init(rec);
 
 	if (rec != NULL)
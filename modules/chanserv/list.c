@@ -40,6 +40,84 @@ struct list_option
 	unsigned int flag;
 };
 
+// The indexes LIST can draw its candidates from
+enum list_source
+{
+	LIST_SOURCE_NAME,
+	LIST_SOURCE_MARKED,
+	LIST_SOURCE_MARK_REASON,
+	LIST_SOURCE_CLOSED,
+	LIST_SOURCE_CLOSE_REASON,
+	LIST_SOURCE_REGISTERED,
+	LIST_SOURCE_LASTUSED,
+	LIST_SOURCE_COUNT,
+};
+
+// How long one slice of a LIST may run before yielding to the event loop
+#define LIST_SLICE_MS           10U
+#define LIST_CHECK_INTERVAL     64U
+
+#define LIST_PRIVDATA           "chanserv:list:entry"
+
+// Where a channel currently sits in the LIST indexes
+struct list_entry
+{
+	struct mychan *         mc;
+	unsigned long           regday;
+	unsigned long           usedday;
+};
+
+// A LIST in progress; its output is spread over several event loop turns
+struct list_req
+{
+	mowgli_node_t                   node;
+	struct sourceinfo *             si;
+	mowgli_eventloop_timer_t *      timer;
+
+	char *                          chanpattern;
+	char *                          markpattern;
+	char *                          closedpattern;
+	unsigned int                    flagset;
+	int                             aclsize;
+	time_t                          age;
+	time_t                          lastused;
+	bool                            closed;
+	bool                            marked;
+
+	unsigned int                    mlock_on;
+	unsigned int                    mlock_off;
+	bool                            mlock_key;
+	bool                            mlock_limit;
+	bool *                          extmlock_on;
+	bool *                          extmlock_off;
+
+	char                            criteriastr[BUFSIZE];
+	char **                         names;
+	size_t                          nnames;
+	size_t                          namesz;
+	size_t                          pos;
+	unsigned int                    matches;
+};
+
+static mowgli_list_t list_reqs = { NULL, NULL, 0 };
+
+/* The indexes are built the first time LIST runs and are kept current from
+ * then on by hooks. A channel's last-used day only moves forward, so one
+ * filed under an older day is merely an extra candidate; it is refiled
+ * when seen.
+ */
+static bool list_indexed = false;
+static mowgli_patricia_t *list_regdays = NULL;
+static mowgli_patricia_t *list_useddays = NULL;
+static mowgli_patricia_t *list_mdsets = NULL;
+
+static const char *const list_indexed_metadata[] = {
+	"private:mark:setter",
+	"private:mark:reason",
+	"private:close:closer",
+	"private:close:reason",
+};
+
 static time_t
 parse_age(const char *s)
 {
@@ -169,6 +247,473 @@ check_extmlock(const struct metadata *md, const bool *modes, bool on)
 	return true;
 }
 
+static void
+list_entry_add(struct mychan *const restrict mc)
+{
+	struct list_entry *const e = smalloc(sizeof *e);
+	mowgli_patricia_iteration_state_t state;
+	struct list_set *set;
+
+	e->mc = mc;
+	e->regday = list_day(mc->registered);
+	e->usedday = list_day(mc->used);
+
+	(void) list_day_insert(list_regdays, e->regday, mc->name, mc);
+	(void) list_day_insert(list_useddays, e->usedday, mc->name, mc);
+
+	MOWGLI_PATRICIA_FOREACH(set, &state, list_mdsets)
+		if (metadata_find(mc, set->name))
+			(void) mowgli_patricia_add(set->members, mc->name, mc);
+
+	(void) privatedata_set(mc, LIST_PRIVDATA, e);
+}
+
+static void
+list_entry_delete(struct list_entry *const restrict e)
+{
+	struct mychan *const mc = e->mc;
+	mowgli_patricia_iteration_state_t state;
+	struct list_set *set;
+
+	(void) list_day_remove(list_regdays, e->regday, mc->name);
+	(void) list_day_remove(list_useddays, e->usedday, mc->name);
+
+	MOWGLI_PATRICIA_FOREACH(set, &state, list_mdsets)
+		(void) mowgli_patricia_delete(set->members, mc->name);
+
+	(void) privatedata_delete(mc, LIST_PRIVDATA);
+	(void) sfree(e);
+}
+
+static void
+list_entry_refresh_used(struct list_entry *const restrict e)
+{
+	const unsigned long usedday = list_day(e->mc->used);
+
+	if (usedday == e->usedday)
+		return;
+
+	(void) list_day_remove(list_useddays, e->usedday, e->mc->name);
+	(void) list_day_insert(list_useddays, usedday, e->mc->name, e->mc);
+
+	e->usedday = usedday;
+}
+
+static void
+list_index_build(void)
+{
+	mowgli_patricia_iteration_state_t state;
+	struct mychan *mc;
+
+	if (list_indexed)
+		return;
+
+	list_regdays = mowgli_patricia_create(&noopcanon);
+	list_useddays = mowgli_patricia_create(&noopcanon);
+	list_mdsets = mowgli_patricia_create(&strcasecanon);
+
+	for (size_t i = 0; i < ARRAY_SIZE(list_indexed_metadata); i++)
+	{
+		struct list_set *const set = list_set_create(list_indexed_metadata[i], 0);
+
+		(void) mowgli_patricia_add(list_mdsets, set->name, set);
+	}
+
+	MOWGLI_PATRICIA_FOREACH(mc, &state, mclist)
+		(void) list_entry_add(mc);
+
+	list_indexed = true;
+
+	(void) slog(LG_DEBUG, "%s: indexed %u channels", __func__, mowgli_patricia_size(mclist));
+}
+
+static void
+list_index_destroy(void)
+{
+	mowgli_patricia_iteration_state_t state;
+	struct mychan *mc;
+
+	if (! list_indexed)
+		return;
+
+	MOWGLI_PATRICIA_FOREACH(mc, &state, mclist)
+	{
+		struct list_entry *const e = privatedata_get(mc, LIST_PRIVDATA);
+
+		if (e)
+			(void) list_entry_delete(e);
+	}
+
+	(void) mowgli_patricia_destroy(list_regdays, &list_set_destroy_cb, NULL);
+	(void) mowgli_patricia_destroy(list_useddays, &list_set_destroy_cb, NULL);
+	(void) mowgli_patricia_destroy(list_mdsets, &list_set_destroy_cb, NULL);
+
+	list_indexed = false;
+}
+
+static void
+list_mychan_add(struct mychan *const restrict mc)
+{
+	if (list_indexed)
+		(void) list_entry_add(mc);
+}
+
+static void
+list_mychan_delete(struct mychan *const restrict mc)
+{
+	struct list_entry *e;
+
+	if (list_indexed && (e = privatedata_get(mc, LIST_PRIVDATA)))
+		(void) list_entry_delete(e);
+}
+
+static void
+list_metadata_change(struct hook_metadata_change *const restrict hdata)
+{
+	struct list_entry *e;
+	struct list_set *set;
+
+	if (! list_indexed || ! (set = mowgli_patricia_retrieve(list_mdsets, hdata->name)))
+		return;
+
+	// Accounts carry the same metadata; only channels have an entry
+	if (! (e = privatedata_get(hdata->target, LIST_PRIVDATA)))
+		return;
+
+	if (hdata->deleted)
+		(void) mowgli_patricia_delete(set->members, e->mc->name);
+	else
+		(void) mowgli_patricia_add(set->members, e->mc->name, e->mc);
+}
+
+static void
+list_req_append(struct list_req *const restrict req, struct mychan *const restrict mc)
+{
+	if (req->nnames == req->namesz)
+	{
+		req->namesz = MAX(req->namesz * 2U, 64U);
+		req->names = sreallocarray(req->names, req->namesz, sizeof *req->names);
+	}
+
+	req->names[req->nnames++] = sstrdup(mc->name);
+}
+
+static void
+list_req_append_set(mowgli_patricia_t *const restrict members, void *const restrict vreq)
+{
+	struct list_req *const req = vreq;
+	mowgli_patricia_iteration_state_t state;
+	struct mychan *mc;
+
+	MOWGLI_PATRICIA_FOREACH(mc, &state, members)
+		(void) list_req_append(req, mc);
+}
+
+static size_t
+list_source_days(struct list_req *const restrict req, mowgli_patricia_t *const restrict tree,
+                 const time_t age, const bool collect)
+{
+	return list_days_before(tree, age, collect ? &list_req_append_set : NULL, req);
+}
+
+static size_t
+list_source_metadata(struct list_req *const restrict req, const char *const restrict name, const bool collect)
+{
+	struct list_set *const set = mowgli_patricia_retrieve(list_mdsets, name);
+
+	if (collect)
+		(void) list_req_append_set(set->members, req);
+
+	return mowgli_patricia_size(set->members);
+}
+
+/* match() also lets a '#' or '&' stand for a digit or a letter, but no
+ * registered channel name starts with either, so a leading one is as good as
+ * literal and the pattern can only match the channel of that name.
+ */
+static bool
+list_pattern_is_name(const char *const restrict pattern)
+{
+	if (*pattern == '#' || *pattern == '&')
+		return match_is_literal(pattern + 1);
+
+	return match_is_literal(pattern);
+}
+
+/* How many candidates one of the request's options narrows the search to,
+ * or SIZE_MAX if no index covers it. With collect set, the candidates are
+ * also added to the request.
+ */
+static size_t
+list_source(struct list_req *const restrict req, const enum list_source which, const bool collect)
+{
+	struct mychan *mc;
+
+	switch (which)
+	{
+		case LIST_SOURCE_NAME:
+			if (! req->chanpattern || ! list_pattern_is_name(req->chanpattern))
+				return SIZE_MAX;
+
+			if (! (mc = mychan_find(req->chanpattern)))
+				return 0;
+
+			if (collect)
+				(void) list_req_append(req, mc);
+
+			return 1;
+
+		case LIST_SOURCE_MARKED:
+			return req->marked ? list_source_metadata(req, "private:mark:setter", collect) : SIZE_MAX;
+
+		case LIST_SOURCE_MARK_REASON:
+			return req->markpattern ? list_source_metadata(req, "private:mark:reason", collect) : SIZE_MAX;
+
+		case LIST_SOURCE_CLOSED:
+			return req->closed ? list_source_metadata(req, "private:close:closer", collect) : SIZE_MAX;
+
+		case LIST_SOURCE_CLOSE_REASON:
+			return req->closedpattern ? list_source_metadata(req, "private:close:reason", collect) : SIZE_MAX;
+
+		case LIST_SOURCE_REGISTERED:
+			return req->age ? list_source_days(req, list_regdays, req->age, collect) : SIZE_MAX;
+
+		case LIST_SOURCE_LASTUSED:
+			return req->lastused ? list_source_days(req, list_useddays, req->lastused, collect) : SIZE_MAX;
+
+		case LIST_SOURCE_COUNT:
+			break;
+	}
+
+	return SIZE_MAX;
+}
+
+// Gather the candidates from the most selective index, or every channel if none applies
+static void
+list_plan(struct list_req *const restrict req)
+{
+	mowgli_patricia_iteration_state_t state;
+	enum list_source best = LIST_SOURCE_COUNT;
+	size_t bestcount = SIZE_MAX;
+	struct mychan *mc;
+
+	for (enum list_source i = 0; i < LIST_SOURCE_COUNT; i++)
+	{
+		const size_t count = list_source(req, i, false);
+
+		if (count < bestcount)
+		{
+			best = i;
+			bestcount = count;
+		}
+	}
+
+	if (best != LIST_SOURCE_COUNT)
+	{
+		(void) list_source(req, best, true);
+		return;
+	}
+
+	MOWGLI_PATRICIA_FOREACH(mc, &state, mclist)
+		(void) list_req_append(req, mc);
+}
+
+static void
+list_req_destroy(struct list_req *const restrict req)
+{
+	if (req->timer)
+		(void) mowgli_timer_destroy(base_eventloop, req->timer);
+
+	for (size_t i = 0; i < req->nnames; i++)
+		(void) sfree(req->names[i]);
+
+	(void) mowgli_node_delete(&req->node, &list_reqs);
+	(void) atheme_object_unref(req->si);
+	(void) sfree(req->chanpattern);
+	(void) sfree(req->markpattern);
+	(void) sfree(req->closedpattern);
+	(void) sfree(req->extmlock_on);
+	(void) sfree(req->extmlock_off);
+	(void) sfree(req->names);
+	(void) sfree(req);
+}
+
+static void
+list_user_delete(struct user *const restrict u)
+{
+	mowgli_node_t *n, *tn;
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, list_reqs.head)
+	{
+		struct list_req *const req = n->data;
+
+		if (req->si->su == u)
+			(void) list_req_destroy(req);
+	}
+}
+
+static bool
+list_req_match(const struct list_req *const restrict req, struct mychan *const restrict mc)
+{
+	if (req->chanpattern != NULL && match(req->chanpattern, mc->name))
+		return false;
+
+	if (req->markpattern)
+	{
+		const struct metadata *md = metadata_find(mc, "private:mark:reason");
+		if (md == NULL || match(req->markpattern, md->value) != 0)
+			return false;
+	}
+
+	if (req->closedpattern)
+	{
+		const struct metadata *md = metadata_find(mc, "private:close:reason");
+		if (md == NULL || match(req->closedpattern, md->value) != 0)
+			return false;
+	}
+
+	if (req->marked && !metadata_find(mc, "private:mark:setter"))
+		return false;
+
+	if (req->closed && !metadata_find(mc, "private:close:closer"))
+		return false;
+
+	if (req->flagset && (mc->flags & req->flagset) != req->flagset)
+		return false;
+
+	if (req->aclsize && MOWGLI_LIST_LENGTH(&mc->chanacs) < (unsigned int)req->aclsize)
+		return false;
+
+	if (req->age && (CURRTIME - mc->registered) < req->age)
+		return false;
+
+	if (req->lastused && (CURRTIME - mc->used) < req->lastused)
+		return false;
+
+	if ((req->mlock_on & mc->mlock_on) != req->mlock_on)
+		return false;
+
+	if ((req->mlock_off & mc->mlock_off) != req->mlock_off)
+		return false;
+
+	if (req->mlock_key && !mc->mlock_key)
+		return false;
+
+	if (req->mlock_limit && !mc->mlock_limit)
+		return false;
+
+	const struct metadata *extmlock_md = metadata_find(mc, "private:mlockext");
+
+	if (!check_extmlock(extmlock_md, req->extmlock_on, true))
+		return false;
+
+	if (!check_extmlock(extmlock_md, req->extmlock_off, false))
+		return false;
+
+	return true;
+}
+
+static void
+list_one(struct sourceinfo *si, struct mychan *mc)
+{
+	// in the future we could add a LIMIT parameter
+	char buf[BUFSIZE] = { 0 };
+
+	if (metadata_find(mc, "private:mark:setter")) {
+		mowgli_strlcat(buf, "\2[marked]\2", BUFSIZE);
+	}
+	if (metadata_find(mc, "private:close:closer")) {
+		if (*buf)
+			mowgli_strlcat(buf, " ", BUFSIZE);
+
+		mowgli_strlcat(buf, "\2[closed]\2", BUFSIZE);
+	}
+	if (mc->flags & MC_HOLD) {
+		if (*buf)
+			mowgli_strlcat(buf, " ", BUFSIZE);
+
+		mowgli_strlcat(buf, "\2[held]\2", BUFSIZE);
+	}
+
+	command_success_nodata(si, "- %s (%s) %s", mc->name, mychan_founder_names(mc), buf);
+}
+
+// Returns true once every candidate has been looked at
+static bool
+list_req_step(struct list_req *const restrict req, const bool unbounded)
+{
+	struct timeval start, elapsed;
+	unsigned int count = 0;
+
+	s_time(&start);
+
+	while (req->pos < req->nnames)
+	{
+		struct mychan *const mc = mychan_find(req->names[req->pos++]);
+		struct list_entry *e;
+
+		// The channel may have been dropped since the LIST started
+		if (mc == NULL)
+			continue;
+
+		if ((e = privatedata_get(mc, LIST_PRIVDATA)))
+			(void) list_entry_refresh_used(e);
+
+		if (list_req_match(req, mc))
+		{
+			list_one(req->si, mc);
+			req->matches++;
+		}
+
+		if (unbounded || ++count % LIST_CHECK_INTERVAL)
+			continue;
+
+		e_time(start, &elapsed);
+
+		if (tv2ms(&elapsed) >= (int) LIST_SLICE_MS)
+			return req->pos >= req->nnames;
+	}
+
+	return true;
+}
+
+static void
+list_req_finish(struct list_req *const restrict req)
+{
+	struct sourceinfo *const si = req->si;
+	const char *const criteriastr = req->criteriastr;
+	const unsigned int matches = req->matches;
+
+	logcommand(si, CMDLOG_ADMIN, "LIST: \2%s\2 (\2%u\2 matches)", criteriastr, matches);
+	if (matches == 0)
+		command_success_nodata(si, _("No channel matched criteria \2%s\2"), criteriastr);
+	else
+		command_success_nodata(si, ngettext(N_("\2%u\2 match for criteria \2%s\2."),
+		                                    N_("\2%u\2 matches for criteria \2%s\2."),
+		                                    matches), matches, criteriastr);
+
+	(void) list_req_destroy(req);
+}
+
+static void
+list_req_slice(void *const restrict vreq)
+{
+	struct list_req *const req = vreq;
+
+	req->timer = NULL;
+
+	/* Only a client on IRC can be answered over several event loop turns;
+	 * RPC callers collect their reply when the command returns.
+	 */
+	if (list_req_step(req, req->si->su == NULL))
+	{
+		(void) list_req_finish(req);
+		return;
+	}
+
+	req->timer = mowgli_timer_add_once(base_eventloop, "list_req_slice", &list_req_slice, req, 0);
+}
+
 static void
 cs_cmd_list(struct sourceinfo *si, int parc, char *parv[])
 {
@@ -221,9 +766,6 @@ cs_cmd_list(struct sourceinfo *si, int parc, char *parv[])
 		return;
 	}
 
-	char criteriastr[BUFSIZE];
-	build_criteriastr(criteriastr, parc, parv);
-
 	unsigned int mlock_on = 0, mlock_off = 0;
 	bool mlock_key = false, mlock_limit = false;
 	bool extmlock_on[ignore_mode_list_size];
@@ -293,100 +835,40 @@ cs_cmd_list(struct sourceinfo *si, int parc, char *parv[])
 		}
 	}
 
-	command_success_nodata(si, _("Channels matching \2%s\2:"), criteriastr);
-
-	unsigned int matches = 0;
-
-	struct mychan *mc;
-	mowgli_patricia_iteration_state_t state;
-
-	MOWGLI_PATRICIA_FOREACH(mc, &state, mclist)
+	struct list_req *const req = smalloc(sizeof *req);
+
+	build_criteriastr(req->criteriastr, parc, parv);
+
+	req->chanpattern = sstrdup(chanpattern);
+	req->markpattern = sstrdup(markpattern);
+	req->closedpattern = sstrdup(closedpattern);
+	req->flagset = flagset;
+	req->aclsize = aclsize;
+	req->age = age;
+	req->lastused = lastused;
+	req->closed = closed;
+	req->marked = marked;
+	req->mlock_on = mlock_on;
+	req->mlock_off = mlock_off;
+	req->mlock_key = mlock_key;
+	req->mlock_limit = mlock_limit;
+	req->extmlock_on = scalloc(MAX(ignore_mode_list_size, 1U), sizeof *req->extmlock_on);
+	req->extmlock_off = scalloc(MAX(ignore_mode_list_size, 1U), sizeof *req->extmlock_off);
+
+	if (ignore_mode_list_size)
 	{
-		if (chanpattern != NULL && match(chanpattern, mc->name))
-			continue;
-
-		if (markpattern)
-		{
-			const struct metadata *md = metadata_find(mc, "private:mark:reason");
-			if (md == NULL || match(markpattern, md->value) != 0)
-				continue;
-		}
-
-		if (closedpattern)
-		{
-			const struct metadata *md = metadata_find(mc, "private:close:reason");
-			if (md == NULL || match(closedpattern, md->value) != 0)
-				continue;
-		}
-
-		if (marked && !metadata_find(mc, "private:mark:setter"))
-			continue;
-
-		if (closed && !metadata_find(mc, "private:close:closer"))
-			continue;
-
-		if (flagset && (mc->flags & flagset) != flagset)
-			continue;
-
-		if (aclsize && MOWGLI_LIST_LENGTH(&mc->chanacs) < (unsigned int)aclsize)
-			continue;
-
-		if (age && (CURRTIME - mc->registered) < age)
-			continue;
-
-		if (lastused && (CURRTIME - mc->used) < lastused)
-			continue;
-
-		if ((mlock_on & mc->mlock_on) != mlock_on)
-			continue;
-
-		if ((mlock_off & mc->mlock_off) != mlock_off)
-			continue;
-
-		if (mlock_key && !mc->mlock_key)
-			continue;
-
-		if (mlock_limit && !mc->mlock_limit)
-			continue;
-
-		const struct metadata *extmlock_md = metadata_find(mc, "private:mlockext");
-
-		if (!check_extmlock(extmlock_md, extmlock_on, true))
-			continue;
-
-		if (!check_extmlock(extmlock_md, extmlock_off, false))
-			continue;
-
-		// in the future we could add a LIMIT parameter
-		char buf[BUFSIZE] = { 0 };
-
-		if (metadata_find(mc, "private:mark:setter")) {
-			mowgli_strlcat(buf, "\2[marked]\2", BUFSIZE);
-		}
-		if (metadata_find(mc, "private:close:closer")) {
-			if (*buf)
-				mowgli_strlcat(buf, " ", BUFSIZE);
-
-			mowgli_strlcat(buf, "\2[closed]\2", BUFSIZE);
-		}
-		if (mc->flags & MC_HOLD) {
-			if (*buf)
-				mowgli_strlcat(buf, " ", BUFSIZE);
+		memcpy(req->extmlock_on, extmlock_on, sizeof extmlock_on);
+		memcpy(req->extmlock_off, extmlock_off, sizeof extmlock_off);
+	}
 
-			mowgli_strlcat(buf, "\2[held]\2", BUFSIZE);
-		}
+	req->si = atheme_object_ref(si);
+	mowgli_node_add(req, &req->node, &list_reqs);
 
-		command_success_nodata(si, "- %s (%s) %s", mc->name, mychan_founder_names(mc), buf);
-		matches++;
-	}
+	command_success_nodata(si, _("Channels matching \2%s\2:"), req->criteriastr);
 
-	logcommand(si, CMDLOG_ADMIN, "LIST: \2%s\2 (\2%u\2 matches)", criteriastr, matches);
-	if (matches == 0)
-		command_success_nodata(si, _("No channel matched criteria \2%s\2"), criteriastr);
-	else
-		command_success_nodata(si, ngettext(N_("\2%u\2 match for criteria \2%s\2."),
-		                                    N_("\2%u\2 matches for criteria \2%s\2."),
-		                                    matches), matches, criteriastr);
+	list_index_build();
+	list_plan(req);
+	list_req_slice(req);
 }
 
 static struct command cs_list = {
@@ -404,12 +886,29 @@ mod_init(struct module *const restrict m)
 	MODULE_TRY_REQUEST_DEPENDENCY(m, "chanserv/main")
 
 	service_named_bind_command("chanserv", &cs_list);
+
+	hook_add_mychan_add(list_mychan_add);
+	hook_add_mychan_delete(list_mychan_delete);
+	hook_add_metadata_change(list_metadata_change);
+	hook_add_user_delete(list_user_delete);
 }
 
 static void
 mod_deinit(const enum module_unload_intent ATHEME_VATTR_UNUSED intent)
 {
+	mowgli_node_t *n, *tn;
+
 	service_named_unbind_command("chanserv", &cs_list);
+
+	hook_del_mychan_add(list_mychan_add);
+	hook_del_mychan_delete(list_mychan_delete);
+	hook_del_metadata_change(list_metadata_change);
+	hook_del_user_delete(list_user_delete);
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, list_reqs.head)
+		(void) list_req_destroy(n->data);
+
+	list_index_destroy();
 }
 
 SIMPLE_DECLARE_MODULE_V1("chanserv/list", MODULE_UNLOAD_CAPABILITY_OK)
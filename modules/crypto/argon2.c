@@ -11,6 +11,17 @@
 
 #include <atheme.h>
 
+#ifdef HAVE_LIBPTHREAD
+/* Verification may run on a password verification worker thread (see
+ * libathemecore/auth.c), and sigprocmask(2) is unspecified in a process
+ * that has more than one thread; pthread_sigmask(3) returns an error number
+ * instead of setting errno.
+ */
+#  define atheme_argon2_sigmask(how, set, oldset)   (errno = pthread_sigmask((how), (set), (oldset)))
+#else
+#  define atheme_argon2_sigmask(how, set, oldset)   sigprocmask((how), (set), (oldset))
+#endif
+
 #define CRYPTO_MODULE_NAME      "crypto/argon2"
 
 #ifdef HAVE_LIBARGON2
@@ -211,7 +222,7 @@ atheme_argon2_compute(argon2_context *const restrict ctx, const enum atheme_argo
 		(void) slog(LG_ERROR, "%s: sigfillset(3): %s", MOWGLI_FUNC_NAME, strerror(errno));
 		return false;
 	}
-	if (sigprocmask(SIG_BLOCK, &newset, &oldset) != 0)
+	if (atheme_argon2_sigmask(SIG_BLOCK, &newset, &oldset) != 0)
 	{
 		(void) slog(LG_ERROR, "%s: sigprocmask(2): %s", MOWGLI_FUNC_NAME, strerror(errno));
 		return false;
@@ -233,7 +244,7 @@ atheme_argon2_compute(argon2_context *const restrict ctx, const enum atheme_argo
 	else
 		result = true;
 
-	if (sigprocmask(SIG_SETMASK, &oldset, NULL) != 0)
+	if (atheme_argon2_sigmask(SIG_SETMASK, &oldset, NULL) != 0)
 		(void) slog(LG_ERROR, "%s: sigprocmask(2): %s", MOWGLI_FUNC_NAME, strerror(errno));
 
 	(void) smemzero(pass, sizeof pass);
@@ -390,9 +401,10 @@ cleanup:
 
 static const struct crypt_impl crypto_argon2_impl = {
 
-	.id         = CRYPTO_MODULE_NAME,
-	.crypt      = &atheme_argon2_crypt,
-	.verify     = &atheme_argon2_verify,
+	.id                = CRYPTO_MODULE_NAME,
+	.crypt             = &atheme_argon2_crypt,
+	.verify            = &atheme_argon2_verify,
+	.verify_threadsafe = true,
 };
 
 static void
@@ -159,9 +159,10 @@ cleanup:
 
 static const struct crypt_impl crypto_bcrypt_impl = {
 
-	.id        = CRYPTO_MODULE_NAME,
-	.crypt     = &atheme_bcrypt_crypt,
-	.verify    = &atheme_bcrypt_verify,
+	.id                = CRYPTO_MODULE_NAME,
+	.crypt             = &atheme_bcrypt_crypt,
+	.verify            = &atheme_bcrypt_verify,
+	.verify_threadsafe = true,
 };
 
 static void
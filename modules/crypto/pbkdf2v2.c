@@ -438,26 +438,41 @@ const struct pbkdf2v2_scram_functions pbkdf2v2_scram_functions = {
 
 #endif /* HAVE_LIBIDN */
 
-static bool ATHEME_FATTR_WUR
-atheme_pbkdf2v2_compute(const char *const restrict password, struct pbkdf2v2_dbentry *const restrict dbe)
+// Puts the password into 'key' in the form PBKDF2 is given it, and returns its length (0 on failure)
+static size_t ATHEME_FATTR_WUR
+atheme_pbkdf2v2_key(const char *const restrict password, const struct pbkdf2v2_dbentry *const restrict dbe,
+                    char key[static (PASSLEN + 1)])
 {
-	char key[PASSLEN + 1];
-	(void) mowgli_strlcpy(key, password, sizeof key);
+	(void) mowgli_strlcpy(key, password, PASSLEN + 1);
 
 #ifdef HAVE_LIBIDN
-	if (dbe->scram && ! atheme_pbkdf2v2_scram_normalize(key, sizeof key))
+	if (dbe->scram && ! atheme_pbkdf2v2_scram_normalize(key, PASSLEN + 1))
 	{
 		(void) slog(LG_DEBUG, "%s: SASLprep normalization of password failed", MOWGLI_FUNC_NAME);
-		(void) smemzero(key, sizeof key);
-		return false;
+		(void) smemzero(key, PASSLEN + 1);
+		return 0;
 	}
+#else
+	(void) dbe;
 #endif /* HAVE_LIBIDN */
 
 	const size_t kl = strlen(key);
 
 	if (! kl)
-	{
 		(void) slog(LG_DEBUG, "%s: password length == 0", MOWGLI_FUNC_NAME);
+
+	return kl;
+}
+
+static bool ATHEME_FATTR_WUR
+atheme_pbkdf2v2_compute(const char *const restrict password, struct pbkdf2v2_dbentry *const restrict dbe)
+{
+	char key[PASSLEN + 1];
+	const size_t kl = atheme_pbkdf2v2_key(password, dbe, key);
+
+	if (! kl)
+	{
+		// This function logs messages on failure
 		(void) smemzero(key, sizeof key);
 		return false;
 	}
@@ -559,54 +574,57 @@ done:
 	return retval;
 }
 
+// Parses the hash and decodes its salt, for atheme_pbkdf2v2_verify() and atheme_pbkdf2v2_verify_batch()
 static bool ATHEME_FATTR_WUR
-atheme_pbkdf2v2_verify(const char *const restrict password, const char *const restrict parameters,
-                       unsigned int *const restrict flags)
+atheme_pbkdf2v2_verify_prepare(const char *const restrict parameters, struct pbkdf2v2_dbentry *const restrict dbe,
+                               unsigned int *const restrict flags)
 {
-	unsigned char csk[DIGEST_MDLEN_MAX];
-	struct pbkdf2v2_dbentry dbe;
-	bool retval = false;
-
-	if (! atheme_pbkdf2v2_parse_dbentry(&dbe, parameters))
+	if (! atheme_pbkdf2v2_parse_dbentry(dbe, parameters))
 		// This function logs messages on failure
-		goto end;
+		return false;
 
-	if (atheme_pbkdf2v2_salt_is_b64(dbe.a))
+	if (atheme_pbkdf2v2_salt_is_b64(dbe->a))
 	{
-		if ((dbe.sl = base64_decode(dbe.salt64, dbe.salt, sizeof dbe.salt)) == BASE64_FAIL)
+		if ((dbe->sl = base64_decode(dbe->salt64, dbe->salt, sizeof dbe->salt)) == BASE64_FAIL)
 		{
-			(void) slog(LG_ERROR, "%s: base64_decode('%s') for salt failed", MOWGLI_FUNC_NAME, dbe.salt64);
-			goto end;
+			(void) slog(LG_ERROR, "%s: base64_decode('%s') for salt failed", MOWGLI_FUNC_NAME, dbe->salt64);
+			return false;
 		}
 
-		if (! atheme_pbkdf2v2_parameters_sane(&dbe))
+		if (! atheme_pbkdf2v2_parameters_sane(dbe))
 			// This function logs messages on failure
-			goto end;
+			return false;
 	}
 	else
 	{
-		dbe.sl = strlen(dbe.salt64);
+		dbe->sl = strlen(dbe->salt64);
 
-		if (! atheme_pbkdf2v2_parameters_sane(&dbe))
+		if (! atheme_pbkdf2v2_parameters_sane(dbe))
 			// This function logs messages on failure
-			goto end;
+			return false;
 
-		(void) memcpy(dbe.salt, dbe.salt64, dbe.sl);
+		(void) memcpy(dbe->salt, dbe->salt64, dbe->sl);
 	}
 
 	*flags |= PWVERIFY_FLAG_MYMODULE;
 
-	if (! atheme_pbkdf2v2_compute(password, &dbe))
-		// This function logs messages on failure
-		goto end;
+	return true;
+}
 
-	if (dbe.scram)
+// Checks the derived key in dbe->cdg against the hash, once it has been computed
+static bool ATHEME_FATTR_WUR
+atheme_pbkdf2v2_verify_finish(const struct pbkdf2v2_dbentry *const restrict dbe, unsigned int *const restrict flags)
+{
+	unsigned char csk[DIGEST_MDLEN_MAX];
+	bool retval = false;
+
+	if (dbe->scram)
 	{
-		if (! atheme_pbkdf2v2_scram_derive(&dbe, dbe.cdg, csk, NULL))
+		if (! atheme_pbkdf2v2_scram_derive(dbe, dbe->cdg, csk, NULL))
 			// This function logs messages on failure
 			goto end;
 
-		if (smemcmp(dbe.ssk, csk, dbe.dl) != 0)
+		if (smemcmp(dbe->ssk, csk, dbe->dl) != 0)
 		{
 			(void) slog(LG_DEBUG, "%s: smemcmp() mismatch on ssk (invalid password?)", MOWGLI_FUNC_NAME);
 			goto end;
@@ -614,24 +632,123 @@ atheme_pbkdf2v2_verify(const char *const restrict password, const char *const re
 	}
 	else
 	{
-		if (smemcmp(dbe.sdg, dbe.cdg, dbe.dl) != 0)
+		if (smemcmp(dbe->sdg, dbe->cdg, dbe->dl) != 0)
 		{
 			(void) slog(LG_DEBUG, "%s: smemcmp() mismatch on sdg (invalid password?)", MOWGLI_FUNC_NAME);
 			goto end;
 		}
 	}
 
-	if (atheme_pbkdf2v2_recrypt(&dbe))
+	if (atheme_pbkdf2v2_recrypt(dbe))
 		*flags |= PWVERIFY_FLAG_RECRYPT;
 
 	retval = true;
 
 end:
 	(void) smemzero(csk, sizeof csk);
+	return retval;
+}
+
+static bool ATHEME_FATTR_WUR
+atheme_pbkdf2v2_verify(const char *const restrict password, const char *const restrict parameters,
+                       unsigned int *const restrict flags)
+{
+	struct pbkdf2v2_dbentry dbe;
+	bool retval = false;
+
+	if (! atheme_pbkdf2v2_verify_prepare(parameters, &dbe, flags))
+		// This function logs messages on failure
+		goto end;
+
+	if (! atheme_pbkdf2v2_compute(password, &dbe))
+		// This function logs messages on failure
+		goto end;
+
+	retval = atheme_pbkdf2v2_verify_finish(&dbe, flags);
+
+end:
 	(void) smemzero(&dbe, sizeof dbe);
 	return retval;
 }
 
+struct pbkdf2v2_batch_entry
+{
+	struct pbkdf2v2_dbentry     dbe;
+	char                        key[PASSLEN + 1];
+	size_t                      kl;
+	bool                        pending;            // waiting for its key to be derived
+};
+
+/* Like atheme_pbkdf2v2_verify() for each of the items, but the derivations
+ * that share a digest and an iteration count are done together, which the
+ * multi-buffer SHA2 kernels (see digest_oneshot_pbkdf2_batch()) are faster at.
+ */
+static void
+atheme_pbkdf2v2_verify_batch(struct crypt_verify_item *const restrict items, const size_t count)
+{
+	struct pbkdf2v2_batch_entry *const entries = smalloc(count * sizeof *entries);
+	struct digest_pbkdf2_job *const jobs = smalloc(count * sizeof *jobs);
+	size_t *const jobidx = smalloc(count * sizeof *jobidx);
+
+	for (size_t i = 0; i < count; i++)
+	{
+		struct pbkdf2v2_batch_entry *const e = &entries[i];
+
+		items[i].verified = false;
+
+		if (! atheme_pbkdf2v2_verify_prepare(items[i].parameters, &e->dbe, &items[i].flags))
+			// This function logs messages on failure
+			continue;
+
+		if (! (e->kl = atheme_pbkdf2v2_key(items[i].password, &e->dbe, e->key)))
+			// This function logs messages on failure
+			continue;
+
+		e->pending = true;
+	}
+
+	for (size_t i = 0; i < count; i++)
+	{
+		if (! entries[i].pending)
+			continue;
+
+		const struct pbkdf2v2_dbentry *const first = &entries[i].dbe;
+		size_t njobs = 0;
+
+		for (size_t j = i; j < count; j++)
+		{
+			struct pbkdf2v2_batch_entry *const e = &entries[j];
+
+			if (! e->pending || e->dbe.md != first->md || e->dbe.c != first->c)
+				continue;
+
+			jobs[njobs].pass = e->key;
+			jobs[njobs].passLen = e->kl;
+			jobs[njobs].salt = e->dbe.salt;
+			jobs[njobs].saltLen = e->dbe.sl;
+			jobs[njobs].dk = e->dbe.cdg;
+			jobs[njobs].dkLen = e->dbe.dl;
+			jobidx[njobs++] = j;
+
+			e->pending = false;
+		}
+
+		if (! digest_oneshot_pbkdf2_batch(first->md, first->c, jobs, njobs))
+		{
+			(void) slog(LG_ERROR, "%s: digest_oneshot_pbkdf2_batch() failed (BUG)", MOWGLI_FUNC_NAME);
+			continue;
+		}
+
+		for (size_t k = 0; k < njobs; k++)
+			items[jobidx[k]].verified = atheme_pbkdf2v2_verify_finish(&entries[jobidx[k]].dbe,
+			                                                          &items[jobidx[k]].flags);
+	}
+
+	(void) smemzerofree(entries, count * sizeof *entries);
+	(void) smemzerofree(jobs, count * sizeof *jobs);
+	(void) sfree(jobidx);
+}
+
 static int
 c_ci_pbkdf2v2_digest(mowgli_config_file_entry_t *const restrict ce)
 {
@@ -699,9 +816,11 @@ c_ci_pbkdf2v2_digest(mowgli_config_file_entry_t *const restrict ce)
 
 static const struct crypt_impl crypto_pbkdf2v2_impl = {
 
-	.id         = CRYPTO_MODULE_NAME,
-	.crypt      = &atheme_pbkdf2v2_crypt,
-	.verify     = &atheme_pbkdf2v2_verify,
+	.id                = CRYPTO_MODULE_NAME,
+	.crypt             = &atheme_pbkdf2v2_crypt,
+	.verify            = &atheme_pbkdf2v2_verify,
+	.verify_batch      = &atheme_pbkdf2v2_verify_batch,
+	.verify_threadsafe = true,
 };
 
 static void
@@ -84,9 +84,10 @@ atheme_scrypt_verify(const char *const restrict password, const char *const rest
 
 static const struct crypt_impl crypto_scrypt_impl = {
 
-	.id        = CRYPTO_MODULE_NAME,
-	.crypt     = &atheme_scrypt_crypt,
-	.verify    = &atheme_scrypt_verify,
+	.id                = CRYPTO_MODULE_NAME,
+	.crypt             = &atheme_scrypt_crypt,
+	.verify            = &atheme_scrypt_verify,
+	.verify_threadsafe = true,
 };
 
 static void
@@ -36,7 +36,7 @@ write_groupdb(struct database_handle *db)
 		struct mygroup *mg = group(mt);
 		continue_if_fail(mg != NULL);
 
-		char *mgflags = gflags_tostr(mg_flags, mg->flags);
+		const char *mgflags = gflags_tostr_cached(mg_flags, mg->flags);
 
 		db_start_row(db, "GRP");
 		db_write_word(db, entity(mg)->id);
@@ -69,7 +69,7 @@ write_groupdb(struct database_handle *db)
 		MOWGLI_ITER_FOREACH(n, mg->acs.head)
 		{
 			struct groupacs *ga = n->data;
-			char *flags = gflags_tostr(ga_flags, ga->flags);
+			const char *flags = gflags_tostr_cached(ga_flags, ga->flags);
 
 			db_start_row(db, "GACL");
 			db_write_word(db, entity(mg)->name);
@@ -139,7 +139,7 @@ db_h_grp(struct database_handle *db, const char *type)
 	{
 		flagset = db_sread_word(db);
 
-		if (!gflags_fromstr(mg_flags, flagset, &mg->flags))
+		if (!gflags_fromstr_cached(mg_flags, flagset, &mg->flags))
 			slog(LG_INFO, "db-h-grp: line %u: confused by flags: %s", db->line, flagset);
 	}
 }
@@ -174,7 +174,7 @@ db_h_gacl(struct database_handle *db, const char *type)
 	{
 		flagset = db_sread_word(db);
 
-		if (!gflags_fromstr(ga_flags, flagset, &flags))
+		if (!gflags_fromstr_cached(ga_flags, flagset, &flags))
 			slog(LG_INFO, "db-h-gacl: line %u: confused by flags: %s", db->line, flagset);
 
 		/* ACL view permission was added, so make up the permission (#279), but only if the database
@@ -32,6 +32,8 @@ ms_cmd_delete(struct sourceinfo *si, int parc, char *parv[])
 		return;
 	}
 
+	myuser_memos_thaw(si->smu);
+
 	// Do we have any memos?
 	if (!si->smu->memos.count)
 	{
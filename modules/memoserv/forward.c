@@ -38,6 +38,8 @@ ms_cmd_forward(struct sourceinfo *si, int parc, char *parv[])
 		return;
 	}
 
+	myuser_memos_thaw(si->smu);
+
 	// Check to see if any memos
 	if (!si->smu->memos.count)
 	{
@@ -52,6 +54,8 @@ ms_cmd_forward(struct sourceinfo *si, int parc, char *parv[])
 		return;
 	}
 
+	myuser_memos_thaw(tmu);
+
 	// Make sure target isn't sender
 	if (si->smu == tmu)
 	{
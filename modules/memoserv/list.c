@@ -22,6 +22,8 @@ ms_cmd_list(struct sourceinfo *si, int parc, char *parv[])
 	char chan[CHANNELLEN + 1];
 	char *p;
 
+	myuser_memos_thaw(si->smu);
+
 	command_success_nodata(si, ngettext(N_("You have %zu memo (%u new)."),
 					    N_("You have %zu memos (%u new)."),
 					    si->smu->memos.count), si->smu->memos.count, si->smu->memoct_new);
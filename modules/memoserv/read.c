@@ -35,6 +35,8 @@ ms_cmd_read(struct sourceinfo *si, int parc, char *parv[])
 		return;
 	}
 
+	myuser_memos_thaw(si->smu);
+
 	// Check to see if any memos
 	if (!si->smu->memos.count)
 	{
@@ -79,6 +81,9 @@ ms_cmd_read(struct sourceinfo *si, int parc, char *parv[])
 					myuser_notice(si->service->me->nick, tmu, "%s has read your memo, which was sent at %s", entity(si->smu)->name, strfbuf);
 				else
 				{
+					if (tmu != NULL)
+						myuser_memos_thaw(tmu);
+
 					// If they have an account, their inbox is not full and they aren't memoserv
 					if ( (tmu != NULL) && (tmu->memos.count < me.mdlimit) && strcasecmp(si->service->nick, memo->sender))
 					{
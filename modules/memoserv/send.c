@@ -80,6 +80,8 @@ ms_cmd_send(struct sourceinfo *si, int parc, char *parv[])
 			return;
 		}
 
+		myuser_memos_thaw(tmu);
+
 		si->smu->memo_ratelimit_num++;
 		si->smu->memo_ratelimit_time = CURRTIME;
 
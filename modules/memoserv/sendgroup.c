@@ -96,7 +96,7 @@ ms_cmd_sendgroup(struct sourceinfo *si, int parc, char *parv[])
 			continue;
 
 		// Check to make sure target inbox not full
-		if (tmu->memos.count >= *maxmemos)
+		if (myuser_memos_count(tmu) >= *maxmemos)
 			continue;
 
 		// As in SEND to a single user, make ignore fail silently
@@ -129,9 +129,18 @@ ms_cmd_sendgroup(struct sourceinfo *si, int parc, char *parv[])
 		mowgli_strlcpy(memo->sender, entity(si->smu)->name, sizeof memo->sender);
 		snprintf(memo->text, sizeof memo->text, "%s %s", entity(mg)->name, m);
 
-		// Create a linked list node and add to memos
-		n = mowgli_node_create();
-		mowgli_node_add(memo, n, &tmu->memos);
+		// Dormant accounts keep their memos in cold storage; add it there rather than bringing them back
+		const bool cold = myuser_memo_append_cold(tmu, memo);
+
+		if (! cold)
+		{
+			myuser_memos_thaw(tmu);
+
+			// Create a linked list node and add to memos
+			n = mowgli_node_create();
+			mowgli_node_add(memo, n, &tmu->memos);
+		}
+
 		tmu->memoct_new++;
 
 		// Should we email this?
@@ -146,12 +155,15 @@ ms_cmd_sendgroup(struct sourceinfo *si, int parc, char *parv[])
 
 		// Is the user online? If so, tell them about the new memo.
 		if (si->su == NULL || !irccasecmp(si->su->nick, entity(si->smu)->name))
-			myuser_notice(memoserv->nick, tmu, "You have a new memo from %s (%zu).", entity(si->smu)->name, MOWGLI_LIST_LENGTH(&tmu->memos));
+			myuser_notice(memoserv->nick, tmu, "You have a new memo from %s (%zu).", entity(si->smu)->name, myuser_memos_count(tmu));
 		else
-			myuser_notice(memoserv->nick, tmu, "You have a new memo from %s (nick: %s) (%zu).", entity(si->smu)->name, si->su->nick, MOWGLI_LIST_LENGTH(&tmu->memos));
+			myuser_notice(memoserv->nick, tmu, "You have a new memo from %s (nick: %s) (%zu).", entity(si->smu)->name, si->su->nick, myuser_memos_count(tmu));
 
 		myuser_notice(si->service->nick, tmu, "To read it, type \2/msg %s READ %zu\2",
-		              memoserv->disp, MOWGLI_LIST_LENGTH(&tmu->memos));
+		              memoserv->disp, myuser_memos_count(tmu));
+
+		if (cold)
+			sfree(memo);
 	}
 
 	// Tell user memo sent, return
@@ -310,6 +310,11 @@ httpd_recvqhandler(struct connection *cptr)
 			else
 				check_close(cptr);
 		}
+		else if (is_get && ph->get)
+		{
+			ph->handler(cptr, NULL);
+			clear_httpddata(hd);
+		}
 		else
 		{
 			if (hd->length <= 0)
@@ -351,11 +356,22 @@ static void
 httpd_closehandler(struct connection *cptr)
 {
 	struct httpddata *hd;
+	mowgli_node_t *n, *tn;
 
 	slog(LG_DEBUG, "httpd_closehandler(): fd %d (%s) closed", cptr->fd, cptr->name);
 	hd = cptr->userdata;
 	if (hd != NULL)
 	{
+		// Nothing may answer a request on this connection any more
+		MOWGLI_ITER_FOREACH_SAFE(n, tn, hd->pending.head)
+		{
+			const struct httpd_pending *const pending = (const struct httpd_pending *) n;
+			void *const data = n->data;
+
+			mowgli_node_delete(n, &hd->pending);
+			pending->cancel(data);
+		}
+
 		sfree(hd->requestbuf);
 		sfree(hd);
 	}
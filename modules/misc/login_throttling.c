@@ -18,38 +18,168 @@
 #define LT_BURST_IPACCT_DEF     2U
 #define LT_REPLENISH_IPACCT_DEF 0.5
 
-#define MAX_ADDR_LEN            56U // strlen("2001:0db8:0000:0000:0000:0000:0000:0001%abcdefghabcdefgh")
+#define LT_TABLE_SIZE_MIN       1024U
+#define LT_TABLE_SIZE_MAX       16777216U
+#define LT_TABLE_SIZE_DEF       65536U
+
+#define LT_IPV6_PREFIX_MIN      32U
+#define LT_IPV6_PREFIX_MAX      128U
+#define LT_IPV6_PREFIX_DEF      64U
+
+#define LT_WAYS                 4U  // entries per set; 4 * sizeof(struct lt_entry) is one cache line
+#define LT_CACHELINE            64U
+
+/* Buckets live in a fixed-size table of sets, indexed by a keyed hash of
+ * the (binary, possibly prefix-truncated) address and optionally account.
+ * Every key has two candidate sets (as in cuckoo hashing, but without
+ * relocation); when both are full, the entry closest to being fully
+ * replenished is evicted. This keeps both memory and the cost of a login
+ * attempt bounded, however many addresses are trying to log in.
+ *
+ * A bucket that has fully replenished is indistinguishable from one that
+ * does not exist, so entries never need to be expired explicitly.
+ */
+struct lt_entry
+{
+	uint64_t        tag;        // hash of the key; 0 if the entry is unused
+	double          timestamp;  // when the bucket will be fully replenished
+};
 
-struct lt_bucket
+enum lt_key_type
 {
-	double  timestamp;
-	char    key[MAX_ADDR_LEN + 1 + IDLEN + 1];
+	LT_KEY_ADDRESS          = 1,
+	LT_KEY_ADDRESS_ACCOUNT  = 2,
 };
 
 static mowgli_list_t lt_config_table;
-static mowgli_patricia_t *lt_buckets = NULL;
-static mowgli_eventloop_timer_t *lt_expire_timer = NULL;
+static void *lt_table_mem = NULL;
+static struct lt_entry *lt_table = NULL;
+static size_t lt_table_sets = 0;
+static uint64_t lt_hash_key[2];
+static unsigned long lt_evictions = 0;
 
 static unsigned int lt_address_account_burst = 0U;
 static double lt_address_account_replenish = 0.0;
 static unsigned int lt_address_burst = 0U;
 static double lt_address_replenish = 0.0;
+static unsigned int lt_table_size = 0U;
+static unsigned int lt_ipv6_prefix = 0U;
+
+#define LT_ROTL64(x, b) ((uint64_t) (((x) << (b)) | ((x) >> (64U - (b)))))
+
+#define LT_SIPROUND                                                                     \
+    do {                                                                                \
+        v0 += v1; v1 = LT_ROTL64(v1, 13); v1 ^= v0; v0 = LT_ROTL64(v0, 32);             \
+        v2 += v3; v3 = LT_ROTL64(v3, 16); v3 ^= v2;                                     \
+        v0 += v3; v3 = LT_ROTL64(v3, 21); v3 ^= v0;                                     \
+        v2 += v1; v1 = LT_ROTL64(v1, 17); v1 ^= v2; v2 = LT_ROTL64(v2, 32);             \
+    } while (0)
+
+// SipHash-2-4; the key is random, so an attacker can't aim for particular sets
+static uint64_t
+lt_siphash(const unsigned char *const restrict in, const size_t len)
+{
+	uint64_t v0 = lt_hash_key[0] ^ UINT64_C(0x736F6D6570736575);
+	uint64_t v1 = lt_hash_key[1] ^ UINT64_C(0x646F72616E646F6D);
+	uint64_t v2 = lt_hash_key[0] ^ UINT64_C(0x6C7967656E657261);
+	uint64_t v3 = lt_hash_key[1] ^ UINT64_C(0x7465646279746573);
+	uint64_t b = ((uint64_t) len) << 56U;
+	size_t i;
+
+	for (i = 0; (i + 8U) <= len; i += 8U)
+	{
+		uint64_t m = 0;
+
+		for (unsigned int j = 0; j < 8U; j++)
+			m |= ((uint64_t) in[i + j]) << (8U * j);
+
+		v3 ^= m;
+		LT_SIPROUND;
+		LT_SIPROUND;
+		v0 ^= m;
+	}
+
+	for (unsigned int j = 0; i < len; i++, j++)
+		b |= ((uint64_t) in[i]) << (8U * j);
+
+	v3 ^= b;
+	LT_SIPROUND;
+	LT_SIPROUND;
+	v0 ^= b;
+	v2 ^= 0xFFU;
+	LT_SIPROUND;
+	LT_SIPROUND;
+	LT_SIPROUND;
+	LT_SIPROUND;
+
+	return (v0 ^ v1 ^ v2 ^ v3);
+}
+
+#undef LT_SIPROUND
+#undef LT_ROTL64
+
+static void
+lt_table_free(void)
+{
+	(void) sfree(lt_table_mem);
+
+	lt_table_mem = NULL;
+	lt_table = NULL;
+	lt_table_sets = 0;
+}
+
+// (Re)allocates the table if the configured size changed; this forgets all buckets
+static void
+lt_table_update(void)
+{
+	size_t sets = 1;
+
+	while ((sets * 2U * LT_WAYS) <= lt_table_size)
+		sets *= 2U;
+
+	if (lt_table && sets == lt_table_sets)
+		return;
+
+	(void) lt_table_free();
+
+	lt_table_mem = smalloc((sets * LT_WAYS * sizeof *lt_table) + LT_CACHELINE);
+	lt_table = (void *) ((((uintptr_t) lt_table_mem) + (LT_CACHELINE - 1U)) & ~((uintptr_t) (LT_CACHELINE - 1U)));
+	lt_table_sets = sets;
+}
 
 static inline bool
-lt_deny_common(const double currts, const char *const restrict key,
+lt_deny_common(const double currts, const unsigned char *const restrict key, const size_t keylen,
                const unsigned int vburst, const double vreplenish)
 {
 	if (! vburst)
 		return false;
 
-	struct lt_bucket *bucket = mowgli_patricia_retrieve(lt_buckets, key);
+	const uint64_t hash = lt_siphash(key, keylen);
+	const uint64_t tag = (hash | 1U);
+	struct lt_entry *const set1 = &lt_table[(hash & (lt_table_sets - 1U)) * LT_WAYS];
+	struct lt_entry *const set2 = &lt_table[((hash >> 32U) & (lt_table_sets - 1U)) * LT_WAYS];
+	struct lt_entry *bucket = NULL;
+	struct lt_entry *victim = NULL;
+
+	for (unsigned int i = 0; i < (2U * LT_WAYS) && ! bucket; i++)
+	{
+		struct lt_entry *const entry = (i < LT_WAYS) ? &set1[i] : &set2[i - LT_WAYS];
+
+		if (entry->tag == tag)
+			bucket = entry;
+		else if (! victim || entry->timestamp < victim->timestamp)
+			victim = entry;
+	}
 
 	if (! bucket)
 	{
-		bucket = smalloc(sizeof *bucket);
+		// Unused and fully replenished entries have a timestamp in the past
+		if (victim->tag && victim->timestamp >= currts)
+			lt_evictions++;
 
-		(void) mowgli_strlcpy(bucket->key, key, sizeof bucket->key);
-		(void) mowgli_patricia_add(lt_buckets, bucket->key, bucket);
+		bucket = victim;
+		bucket->tag = tag;
+		bucket->timestamp = currts;
 	}
 
 	/* bucket->timestamp tells us when our bucket will next be totally
@@ -94,21 +224,29 @@ lt_deny_common(const double currts, const char *const restrict key,
 }
 
 static bool
-lt_deny_iplogin(const double currts, const char *const restrict ipaddr,
+lt_deny_iplogin(const double currts, const unsigned char *const restrict addr,
                 struct myuser ATHEME_VATTR_UNUSED *const restrict mu)
 {
-	return lt_deny_common(currts, ipaddr, lt_address_burst, lt_address_replenish);
+	unsigned char key[1 + 16];
+
+	key[0] = LT_KEY_ADDRESS;
+	(void) memcpy(key + 1, addr, 16);
+
+	return lt_deny_common(currts, key, sizeof key, lt_address_burst, lt_address_replenish);
 }
 
 static bool
-lt_deny_ipacctlogin(const double currts, const char *const restrict ipaddr,
+lt_deny_ipacctlogin(const double currts, const unsigned char *const restrict addr,
                     struct myuser *const restrict mu)
 {
-	char key[BUFSIZE];
+	unsigned char key[1 + 16 + IDLEN + 1];
+	const size_t idlen = strlen(entity(mu)->id);
 
-	(void) snprintf(key, sizeof key, "%s/%s", ipaddr, entity(mu)->id);
+	key[0] = LT_KEY_ADDRESS_ACCOUNT;
+	(void) memcpy(key + 1, addr, 16);
+	(void) memcpy(key + 1 + 16, entity(mu)->id, idlen);
 
-	return lt_deny_common(currts, key, lt_address_account_burst, lt_address_account_replenish);
+	return lt_deny_common(currts, key, 1 + 16 + idlen, lt_address_account_burst, lt_address_account_replenish);
 }
 
 static void
@@ -116,7 +254,7 @@ lt_user_can_login_hook(struct hook_user_login_check *const restrict hdata)
 {
 	static const struct {
 		const char *    type;
-		bool          (*func)(double, const char *, struct myuser *);
+		bool          (*func)(double, const unsigned char *, struct myuser *);
 	} checks[] = {
 		{         "IPADDR", &lt_deny_iplogin     },
 		{ "IPADDR/ACCOUNT", &lt_deny_ipacctlogin },
@@ -137,6 +275,10 @@ lt_user_can_login_hook(struct hook_user_login_check *const restrict hdata)
 		// We only throttle password-based login attempts
 		return;
 
+	if (hdata->recheck)
+		// This attempt was already counted before its password was verified
+		return;
+
 	if (hdata->si->su && is_ircop(hdata->si->su))
 		// Don't throttle opers
 		return;
@@ -152,23 +294,40 @@ lt_user_can_login_hook(struct hook_user_login_check *const restrict hdata)
 		// We can't determine their IP address
 		return;
 
-	if (inet_pton(AF_INET, ipaddr, addrbytes) == 1)
+	(void) memset(addrbytes, 0x00, sizeof addrbytes);
+
+	if (inet_pton(AF_INET, ipaddr, addrbytes + 12) == 1)
 	{
-		// Do Nothing
+		// Store it as an IPv4-mapped IPv6 address
+		addrbytes[10] = 0xFFU;
+		addrbytes[11] = 0xFFU;
 	}
 	else if (inet_pton(AF_INET6, ipaddr, addrbytes) == 1)
 	{
-		// Do Nothing
+		static const unsigned char v4mapped[12] = {
+			0x00U, 0x00U, 0x00U, 0x00U, 0x00U, 0x00U, 0x00U, 0x00U, 0x00U, 0x00U, 0xFFU, 0xFFU,
+		};
+
+		/* An IPv4-mapped address (::ffff:a.b.c.d) is an IPv4 client, and is
+		 * stored as it is above; masking it to the prefix would put every one
+		 * of them in the same bucket
+		 */
+		if (memcmp(addrbytes, v4mapped, sizeof v4mapped) != 0)
+			// Throttle a whole prefix together; clients usually get at least a /64 each
+			for (unsigned int bit = lt_ipv6_prefix; bit < 128U; bit++)
+				addrbytes[bit / 8U] &= (unsigned char) ~(0x80U >> (bit % 8U));
 	}
 	else
 		// Invalid IP address
 		return;
 
+	(void) lt_table_update();
+
 	const time_t currts = time(NULL);
 
 	for (size_t i = 0; i < ARRAY_SIZE(checks); i++)
 	{
-		if (! ((*(checks[i].func))((double) currts, ipaddr, hdata->mu)))
+		if (! ((*(checks[i].func))((double) currts, addrbytes, hdata->mu)))
 			continue;
 
 		(void) slog(LG_VERBOSE, "LOGIN:THROTTLE:%s: \2%s\2 (\2%s\2)",
@@ -182,58 +341,22 @@ lt_user_can_login_hook(struct hook_user_login_check *const restrict hdata)
 static void
 lt_operserv_info_hook(struct sourceinfo *const restrict si)
 {
-	const unsigned int vsize = mowgli_patricia_size(lt_buckets);
-
-	(void) command_success_nodata(si, _("Number of login throttling entries: %u"), vsize);
-}
-
-static void
-lt_expire_timer_cb(void ATHEME_VATTR_UNUSED *const restrict unused)
-{
-	mowgli_patricia_iteration_state_t state;
-	struct lt_bucket *bucket;
-
-	const time_t currts = time(NULL);
-
-	MOWGLI_PATRICIA_FOREACH(bucket, &state, lt_buckets)
-	{
-		if (((time_t) bucket->timestamp) > currts)
-			continue;
+	const double currts = (double) time(NULL);
+	size_t active = 0;
 
-		(void) mowgli_patricia_delete(lt_buckets, bucket->key);
-		(void) sfree(bucket);
-	}
-}
+	for (size_t i = 0; i < (lt_table_sets * LT_WAYS); i++)
+		if (lt_table[i].tag && lt_table[i].timestamp >= currts)
+			active++;
 
-static void
-lt_patricia_destroy_cb(const char ATHEME_VATTR_UNUSED *const restrict key,
-                       void *const restrict bucket,
-                       void ATHEME_VATTR_UNUSED *const restrict unused)
-{
-	(void) sfree(bucket);
+	(void) command_success_nodata(si, _("Number of login throttling entries: %zu (of %zu)"),
+	                              active, lt_table_sets * LT_WAYS);
+	(void) command_success_nodata(si, _("Login throttling entries evicted early: %lu"), lt_evictions);
 }
 
 static void
 mod_init(struct module *const restrict m)
 {
-	if (! (lt_buckets = mowgli_patricia_create(&strcasecanon)))
-	{
-		(void) slog(LG_ERROR, "%s: mowgli_patricia_create() failed", m->name);
-
-		m->mflags |= MODFLAG_FAIL;
-		return;
-	}
-
-	if (! (lt_expire_timer = mowgli_timer_add(base_eventloop, "login_throttle_expire_timer",
-	                                          &lt_expire_timer_cb, NULL, SECONDS_PER_HOUR)))
-	{
-		(void) slog(LG_ERROR, "%s: mowgli_timer_add() failed", m->name);
-
-		(void) mowgli_patricia_destroy(lt_buckets, NULL, NULL);
-
-		m->mflags |= MODFLAG_FAIL;
-		return;
-	}
+	(void) atheme_random_buf(lt_hash_key, sizeof lt_hash_key);
 
 	(void) hook_add_operserv_info(&lt_operserv_info_hook);
 	(void) hook_add_user_can_login(&lt_user_can_login_hook);
@@ -247,6 +370,12 @@ mod_init(struct module *const restrict m)
 	                          LT_BURST_MIN, LT_BURST_MAX, LT_BURST_IP_DEF);
 	(void) add_double_conf_item("address_replenish", &lt_config_table, 0, &lt_address_replenish,
 	                          LT_REPLENISH_MIN, LT_REPLENISH_MAX, LT_REPLENISH_IP_DEF);
+	(void) add_uint_conf_item("table_size", &lt_config_table, 0, &lt_table_size,
+	                          LT_TABLE_SIZE_MIN, LT_TABLE_SIZE_MAX, LT_TABLE_SIZE_DEF);
+	(void) add_uint_conf_item("ipv6_prefix", &lt_config_table, 0, &lt_ipv6_prefix,
+	                          LT_IPV6_PREFIX_MIN, LT_IPV6_PREFIX_MAX, LT_IPV6_PREFIX_DEF);
+
+	(void) lt_table_update();
 }
 
 static void
@@ -256,12 +385,13 @@ mod_deinit(const enum module_unload_intent ATHEME_VATTR_UNUSED intent)
 	(void) del_conf_item("address_account_replenish", &lt_config_table);
 	(void) del_conf_item("address_burst", &lt_config_table);
 	(void) del_conf_item("address_replenish", &lt_config_table);
+	(void) del_conf_item("table_size", &lt_config_table);
+	(void) del_conf_item("ipv6_prefix", &lt_config_table);
 	(void) del_top_conf("throttle");
 
 	(void) hook_del_operserv_info(&lt_operserv_info_hook);
 	(void) hook_del_user_can_login(&lt_user_can_login_hook);
-	(void) mowgli_timer_destroy(base_eventloop, lt_expire_timer);
-	(void) mowgli_patricia_destroy(lt_buckets, &lt_patricia_destroy_cb, NULL);
+	(void) lt_table_free();
 }
 
 SIMPLE_DECLARE_MODULE_V1("misc/login_throttling", MODULE_UNLOAD_CAPABILITY_OK)
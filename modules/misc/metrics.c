@@ -0,0 +1,259 @@
+/*
+ * SPDX-License-Identifier: ISC
+ * SPDX-URL: https://spdx.org/licenses/ISC.html
+ *
+ * Copyright (C) 2026 Atheme Development Group (https://atheme.github.io/)
+ *
+ * Exports the core's counters on the built-in HTTP server at /metrics, in the
+ * Prometheus text format.
+ */
+
+#include <atheme.h>
+
+static mowgli_list_t *httpd_path_handlers = NULL;
+
+static const struct {
+	const char *            name;
+	const char *            help;
+	const unsigned int *    value;
+} metrics_gauges[] = {
+	{ "atheme_servers",             "Servers on the network",                       &cnt.server        },
+	{ "atheme_users",               "Users on the network",                         &cnt.user          },
+	{ "atheme_channels",            "Channels on the network",                      &cnt.chan          },
+	{ "atheme_channel_members",     "Channel memberships on the network",           &cnt.chanuser      },
+	{ "atheme_accounts",            "Registered accounts",                          &cnt.myuser        },
+	{ "atheme_nicknames",           "Registered nicknames",                         &cnt.mynick        },
+	{ "atheme_registered_channels", "Registered channels",                          &cnt.mychan        },
+	{ "atheme_chanacs",             "Channel access list entries",                  &cnt.chanacs       },
+	{ "atheme_klines",              "Network bans (K-lines)",                       &cnt.kline         },
+	{ "atheme_xlines",              "Gecos bans (X-lines)",                         &cnt.xline         },
+	{ "atheme_qlines",              "Nickname and channel reservations (Q-lines)",  &cnt.qline         },
+	{ "atheme_svsignores",          "Services ignores",                             &cnt.svsignore     },
+	{ "atheme_sopers",              "Services operators",                           &cnt.soper         },
+};
+
+static void ATHEME_FATTR_PRINTF(2, 3)
+metrics_printf(mowgli_string_t *const restrict str, const char *const restrict fmt, ...)
+{
+	char buf[BUFSIZE];
+	va_list ap;
+
+	va_start(ap, fmt);
+	const int len = vsnprintf(buf, sizeof buf, fmt, ap);
+	va_end(ap);
+
+	if (len > 0)
+		(void) mowgli_string_append(str, buf, ((size_t) len < sizeof buf) ? (size_t) len : sizeof buf - 1);
+}
+
+static void
+metrics_header(mowgli_string_t *const restrict str, const char *const restrict name,
+               const char *const restrict type, const char *const restrict help)
+{
+	(void) metrics_printf(str, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+// Label values are service and command names, which should never need this
+static const char *
+metrics_label(const char *const restrict value, char *const restrict buf, const size_t bufsz)
+{
+	size_t i = 0;
+
+	for (const char *p = value; *p && i + 2 < bufsz; p++)
+	{
+		if (*p == '\\' || *p == '"')
+			buf[i++] = '\\';
+		else if (*p == '\n')
+			continue;
+
+		buf[i++] = *p;
+	}
+
+	buf[i] = '\0';
+
+	return buf;
+}
+
+/* The core's histograms have far more buckets than is useful to scrape; only
+ * the powers of two from 16us on are exported, which its buckets line up with.
+ */
+static void
+metrics_histogram(mowgli_string_t *const restrict str, const char *const restrict name,
+                  const struct metrics_timing *const restrict timing)
+{
+	unsigned long long cumulative = 0;
+
+	for (unsigned int i = 0; i < METRICS_BUCKETS; i++)
+	{
+		cumulative += timing->bucket[i];
+
+		if (i < (2U * METRICS_SUB_BUCKETS) - 1U || (i % METRICS_SUB_BUCKETS) != METRICS_SUB_BUCKETS - 1U)
+			continue;
+
+		(void) metrics_printf(str, "%s_bucket{le=\"%.6f\"} %llu\n", name,
+		                      (double) metrics_bucket_bound(i) / 1000000.0, cumulative);
+	}
+
+	(void) metrics_printf(str, "%s_bucket{le=\"+Inf\"} %llu\n", name, timing->count);
+	(void) metrics_printf(str, "%s_sum %.6f\n", name, (double) timing->usec / 1000000.0);
+	(void) metrics_printf(str, "%s_count %llu\n", name, timing->count);
+}
+
+static void
+metrics_command_calls(const struct metrics_command *const restrict mc, void *const restrict vstr)
+{
+	char service[BUFSIZE];
+	char command[BUFSIZE];
+
+	if (! mc->timing.count)
+		return;
+
+	(void) metrics_printf(vstr, "atheme_service_command_calls_total{service=\"%s\",command=\"%s\"} %llu\n",
+	                      metrics_label(mc->service, service, sizeof service),
+	                      metrics_label(mc->name, command, sizeof command), mc->timing.count);
+}
+
+static void
+metrics_command_seconds(const struct metrics_command *const restrict mc, void *const restrict vstr)
+{
+	char service[BUFSIZE];
+	char command[BUFSIZE];
+
+	if (! mc->timing.count)
+		return;
+
+	(void) metrics_printf(vstr, "atheme_service_command_seconds_total{service=\"%s\",command=\"%s\"} %.6f\n",
+	                      metrics_label(mc->service, service, sizeof service),
+	                      metrics_label(mc->name, command, sizeof command),
+	                      (double) mc->timing.usec / 1000000.0);
+}
+
+static void
+metrics_pcommands(mowgli_string_t *const restrict str)
+{
+	mowgli_patricia_iteration_state_t state;
+	const struct proto_cmd *pcmd;
+	char token[BUFSIZE];
+
+	(void) metrics_header(str, "atheme_protocol_command_calls_total", "counter",
+	                      "Protocol messages handled, by command");
+
+	MOWGLI_PATRICIA_FOREACH(pcmd, &state, pcommands)
+		if (pcmd->timing.count)
+			(void) metrics_printf(str, "atheme_protocol_command_calls_total{command=\"%s\"} %llu\n",
+			                      metrics_label(pcmd->token, token, sizeof token), pcmd->timing.count);
+
+	(void) metrics_header(str, "atheme_protocol_command_seconds_total", "counter",
+	                      "Time spent handling protocol messages, by command");
+
+	MOWGLI_PATRICIA_FOREACH(pcmd, &state, pcommands)
+		if (pcmd->timing.count)
+			(void) metrics_printf(str, "atheme_protocol_command_seconds_total{command=\"%s\"} %.6f\n",
+			                      metrics_label(pcmd->token, token, sizeof token),
+			                      (double) pcmd->timing.usec / 1000000.0);
+}
+
+static void
+metrics_build(mowgli_string_t *const restrict str)
+{
+	mowgli_node_t *n;
+	size_t sendq = 0;
+
+	for (size_t i = 0; i < ARRAY_SIZE(metrics_gauges); i++)
+	{
+		(void) metrics_header(str, metrics_gauges[i].name, "gauge", metrics_gauges[i].help);
+		(void) metrics_printf(str, "%s %u\n", metrics_gauges[i].name, *metrics_gauges[i].value);
+	}
+
+	(void) metrics_header(str, "atheme_received_bytes_total", "counter", "Bytes received on all connections");
+	(void) metrics_printf(str, "atheme_received_bytes_total %llu\n", cnt.bin);
+	(void) metrics_header(str, "atheme_sent_bytes_total", "counter", "Bytes sent on all connections");
+	(void) metrics_printf(str, "atheme_sent_bytes_total %llu\n", cnt.bout);
+
+	MOWGLI_ITER_FOREACH(n, connection_list.head)
+		sendq += sendq_length(n->data);
+
+	(void) metrics_header(str, "atheme_sendq_bytes", "gauge", "Bytes waiting to be sent on all connections");
+	(void) metrics_printf(str, "atheme_sendq_bytes %zu\n", sendq);
+	(void) metrics_header(str, "atheme_uplink_sendq_bytes", "gauge", "Bytes waiting to be sent to the uplink");
+	(void) metrics_printf(str, "atheme_uplink_sendq_bytes %zu\n",
+	                      (curr_uplink && curr_uplink->conn) ? sendq_length(curr_uplink->conn) : (size_t) 0);
+
+	(void) metrics_header(str, "atheme_password_verify_queue", "gauge",
+	                      "Password verifications waiting for or running on a worker thread");
+	(void) metrics_printf(str, "atheme_password_verify_queue %u\n", verify_password_pending());
+
+	(void) metrics_header(str, "atheme_start_time_seconds", "gauge", "When services were started");
+	(void) metrics_printf(str, "atheme_start_time_seconds %lld\n", (long long) me.start);
+
+	(void) metrics_header(str, "atheme_eventloop_busy_seconds", "histogram",
+	                      "Time each event loop iteration spent handling I/O");
+	(void) metrics_histogram(str, "atheme_eventloop_busy_seconds", &metrics.loop);
+
+	(void) metrics_header(str, "atheme_db_save_seconds", "histogram",
+	                      "Time the event loop spent on each database save");
+	(void) metrics_histogram(str, "atheme_db_save_seconds", &metrics.db_save);
+
+	(void) metrics_pcommands(str);
+
+	(void) metrics_header(str, "atheme_service_command_calls_total", "counter",
+	                      "Service commands executed, by service and command");
+	(void) metrics_command_foreach(&metrics_command_calls, str);
+
+	(void) metrics_header(str, "atheme_service_command_seconds_total", "counter",
+	                      "Time spent executing service commands, by service and command");
+	(void) metrics_command_foreach(&metrics_command_seconds, str);
+}
+
+static void
+handle_request(struct connection *const restrict cptr, void ATHEME_VATTR_UNUSED *const restrict requestbuf)
+{
+	const struct httpddata *const hd = cptr->userdata;
+	mowgli_string_t *const str = mowgli_string_create();
+	char buf[300];
+
+	(void) metrics_build(str);
+
+	(void) snprintf(buf, sizeof buf,
+	                "HTTP/1.1 200 OK\r\n"
+	                "Server: %s/%s\r\n"
+	                "Content-Type: text/plain; version=0.0.4\r\n"
+	                "Content-Length: %zu\r\n"
+	                "%s"
+	                "\r\n",
+	                PACKAGE_TARNAME, PACKAGE_VERSION,
+	                str->pos,
+	                hd->connection_close ? "Connection: close\r\n" : "");
+
+	(void) sendq_add(cptr, buf, strlen(buf));
+	(void) sendq_add(cptr, str->str, str->pos);
+
+	if (hd->connection_close)
+		(void) sendq_add_eof(cptr);
+
+	(void) mowgli_string_destroy(str);
+}
+
+static struct path_handler handle_metrics = { "/metrics", handle_request, true };
+
+static void
+mod_init(struct module *const restrict m)
+{
+	MODULE_TRY_REQUEST_SYMBOL(m, httpd_path_handlers, "misc/httpd", "httpd_path_handlers")
+
+	(void) mowgli_node_add(&handle_metrics, mowgli_node_create(), httpd_path_handlers);
+}
+
+static void
+mod_deinit(const enum module_unload_intent ATHEME_VATTR_UNUSED intent)
+{
+	mowgli_node_t *n;
+
+	if ((n = mowgli_node_find(&handle_metrics, httpd_path_handlers)) != NULL)
+	{
+		(void) mowgli_node_delete(n, httpd_path_handlers);
+		(void) mowgli_node_free(n);
+	}
+}
+
+SIMPLE_DECLARE_MODULE_V1("misc/metrics", MODULE_UNLOAD_CAPABILITY_OK)
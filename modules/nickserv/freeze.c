@@ -149,10 +149,12 @@ mod_init(struct module *const restrict m)
 	static struct list_param frozen;
 	frozen.opttype = OPT_BOOL;
 	frozen.is_match = is_frozen;
+	frozen.indexed_metadata = "private:freeze:freezer";
 
 	static struct list_param frozen_reason;
 	frozen_reason.opttype = OPT_STRING;
 	frozen_reason.is_match = frozen_match;
+	frozen_reason.indexed_metadata = "private:freeze:reason";
 
 	list_register("frozen", &frozen);
 	list_register("frozen-reason", &frozen_reason);
@@ -20,67 +20,67 @@
 #define COMMAND_DESC	N_("Identifies to services for a nickname.")
 #endif
 
-static void
-ns_cmd_login(struct sourceinfo *si, int parc, char *parv[])
+// A login waiting for its password to be verified
+struct ns_login_req
 {
-	struct user *u = si->su;
-	struct myuser *mu;
-	mowgli_node_t *n, *tn;
-	const char *target = parv[0];
-	const char *password = parv[1];
-	char lau[BUFSIZE];
+	mowgli_node_t                   node;
+	struct sourceinfo *             si;
+	struct user *                   u;
+	struct verify_password_req *    vreq;
+};
 
-	if (si->su == NULL)
-	{
-		command_fail(si, fault_noprivs, STR_IRC_COMMAND_ONLY, COMMAND_UC);
-		return;
-	}
+static mowgli_list_t ns_login_reqs = { NULL, NULL, 0 };
 
-	if (u->flags & UF_DOING_SASL)
-	{
-		command_fail(si, fault_authfail, _("You are already performing an SASL login."));
-		return;
-	}
+static struct ns_login_req *
+ns_login_req_find(const struct user *const restrict u)
+{
+	mowgli_node_t *n;
 
-#ifndef NICKSERV_LOGIN
-	if (!nicksvs.no_nick_ownership && target && !password)
+	MOWGLI_ITER_FOREACH(n, ns_login_reqs.head)
 	{
-		password = target;
-		target = si->su->nick;
-	}
-#endif
+		struct ns_login_req *const req = n->data;
 
-	if (!target || !password)
-	{
-		command_fail(si, fault_needmoreparams, STR_INSUFFICIENT_PARAMS, COMMAND_UC);
-		command_fail(si, fault_needmoreparams, nicksvs.no_nick_ownership ? "Syntax: " COMMAND_UC " <account> <password>" : "Syntax: " COMMAND_UC " [nick] <password>");
-		return;
+		if (req->u == u)
+			return req;
 	}
 
-	mu = myuser_find_by_nick(target);
-	if (!mu)
-	{
-		command_fail(si, fault_nosuch_target, _("\2%s\2 is not a registered nickname."), target);
-		return;
-	}
-	else if (u->myuser == mu)
-	{
-		command_fail(si, fault_nochange, _("You are already logged in as \2%s\2."), entity(u->myuser)->name);
-		if (mu->flags & MU_WAITAUTH)
-			command_fail(si, fault_nochange, _("Please check your email for instructions to complete your registration."));
-		return;
-	}
-	else if (u->myuser != NULL && !command_find(si->service->commands, "LOGOUT"))
-	{
-		command_fail(si, fault_alreadyexists, _("You are already logged in as \2%s\2."), entity(u->myuser)->name);
+	return NULL;
+}
+
+static void
+ns_login_req_destroy(struct ns_login_req *const restrict req)
+{
+	(void) mowgli_node_delete(&req->node, &ns_login_reqs);
+	(void) atheme_object_unref(req->si);
+	(void) sfree(req);
+}
+
+static void
+ns_login_user_delete(struct user *const restrict u)
+{
+	struct ns_login_req *const req = ns_login_req_find(u);
+
+	if (! req)
 		return;
-	}
 
+	(void) verify_password_cancel(req->vreq);
+	(void) ns_login_req_destroy(req);
+}
+
+/* Whether the user may log in to the account by password. This is checked
+ * before the password is verified, and again once it has been, since the
+ * account may have been frozen or had password logins disabled meanwhile.
+ */
+static bool
+ns_login_allowed(struct sourceinfo *const restrict si, struct user *const restrict u,
+                 struct myuser *const restrict mu, const bool recheck)
+{
 	struct hook_user_login_check login_req = {
 		.si      = si,
 		.mu      = mu,
 		.method  = HULM_PASSWORD,
 		.allowed = true,
+		.recheck = recheck,
 	};
 
 	struct hook_user_logout_check logout_req = {
@@ -100,7 +100,7 @@ ns_cmd_login(struct sourceinfo *si, int parc, char *parv[])
 		command_fail(si, fault_authfail, nicksvs.no_nick_ownership ? _("You cannot log in as \2%s\2 because the server configuration disallows it.")
 									   : _("You cannot identify to \2%s\2 because the server configuration disallows it."), entity(mu)->name);
 		logcommand(si, CMDLOG_LOGIN, "failed " COMMAND_UC " to \2%s\2 (denied by hook)", entity(mu)->name);
-		return;
+		return false;
 	}
 
 	if (metadata_find(mu, "private:freeze:freezer"))
@@ -108,18 +108,46 @@ ns_cmd_login(struct sourceinfo *si, int parc, char *parv[])
 		command_fail(si, fault_authfail, nicksvs.no_nick_ownership ? _("You cannot log in as \2%s\2 because the account has been frozen.")
 									   : _("You cannot identify to \2%s\2 because the nickname has been frozen."), entity(mu)->name);
 		logcommand(si, CMDLOG_LOGIN, "failed " COMMAND_UC " to \2%s\2 (frozen)", entity(mu)->name);
-		return;
+		return false;
 	}
 
 	if (mu->flags & MU_NOPASSWORD)
 	{
 		command_fail(si, fault_authfail, _("Password authentication is disabled for this account."));
 		logcommand(si, CMDLOG_LOGIN, "failed " COMMAND_UC " to \2%s\2 (password authentication disabled)", entity(mu)->name);
-		return;
+		return false;
+	}
+
+	return true;
+}
+
+static void
+ns_login_verified(struct myuser *const restrict mu, const bool verified, void *const restrict vreq)
+{
+	struct ns_login_req *const req = vreq;
+	struct sourceinfo *const si = atheme_object_ref(req->si);
+	struct user *const u = req->u;
+	mowgli_node_t *n, *tn;
+	char lau[BUFSIZE];
+
+	(void) ns_login_req_destroy(req);
+
+	if (! mu)
+	{
+		command_fail(si, fault_nosuch_target, _("The account you tried to log in to has been dropped."));
+		goto out;
+	}
+	else if (u->myuser == mu)
+	{
+		command_fail(si, fault_nochange, _("You are already logged in as \2%s\2."), entity(u->myuser)->name);
+		goto out;
 	}
 
-	if (verify_password(mu, password))
+	if (verified)
 	{
+		if (! ns_login_allowed(si, u, mu, true))
+			goto out;
+
 		if (user_loginmaxed(mu))
 		{
 			command_fail(si, fault_toomany, _("There are already \2%zu\2 sessions logged in to \2%s\2 (maximum allowed: %u)."), MOWGLI_LIST_LENGTH(&mu->logins), entity(mu)->name, me.maxlogins);
@@ -132,7 +160,7 @@ ns_cmd_login(struct sourceinfo *si, int parc, char *parv[])
 			}
 			command_fail(si, fault_toomany, _("Logged in nicks are: %s"), lau);
 			logcommand(si, CMDLOG_LOGIN, "failed " COMMAND_UC " to \2%s\2 (too many logins)", entity(mu)->name);
-			return;
+			goto out;
 		}
 
 		// if they are identified to another account, nuke their session first
@@ -142,7 +170,7 @@ ns_cmd_login(struct sourceinfo *si, int parc, char *parv[])
 
 			if (ircd_on_logout(u, entity(u->myuser)->name))
 				// logout killed the user...
-				return;
+				goto out;
 		        u->myuser->lastlogin = CURRTIME;
 		        MOWGLI_ITER_FOREACH_SAFE(n, tn, u->myuser->logins.head)
 		        {
@@ -160,13 +188,96 @@ ns_cmd_login(struct sourceinfo *si, int parc, char *parv[])
 		myuser_login(si->service, u, mu, true);
 		logcommand(si, CMDLOG_LOGIN, COMMAND_UC);
 
-		return;
+		goto out;
 	}
 
 	logcommand(si, CMDLOG_LOGIN, "failed " COMMAND_UC " to \2%s\2 (bad password)", entity(mu)->name);
 
 	command_fail(si, fault_authfail, _("Invalid password for \2%s\2."), entity(mu)->name);
 	bad_password(si, mu);
+
+out:
+	atheme_object_unref(si);
+}
+
+static void
+ns_cmd_login(struct sourceinfo *si, int parc, char *parv[])
+{
+	struct user *u = si->su;
+	struct myuser *mu;
+	const char *target = parv[0];
+	const char *password = parv[1];
+
+	if (si->su == NULL)
+	{
+		command_fail(si, fault_noprivs, STR_IRC_COMMAND_ONLY, COMMAND_UC);
+		return;
+	}
+
+	if (u->flags & UF_DOING_SASL)
+	{
+		command_fail(si, fault_authfail, _("You are already performing an SASL login."));
+		return;
+	}
+
+#ifndef NICKSERV_LOGIN
+	if (!nicksvs.no_nick_ownership && target && !password)
+	{
+		password = target;
+		target = si->su->nick;
+	}
+#endif
+
+	if (!target || !password)
+	{
+		command_fail(si, fault_needmoreparams, STR_INSUFFICIENT_PARAMS, COMMAND_UC);
+		command_fail(si, fault_needmoreparams, nicksvs.no_nick_ownership ? "Syntax: " COMMAND_UC " <account> <password>" : "Syntax: " COMMAND_UC " [nick] <password>");
+		return;
+	}
+
+	mu = myuser_find_by_nick(target);
+	if (!mu)
+	{
+		command_fail(si, fault_nosuch_target, _("\2%s\2 is not a registered nickname."), target);
+		return;
+	}
+	else if (u->myuser == mu)
+	{
+		command_fail(si, fault_nochange, _("You are already logged in as \2%s\2."), entity(u->myuser)->name);
+		if (mu->flags & MU_WAITAUTH)
+			command_fail(si, fault_nochange, _("Please check your email for instructions to complete your registration."));
+		return;
+	}
+	else if (u->myuser != NULL && !command_find(si->service->commands, "LOGOUT"))
+	{
+		command_fail(si, fault_alreadyexists, _("You are already logged in as \2%s\2."), entity(u->myuser)->name);
+		return;
+	}
+
+	if (! ns_login_allowed(si, u, mu, false))
+		return;
+
+	if (ns_login_req_find(u))
+	{
+		command_fail(si, fault_toomany, _("Your previous %s is still being processed; please wait."), COMMAND_UC);
+		return;
+	}
+
+	/* Checking the password can take a while, so it is done in the background;
+	 * the rest happens in ns_login_verified(), unless the user quits first.
+	 */
+	struct ns_login_req *const req = smalloc(sizeof *req);
+
+	req->si = atheme_object_ref(si);
+	req->u = u;
+
+	(void) mowgli_node_add(req, &req->node, &ns_login_reqs);
+
+	if (! (req->vreq = verify_password_async(mu, password, &ns_login_verified, req)))
+	{
+		command_fail(si, fault_authfail, _("Invalid password for \2%s\2."), entity(mu)->name);
+		(void) ns_login_req_destroy(req);
+	}
 }
 
 static struct command ns_login = {
@@ -184,12 +295,26 @@ mod_init(struct module *const restrict m)
 	MODULE_TRY_REQUEST_DEPENDENCY(m, "nickserv/main")
 
 	service_named_bind_command("nickserv", &ns_login);
+
+	hook_add_user_delete(ns_login_user_delete);
 }
 
 static void
 mod_deinit(const enum module_unload_intent ATHEME_VATTR_UNUSED intent)
 {
+	mowgli_node_t *n, *tn;
+
 	service_named_unbind_command("nickserv", &ns_login);
+
+	hook_del_user_delete(ns_login_user_delete);
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, ns_login_reqs.head)
+	{
+		struct ns_login_req *const req = n->data;
+
+		(void) verify_password_cancel(req->vreq);
+		(void) ns_login_req_destroy(req);
+	}
 }
 
 SIMPLE_DECLARE_MODULE_V1("nickserv/" COMMAND_LC, MODULE_UNLOAD_CAPABILITY_OK)
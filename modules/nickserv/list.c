@@ -16,7 +16,64 @@
 extern void list_register(const char *, struct list_param *);
 extern void list_unregister(const char *);
 
+// How long one slice of a LIST may run before yielding to the event loop
+#define LIST_SLICE_MS           10U
+#define LIST_CHECK_INTERVAL     64U
+
+#define LIST_MAX_CRITERIA       10U
+#define LIST_PRIVDATA           "nickserv:list:entry"
+
+// Where an account currently sits in the LIST indexes
+struct list_entry
+{
+	struct myuser *         mu;
+	char *                  email;
+	const char *            domain;
+	unsigned long           regday;
+	unsigned long           loginday;
+};
+
+struct list_criterion
+{
+	struct list_param *     param;
+	union {
+		bool            boolval;
+		int             intval;
+		char *          strval;
+		time_t          ageval;
+	}                       arg;
+};
+
+// A LIST in progress; its output is spread over several event loop turns
+struct list_req
+{
+	mowgli_node_t                   node;
+	struct sourceinfo *             si;
+	mowgli_eventloop_timer_t *      timer;
+	struct list_criterion           crit[LIST_MAX_CRITERIA];
+	unsigned int                    ncrit;
+	char                            criteriastr[BUFSIZE];
+	char                            (*ids)[IDLEN + 1];
+	size_t                          nids;
+	size_t                          idsz;
+	size_t                          pos;
+	unsigned int                    matches;
+};
+
 static mowgli_patricia_t *list_params;
+static mowgli_list_t list_reqs = { NULL, NULL, 0 };
+
+/* The indexes are built the first time LIST runs and are kept current from
+ * then on by hooks. Login days only ever move forward, so an account filed
+ * under an older day is merely an extra candidate; it is refiled when seen.
+ */
+static bool list_indexed = false;
+static mowgli_patricia_t *list_emails = NULL;
+static mowgli_patricia_t *list_domains = NULL;
+static mowgli_patricia_t *list_nodomain = NULL;
+static mowgli_patricia_t *list_regdays = NULL;
+static mowgli_patricia_t *list_logindays = NULL;
+static mowgli_patricia_t *list_mdsets = NULL;
 
 static bool
 email_match(const struct mynick *mn, const void *arg)
@@ -113,6 +170,421 @@ has_waitauth(const struct mynick *mn, const void *arg)
 	return ( mu->flags & MU_WAITAUTH ) == MU_WAITAUTH;
 }
 
+static struct list_param list_email = {
+	.opttype        = OPT_STRING,
+	.is_match       = &email_match,
+};
+
+static struct list_param list_lastlogin = {
+	.opttype        = OPT_AGE,
+	.is_match       = &lastlogin_match,
+};
+
+static struct list_param list_registered = {
+	.opttype        = OPT_AGE,
+	.is_match       = &registered_match,
+};
+
+static void
+list_entry_index_email(struct list_entry *const restrict e)
+{
+	e->email = sstrdup(e->mu->email);
+
+	const char *const at = strchr(e->email, '@');
+
+	// Only an address with exactly one '@' has a domain we can file it under
+	e->domain = (at && at == strrchr(e->email, '@')) ? (at + 1) : NULL;
+
+	(void) list_set_insert(list_emails, e->email, 0, entity(e->mu)->id, e->mu);
+
+	if (e->domain)
+		(void) list_set_insert(list_domains, e->domain, 0, entity(e->mu)->id, e->mu);
+	else
+		(void) mowgli_patricia_add(list_nodomain, entity(e->mu)->id, e->mu);
+}
+
+static void
+list_entry_unindex_email(struct list_entry *const restrict e)
+{
+	(void) list_set_remove(list_emails, e->email, entity(e->mu)->id);
+
+	if (e->domain)
+		(void) list_set_remove(list_domains, e->domain, entity(e->mu)->id);
+	else
+		(void) mowgli_patricia_delete(list_nodomain, entity(e->mu)->id);
+
+	(void) sfree(e->email);
+
+	e->email = NULL;
+	e->domain = NULL;
+}
+
+static void
+list_entry_add(struct myuser *const restrict mu)
+{
+	struct list_entry *const e = smalloc(sizeof *e);
+	mowgli_patricia_iteration_state_t state;
+	struct list_set *set;
+
+	e->mu = mu;
+	e->regday = list_day(mu->registered);
+	e->loginday = list_day(mu->lastlogin);
+
+	(void) list_entry_index_email(e);
+	(void) list_day_insert(list_regdays, e->regday, entity(mu)->id, mu);
+	(void) list_day_insert(list_logindays, e->loginday, entity(mu)->id, mu);
+
+	MOWGLI_PATRICIA_FOREACH(set, &state, list_mdsets)
+		if (metadata_find(mu, set->name))
+			(void) mowgli_patricia_add(set->members, entity(mu)->id, mu);
+
+	(void) privatedata_set(mu, LIST_PRIVDATA, e);
+}
+
+static void
+list_entry_delete(struct list_entry *const restrict e)
+{
+	struct myuser *const mu = e->mu;
+	mowgli_patricia_iteration_state_t state;
+	struct list_set *set;
+
+	(void) list_entry_unindex_email(e);
+	(void) list_day_remove(list_regdays, e->regday, entity(mu)->id);
+	(void) list_day_remove(list_logindays, e->loginday, entity(mu)->id);
+
+	MOWGLI_PATRICIA_FOREACH(set, &state, list_mdsets)
+		(void) mowgli_patricia_delete(set->members, entity(mu)->id);
+
+	(void) privatedata_delete(mu, LIST_PRIVDATA);
+	(void) sfree(e);
+}
+
+static void
+list_entry_refresh_login(struct list_entry *const restrict e)
+{
+	const unsigned long loginday = list_day(e->mu->lastlogin);
+
+	if (loginday == e->loginday)
+		return;
+
+	(void) list_day_remove(list_logindays, e->loginday, entity(e->mu)->id);
+	(void) list_day_insert(list_logindays, loginday, entity(e->mu)->id, e->mu);
+
+	e->loginday = loginday;
+}
+
+static void
+list_index_build(void)
+{
+	struct myentity_iteration_state state;
+	struct myentity *mt;
+
+	if (list_indexed)
+		return;
+
+	list_emails = mowgli_patricia_create(&strcasecanon);
+	list_domains = mowgli_patricia_create(&strcasecanon);
+	list_nodomain = mowgli_patricia_create(&noopcanon);
+	list_regdays = mowgli_patricia_create(&noopcanon);
+	list_logindays = mowgli_patricia_create(&noopcanon);
+	list_mdsets = mowgli_patricia_create(&strcasecanon);
+
+	unsigned int count = 0;
+
+	MYENTITY_FOREACH_T(mt, &state, ENT_USER)
+	{
+		(void) list_entry_add(user(mt));
+		count++;
+	}
+
+	list_indexed = true;
+
+	(void) slog(LG_DEBUG, "%s: indexed %u accounts in %u domains", __func__, count,
+	                      mowgli_patricia_size(list_domains));
+}
+
+static void
+list_index_destroy(void)
+{
+	struct myentity_iteration_state state;
+	struct myentity *mt;
+
+	if (! list_indexed)
+		return;
+
+	MYENTITY_FOREACH_T(mt, &state, ENT_USER)
+	{
+		struct list_entry *const e = privatedata_get(mt, LIST_PRIVDATA);
+
+		if (e)
+			(void) list_entry_delete(e);
+	}
+
+	(void) mowgli_patricia_destroy(list_emails, &list_set_destroy_cb, NULL);
+	(void) mowgli_patricia_destroy(list_domains, &list_set_destroy_cb, NULL);
+	(void) mowgli_patricia_destroy(list_nodomain, NULL, NULL);
+	(void) mowgli_patricia_destroy(list_regdays, &list_set_destroy_cb, NULL);
+	(void) mowgli_patricia_destroy(list_logindays, &list_set_destroy_cb, NULL);
+	(void) mowgli_patricia_destroy(list_mdsets, &list_set_destroy_cb, NULL);
+
+	list_indexed = false;
+}
+
+// The accounts carrying a metadata entry, found by one scan the first time it is asked for
+static struct list_set *
+list_mdset(const char *const restrict name)
+{
+	struct myentity_iteration_state state;
+	struct myentity *mt;
+	struct list_set *set;
+
+	if ((set = mowgli_patricia_retrieve(list_mdsets, name)))
+		return set;
+
+	set = list_set_create(name, 0);
+
+	(void) mowgli_patricia_add(list_mdsets, set->name, set);
+
+	MYENTITY_FOREACH_T(mt, &state, ENT_USER)
+		if (metadata_find(mt, name))
+			(void) mowgli_patricia_add(set->members, mt->id, mt);
+
+	return set;
+}
+
+static void
+list_myuser_add(struct myuser *const restrict mu)
+{
+	if (list_indexed)
+		(void) list_entry_add(mu);
+}
+
+static void
+list_myuser_delete(struct myuser *const restrict mu)
+{
+	struct list_entry *e;
+
+	if (list_indexed && (e = privatedata_get(mu, LIST_PRIVDATA)))
+		(void) list_entry_delete(e);
+}
+
+static void
+list_myuser_changed_email(struct myuser *const restrict mu)
+{
+	struct list_entry *e;
+
+	if (! list_indexed || ! (e = privatedata_get(mu, LIST_PRIVDATA)))
+		return;
+
+	(void) list_entry_unindex_email(e);
+	(void) list_entry_index_email(e);
+}
+
+static void
+list_metadata_change(struct hook_metadata_change *const restrict hdata)
+{
+	struct list_entry *e;
+	struct list_set *set;
+
+	if (! list_indexed || ! (set = mowgli_patricia_retrieve(list_mdsets, hdata->name)))
+		return;
+
+	// Channels and groups carry metadata too; only accounts have an entry
+	if (! (e = privatedata_get(hdata->target, LIST_PRIVDATA)))
+		return;
+
+	if (hdata->deleted)
+		(void) mowgli_patricia_delete(set->members, entity(e->mu)->id);
+	else
+		(void) mowgli_patricia_add(set->members, entity(e->mu)->id, e->mu);
+}
+
+static void
+list_req_append(struct list_req *const restrict req, mowgli_patricia_t *const restrict members)
+{
+	mowgli_patricia_iteration_state_t state;
+	struct myuser *mu;
+
+	const size_t need = req->nids + mowgli_patricia_size(members);
+
+	if (need > req->idsz)
+	{
+		req->idsz = MAX(need, req->idsz * 2U);
+		req->ids = sreallocarray(req->ids, req->idsz, sizeof *req->ids);
+	}
+
+	MOWGLI_PATRICIA_FOREACH(mu, &state, members)
+		(void) mowgli_strlcpy(req->ids[req->nids++], entity(mu)->id, sizeof *req->ids);
+}
+
+static void
+list_req_append_cb(mowgli_patricia_t *const restrict members, void *const restrict vreq)
+{
+	(void) list_req_append(vreq, members);
+}
+
+static size_t
+list_source_email(struct list_req *const restrict req, const char *const restrict pattern, const bool collect)
+{
+	mowgli_patricia_iteration_state_t state;
+	struct list_set *set;
+	size_t count;
+
+	if (match_is_literal(pattern))
+	{
+		if (! (set = mowgli_patricia_retrieve(list_emails, pattern)))
+			return 0;
+
+		if (collect)
+			(void) list_req_append(req, set->members);
+
+		return mowgli_patricia_size(set->members);
+	}
+
+	/* With exactly one '@' in the address, whatever follows the last '@'
+	 * in the pattern has to match its domain. Addresses without such a
+	 * domain are always candidates.
+	 */
+	const char *const at = strrchr(pattern, '@');
+
+	if (! at)
+		return SIZE_MAX;
+
+	const char *const dompattern = at + 1;
+
+	count = mowgli_patricia_size(list_nodomain);
+
+	if (collect)
+		(void) list_req_append(req, list_nodomain);
+
+	if (match_is_literal(dompattern))
+	{
+		if ((set = mowgli_patricia_retrieve(list_domains, dompattern)))
+		{
+			count += mowgli_patricia_size(set->members);
+
+			if (collect)
+				(void) list_req_append(req, set->members);
+		}
+
+		return count;
+	}
+
+	MOWGLI_PATRICIA_FOREACH(set, &state, list_domains)
+	{
+		if (match(dompattern, set->name))
+			continue;
+
+		count += mowgli_patricia_size(set->members);
+
+		if (collect)
+			(void) list_req_append(req, set->members);
+	}
+
+	return count;
+}
+
+/* How many candidates a criterion narrows the search to, or SIZE_MAX if no
+ * index covers it. With collect set, the candidates are also added to the
+ * request.
+ */
+static size_t
+list_source(struct list_req *const restrict req, const struct list_criterion *const restrict c, const bool collect)
+{
+	if (c->param == &list_email)
+		return list_source_email(req, c->arg.strval, collect);
+
+	if (c->param == &list_lastlogin)
+		return list_days_before(list_logindays, c->arg.ageval, collect ? &list_req_append_cb : NULL, req);
+
+	if (c->param == &list_registered)
+		return list_days_before(list_regdays, c->arg.ageval, collect ? &list_req_append_cb : NULL, req);
+
+	if (c->param->indexed_metadata)
+	{
+		struct list_set *const set = list_mdset(c->param->indexed_metadata);
+
+		if (collect)
+			(void) list_req_append(req, set->members);
+
+		return mowgli_patricia_size(set->members);
+	}
+
+	return SIZE_MAX;
+}
+
+// Gather the candidates from the most selective index, or every account if none applies
+static void
+list_plan(struct list_req *const restrict req)
+{
+	const struct list_criterion *best = NULL;
+	size_t bestcount = SIZE_MAX;
+
+	for (unsigned int i = 0; i < req->ncrit; i++)
+	{
+		const size_t count = list_source(req, &req->crit[i], false);
+
+		if (count < bestcount)
+		{
+			best = &req->crit[i];
+			bestcount = count;
+		}
+	}
+
+	if (best)
+	{
+		(void) list_source(req, best, true);
+		return;
+	}
+
+	struct myentity_iteration_state state;
+	struct myentity *mt;
+
+	req->idsz = MAX(cnt.myuser, 1U);
+	req->ids = sreallocarray(NULL, req->idsz, sizeof *req->ids);
+
+	MYENTITY_FOREACH_T(mt, &state, ENT_USER)
+	{
+		if (req->nids == req->idsz)
+		{
+			req->idsz *= 2U;
+			req->ids = sreallocarray(req->ids, req->idsz, sizeof *req->ids);
+		}
+
+		(void) mowgli_strlcpy(req->ids[req->nids++], mt->id, sizeof *req->ids);
+	}
+}
+
+static void
+list_req_destroy(struct list_req *const restrict req)
+{
+	if (req->timer)
+		(void) mowgli_timer_destroy(base_eventloop, req->timer);
+
+	for (unsigned int i = 0; i < req->ncrit; i++)
+		if (req->crit[i].param->opttype == OPT_STRING)
+			(void) sfree(req->crit[i].arg.strval);
+
+	(void) mowgli_node_delete(&req->node, &list_reqs);
+	(void) atheme_object_unref(req->si);
+	(void) sfree(req->ids);
+	(void) sfree(req);
+}
+
+static void
+list_user_delete(struct user *const restrict u)
+{
+	mowgli_node_t *n, *tn;
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, list_reqs.head)
+	{
+		struct list_req *const req = n->data;
+
+		if (req->si->su == u)
+			(void) list_req_destroy(req);
+	}
+}
+
 void
 list_register(const char *param_name, struct list_param *param)
 {
@@ -122,6 +594,28 @@ list_register(const char *param_name, struct list_param *param)
 void
 list_unregister(const char *param_name)
 {
+	struct list_param *const param = mowgli_patricia_retrieve(list_params, param_name);
+	mowgli_node_t *n, *tn;
+
+	if (param == NULL)
+		return;
+
+	// A LIST still in progress may be using the criterion that is going away
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, list_reqs.head)
+	{
+		struct list_req *const req = n->data;
+
+		for (unsigned int i = 0; i < req->ncrit; i++)
+		{
+			if (req->crit[i].param != param)
+				continue;
+
+			command_fail(req->si, fault_nosuch_key, _("LIST aborted: \2%s\2 is no longer a recognized LIST criterion"), param_name);
+			(void) list_req_destroy(req);
+			break;
+		}
+	}
+
 	mowgli_patricia_delete(list_params, param_name);
 }
 
@@ -203,95 +697,78 @@ list_one(struct sourceinfo *si, struct myuser *mu, struct mynick *mn)
 		command_success_nodata(si, "- %s (%s) (%s) %s", mn->nick, mu->email, entity(mu)->name, buf);
 }
 
-static void
-ns_cmd_list(struct sourceinfo *si, int parc, char *parv[])
+static bool
+list_req_match(const struct list_req *const restrict req, const struct mynick *const restrict mn)
 {
-	char criteriastr[BUFSIZE];
+	for (unsigned int i = 0; i < req->ncrit; i++)
+	{
+		const struct list_criterion *const c = &req->crit[i];
+		const void *arg = &c->arg;
 
-	mowgli_patricia_iteration_state_t state;
-	struct myentity_iteration_state mestate;
-	struct mynick *mn;
+		if (c->param->opttype == OPT_FLAG)
+			continue;
 
-	unsigned int matches = 0;
+		if (c->param->opttype == OPT_STRING)
+			arg = c->arg.strval;
 
-	int i;
-	bool error = false;
-	bool found;
+		if (!c->param->is_match(mn, arg))
+			return false;
+	}
 
-	MOWGLI_PATRICIA_FOREACH(mn, &state, nicklist)
+	return true;
+}
+
+// Returns true once every candidate has been looked at
+static bool
+list_req_step(struct list_req *const restrict req, const bool unbounded)
+{
+	struct timeval start, elapsed;
+	unsigned int count = 0;
+
+	s_time(&start);
+
+	while (req->pos < req->nids)
 	{
-		found = true;
+		struct myuser *const mu = user(myentity_find_uid(req->ids[req->pos++]));
+		struct list_entry *e;
+		mowgli_node_t *n;
+
+		// The account may have been dropped since the LIST started
+		if (mu == NULL)
+			continue;
 
-		for (i = 0; i < parc; i++)
+		if ((e = privatedata_get(mu, LIST_PRIVDATA)))
+			(void) list_entry_refresh_login(e);
+
+		MOWGLI_ITER_FOREACH(n, mu->nicks.head)
 		{
-			struct list_param *param = mowgli_patricia_retrieve(list_params, parv[i]);
-
-			if (param == NULL) {
-				command_fail(si, fault_badparams, _("\2%s\2 is not a recognized LIST criterion"), parv[i]);
-				error = true;
-				break;
-			}
-
-			if (param->opttype == OPT_BOOL) {
-				bool arg = true;
-
-				if (!param->is_match(mn, &arg)) {
-					found = false;
-					break;
-				}
-			} else if (param->opttype == OPT_INT) {
-				if (i + 1 < parc) {
-					int arg = atoi(parv[++i]);
-
-					if (!param->is_match (mn, &arg)) {
-						found = false;
-						break;
-					}
-				} else {
-					command_fail(si, fault_needmoreparams, STR_INSUFFICIENT_PARAMS, parv[i]);
-					error = true;
-					break;
-				}
-			} else if (param->opttype == OPT_STRING) {
-				if (i + 1 < parc) {
-					if (!param->is_match (mn, parv[++i])) {
-						found = false;
-						break;
-					}
-				} else {
-					command_fail(si, fault_needmoreparams, STR_INSUFFICIENT_PARAMS, parv[i]);
-					error = true;
-					break;
-				}
-			}
-			else if (param->opttype == OPT_AGE) {
-				if (i + 1 < parc)
-				{
-					time_t age = parse_age(parv[++i]);
-
-					if (!param->is_match (mn, &age)) {
-						found = false;
-						break;
-					}
-				} else {
-					command_fail(si, fault_needmoreparams, STR_INSUFFICIENT_PARAMS, parv[i]);
-					error = true;
-					break;
-				}
-			}
-		} //for (i = 0; i < parc; i++)
-
-		if (error) {
-			break;
-		}
+			struct mynick *const mn = n->data;
 
-		if (found) {
-			list_one(si, NULL, mn);
-			matches++;
+			if (!list_req_match(req, mn))
+				continue;
+
+			list_one(req->si, NULL, mn);
+			req->matches++;
 		}
-	} //MOWGLI_PATRICIA_FOREACH(mn, &state, nicklist)
 
-	build_criteriastr(criteriastr, parc, parv);
+		if (unbounded || ++count % LIST_CHECK_INTERVAL)
+			continue;
+
+		e_time(start, &elapsed);
+
+		if (tv2ms(&elapsed) >= (int) LIST_SLICE_MS)
+			return req->pos >= req->nids;
+	}
+
+	return true;
+}
+
+static void
+list_req_finish(struct list_req *const restrict req)
+{
+	struct sourceinfo *const si = req->si;
+	const char *const criteriastr = req->criteriastr;
+	const unsigned int matches = req->matches;
 
 	logcommand(si, CMDLOG_ADMIN, "LIST: \2%s\2 (\2%u\2 matches)", criteriastr, matches);
 	if (matches == 0)
@@ -300,6 +777,78 @@ ns_cmd_list(struct sourceinfo *si, int parc, char *parv[])
 		command_success_nodata(si, ngettext(N_("\2%u\2 match for criteria \2%s\2."),
 		                                    N_("\2%u\2 matches for criteria \2%s\2."), matches),
 		                                    matches, criteriastr);
+
+	(void) list_req_destroy(req);
+}
+
+static void
+list_req_slice(void *const restrict vreq)
+{
+	struct list_req *const req = vreq;
+
+	req->timer = NULL;
+
+	/* Only a client on IRC can be answered over several event loop turns;
+	 * RPC callers collect their reply when the command returns.
+	 */
+	if (list_req_step(req, req->si->su == NULL))
+	{
+		(void) list_req_finish(req);
+		return;
+	}
+
+	req->timer = mowgli_timer_add_once(base_eventloop, "list_req_slice", &list_req_slice, req, 0);
+}
+
+static void
+ns_cmd_list(struct sourceinfo *si, int parc, char *parv[])
+{
+	struct list_req *const req = smalloc(sizeof *req);
+
+	int i;
+
+	// Check every criterion before doing any work
+	for (i = 0; i < parc && req->ncrit < LIST_MAX_CRITERIA; i++)
+	{
+		struct list_param *param = mowgli_patricia_retrieve(list_params, parv[i]);
+		struct list_criterion *c;
+
+		if (param == NULL) {
+			command_fail(si, fault_badparams, _("\2%s\2 is not a recognized LIST criterion"), parv[i]);
+			break;
+		}
+
+		if (param->opttype != OPT_BOOL && param->opttype != OPT_FLAG && i + 1 >= parc) {
+			command_fail(si, fault_needmoreparams, STR_INSUFFICIENT_PARAMS, parv[i]);
+			break;
+		}
+
+		c = &req->crit[req->ncrit++];
+		c->param = param;
+
+		if (param->opttype == OPT_BOOL)
+			c->arg.boolval = true;
+		else if (param->opttype == OPT_INT)
+			c->arg.intval = atoi(parv[++i]);
+		else if (param->opttype == OPT_STRING)
+			c->arg.strval = sstrdup(parv[++i]);
+		else if (param->opttype == OPT_AGE)
+			c->arg.ageval = parse_age(parv[++i]);
+	}
+
+	req->si = atheme_object_ref(si);
+	mowgli_node_add(req, &req->node, &list_reqs);
+
+	if (i < parc) {
+		(void) list_req_destroy(req);
+		return;
+	}
+
+	build_criteriastr(req->criteriastr, parc, parv);
+
+	list_index_build();
+	list_plan(req);
+	list_req_slice(req);
 }
 
 static struct command ns_list = {
@@ -319,33 +868,26 @@ mod_init(struct module *const restrict m)
 	list_params = mowgli_patricia_create(strcasecanon);
 	service_named_bind_command("nickserv", &ns_list);
 
-	// list email
-	static struct list_param email;
-	email.opttype = OPT_STRING;
-	email.is_match = email_match;
-
-	static struct list_param lastlogin;
-	lastlogin.opttype = OPT_AGE;
-	lastlogin.is_match = lastlogin_match;
+	hook_add_myuser_add(list_myuser_add);
+	hook_add_myuser_delete(list_myuser_delete);
+	hook_add_myuser_changed_email(list_myuser_changed_email);
+	hook_add_metadata_change(list_metadata_change);
+	hook_add_user_delete(list_user_delete);
 
 	static struct list_param pattern;
 	pattern.opttype = OPT_STRING;
 	pattern.is_match = pattern_match;
 
-	static struct list_param registered;
-	registered.opttype = OPT_AGE;
-	registered.is_match = registered_match;
-
 	static struct list_param primary;
 	primary.opttype = OPT_BOOL;
 	primary.is_match = primary_match;
 
-	list_register("email", &email);
-	list_register("lastlogin", &lastlogin);
-	list_register("mail", &email);
+	list_register("email", &list_email);
+	list_register("lastlogin", &list_lastlogin);
+	list_register("mail", &list_email);
 
 	list_register("pattern", &pattern);
-	list_register("registered", &registered);
+	list_register("registered", &list_registered);
 	list_register("primary", &primary);
 
 	static struct list_param waitauth;
@@ -358,14 +900,28 @@ mod_init(struct module *const restrict m)
 static void
 mod_deinit(const enum module_unload_intent ATHEME_VATTR_UNUSED intent)
 {
+	mowgli_node_t *n, *tn;
+
 	service_named_unbind_command("nickserv", &ns_list);
 
+	hook_del_myuser_add(list_myuser_add);
+	hook_del_myuser_delete(list_myuser_delete);
+	hook_del_myuser_changed_email(list_myuser_changed_email);
+	hook_del_metadata_change(list_metadata_change);
+	hook_del_user_delete(list_user_delete);
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, list_reqs.head)
+		(void) list_req_destroy(n->data);
+
+	list_index_destroy();
+
 	list_unregister("email");
 	list_unregister("lastlogin");
 	list_unregister("mail");
 
 	list_unregister("pattern");
 	list_unregister("registered");
+	list_unregister("primary");
 
 	list_unregister("waitauth");
 }
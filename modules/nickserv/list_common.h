@@ -25,6 +25,11 @@ struct list_param
 {
 	enum list_opttype opttype;
 	bool (*is_match)(const struct mynick *mn, const void *arg);
+
+	/* If set, the criterion only ever matches accounts that carry this
+	 * metadata entry, and LIST may restrict its search to those.
+	 */
+	const char *indexed_metadata;
 };
 
 #endif /* !ATHEME_MOD_NICKSERV_LIST_COMMON_H */
@@ -136,10 +136,12 @@ mod_init(struct module *const restrict m)
 	static struct list_param mark;
 	mark.opttype = OPT_STRING;
 	mark.is_match = mark_match;
+	mark.indexed_metadata = "private:mark:reason";
 
 	static struct list_param marked;
 	marked.opttype = OPT_BOOL;
 	marked.is_match = is_marked;
+	marked.indexed_metadata = "private:mark:setter";
 
 	list_register("mark-reason", &mark);
 	list_register("marked", &marked);
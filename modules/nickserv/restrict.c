@@ -151,10 +151,12 @@ mod_init(struct module *const restrict m)
 	static struct list_param restricted;
 	restricted.opttype = OPT_BOOL;
 	restricted.is_match = is_restricted;
+	restricted.indexed_metadata = "private:restrict:setter";
 
 	static struct list_param restrict_match;
 	restrict_match.opttype = OPT_STRING;
 	restrict_match.is_match = restricted_match;
+	restrict_match.indexed_metadata = "private:restrict:reason";
 
 	list_register("restricted", &restricted);
 	list_register("restricted-reason", &restrict_match);
@@ -21,7 +21,6 @@ ns_cmd_set_property(struct sourceinfo *si, int parc, char *parv[])
 	unsigned int count;
 	mowgli_patricia_iteration_state_t state;
 	struct metadata *md;
-	struct hook_metadata_change mdchange;
 
 	if (!property)
 	{
@@ -49,11 +48,6 @@ ns_cmd_set_property(struct sourceinfo *si, int parc, char *parv[])
 			return;
 		}
 
-		mdchange.target = si->smu;
-		mdchange.name = md->name;
-		mdchange.value = md->value;
-		hook_call_metadata_change(&mdchange);
-
 		metadata_delete(si->smu, property);
 		logcommand(si, CMDLOG_SET, "SET:PROPERTY: \2%s\2 (deleted)", property);
 		command_success_nodata(si, _("Metadata entry \2%s\2 has been deleted."), property);
@@ -79,14 +73,7 @@ ns_cmd_set_property(struct sourceinfo *si, int parc, char *parv[])
 		return;
 	}
 
-	md = metadata_add(si->smu, property, value);
-	if (md != NULL)
-	{
-		mdchange.target = si->smu;
-		mdchange.name = md->name;
-		mdchange.value = md->value;
-		hook_call_metadata_change(&mdchange);
-	}
+	metadata_add(si->smu, property, value);
 	logcommand(si, CMDLOG_SET, "SET:PROPERTY: \2%s\2 to \2%s\2", property, value);
 	command_success_nodata(si, _("Metadata entry \2%s\2 added."), property);
 }
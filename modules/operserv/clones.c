@@ -11,7 +11,24 @@
 
 #define CLONESDB_VERSION	3
 #define CLONES_GRACE_TIMEPERIOD	180
-
+#define CLONES_MAX_LEVELS	4U
+#define CLONES_HEAP_MIN		2U	// nodes with at least this many clients are ranked
+#define CLONES_LIST_MIN		3U	// CLONES LIST only shows nodes with more clients than this
+#define CLONES_LIST_DEFAULT	20U
+#define CLONES_LIST_MAX		100U
+#define CLONES_PREFIXLEN	(INET6_ADDRSTRLEN + 5U)
+
+/* Clients are counted in a path-compressed binary trie over their (binary)
+ * addresses, with IPv4 stored as IPv4-mapped IPv6 (::ffff:0:0/96), so that
+ * one structure holds every family. Each client is counted in one node per
+ * configured prefix length of its family; the first of those is where the
+ * clone limits are enforced, and the others only aggregate for CLONES LIST.
+ *
+ * Exemptions hang off the node for their own prefix, so finding the one for
+ * an address is a single descent, keeping the longest match. Nodes with at
+ * least CLONES_HEAP_MIN clients are also kept in a max-heap by count, which
+ * CLONES LIST walks best-first instead of scanning every address.
+ */
 struct clones_exemption
 {
 	char *ip;
@@ -19,21 +36,58 @@ struct clones_exemption
 	unsigned int warn;
 	char *reason;
 	long expires;
+	struct clones_node *node;
 };
 
 struct clones_hostentry
 {
-	char ip[HOSTIPLEN + 1];
 	mowgli_list_t clients;
 	time_t firstkill;
 	unsigned int gracekills;
 };
 
+struct clones_node
+{
+	struct clones_node *parent;
+	struct clones_node *child[2];
+	uint8_t addr[16];
+	unsigned int len;
+	unsigned int clients;
+	size_t heappos;                         // 1-based index into clones_heap, or 0
+	struct clones_hostentry *he;            // only on enforcement nodes
+	struct clones_exemption *exempt;
+};
+
+struct clones_levels
+{
+	unsigned int ipv4[CLONES_MAX_LEVELS];
+	unsigned int ipv4_count;
+	unsigned int ipv6[CLONES_MAX_LEVELS];
+	unsigned int ipv6_count;
+};
+
+static const uint8_t clones_ipv4_mapped[12] = { [10] = 0xFFU, [11] = 0xFFU };
+
+// Prefix lengths are in trie bits, so the IPv4 ones have 96 added
+static const struct clones_levels clones_levels_default = {
+	.ipv4           = { 128U, 120U },
+	.ipv4_count     = 2U,
+	.ipv6           = { 64U, 48U },
+	.ipv6_count     = 2U,
+};
+
 static mowgli_patricia_t *os_clones_cmds = NULL;
-static mowgli_patricia_t *hostlist = NULL;
 static mowgli_heap_t *hostentry_heap = NULL;
+static mowgli_heap_t *clones_node_heap = NULL;
 static struct service *serviceinfo = NULL;
 
+static struct clones_node *clones_root = NULL;
+static struct clones_node **clones_heap = NULL;
+static size_t clones_heap_count = 0;
+static size_t clones_heap_size = 0;
+static struct clones_levels clones_levels;
+static struct clones_levels clones_levels_conf;
+
 static mowgli_list_t clone_exempts;
 static bool kline_enabled;
 static unsigned int grace_count;
@@ -50,11 +104,604 @@ cexempt_expired(struct clones_exemption *c)
 	return false;
 }
 
+static inline unsigned int
+clones_bit(const uint8_t *const restrict addr, const unsigned int bit)
+{
+	return (addr[bit / 8U] >> (7U - (bit % 8U))) & 1U;
+}
+
+static unsigned int
+clones_common(const uint8_t *const restrict a, const uint8_t *const restrict b, const unsigned int max)
+{
+	unsigned int bits = 0;
+
+	while (bits < max)
+	{
+		const unsigned int diff = a[bits / 8U] ^ b[bits / 8U];
+
+		if (! diff)
+		{
+			bits += 8U;
+			continue;
+		}
+
+		while (! (diff & (0x80U >> (bits % 8U))))
+			bits++;
+
+		break;
+	}
+
+	return MIN(bits, max);
+}
+
+static bool
+clones_parse_addr(const char *const restrict str, uint8_t *const restrict addr, unsigned int *const restrict len)
+{
+	char host[HOSTIPLEN + 1];
+	const char *const slash = strchr(str, '/');
+	const size_t hostlen = slash ? (size_t) (slash - str) : strlen(str);
+	unsigned int maxbits;
+	unsigned int offset;
+
+	if (hostlen >= sizeof host)
+		return false;
+
+	(void) memcpy(host, str, hostlen);
+	host[hostlen] = '\0';
+
+	(void) memset(addr, 0x00, 16U);
+
+	if (inet_pton(AF_INET, host, addr + 12) == 1)
+	{
+		(void) memcpy(addr, clones_ipv4_mapped, sizeof clones_ipv4_mapped);
+		maxbits = 32U;
+		offset = 96U;
+	}
+	else if (inet_pton(AF_INET6, host, addr) == 1)
+	{
+		maxbits = 128U;
+		offset = 0U;
+	}
+	else
+		return false;
+
+	unsigned int bits = maxbits;
+
+	if (slash && (! string_to_uint(slash + 1, &bits) || bits > maxbits))
+		return false;
+
+	*len = bits + offset;
+	return true;
+}
+
+static void
+clones_prefix_string(const uint8_t *const restrict addr, const unsigned int len, char *const restrict buf,
+                     const size_t bufsize)
+{
+	char host[INET6_ADDRSTRLEN];
+	unsigned int bits = len;
+	unsigned int maxbits = 128U;
+
+	if (len >= 96U && memcmp(addr, clones_ipv4_mapped, sizeof clones_ipv4_mapped) == 0)
+	{
+		(void) inet_ntop(AF_INET, addr + 12, host, sizeof host);
+		bits -= 96U;
+		maxbits = 32U;
+	}
+	else
+		(void) inet_ntop(AF_INET6, addr, host, sizeof host);
+
+	if (bits == maxbits)
+		(void) mowgli_strlcpy(buf, host, bufsize);
+	else
+		(void) snprintf(buf, bufsize, "%s/%u", host, bits);
+}
+
+static const unsigned int *
+clones_addr_levels(const uint8_t *const restrict addr, unsigned int *const restrict count)
+{
+	if (memcmp(addr, clones_ipv4_mapped, sizeof clones_ipv4_mapped) == 0)
+	{
+		*count = clones_levels.ipv4_count;
+		return clones_levels.ipv4;
+	}
+
+	*count = clones_levels.ipv6_count;
+	return clones_levels.ipv6;
+}
+
+static struct clones_node *
+clones_node_create(const uint8_t *const restrict addr, const unsigned int len)
+{
+	struct clones_node *const n = mowgli_heap_alloc(clones_node_heap);
+
+	(void) memset(n, 0x00, sizeof *n);
+	(void) memcpy(n->addr, addr, sizeof n->addr);
+
+	for (unsigned int bit = len; bit < 128U; bit++)
+		n->addr[bit / 8U] &= (uint8_t) ~(0x80U >> (bit % 8U));
+
+	n->len = len;
+	return n;
+}
+
+static struct clones_node **
+clones_trie_slot(const struct clones_node *const restrict n)
+{
+	if (! n->parent)
+		return &clones_root;
+
+	return &n->parent->child[clones_bit(n->addr, n->parent->len)];
+}
+
+static struct clones_node *
+clones_trie_get(const uint8_t *const restrict addr, const unsigned int len, const bool create)
+{
+	struct clones_node **slot = &clones_root;
+	struct clones_node *parent = NULL;
+
+	while (*slot)
+	{
+		struct clones_node *const n = *slot;
+		const unsigned int common = clones_common(n->addr, addr, MIN(n->len, len));
+
+		if (common == n->len)
+		{
+			if (n->len == len)
+				return n;
+
+			parent = n;
+			slot = &n->child[clones_bit(addr, n->len)];
+			continue;
+		}
+
+		if (! create)
+			return NULL;
+
+		struct clones_node *const x = clones_node_create(addr, len);
+
+		if (common == len)
+		{
+			// The new prefix contains this node; insert it above
+			x->parent = parent;
+			x->child[clones_bit(n->addr, len)] = n;
+			n->parent = x;
+			*slot = x;
+			return x;
+		}
+
+		// The two diverge at bit 'common'; join them under a new branch node
+		struct clones_node *const branch = clones_node_create(addr, common);
+
+		branch->parent = parent;
+		branch->child[clones_bit(n->addr, common)] = n;
+		branch->child[clones_bit(addr, common)] = x;
+		n->parent = branch;
+		x->parent = branch;
+		*slot = branch;
+		return x;
+	}
+
+	if (! create)
+		return NULL;
+
+	struct clones_node *const x = clones_node_create(addr, len);
+
+	x->parent = parent;
+	*slot = x;
+	return x;
+}
+
+static void
+clones_trie_prune(struct clones_node *n)
+{
+	while (n && ! n->clients && ! n->exempt && ! n->he)
+	{
+		struct clones_node *const parent = n->parent;
+
+		// Still needed to branch
+		if (n->child[0] && n->child[1])
+			return;
+
+		struct clones_node *const child = n->child[0] ? n->child[0] : n->child[1];
+
+		*clones_trie_slot(n) = child;
+		(void) mowgli_heap_free(clones_node_heap, n);
+
+		if (child)
+		{
+			child->parent = parent;
+			return;
+		}
+
+		// The parent may now be a branch node with only one child left
+		n = parent;
+	}
+}
+
+static struct clones_exemption *
+clones_trie_exempt(const uint8_t *const restrict addr, const unsigned int len)
+{
+	struct clones_exemption *best = NULL;
+	const struct clones_node *n = clones_root;
+
+	while (n && n->len <= len && clones_common(n->addr, addr, n->len) == n->len)
+	{
+		if (n->exempt && ! cexempt_expired(n->exempt))
+			best = n->exempt;
+
+		if (n->len == len)
+			break;
+
+		n = n->child[clones_bit(addr, n->len)];
+	}
+
+	return best;
+}
+
+// Whether any exemption applies to only part of the given prefix
+static bool
+clones_trie_exempt_below(const struct clones_node *const restrict n)
+{
+	for (unsigned int i = 0; i < 2U; i++)
+	{
+		const struct clones_node *const child = n->child[i];
+
+		if (! child)
+			continue;
+
+		if (child->exempt && ! cexempt_expired(child->exempt))
+			return true;
+
+		if (clones_trie_exempt_below(child))
+			return true;
+	}
+
+	return false;
+}
+
+static inline void
+clones_heap_set(const size_t i, struct clones_node *const restrict n)
+{
+	clones_heap[i] = n;
+	n->heappos = i + 1U;
+}
+
+static void
+clones_heap_up(size_t i)
+{
+	struct clones_node *const n = clones_heap[i];
+
+	while (i)
+	{
+		const size_t parent = (i - 1U) / 2U;
+
+		if (clones_heap[parent]->clients >= n->clients)
+			break;
+
+		(void) clones_heap_set(i, clones_heap[parent]);
+		i = parent;
+	}
+
+	(void) clones_heap_set(i, n);
+}
+
+static void
+clones_heap_down(size_t i)
+{
+	struct clones_node *const n = clones_heap[i];
+
+	for (;;)
+	{
+		size_t child = (2U * i) + 1U;
+
+		if (child >= clones_heap_count)
+			break;
+
+		if (child + 1U < clones_heap_count && clones_heap[child + 1U]->clients > clones_heap[child]->clients)
+			child++;
+
+		if (clones_heap[child]->clients <= n->clients)
+			break;
+
+		(void) clones_heap_set(i, clones_heap[child]);
+		i = child;
+	}
+
+	(void) clones_heap_set(i, n);
+}
+
+static void
+clones_heap_update(struct clones_node *const restrict n)
+{
+	if (n->clients >= CLONES_HEAP_MIN && ! n->heappos)
+	{
+		if (clones_heap_count == clones_heap_size)
+		{
+			clones_heap_size = MAX(clones_heap_size * 2U, 64U);
+			clones_heap = sreallocarray(clones_heap, clones_heap_size, sizeof *clones_heap);
+		}
+
+		(void) clones_heap_set(clones_heap_count++, n);
+		(void) clones_heap_up(n->heappos - 1U);
+	}
+	else if (n->clients < CLONES_HEAP_MIN && n->heappos)
+	{
+		const size_t i = n->heappos - 1U;
+		struct clones_node *const last = clones_heap[--clones_heap_count];
+
+		n->heappos = 0;
+
+		if (last != n)
+		{
+			(void) clones_heap_set(i, last);
+			(void) clones_heap_up(i);
+			(void) clones_heap_down(last->heappos - 1U);
+		}
+	}
+	else if (n->heappos)
+	{
+		(void) clones_heap_up(n->heappos - 1U);
+		(void) clones_heap_down(n->heappos - 1U);
+	}
+}
+
+/* Counts the user at every level and returns the node clone limits apply to.
+ * That is the first level, unless the user is covered by an exemption that is
+ * narrower than it; the exempted range is then counted on its own, and not
+ * towards the first level's limit.
+ */
+static struct clones_node *
+clones_track(struct user *const restrict u, uint8_t *const restrict addr)
+{
+	struct clones_node *enforce = NULL;
+	unsigned int count;
+	unsigned int len;
+
+	if (! clones_parse_addr(u->ip, addr, &len))
+	{
+		(void) slog(LG_DEBUG, "%s: cannot parse IP address '%s' of %s", MOWGLI_FUNC_NAME, u->ip, u->nick);
+		return NULL;
+	}
+
+	const unsigned int *const levels = clones_addr_levels(addr, &count);
+
+	for (unsigned int i = 0; i < count; i++)
+	{
+		struct clones_node *const n = clones_trie_get(addr, levels[i], true);
+
+		n->clients++;
+		(void) clones_heap_update(n);
+
+		if (i == 0)
+			enforce = n;
+	}
+
+	if (! enforce)
+		return NULL;
+
+	const struct clones_exemption *const c = clones_trie_exempt(addr, 128U);
+
+	if (c && c->node->len > enforce->len)
+		enforce = c->node;
+
+	if (! enforce->he)
+		enforce->he = mowgli_heap_alloc(hostentry_heap);
+
+	mowgli_node_add(u, mowgli_node_create(), &enforce->he->clients);
+
+	return enforce;
+}
+
+static void
+clones_untrack(struct user *const restrict u)
+{
+	uint8_t addr[16];
+	unsigned int count;
+	unsigned int len;
+
+	if (! clones_parse_addr(u->ip, addr, &len))
+		return;
+
+	/* Exemptions may have been added or removed since the user was counted,
+	 * so look for the user on every node their address is under.
+	 */
+	struct clones_node *en = clones_root;
+
+	while (en && clones_common(en->addr, addr, en->len) == en->len)
+	{
+		struct clones_node *const next = (en->len < 128U) ? en->child[clones_bit(addr, en->len)] : NULL;
+		mowgli_node_t *const un = en->he ? mowgli_node_find(u, &en->he->clients) : NULL;
+
+		if (un)
+		{
+			mowgli_node_delete(un, &en->he->clients);
+			mowgli_node_free(un);
+
+			if (MOWGLI_LIST_LENGTH(&en->he->clients) == 0)
+			{
+				// TODO: free later if he->firstkill > time(NULL) - CLONES_GRACE_TIMEPERIOD.
+				mowgli_heap_free(hostentry_heap, en->he);
+				en->he = NULL;
+				(void) clones_trie_prune(en);
+			}
+
+			break;
+		}
+
+		en = next;
+	}
+
+	const unsigned int *const levels = clones_addr_levels(addr, &count);
+
+	for (unsigned int i = 0; i < count; i++)
+	{
+		struct clones_node *const n = clones_trie_get(addr, levels[i], false);
+
+		if (! n || ! n->clients)
+		{
+			(void) slog(LG_DEBUG, "%s: node for %s/%u not found??", MOWGLI_FUNC_NAME, u->ip, levels[i]);
+			continue;
+		}
+
+		n->clients--;
+		(void) clones_heap_update(n);
+		(void) clones_trie_prune(n);
+	}
+}
+
+static void
+clones_exempt_link(struct clones_exemption *const restrict c)
+{
+	uint8_t addr[16];
+	unsigned int len;
+
+	if (! clones_parse_addr(c->ip, addr, &len))
+	{
+		(void) slog(LG_ERROR, "%s: clone exemption '%s' is not an IP address or CIDR mask; it will never match",
+		                      MOWGLI_FUNC_NAME, c->ip);
+		return;
+	}
+
+	struct clones_node *const n = clones_trie_get(addr, len, true);
+
+	if (n->exempt)
+	{
+		(void) slog(LG_ERROR, "%s: clone exemption '%s' duplicates '%s'; it will never match",
+		                      MOWGLI_FUNC_NAME, c->ip, n->exempt->ip);
+		return;
+	}
+
+	n->exempt = c;
+	c->node = n;
+}
+
+static bool
+clones_exempt_match(const struct clones_exemption *const restrict c, const char *const restrict ip)
+{
+	uint8_t addr[16];
+	unsigned int len;
+
+	if (! strcmp(c->ip, ip))
+		return true;
+
+	if (! c->node || ! clones_parse_addr(ip, addr, &len))
+		return false;
+
+	return len == c->node->len && clones_common(c->node->addr, addr, len) == len;
+}
+
+static void
+clones_exempt_destroy(struct clones_exemption *const restrict c, mowgli_node_t *const restrict n)
+{
+	if (c->node)
+	{
+		c->node->exempt = NULL;
+		(void) clones_trie_prune(c->node);
+	}
+
+	sfree(c->ip);
+	sfree(c->reason);
+	sfree(c);
+	mowgli_node_delete(n, &clone_exempts);
+	mowgli_node_free(n);
+}
+
+static void
+clones_config_prefixes(mowgli_config_file_entry_t *const restrict ce, unsigned int *const restrict levels,
+                       unsigned int *const restrict count, const unsigned int maxbits, const unsigned int offset)
+{
+	mowgli_config_file_entry_t *cce;
+
+	*count = 0;
+
+	MOWGLI_ITER_FOREACH(cce, ce->entries)
+	{
+		unsigned int bits;
+		bool duplicate = false;
+
+		if (! string_to_uint(cce->varname, &bits) || ! bits || bits > maxbits)
+		{
+			(void) conf_report_warning(cce, "invalid prefix length (must be 1 to %u)", maxbits);
+			continue;
+		}
+
+		for (unsigned int i = 0; i < *count; i++)
+			if (levels[i] == bits + offset)
+				duplicate = true;
+
+		if (duplicate)
+		{
+			(void) conf_report_warning(cce, "duplicate prefix length");
+			continue;
+		}
+
+		if (*count == CLONES_MAX_LEVELS)
+		{
+			(void) conf_report_warning(cce, "too many prefix lengths (at most %u)", CLONES_MAX_LEVELS);
+			break;
+		}
+
+		levels[(*count)++] = bits + offset;
+	}
+}
+
+static int
+clones_ipv4_prefixes_handler(mowgli_config_file_entry_t *const restrict ce)
+{
+	(void) clones_config_prefixes(ce, clones_levels_conf.ipv4, &clones_levels_conf.ipv4_count, 32U, 96U);
+	return 0;
+}
+
+static int
+clones_ipv6_prefixes_handler(mowgli_config_file_entry_t *const restrict ce)
+{
+	(void) clones_config_prefixes(ce, clones_levels_conf.ipv6, &clones_levels_conf.ipv6_count, 128U, 0U);
+	return 0;
+}
+
+static void
+clones_configpurge(void *unused)
+{
+	(void) memset(&clones_levels_conf, 0x00, sizeof clones_levels_conf);
+}
+
 static void
 clones_configready(void *unused)
 {
 	clones_allowed = config_options.default_clone_allowed;
 	clones_warn = config_options.default_clone_warn;
+
+	struct clones_levels levels = clones_levels_conf;
+
+	if (! levels.ipv4_count)
+	{
+		(void) memcpy(levels.ipv4, clones_levels_default.ipv4, sizeof levels.ipv4);
+		levels.ipv4_count = clones_levels_default.ipv4_count;
+	}
+	if (! levels.ipv6_count)
+	{
+		(void) memcpy(levels.ipv6, clones_levels_default.ipv6, sizeof levels.ipv6);
+		levels.ipv6_count = clones_levels_default.ipv6_count;
+	}
+
+	if (memcmp(&levels, &clones_levels, sizeof levels) == 0)
+		return;
+
+	// Recount everyone at the new levels; this only tracks, it does not enforce
+	struct user *u;
+	mowgli_patricia_iteration_state_t state;
+	uint8_t addr[16];
+
+	MOWGLI_PATRICIA_FOREACH(u, &state, userlist)
+		if (! is_internal_client(u) && u->ip != NULL)
+			(void) clones_untrack(u);
+
+	clones_levels = levels;
+
+	MOWGLI_PATRICIA_FOREACH(u, &state, userlist)
+		if (! is_internal_client(u) && u->ip != NULL)
+			(void) clones_track(u, addr);
 }
 
 static void
@@ -80,13 +727,7 @@ write_exemptdb(struct database_handle *db)
 	{
 		struct clones_exemption *c = n->data;
 		if (cexempt_expired(c))
-		{
-			sfree(c->ip);
-			sfree(c->reason);
-			sfree(c);
-			mowgli_node_delete(n, &clone_exempts);
-			mowgli_node_free(n);
-		}
+			(void) clones_exempt_destroy(c, n);
 		else
 		{
 			db_start_row(db, "CLONES-EX");
@@ -156,32 +797,7 @@ db_h_ex(struct database_handle *db, const char *type)
 	c->expires = expires;
 	c->reason = sstrdup(reason);
 	mowgli_node_add(c, mowgli_node_create(), &clone_exempts);
-}
-
-static struct clones_exemption *
-find_exempt(const char *ip)
-{
-	mowgli_node_t *n;
-
-	// first check for an exact match
-	MOWGLI_ITER_FOREACH(n, clone_exempts.head)
-	{
-		struct clones_exemption *c = n->data;
-
-		if (!strcmp(ip, c->ip))
-			return c;
-	}
-
-	// then look for cidr
-	MOWGLI_ITER_FOREACH(n, clone_exempts.head)
-	{
-		struct clones_exemption *c = n->data;
-
-		if (!match_ips(c->ip, ip))
-			return c;
-	}
-
-	return 0;
+	(void) clones_exempt_link(c);
 }
 
 static void
@@ -264,22 +880,56 @@ os_cmd_clones_kline(struct sourceinfo *si, int parc, char *parv[])
 static void
 os_cmd_clones_list(struct sourceinfo *si, int parc, char *parv[])
 {
-	struct clones_hostentry *he;
-	unsigned int k = 0;
-	mowgli_patricia_iteration_state_t state;
+	unsigned int limit = CLONES_LIST_DEFAULT;
+	unsigned int shown = 0;
 
-	MOWGLI_PATRICIA_FOREACH(he, &state, hostlist)
+	if (parv[0] && (! string_to_uint(parv[0], &limit) || ! limit || limit > CLONES_LIST_MAX))
 	{
-		k = MOWGLI_LIST_LENGTH(&he->clients);
+		command_fail(si, fault_badparams, STR_INVALID_PARAMS, "CLONES LIST");
+		command_fail(si, fault_badparams, _("Syntax: CLONES LIST [1-%u]"), CLONES_LIST_MAX);
+		return;
+	}
 
-		if (k > 3)
-		{
-			struct clones_exemption *c = find_exempt(he->ip);
-			if (c)
-				command_success_nodata(si, _("%u from %s (\2EXEMPT\2; allowed %u)"), k, he->ip, c->allowed);
-			else
-				command_success_nodata(si, _("%u from %s"), k, he->ip);
-		}
+	/* Walk the heap best-first: the next largest entry is always one of the
+	 * children of an entry already shown, so only those are candidates.
+	 */
+	size_t frontier[CLONES_LIST_MAX + 1U];
+	size_t nfrontier = 0;
+
+	if (clones_heap_count)
+		frontier[nfrontier++] = 0;
+
+	while (nfrontier && shown < limit)
+	{
+		size_t best = 0;
+
+		for (size_t j = 1; j < nfrontier; j++)
+			if (clones_heap[frontier[j]]->clients > clones_heap[frontier[best]]->clients)
+				best = j;
+
+		const size_t i = frontier[best];
+		const struct clones_node *const n = clones_heap[i];
+
+		if (n->clients <= CLONES_LIST_MIN)
+			break;
+
+		frontier[best] = frontier[--nfrontier];
+
+		if ((2U * i) + 1U < clones_heap_count)
+			frontier[nfrontier++] = (2U * i) + 1U;
+		if ((2U * i) + 2U < clones_heap_count)
+			frontier[nfrontier++] = (2U * i) + 2U;
+
+		char prefix[CLONES_PREFIXLEN];
+		(void) clones_prefix_string(n->addr, n->len, prefix, sizeof prefix);
+
+		struct clones_exemption *c = clones_trie_exempt(n->addr, n->len);
+		if (c)
+			command_success_nodata(si, _("%u from %s (\2EXEMPT\2; allowed %u)"), n->clients, prefix, c->allowed);
+		else
+			command_success_nodata(si, _("%u from %s"), n->clients, prefix);
+
+		shown++;
 	}
 	command_success_nodata(si, _("End of CLONES LIST"));
 	logcommand(si, CMDLOG_ADMIN, "CLONES:LIST");
@@ -288,7 +938,6 @@ os_cmd_clones_list(struct sourceinfo *si, int parc, char *parv[])
 static void
 os_cmd_clones_addexempt(struct sourceinfo *si, int parc, char *parv[])
 {
-	mowgli_node_t *n;
 	char *ip = parv[0];
 	char *clonesstr = parv[1];
 	unsigned int clones;
@@ -297,6 +946,8 @@ os_cmd_clones_addexempt(struct sourceinfo *si, int parc, char *parv[])
 	char rreason[BUFSIZE];
 	struct clones_exemption *c = NULL;
 	long duration;
+	uint8_t addr[16];
+	unsigned int len;
 
 	if (!ip || !clonesstr || !expiry || ! string_to_uint(clonesstr, &clones) || ! clones)
 	{
@@ -305,7 +956,7 @@ os_cmd_clones_addexempt(struct sourceinfo *si, int parc, char *parv[])
 		return;
 	}
 
-	if (!valid_ip_or_mask(ip))
+	if (!valid_ip_or_mask(ip) || !clones_parse_addr(ip, addr, &len))
 	{
 		command_fail(si, fault_badparams, _("Invalid IP/mask given."));
 		command_fail(si, fault_badparams, _("Syntax: CLONES ADDEXEMPT <ip> <clones> [!P|!T <minutes>] <reason>"));
@@ -386,13 +1037,9 @@ os_cmd_clones_addexempt(struct sourceinfo *si, int parc, char *parv[])
 		return;
 	}
 
-	MOWGLI_ITER_FOREACH(n, clone_exempts.head)
-	{
-		struct clones_exemption *t = n->data;
-
-		if (!strcmp(ip, t->ip))
-			c = t;
-	}
+	struct clones_node *const node = clones_trie_get(addr, len, false);
+	if (node)
+		c = node->exempt;
 
 	if (c == NULL)
 	{
@@ -407,6 +1054,7 @@ os_cmd_clones_addexempt(struct sourceinfo *si, int parc, char *parv[])
 		c->ip = sstrdup(ip);
 		c->reason = sstrdup(rreason);
 		mowgli_node_add(c, mowgli_node_create(), &clone_exempts);
+		(void) clones_exempt_link(c);
 		command_success_nodata(si, _("Added \2%s\2 to clone exempt list."), ip);
 	}
 	else
@@ -445,20 +1093,10 @@ os_cmd_clones_delexempt(struct sourceinfo *si, int parc, char *parv[])
 		struct clones_exemption *c = n->data;
 
 		if (cexempt_expired(c))
+			(void) clones_exempt_destroy(c, n);
+		else if (clones_exempt_match(c, arg))
 		{
-			sfree(c->ip);
-			sfree(c->reason);
-			sfree(c);
-			mowgli_node_delete(n, &clone_exempts);
-			mowgli_node_free(n);
-		}
-		else if (!strcmp(c->ip, arg))
-		{
-			sfree(c->ip);
-			sfree(c->reason);
-			sfree(c);
-			mowgli_node_delete(n, &clone_exempts);
-			mowgli_node_free(n);
+			(void) clones_exempt_destroy(c, n);
 			command_success_nodata(si, _("Removed \2%s\2 from clone exempt list."), arg);
 			logcommand(si, CMDLOG_ADMIN, "CLONES:DELEXEMPT: \2%s\2", arg);
 			return;
@@ -526,14 +1164,8 @@ os_cmd_clones_setexempt(struct sourceinfo *si, int parc, char *parv[])
 			struct clones_exemption *c = n->data;
 
 			if (cexempt_expired(c))
-			{
-				sfree(c->ip);
-				sfree(c->reason);
-				sfree(c);
-				mowgli_node_delete(n, &clone_exempts);
-				mowgli_node_free(n);
-			}
-			else if (!strcmp(c->ip, ip))
+				(void) clones_exempt_destroy(c, n);
+			else if (clones_exempt_match(c, ip))
 			{
 				if (!strcasecmp(subcmd, "ALLOWED"))
 				{
@@ -677,13 +1309,7 @@ os_cmd_clones_listexempt(struct sourceinfo *si, int parc, char *parv[])
 		struct clones_exemption *c = n->data;
 
 		if (cexempt_expired(c))
-		{
-			sfree(c->ip);
-			sfree(c->reason);
-			sfree(c);
-			mowgli_node_delete(n, &clone_exempts);
-			mowgli_node_free(n);
-		}
+			(void) clones_exempt_destroy(c, n);
 		else if (c->expires)
 			command_success_nodata(si, _("%s - allowed limit %u, warn on %u - expires in %s - \2%s\2"), c->ip, c->allowed, c->warn, timediff(c->expires > CURRTIME ? c->expires - CURRTIME : 0), c->reason);
 		else
@@ -698,9 +1324,12 @@ clones_newuser(struct hook_user_nick *data)
 {
 	struct user *u = data->u;
 	unsigned int i;
+	struct clones_node *node;
 	struct clones_hostentry *he;
 	unsigned int allowed, warn;
 	mowgli_node_t *n;
+	uint8_t addr[16];
+	char prefix[CLONES_PREFIXLEN];
 
 	// If the user has been killed, don't do anything.
 	if (!u)
@@ -710,17 +1339,20 @@ clones_newuser(struct hook_user_nick *data)
 	if (is_internal_client(u) || u->ip == NULL)
 		return;
 
-	he = mowgli_patricia_retrieve(hostlist, u->ip);
-	if (he == NULL)
-	{
-		he = mowgli_heap_alloc(hostentry_heap);
-		mowgli_strlcpy(he->ip, u->ip, sizeof he->ip);
-		mowgli_patricia_add(hostlist, he->ip, he);
-	}
-	mowgli_node_add(u, mowgli_node_create(), &he->clients);
+	if (! (node = clones_track(u, addr)))
+		return;
+
+	he = node->he;
 	i = MOWGLI_LIST_LENGTH(&he->clients);
 
-	struct clones_exemption *c = find_exempt(u->ip);
+	// Single addresses are reported (and klined) in the form the ircd uses
+	if (node->len == 128U)
+		(void) mowgli_strlcpy(prefix, u->ip, sizeof prefix);
+	else
+		(void) clones_prefix_string(node->addr, node->len, prefix, sizeof prefix);
+
+	// Only an exemption that covers all of the enforced range may raise its limit
+	struct clones_exemption *c = clones_trie_exempt(addr, node->len);
 	if (c == 0)
 	{
 		allowed = clones_allowed;
@@ -760,7 +1392,7 @@ clones_newuser(struct hook_user_nick *data)
 	{
 		// User has exceeded the maximum number of allowed clones.
 		if (is_autokline_exempt(u))
-			slog(LG_INFO, "CLONES: \2%u\2 clones on \2%s\2 (%s!%s@%s) (user is autokline exempt)", i, u->ip, u->nick, u->user, u->host);
+			slog(LG_INFO, "CLONES: \2%u\2 clones on \2%s\2 (%s!%s@%s) (user is autokline exempt)", i, prefix, u->nick, u->user, u->host);
 		else if (!kline_enabled || he->gracekills < grace_count || (grace_count > 0 && he->firstkill < time(NULL) - CLONES_GRACE_TIMEPERIOD))
 		{
 			if (he->firstkill < time(NULL) - CLONES_GRACE_TIMEPERIOD)
@@ -774,9 +1406,9 @@ clones_newuser(struct hook_user_nick *data)
 			}
 
 			if (!kline_enabled)
-				slog(LG_INFO, "CLONES: \2%u\2 clones on \2%s\2 (%s!%s@%s) (TKLINE disabled, killing user)", i, u->ip, u->nick, u->user, u->host);
+				slog(LG_INFO, "CLONES: \2%u\2 clones on \2%s\2 (%s!%s@%s) (TKLINE disabled, killing user)", i, prefix, u->nick, u->user, u->host);
 			else
-				slog(LG_INFO, "CLONES: \2%u\2 clones on \2%s\2 (%s!%s@%s) (grace period, killing user, %u grace kills remaining)", i, u->ip, u->nick,
+				slog(LG_INFO, "CLONES: \2%u\2 clones on \2%s\2 (%s!%s@%s) (grace period, killing user, %u grace kills remaining)", i, prefix, u->nick,
 					u->user, u->host, grace_count - he->gracekills);
 
 			kill_user(serviceinfo->me, u, "Too many connections from this host.");
@@ -785,8 +1417,11 @@ clones_newuser(struct hook_user_nick *data)
 		else
 		{
 			if (! (u->flags & UF_KLINESENT)) {
-				slog(LG_INFO, "CLONES: \2%u\2 clones on \2%s\2 (%s!%s@%s) (TKLINE due to excess clones)", i, u->ip, u->nick, u->user, u->host);
-				kline_sts("*", "*", u->ip, kline_duration, "Excessive clones");
+				// Don't ban addresses in the range that are exempt from it
+				const char *const target = clones_trie_exempt_below(node) ? u->ip : prefix;
+
+				slog(LG_INFO, "CLONES: \2%u\2 clones on \2%s\2 (%s!%s@%s) (TKLINE on %s due to excess clones)", i, prefix, u->nick, u->user, u->host, target);
+				kline_sts("*", "*", target, kline_duration, "Excessive clones");
 				u->flags |= UF_KLINESENT;
 			}
 		}
@@ -794,7 +1429,7 @@ clones_newuser(struct hook_user_nick *data)
 	}
 	else if (i >= warn && warn != 0)
 	{
-		slog(LG_INFO, "CLONES: \2%u\2 clones on \2%s\2 (%s!%s@%s) (\2%u\2 allowed)", i, u->ip, u->nick, u->user, u->host, allowed);
+		slog(LG_INFO, "CLONES: \2%u\2 clones on \2%s\2 (%s!%s@%s) (\2%u\2 allowed)", i, prefix, u->nick, u->user, u->host, allowed);
 		msg(serviceinfo->nick, u->nick, _("\2WARNING\2: You may not have more than \2%u\2 clients connected to the network at once. Any further connections risks being removed."), allowed);
 	}
 }
@@ -802,31 +1437,11 @@ clones_newuser(struct hook_user_nick *data)
 static void
 clones_userquit(struct user *u)
 {
-	mowgli_node_t *n;
-	struct clones_hostentry *he;
-
 	// User has no IP, ignore them
 	if (is_internal_client(u) || u->ip == NULL)
 		return;
 
-	he = mowgli_patricia_retrieve(hostlist, u->ip);
-	if (he == NULL)
-	{
-		slog(LG_DEBUG, "clones_userquit(): hostentry for %s not found??", u->ip);
-		return;
-	}
-	n = mowgli_node_find(u, &he->clients);
-	if (n)
-	{
-		mowgli_node_delete(n, &he->clients);
-		mowgli_node_free(n);
-		if (MOWGLI_LIST_LENGTH(&he->clients) == 0)
-		{
-			// TODO: free later if he->firstkill > time(NULL) - CLONES_GRACE_TIMEPERIOD.
-			mowgli_patricia_delete(hostlist, he->ip);
-			mowgli_heap_free(hostentry_heap, he);
-		}
-	}
+	(void) clones_untrack(u);
 }
 
 static struct command os_clones = {
@@ -851,7 +1466,7 @@ static struct command os_clones_list = {
 	.name           = "LIST",
 	.desc           = N_("Lists clones on the network."),
 	.access         = AC_NONE,
-	.maxparc        = 0,
+	.maxparc        = 1,
 	.cmd            = &os_cmd_clones_list,
 	.help           = { .path = "" },
 };
@@ -930,9 +1545,9 @@ mod_init(struct module *const restrict m)
 		return;
 	}
 
-	if (! (hostlist = mowgli_patricia_create(&noopcanon)))
+	if (! (hostentry_heap = mowgli_heap_create(sizeof(struct clones_hostentry), HEAP_USER, BH_NOW)))
 	{
-		(void) slog(LG_ERROR, "%s: mowgli_patricia_create() failed", m->name);
+		(void) slog(LG_ERROR, "%s: mowgli_heap_create() failed", m->name);
 
 		(void) mowgli_patricia_destroy(os_clones_cmds, NULL, NULL);
 
@@ -940,17 +1555,19 @@ mod_init(struct module *const restrict m)
 		return;
 	}
 
-	if (! (hostentry_heap = mowgli_heap_create(sizeof(struct clones_hostentry), HEAP_USER, BH_NOW)))
+	if (! (clones_node_heap = mowgli_heap_create(sizeof(struct clones_node), HEAP_USER, BH_NOW)))
 	{
 		(void) slog(LG_ERROR, "%s: mowgli_heap_create() failed", m->name);
 
 		(void) mowgli_patricia_destroy(os_clones_cmds, NULL, NULL);
-		(void) mowgli_patricia_destroy(hostlist, NULL, NULL);
+		(void) mowgli_heap_destroy(hostentry_heap);
 
 		m->mflags |= MODFLAG_FAIL;
 		return;
 	}
 
+	clones_levels = clones_levels_default;
+
 	(void) command_add(&os_clones_kline, os_clones_cmds);
 	(void) command_add(&os_clones_list, os_clones_cmds);
 	(void) command_add(&os_clones_addexempt, os_clones_cmds);
@@ -961,6 +1578,10 @@ mod_init(struct module *const restrict m)
 
 	(void) service_named_bind_command("operserv", &os_clones);
 
+	(void) add_conf_item("CLONES_IPV4_PREFIXES", &serviceinfo->conf_table, &clones_ipv4_prefixes_handler);
+	(void) add_conf_item("CLONES_IPV6_PREFIXES", &serviceinfo->conf_table, &clones_ipv6_prefixes_handler);
+
+	(void) hook_add_config_purge(&clones_configpurge);
 	(void) hook_add_config_ready(&clones_configready);
 	(void) hook_add_user_add(&clones_newuser);
 	(void) hook_add_user_delete(&clones_userquit);
@@ -972,7 +1593,7 @@ mod_init(struct module *const restrict m)
 	(void) db_register_type_handler("CLONES-GR", &db_h_gr);
 	(void) db_register_type_handler("CLONES-EX", &db_h_ex);
 
-	// add everyone to host hash
+	// add everyone to the address trie
 	struct user *u;
 	mowgli_patricia_iteration_state_t state;
 	MOWGLI_PATRICIA_FOREACH(u, &state, userlist)
@@ -0,0 +1,152 @@
+/*
+ * SPDX-License-Identifier: ISC
+ * SPDX-URL: https://spdx.org/licenses/ISC.html
+ *
+ * Copyright (C) 2026 Atheme Development Group (https://atheme.github.io/)
+ *
+ * This file contains code for OS CMDSTATS
+ */
+
+#include <atheme.h>
+
+#define CMDSTATS_DEFAULT        20U
+#define CMDSTATS_MAX            100U
+
+struct cmdstats_entry
+{
+	char                            name[BUFSIZE];
+	const struct metrics_timing *   timing;
+};
+
+struct cmdstats_list
+{
+	struct cmdstats_entry *         entries;
+	size_t                          count;
+	size_t                          size;
+};
+
+static void
+cmdstats_add(struct cmdstats_list *const restrict list, const struct metrics_timing *const restrict timing,
+             const char *const restrict service, const char *const restrict name)
+{
+	if (! timing->count)
+		return;
+
+	if (list->count == list->size)
+	{
+		list->size = list->size ? (list->size * 2) : 64;
+		list->entries = sreallocarray(list->entries, list->size, sizeof *list->entries);
+	}
+
+	struct cmdstats_entry *const entry = &list->entries[list->count++];
+
+	if (service)
+		(void) snprintf(entry->name, sizeof entry->name, "%s %s", service, name);
+	else
+		(void) mowgli_strlcpy(entry->name, name, sizeof entry->name);
+
+	entry->timing = timing;
+}
+
+static void
+cmdstats_add_command(const struct metrics_command *const restrict mc, void *const restrict vlist)
+{
+	(void) cmdstats_add(vlist, &mc->timing, mc->service, mc->name);
+}
+
+// Most total time first; that is what a command costs the event loop overall
+static int
+cmdstats_compare(const void *const restrict va, const void *const restrict vb)
+{
+	const struct cmdstats_entry *const a = va;
+	const struct cmdstats_entry *const b = vb;
+
+	if (a->timing->usec != b->timing->usec)
+		return (a->timing->usec < b->timing->usec) ? 1 : -1;
+
+	return strcmp(a->name, b->name);
+}
+
+static void
+os_cmd_cmdstats_func(struct sourceinfo *const restrict si, const int parc, char **const restrict parv)
+{
+	struct cmdstats_list list = { NULL, 0, 0 };
+	unsigned int limit = CMDSTATS_DEFAULT;
+	bool protocol = false;
+
+	for (int i = 0; i < parc; i++)
+	{
+		if (strcasecmp(parv[i], "PROTOCOL") == 0)
+			protocol = true;
+		else if (! string_to_uint(parv[i], &limit) || ! limit || limit > CMDSTATS_MAX)
+		{
+			(void) command_fail(si, fault_badparams, STR_INVALID_PARAMS, "CMDSTATS");
+			(void) command_fail(si, fault_badparams, _("Syntax: CMDSTATS [PROTOCOL] [1-%u]"), CMDSTATS_MAX);
+			return;
+		}
+	}
+
+	if (protocol)
+	{
+		mowgli_patricia_iteration_state_t state;
+		const struct proto_cmd *pcmd;
+
+		MOWGLI_PATRICIA_FOREACH(pcmd, &state, pcommands)
+			(void) cmdstats_add(&list, &pcmd->timing, NULL, pcmd->token);
+	}
+	else
+		(void) metrics_command_foreach(&cmdstats_add_command, &list);
+
+	if (! list.count)
+	{
+		(void) command_success_nodata(si, _("No commands have been timed yet."));
+		return;
+	}
+
+	(void) qsort(list.entries, list.count, sizeof *list.entries, &cmdstats_compare);
+
+	(void) command_success_nodata(si, "%-28s %9s %11s %9s %9s %9s %9s", _("Command"), _("Calls"), _("Total (ms)"),
+	                              _("Mean"), _("Median"), _("99%"), _("Max"));
+	(void) command_success_nodata(si, "---------------------------- --------- ----------- "
+	                                  "--------- --------- --------- ---------");
+
+	for (size_t i = 0; i < list.count && i < limit; i++)
+	{
+		const struct metrics_timing *const t = list.entries[i].timing;
+
+		(void) command_success_nodata(si, "%-28s %9llu %11.1f %9.1f %9.1f %9.1f %9.1f", list.entries[i].name,
+		                              t->count, t->usec / 1000.0, (t->usec / 1000.0) / t->count,
+		                              metrics_timing_quantile(t, 0.5) / 1000.0,
+		                              metrics_timing_quantile(t, 0.99) / 1000.0, t->max / 1000.0);
+	}
+
+	(void) command_success_nodata(si, _("End of list; times other than the total are per call, in milliseconds."));
+
+	(void) sfree(list.entries);
+	(void) logcommand(si, CMDLOG_GET, "CMDSTATS%s", protocol ? ": \2PROTOCOL\2" : "");
+}
+
+static struct command os_cmd_cmdstats = {
+	.name           = "CMDSTATS",
+	.desc           = N_("Shows which commands take the most time."),
+	.access         = PRIV_SERVER_AUSPEX,
+	.maxparc        = 2,
+	.cmd            = &os_cmd_cmdstats_func,
+	.help           = { .path = "oservice/cmdstats" },
+};
+
+static void
+mod_init(struct module *const restrict m)
+{
+	MODULE_TRY_REQUEST_DEPENDENCY(m, "operserv/main")
+
+	(void) service_named_bind_command("operserv", &os_cmd_cmdstats);
+}
+
+static void
+mod_deinit(const enum module_unload_intent ATHEME_VATTR_UNUSED intent)
+{
+	(void) service_named_unbind_command("operserv", &os_cmd_cmdstats);
+}
+
+SIMPLE_DECLARE_MODULE_V1("operserv/cmdstats", MODULE_UNLOAD_CAPABILITY_OK)
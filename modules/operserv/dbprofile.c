@@ -0,0 +1,94 @@
+/*
+ * SPDX-License-Identifier: ISC
+ * SPDX-URL: https://spdx.org/licenses/ISC.html
+ *
+ * Copyright (C) 2026 Atheme Development Group (https://atheme.github.io/)
+ *
+ * This file contains code for OS DBPROFILE
+ */
+
+#include <atheme.h>
+
+static void
+os_cmd_dbprofile_func(struct sourceinfo *const restrict si, const int parc, char **const restrict parv)
+{
+	enum database_transaction txn = DB_WRITE;
+
+	if (parc >= 1 && strcasecmp(parv[0], "LOAD") == 0)
+		txn = DB_READ;
+	else if (parc >= 1 && strcasecmp(parv[0], "SAVE") != 0)
+	{
+		(void) command_fail(si, fault_badparams, STR_INVALID_PARAMS, "DBPROFILE");
+		(void) command_fail(si, fault_badparams, _("Syntax: DBPROFILE [LOAD|SAVE]"));
+		return;
+	}
+
+	if (! db_profile_ts[txn])
+	{
+		if (txn == DB_READ)
+			(void) command_fail(si, fault_nochange, _("No database has been loaded by this process."));
+		else
+			(void) command_fail(si, fault_nochange, _("No database has been saved by this process yet. Saves "
+			                                          "done by a forked child process are not profiled."));
+		return;
+	}
+
+	size_t count = 0;
+	struct database_row_profile **const profs = db_profile_sort(txn, &count);
+	struct database_row_stats total = { 0, 0, 0 };
+
+	for (size_t i = 0; i < count; i++)
+	{
+		total.rows += profs[i]->stats[txn].rows;
+		total.bytes += profs[i]->stats[txn].bytes;
+		total.usec += profs[i]->stats[txn].usec;
+	}
+
+	(void) command_success_nodata(si, (txn == DB_READ) ? _("Database load profile (%s ago):")
+	                                                   : _("Database save profile (%s ago):"),
+	                                  time_ago(db_profile_ts[txn]));
+
+	(void) command_success_nodata(si, "%-6s %10s %12s %6s %10s", _("Type"), _("Rows"), _("Bytes"), "%", _("Time (ms)"));
+	(void) command_success_nodata(si, "------ ---------- ------------ ------ ----------");
+
+	for (size_t i = 0; i < count; i++)
+	{
+		const struct database_row_stats *const stats = &profs[i]->stats[txn];
+
+		(void) command_success_nodata(si, "%-6s %10llu %12llu %5.1f%% %10.1f", profs[i]->type, stats->rows,
+		                              stats->bytes, total.bytes ? (100.0 * stats->bytes / total.bytes) : 0.0,
+		                              stats->usec / 1000.0);
+	}
+
+	(void) command_success_nodata(si, "------ ---------- ------------ ------ ----------");
+	(void) command_success_nodata(si, "%-6s %10llu %12llu %5.1f%% %10.1f", _("Total"), total.rows, total.bytes,
+	                              100.0, total.usec / 1000.0);
+
+	(void) sfree(profs);
+	(void) logcommand(si, CMDLOG_GET, "DBPROFILE: \2%s\2", (txn == DB_READ) ? "LOAD" : "SAVE");
+}
+
+static struct command os_cmd_dbprofile = {
+	.name           = "DBPROFILE",
+	.desc           = N_("Shows database size and timing by row type."),
+	.access         = PRIV_SERVER_AUSPEX,
+	.maxparc        = 1,
+	.cmd            = &os_cmd_dbprofile_func,
+	.help           = { .path = "oservice/dbprofile" },
+};
+
+static void
+mod_init(struct module *const restrict m)
+{
+	MODULE_TRY_REQUEST_DEPENDENCY(m, "operserv/main")
+
+	(void) service_named_bind_command("operserv", &os_cmd_dbprofile);
+}
+
+static void
+mod_deinit(const enum module_unload_intent ATHEME_VATTR_UNUSED intent)
+{
+	(void) service_named_unbind_command("operserv", &os_cmd_dbprofile);
+}
+
+SIMPLE_DECLARE_MODULE_V1("operserv/dbprofile", MODULE_UNLOAD_CAPABILITY_OK)
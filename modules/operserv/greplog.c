@@ -11,6 +11,69 @@
 
 #define MAXMATCHES 100
 
+/* Log files are searched on a small pool of worker threads, one file per job
+ * and at most GREPLOG_THREADS files of a search at a time, so that searching
+ * a month of large logs does not stall services. Each file is mapped into
+ * memory and scanned for the longest literal part of the pattern before any
+ * line is handed to match(). Results are sent to the oper a day at a time,
+ * in order, as the files finish; a search can be cancelled, and an oper can
+ * only have a few searches running at once. A cancelled search keeps counting
+ * towards that until its files have stopped being scanned, which they do
+ * within GREPLOG_STOP_LINES lines (or GREPLOG_CHUNK bytes without a line).
+ *
+ * Without thread support, and for sources that need the reply right away
+ * (such as XMLRPC), the same jobs are simply run in the command handler.
+ */
+
+#define GREPLOG_THREADS         2U
+#define GREPLOG_MAX_PER_USER    2U
+#define GREPLOG_LINELEN         1024U
+#define GREPLOG_STOP_LINES      4096U           // lines between checks for cancellation
+#define GREPLOG_CHUNK           (1024U * 1024U) // most bytes searched for the literal at once
+
+struct greplog_search;
+
+struct greplog_day
+{
+	struct greplog_search *         search;
+	char                            path[256];
+	char *                          lines[MAXMATCHES];      // ring buffer of the newest matches
+	unsigned int                    matches;
+	unsigned int                    lines_seen;
+	unsigned int                    lines_valid;
+	int                             error;
+	bool                            done;
+};
+
+struct greplog_search
+{
+	mowgli_node_t                   node;
+	struct sourceinfo *             si;
+	struct user *                   u;
+	char *                          service;
+	char *                          pattern;
+	unsigned char                   literal[GREPLOG_LINELEN];       // folded with ToLower()
+	size_t                          literal_len;
+	unsigned char                   first[UCHAR_MAX + 1];           // bytes that fold to literal[0]
+	unsigned int                    first_count;
+	struct greplog_day *            days;
+	unsigned int                    ndays;
+	unsigned int                    submitted;
+	unsigned int                    reported;
+	unsigned int                    running;
+	unsigned int                    matches;
+	bool                            async;
+	bool                            stopped;
+	bool                            cancelled;      // stopped, as seen by the worker threads
+};
+
+static struct threadpool *greplog_pool = NULL;
+static mowgli_list_t greplog_searches = { NULL, NULL, 0 };
+
+#ifdef HAVE_LIBPTHREAD
+static pthread_mutex_t greplog_cancel_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
 static const char *
 get_logfile(const unsigned int *masks)
 {
@@ -52,21 +115,443 @@ get_account_log(void)
 	return get_logfile(masks);
 }
 
+/* Finds the longest run of the pattern that match() compares literally; every
+ * matching line must contain it (ignoring case), so lines without it can be
+ * skipped without looking at them.
+ */
+static void
+greplog_literal(struct greplog_search *const restrict gs)
+{
+	unsigned char run[GREPLOG_LINELEN];
+	size_t runlen = 0;
+
+	for (const char *p = gs->pattern; ; p++)
+	{
+		if (*p == '\\' && (p[1] == '*' || p[1] == '?' || p[1] == '&' || p[1] == '#' || p[1] == '%'))
+			p++;
+		else if (! *p || *p == '*' || *p == '?' || *p == '&' || *p == '#' || *p == '%')
+		{
+			if (runlen > gs->literal_len)
+			{
+				(void) memcpy(gs->literal, run, runlen);
+				gs->literal_len = runlen;
+			}
+
+			runlen = 0;
+
+			if (! *p)
+				break;
+
+			continue;
+		}
+
+		if (runlen < sizeof run)
+			run[runlen++] = (unsigned char) ToLower(*p);
+	}
+
+	if (! gs->literal_len)
+		return;
+
+	// memmem() cannot ignore case, so look for every spelling of the first byte instead
+	for (unsigned int c = 1; c <= UCHAR_MAX; c++)
+		if ((unsigned char) ToLower((int) c) == gs->literal[0])
+			gs->first[gs->first_count++] = (unsigned char) c;
+}
+
+static const char *
+greplog_find(const struct greplog_search *const restrict gs, const char *const restrict start,
+             const char *const restrict end)
+{
+	const char *next[UCHAR_MAX + 1];
+	const char *p = start;
+
+	for (unsigned int i = 0; i < gs->first_count; i++)
+		next[i] = NULL;
+
+	while ((size_t) (end - p) >= gs->literal_len)
+	{
+		const size_t avail = (size_t) (end - p) - gs->literal_len + 1U;
+		const char *best = NULL;
+
+		// Each spelling's next position is only searched for again once we are past it
+		for (unsigned int i = 0; i < gs->first_count; i++)
+		{
+			if (next[i] != end && (! next[i] || next[i] < p))
+				if (! (next[i] = memchr(p, gs->first[i], avail)))
+					next[i] = end;
+
+			if (next[i] != end && (! best || next[i] < best))
+				best = next[i];
+		}
+
+		if (! best)
+			return NULL;
+
+		size_t i;
+
+		for (i = 1; i < gs->literal_len; i++)
+			if ((unsigned char) ToLower((unsigned char) best[i]) != gs->literal[i])
+				break;
+
+		if (i == gs->literal_len)
+			return best;
+
+		p = best + 1;
+	}
+
+	return NULL;
+}
+
+static void
+greplog_line(struct greplog_day *const restrict gd, const char *const restrict line, const size_t len)
+{
+	const struct greplog_search *const gs = gd->search;
+	char str[GREPLOG_LINELEN];
+	char *p, *q;
+
+	(void) memcpy(str, line, MIN(len, sizeof str - 1U));
+	str[MIN(len, sizeof str - 1U)] = '\0';
+
+	gd->lines_seen++;
+	p = *str == '[' ? strchr(str, ']') : NULL;
+	if (p == NULL)
+		return;
+	p++;
+	if (*p++ != ' ')
+		return;
+	q = strchr(p, ' ');
+	if (q == NULL)
+		return;
+	gd->lines_valid++;
+	*q = '\0';
+	if (strcmp(gs->service, "*") && strcasecmp(gs->service, p))
+		return;
+	*q++ = ' ';
+	if (match(gs->pattern, q))
+		return;
+
+	char **const slot = &gd->lines[gd->matches++ % MAXMATCHES];
+
+	(void) sfree(*slot);
+	*slot = sstrdup(str);
+}
+
+static bool
+greplog_cancelled(const struct greplog_search *const restrict gs)
+{
+#ifdef HAVE_LIBPTHREAD
+	(void) pthread_mutex_lock(&greplog_cancel_lock);
+
+	const bool cancelled = gs->cancelled;
+
+	(void) pthread_mutex_unlock(&greplog_cancel_lock);
+
+	return cancelled;
+#else
+	return gs->cancelled;
+#endif
+}
+
+/* Runs on a worker thread; only touches its own greplog_day, the search's
+ * constant fields, and its cancelled flag (under greplog_cancel_lock).
+ */
+static void
+greplog_scan(void *const restrict vgd)
+{
+	struct greplog_day *const gd = vgd;
+	const struct greplog_search *const gs = gd->search;
+	unsigned int lines = 0;
+	struct stat sb;
+	int fd;
+
+	// Jobs that were still queued when the search was cancelled
+	if (greplog_cancelled(gs))
+		return;
+
+	if ((fd = open(gd->path, O_RDONLY)) == -1)
+	{
+		gd->error = errno;
+		return;
+	}
+
+	if (fstat(fd, &sb) != 0)
+	{
+		gd->error = errno;
+		(void) close(fd);
+		return;
+	}
+
+	if (sb.st_size <= 0)
+	{
+		(void) close(fd);
+		return;
+	}
+
+	const size_t size = (size_t) sb.st_size;
+
+#ifdef HAVE_MMAP
+	char *const map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+	(void) close(fd);
+
+	if (map == MAP_FAILED)
+	{
+		gd->error = errno;
+		return;
+	}
+
+#  ifdef MADV_SEQUENTIAL
+	(void) madvise(map, size, MADV_SEQUENTIAL);
+#  endif
+#else
+	char *const map = smalloc(size);
+	ssize_t ret = 0;
+
+	for (size_t off = 0; off < size; off += (size_t) ret)
+	{
+		if ((ret = read(fd, map + off, size - off)) <= 0)
+		{
+			gd->error = ret ? errno : EIO;
+			(void) close(fd);
+			(void) sfree(map);
+			return;
+		}
+	}
+
+	(void) close(fd);
+#endif
+
+	const char *const end = map + size;
+	const char *p = map;
+
+	while (p < end)
+	{
+		if (++lines == GREPLOG_STOP_LINES)
+		{
+			if (greplog_cancelled(gs))
+				break;
+
+			lines = 0;
+		}
+
+		if (gs->literal_len)
+		{
+			const char *const limit = ((size_t) (end - p) > GREPLOG_CHUNK) ? (p + GREPLOG_CHUNK) : end;
+			const char *const hit = greplog_find(gs, p, limit);
+
+			if (! hit && limit == end)
+				break;
+
+			if (! hit)
+			{
+				// The literal may start in this chunk and end in the next one; check for cancellation first
+				p = limit - gs->literal_len + 1U;
+				lines = GREPLOG_STOP_LINES - 1U;
+				continue;
+			}
+
+			p = hit;
+
+			while (p > map && p[-1] != '\n')
+				p--;
+		}
+
+		const char *eol = memchr(p, '\n', (size_t) (end - p));
+
+		if (! eol)
+			eol = end;
+
+		(void) greplog_line(gd, p, (size_t) (eol - p));
+
+		p = eol + 1;
+	}
+
+#ifdef HAVE_MMAP
+	(void) munmap(map, size);
+#else
+	(void) sfree(map);
+#endif
+}
+
+static void
+greplog_release(struct greplog_search *const restrict gs)
+{
+	for (unsigned int i = 0; i < gs->ndays; i++)
+		for (unsigned int j = 0; j < MAXMATCHES; j++)
+			(void) sfree(gs->days[i].lines[j]);
+
+	(void) mowgli_node_delete(&gs->node, &greplog_searches);
+	(void) atheme_object_unref(gs->si);
+	(void) sfree(gs->days);
+	(void) sfree(gs->service);
+	(void) sfree(gs->pattern);
+	(void) sfree(gs);
+}
+
+static void
+greplog_stop(struct greplog_search *const restrict gs, const bool report)
+{
+	struct sourceinfo *const si = gs->si;
+
+	gs->stopped = true;
+
+#ifdef HAVE_LIBPTHREAD
+	(void) pthread_mutex_lock(&greplog_cancel_lock);
+#endif
+
+	gs->cancelled = true;
+
+#ifdef HAVE_LIBPTHREAD
+	(void) pthread_mutex_unlock(&greplog_cancel_lock);
+#endif
+
+	if (report)
+	{
+		logcommand(si, CMDLOG_ADMIN, "GREPLOG: \2%s\2 \2%s\2 (\2%u\2 matches)", gs->service, gs->pattern, gs->matches);
+		if (gs->matches == 0)
+			command_success_nodata(si, _("No lines matched pattern \2%s\2"), gs->pattern);
+		else
+			command_success_nodata(si, ngettext(N_("\2%u\2 match for pattern \2%s\2"),
+							    N_("\2%u\2 matches for pattern \2%s\2"), gs->matches), gs->matches, gs->pattern);
+	}
+}
+
+// Sends the results of every finished day that all earlier days have been sent for
+static void
+greplog_report(struct greplog_search *const restrict gs)
+{
+	struct sourceinfo *const si = gs->si;
+
+	while (! gs->stopped && gs->reported < gs->submitted && gs->days[gs->reported].done)
+	{
+		struct greplog_day *const gd = &gs->days[gs->reported++];
+
+		if (gd->error)
+		{
+			command_success_nodata(si, _("Failed to open log file %s"), gd->path);
+			continue;
+		}
+
+		// Newest first, and no more than the search has left
+		const unsigned int kept = MIN(gd->matches, MAXMATCHES);
+		const unsigned int shown = MIN(kept, MAXMATCHES - gs->matches);
+
+		for (unsigned int i = 0; i < shown; i++)
+		{
+			char **const slot = &gd->lines[(gd->matches - 1U - i) % MAXMATCHES];
+
+			gs->matches++;
+			command_success_nodata(si, "[%u] %s", gs->matches, *slot);
+			(void) sfree(*slot);
+		}
+
+		if (gs->matches == 0 && gd->lines_seen > gd->lines_valid)
+			command_success_nodata(si, _("Log file may be corrupted, %u/%u unexpected lines"),
+			                       gd->lines_seen - gd->lines_valid, gd->lines_seen);
+		if (gs->matches >= MAXMATCHES)
+		{
+			command_success_nodata(si, _("Too many matches, halting search"));
+			(void) greplog_stop(gs, true);
+			return;
+		}
+	}
+
+	if (! gs->stopped && gs->reported == gs->ndays)
+		(void) greplog_stop(gs, true);
+}
+
+static void greplog_scanned(void *);
+
+static void
+greplog_pump(struct greplog_search *const restrict gs)
+{
+	while (! gs->stopped && gs->submitted < gs->ndays && gs->running < GREPLOG_THREADS)
+	{
+		struct greplog_day *const gd = &gs->days[gs->submitted++];
+
+		gs->running++;
+
+		if (gs->async && threadpool_submit(greplog_pool, &greplog_scan, &greplog_scanned, gd))
+			continue;
+
+		(void) greplog_scan(gd);
+
+		gd->done = true;
+		gs->running--;
+
+		(void) greplog_report(gs);
+	}
+}
+
+static void
+greplog_scanned(void *const restrict vgd)
+{
+	struct greplog_day *const gd = vgd;
+	struct greplog_search *const gs = gd->search;
+
+	gd->done = true;
+	gs->running--;
+
+	if (! gs->stopped)
+	{
+		(void) greplog_report(gs);
+		(void) greplog_pump(gs);
+	}
+
+	// A stopped search is released once none of its files are being scanned any more
+	if (gs->stopped && ! gs->running)
+		(void) greplog_release(gs);
+}
+
+static unsigned int
+greplog_cancel(const struct user *const restrict u)
+{
+	mowgli_node_t *n, *tn;
+	unsigned int cancelled = 0;
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, greplog_searches.head)
+	{
+		struct greplog_search *const gs = n->data;
+
+		if (gs->u != u || gs->stopped)
+			continue;
+
+		(void) greplog_stop(gs, false);
+		cancelled++;
+
+		if (! gs->running)
+			(void) greplog_release(gs);
+	}
+
+	return cancelled;
+}
+
+static void
+greplog_user_delete(struct user *const restrict u)
+{
+	mowgli_node_t *n;
+
+	(void) greplog_cancel(u);
+
+	// Whatever is still being scanned must not count against whoever gets this user's memory next
+	MOWGLI_ITER_FOREACH(n, greplog_searches.head)
+	{
+		struct greplog_search *const gs = n->data;
+
+		if (gs->u == u)
+			gs->u = NULL;
+	}
+}
+
 // GREPLOG <service> <mask>
 static void
 os_cmd_greplog(struct sourceinfo *si, int parc, char *parv[])
 {
 	const char *service, *pattern, *baselog;
-	unsigned int matches = 0, matches_sv = 0;
-	unsigned int day, days, maxdays, lines, linesv;
-	FILE *in;
-	char str[1024];
-	char *p, *q;
-	char logfile[256];
+	unsigned int day, days, maxdays;
 	time_t t;
 	struct tm *tm;
-	mowgli_list_t loglines = { NULL, NULL, 0 };
-	mowgli_node_t *n, *tn;
+	mowgli_node_t *n;
 
 	// require user, channel and server auspex (channel auspex checked via in struct command)
 	if (!has_priv(si, PRIV_USER_AUSPEX))
@@ -80,10 +565,27 @@ os_cmd_greplog(struct sourceinfo *si, int parc, char *parv[])
 		return;
 	}
 
+	if (parc == 1 && !strcasecmp(parv[0], "CANCEL"))
+	{
+		const unsigned int cancelled = si->su ? greplog_cancel(si->su) : 0;
+
+		if (!cancelled)
+		{
+			command_fail(si, fault_nochange, _("You have no GREPLOG searches running."));
+			return;
+		}
+
+		command_success_nodata(si, ngettext(N_("Cancelled \2%u\2 GREPLOG search."),
+		                                    N_("Cancelled \2%u\2 GREPLOG searches."), cancelled), cancelled);
+		logcommand(si, CMDLOG_ADMIN, "GREPLOG:CANCEL");
+		return;
+	}
+
 	if (parc < 2)
 	{
 		command_fail(si, fault_needmoreparams, STR_INSUFFICIENT_PARAMS, "GREPLOG");
 		command_fail(si, fault_needmoreparams, _("Syntax: GREPLOG <service> <pattern> [days]"));
+		command_fail(si, fault_needmoreparams, _("Syntax: GREPLOG CANCEL"));
 		return;
 	}
 
@@ -109,84 +611,67 @@ os_cmd_greplog(struct sourceinfo *si, int parc, char *parv[])
 		return;
 	}
 
+	if (si->su != NULL)
+	{
+		unsigned int running = 0;
+
+		// Cancelled searches count until their files have stopped being scanned
+		MOWGLI_ITER_FOREACH(n, greplog_searches.head)
+		{
+			const struct greplog_search *const gs = n->data;
+
+			if (gs->u == si->su)
+				running++;
+		}
+
+		if (running >= GREPLOG_MAX_PER_USER)
+		{
+			command_fail(si, fault_toomany, _("You already have \2%u\2 GREPLOG searches running; wait for them "
+			                                  "to finish or use \2GREPLOG CANCEL\2."), running);
+			return;
+		}
+
+		if (! greplog_pool && threadpool_available())
+			greplog_pool = threadpool_create("greplog", GREPLOG_THREADS);
+	}
+
+	struct greplog_search *const gs = smalloc(sizeof *gs);
+
+	gs->si = atheme_object_ref(si);
+	gs->u = si->su;
+	gs->service = sstrdup(service);
+	gs->pattern = sstrdup(pattern);
+	gs->ndays = days + 1;
+	gs->days = smalloc(gs->ndays * sizeof *gs->days);
+
+	// Only users can be sent results later; anything else (e.g. RPC) needs them now
+	gs->async = (si->su != NULL && greplog_pool != NULL);
+
+	(void) greplog_literal(gs);
+
 	for (day = 0; day <= days; day++)
 	{
+		struct greplog_day *const gd = &gs->days[day];
+
+		gd->search = gs;
+
 		if (day == 0)
-			mowgli_strlcpy(logfile, baselog, sizeof logfile);
+			mowgli_strlcpy(gd->path, baselog, sizeof gd->path);
 		else
 		{
 			t = CURRTIME - (day * SECONDS_PER_DAY);
 			tm = localtime(&t);
-			snprintf(logfile, sizeof logfile, "%s.%04u%02u%02u",
+			snprintf(gd->path, sizeof gd->path, "%s.%04u%02u%02u",
 					baselog, (unsigned int) (tm->tm_year + 1900),
 					(unsigned int) (tm->tm_mon + 1), (unsigned int) tm->tm_mday);
 		}
-		in = fopen(logfile, "r");
-		if (in == NULL)
-		{
-			command_success_nodata(si, _("Failed to open log file %s"), logfile);
-			continue;
-		}
-		matches_sv = matches;
-		lines = linesv = 0;
-		while (fgets(str, sizeof str, in) != NULL)
-		{
-			p = strchr(str, '\n');
-			if (p != NULL)
-				*p = '\0';
-			lines++;
-			p = *str == '[' ? strchr(str, ']') : NULL;
-			if (p == NULL)
-				continue;
-			p++;
-			if (*p++ != ' ')
-				continue;
-			q = strchr(p, ' ');
-			if (q == NULL)
-				continue;
-			linesv++;
-			*q = '\0';
-			if (strcmp(service, "*") && strcasecmp(service, p))
-				continue;
-			*q++ = ' ';
-			if (match(pattern, q))
-				continue;
-			matches++;
-			mowgli_node_add_head(sstrdup(str), mowgli_node_create(), &loglines);
-			if (matches > MAXMATCHES)
-			{
-				n = loglines.tail;
-				mowgli_node_delete(n, &loglines);
-				sfree(n->data);
-				mowgli_node_free(n);
-			}
-		}
-		fclose(in);
-		matches = matches_sv;
-		MOWGLI_ITER_FOREACH_SAFE(n, tn, loglines.head)
-		{
-			p = n->data;
-			matches++;
-			command_success_nodata(si, "[%u] %s", matches, p);
-			mowgli_node_delete(n, &loglines);
-			sfree(n->data);
-			mowgli_node_free(n);
-		}
-		if (matches == 0 && lines > linesv && lines > 0)
-			command_success_nodata(si, _("Log file may be corrupted, %u/%u unexpected lines"), lines - linesv, lines);
-		if (matches >= MAXMATCHES)
-		{
-			command_success_nodata(si, _("Too many matches, halting search"));
-			break;
-		}
 	}
 
-	logcommand(si, CMDLOG_ADMIN, "GREPLOG: \2%s\2 \2%s\2 (\2%u\2 matches)", service, pattern, matches);
-	if (matches == 0)
-		command_success_nodata(si, _("No lines matched pattern \2%s\2"), pattern);
-	else if (matches > 0)
-		command_success_nodata(si, ngettext(N_("\2%u\2 match for pattern \2%s\2"),
-						    N_("\2%u\2 matches for pattern \2%s\2"), matches), matches, pattern);
+	(void) mowgli_node_add(gs, &gs->node, &greplog_searches);
+	(void) greplog_pump(gs);
+
+	if (gs->stopped && ! gs->running)
+		(void) greplog_release(gs);
 }
 
 static struct command os_greplog = {
@@ -204,11 +689,35 @@ mod_init(struct module *const restrict m)
 	MODULE_TRY_REQUEST_DEPENDENCY(m, "operserv/main")
 
 	service_named_bind_command("operserv", &os_greplog);
+
+	hook_add_user_delete(greplog_user_delete);
 }
 
 static void
 mod_deinit(const enum module_unload_intent ATHEME_VATTR_UNUSED intent)
 {
+	mowgli_node_t *n, *tn;
+
+	hook_del_user_delete(greplog_user_delete);
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, greplog_searches.head)
+	{
+		struct greplog_search *const gs = n->data;
+
+		if (! gs->stopped)
+			(void) greplog_stop(gs, false);
+		if (! gs->running)
+			(void) greplog_release(gs);
+	}
+
+	/* Waits for the files still being scanned, which stop soon after seeing
+	 * that their search was cancelled; their completions free what is left.
+	 */
+	if (greplog_pool)
+		(void) threadpool_destroy(greplog_pool);
+
+	greplog_pool = NULL;
+
 	service_named_unbind_command("operserv", &os_greplog);
 }
 
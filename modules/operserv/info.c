@@ -14,6 +14,7 @@ static void
 os_cmd_info(struct sourceinfo *si, int parc, char *parv[])
 {
 	mowgli_node_t *tn, *n2;
+	struct mailer_stats ms;
 
 	logcommand(si, CMDLOG_GET, "INFO");
 
@@ -60,6 +61,15 @@ os_cmd_info(struct sourceinfo *si, int parc, char *parv[])
 		}
 	}
 
+	if (me.mta)
+	{
+		(void) mailer_get_stats(&ms);
+
+		command_success_nodata(si, _("Maximum number of emails sent to one address per %u seconds (if 0, unlimited): %u"), me.emailtime, me.emailrcptlimit);
+		command_success_nodata(si, _("Emails queued: %lu, sent: %lu, failed: %lu, retried: %lu, rate-limited: %lu, rejected: %lu"), ms.queued, ms.sent, ms.failed, ms.retried, ms.ratelimited, ms.rejected);
+		command_success_nodata(si, _("Emails waiting: %zu, being delivered: %zu (mailer helper %s, started %lu times)"), ms.pending, ms.inflight, ms.helper_running ? _("running") : _("not running"), ms.spawns);
+	}
+
 	MOWGLI_ITER_FOREACH(tn, nicksvs.emailexempts.head)
 	{
 		command_success_nodata(si, _("Email address(es) exempt from the maximum usernames check: %s"), (char *)tn->data);
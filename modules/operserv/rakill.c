@@ -18,10 +18,10 @@ static void
 os_cmd_rakill(struct sourceinfo *si, int parc, char *parv[])
 {
 	struct atheme_regex *regex;
-	char usermask[512];
 	unsigned int matches = 0;
-	mowgli_patricia_iteration_state_t state;
-	struct user *u;
+	struct user **found;
+	size_t count, masklen;
+	const char *usermask;
 	char *args = parv[0];
 	char *pattern;
 	char *reason;
@@ -72,8 +72,8 @@ os_cmd_rakill(struct sourceinfo *si, int parc, char *parv[])
 	if (source == NULL)
 		source = si->smu != NULL && MOWGLI_LIST_LENGTH(&si->smu->logins) > 0 ?
 			si->smu->logins.head->data : si->service->me;
-	sprintf(usermask, "%s!%s@%s %s", source->nick, source->user, source->host, source->gecos);
-	if (regex_match(regex, usermask))
+	usermask = user_matchstr(source, &masklen);
+	if (regex_match_len(regex, usermask, masklen))
 	{
 		regex_destroy(regex);
 		command_fail(si, fault_noprivs, _("The provided regex matches you, refusing RAKILL."));
@@ -83,22 +83,22 @@ os_cmd_rakill(struct sourceinfo *si, int parc, char *parv[])
 		return;
 	}
 
-	MOWGLI_PATRICIA_FOREACH(u, &state, userlist)
+	// All matches are known before the first AKILL is sent
+	found = user_regex_scan(regex, &count);
+
+	for (size_t i = 0; i < count; i++)
 	{
-		sprintf(usermask, "%s!%s@%s %s", u->nick, u->user, u->host, u->gecos);
-
-		if (regex_match(regex, usermask))
-		{
-			// match
-			command_success_nodata(si, _("\2Match:\2  %s!%s@%s %s - AKILLing"), u->nick, u->user, u->host, u->gecos);
-			if (! (u->flags & UF_KLINESENT)) {
-				kline_sts("*", "*", u->host, SECONDS_PER_WEEK, reason);
-				u->flags |= UF_KLINESENT;
-			}
-			matches++;
+		struct user *const u = found[i];
+
+		command_success_nodata(si, _("\2Match:\2  %s!%s@%s %s - AKILLing"), u->nick, u->user, u->host, u->gecos);
+		if (! (u->flags & UF_KLINESENT)) {
+			kline_sts("*", "*", u->host, SECONDS_PER_WEEK, reason);
+			u->flags |= UF_KLINESENT;
 		}
+		matches++;
 	}
 
+	sfree(found);
 	regex_destroy(regex);
 	command_success_nodata(si, ngettext(N_("\2%u\2 match for \2%s\2 AKILLed."),
 	                                    N_("\2%u\2 matches for \2%s\2 AKILLed."),
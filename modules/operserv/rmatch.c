@@ -19,10 +19,9 @@ static void
 os_cmd_rmatch(struct sourceinfo *si, int parc, char *parv[])
 {
 	struct atheme_regex *regex;
-	char usermask[512];
 	unsigned int matches = 0, maxmatches;
-	mowgli_patricia_iteration_state_t state;
-	struct user *u;
+	struct user **found;
+	size_t count;
 	char *args = parv[0];
 	char *pattern;
 	int flags = 0;
@@ -64,23 +63,23 @@ os_cmd_rmatch(struct sourceinfo *si, int parc, char *parv[])
 		return;
 	}
 
-	MOWGLI_PATRICIA_FOREACH(u, &state, userlist)
+	found = user_regex_scan(regex, &count);
+
+	for (size_t i = 0; i < count; i++)
 	{
-		sprintf(usermask, "%s!%s@%s %s", u->nick, u->user, u->host, u->gecos);
+		const struct user *const u = found[i];
 
-		if (regex_match(regex, usermask))
+		matches++;
+		if (matches <= maxmatches)
+			command_success_nodata(si, _("\2Match:\2  %s!%s@%s %s"), u->nick, u->user, u->host, u->gecos);
+		else if (matches == maxmatches + 1)
 		{
-			matches++;
-			if (matches <= maxmatches)
-				command_success_nodata(si, _("\2Match:\2  %s!%s@%s %s"), u->nick, u->user, u->host, u->gecos);
-			else if (matches == maxmatches + 1)
-			{
-				command_success_nodata(si, _("Too many matches, not displaying any more"));
-				command_success_nodata(si, _("Add the FORCE keyword to see them all"));
-			}
+			command_success_nodata(si, _("Too many matches, not displaying any more"));
+			command_success_nodata(si, _("Add the FORCE keyword to see them all"));
 		}
 	}
 
+	sfree(found);
 	regex_destroy(regex);
 	command_success_nodata(si, ngettext(N_("\2%u\2 match for pattern \2%s\2"),
 	                                    N_("\2%u\2 matches for pattern \2%s\2"),
@@ -13,6 +13,9 @@
 #define RWACT_KLINE 		2
 #define RWACT_QUARANTINE	4
 
+#define RWATCH_LITERAL_MIN	2U      // shorter literals are not worth filtering on
+#define RWATCH_LITERAL_MAX	16U     // a prefix of a required literal is required too
+
 struct rwatch
 {
 	char *regex;
@@ -20,6 +23,35 @@ struct rwatch
 	char *reason;
 	int actions; // RWACT_*
 	struct atheme_regex *re;
+	unsigned int filter_id; // index into the prefilter's candidate arrays
+	bool filter_always;     // no required literal; always run the regex
+};
+
+/* Prefilter: most patterns contain a literal string that every subject they
+ * match must contain (e.g. "guest" in /^guest[0-9]+!/). The longest such
+ * literal of every pattern goes into an Aho-Corasick automaton, so a single
+ * pass over the usermask finds the (usually few) patterns that can possibly
+ * match it; only those are run. Matching is case-insensitive, which can only
+ * produce extra candidates, never miss one.
+ */
+struct rwatch_filter_out
+{
+	unsigned int id;        // rwatch filter_id whose literal ends here
+	unsigned int next;      // next output of the same state, plus 1 (0 = none)
+};
+
+struct rwatch_filter
+{
+	unsigned int *delta;    // transitions; [state * classes + class]
+	unsigned int *out;      // first output of each state, plus 1 (0 = none)
+	unsigned int *dict;     // nearest state on the failure chain with outputs
+	struct rwatch_filter_out *outs;
+	unsigned int classes;
+	unsigned char class_of[UCHAR_MAX + 1];
+	unsigned int entries;
+	unsigned int *seen;     // [entries]; == gen if candidate for the last scan
+	unsigned int *seen_old; // likewise, for the old mask on nick change
+	unsigned int gen;
 };
 
 static struct rwatch *rwread = NULL;
@@ -28,6 +60,9 @@ static FILE *f;
 static mowgli_patricia_t *os_rwatch_cmds;
 static mowgli_list_t rwatch_list;
 
+static struct rwatch_filter rwatch_filter;
+static bool rwatch_filter_dirty = true;
+
 static void
 write_rwatchdb(struct database_handle *db)
 {
@@ -93,6 +128,7 @@ load_rwatchdb(char *path)
 				rw->actions = atoi(actionstr);
 				rw->reason = sstrdup(reason);
 				mowgli_node_add(rw, mowgli_node_create(), &rwatch_list);
+				rwatch_filter_dirty = true;
 				rw = NULL;
 			}
 		}
@@ -141,6 +177,7 @@ db_h_rr(struct database_handle *db, const char *type)
 	rwread->actions = actions;
 	rwread->reason = sstrdup(reason);
 	mowgli_node_add(rwread, mowgli_node_create(), &rwatch_list);
+	rwatch_filter_dirty = true;
 	rwread = NULL;
 }
 
@@ -218,6 +255,7 @@ os_cmd_rwatch_add(struct sourceinfo *si, int parc, char *parv[])
 	rw->re = regex;
 
 	mowgli_node_add(rw, mowgli_node_create(), &rwatch_list);
+	rwatch_filter_dirty = true;
 	command_success_nodata(si, _("Added \2%s\2 to regex watch list."), pattern);
 	logcommand(si, CMDLOG_ADMIN, "RWATCH:ADD: \2%s\2 (reason: \2%s\2)", pattern, reason);
 }
@@ -276,6 +314,7 @@ os_cmd_rwatch_del(struct sourceinfo *si, int parc, char *parv[])
 			sfree(rw);
 			mowgli_node_delete(n, &rwatch_list);
 			mowgli_node_free(n);
+			rwatch_filter_dirty = true;
 			command_success_nodata(si, _("Removed \2%s\2 from regex watch list."), pattern);
 			logcommand(si, CMDLOG_ADMIN, "RWATCH:DEL: \2%s\2", pattern);
 			return;
@@ -435,13 +474,416 @@ os_cmd_rwatch_set(struct sourceinfo *si, int parc, char *parv[])
 	command_fail(si, fault_nosuch_target, _("\2%s\2 not found in regex watch list."), pattern);
 }
 
+/* Skips a bracket expression starting at `p' (which points at the '[');
+ * returns a pointer past its closing ']', or NULL if it is not terminated.
+ */
+static const char *
+rwatch_skip_class(const char *p, const bool pcre)
+{
+	p++;
+
+	if (*p == '^')
+		p++;
+	if (*p == ']')
+		p++;
+
+	while (*p != ']')
+	{
+		if (*p == '\0')
+			return NULL;
+
+		if (*p == '[' && (p[1] == ':' || p[1] == '=' || p[1] == '.'))
+		{
+			const char term[] = { p[1], ']', '\0' };
+
+			if (! (p = strstr(p + 2, term)))
+				return NULL;
+
+			p += 2;
+			continue;
+		}
+		if (pcre && *p == '\\' && p[1] != '\0')
+			p++;
+
+		p++;
+	}
+
+	return p + 1;
+}
+
+// Skips a parenthesised group starting at `p'; as rwatch_skip_class()
+static const char *
+rwatch_skip_group(const char *p, const bool pcre)
+{
+	unsigned int depth = 0;
+
+	while (*p != '\0')
+	{
+		switch (*p)
+		{
+			case '\\':
+				if (*++p == '\0')
+					return NULL;
+				p++;
+				break;
+
+			case '[':
+				if (! (p = rwatch_skip_class(p, pcre)))
+					return NULL;
+				break;
+
+			case '(':
+				depth++;
+				p++;
+				break;
+
+			case ')':
+				p++;
+				if (--depth == 0)
+					return p;
+				break;
+
+			default:
+				p++;
+				break;
+		}
+	}
+
+	return NULL;
+}
+
+/* Finds the longest literal string that any subject matched by `pattern'
+ * must contain, lowercased, and returns its length (0 if there is none or
+ * the pattern uses syntax this doesn't understand).
+ */
+static size_t
+rwatch_extract_literal(const char *const restrict pattern, const int reflags, char *const restrict out)
+{
+	const bool pcre = (reflags & AREGEX_PCRE);
+	char run[RWATCH_LITERAL_MAX];
+	size_t runlen = 0;
+	size_t outlen = 0;
+	const char *p = pattern;
+
+#define RUN_COMMIT()                                    \
+	do {                                            \
+		if (runlen > outlen)                    \
+		{                                       \
+			(void) memcpy(out, run, runlen);\
+			outlen = runlen;                \
+		}                                       \
+		runlen = 0;                             \
+	} while (0)
+
+#define RUN_APPEND(c)                                   \
+	do {                                            \
+		if (runlen < sizeof run)                \
+			run[runlen++] = (char) tolower((unsigned char) (c)); \
+	} while (0)
+
+	while (*p != '\0')
+	{
+		const unsigned char c = (unsigned char) *p;
+
+		switch (c)
+		{
+			case '\\':
+			{
+				const unsigned char e = (unsigned char) p[1];
+
+				if (e == '\0')
+					return 0;
+
+				if (isalnum(e) || e >= 0x80U)
+				{
+					// Only escapes that stand for a class of characters or an assertion
+					if (! strchr("dDwWsSbB", e))
+						return 0;
+
+					RUN_COMMIT();
+				}
+				else if (! pcre && strchr("<>`'", e))
+					RUN_COMMIT();
+				else
+					RUN_APPEND(e);
+
+				p += 2;
+				break;
+			}
+
+			case '[':
+				RUN_COMMIT();
+				if (! (p = rwatch_skip_class(p, pcre)))
+					return 0;
+				break;
+
+			case '(':
+				// (?x) changes the meaning of everything after it
+				if (pcre && p[1] == '?' && memchr(p + 2, 'x', strcspn(p + 2, ":)")))
+					return 0;
+
+				RUN_COMMIT();
+				if (! (p = rwatch_skip_group(p, pcre)))
+					return 0;
+				break;
+
+			case ')':
+			case '|':
+				// Top-level alternation; nothing is required
+				return 0;
+
+			case '*':
+			case '?':
+				// The previous character is optional
+				if (runlen)
+					runlen--;
+				RUN_COMMIT();
+				p++;
+				break;
+
+			case '{':
+				if (runlen)
+					runlen--;
+				RUN_COMMIT();
+				if (! (p = strchr(p, '}')))
+					return 0;
+				p++;
+				break;
+
+			case '+':
+			case '.':
+			case '^':
+			case '$':
+				RUN_COMMIT();
+				p++;
+				break;
+
+			default:
+				/* Non-ASCII bytes may be part of multibyte characters that a quantifier
+				 * applies to as a whole, or that case-fold in ways tolower() doesn't know
+				 */
+				if (c >= 0x80U)
+					RUN_COMMIT();
+				else
+					RUN_APPEND(c);
+				p++;
+				break;
+		}
+	}
+
+	RUN_COMMIT();
+
+#undef RUN_COMMIT
+#undef RUN_APPEND
+
+	return (outlen >= RWATCH_LITERAL_MIN) ? outlen : 0;
+}
+
+static void
+rwatch_filter_clear(void)
+{
+	struct rwatch_filter *const f = &rwatch_filter;
+
+	sfree(f->delta);
+	sfree(f->out);
+	sfree(f->dict);
+	sfree(f->outs);
+	sfree(f->seen);
+	sfree(f->seen_old);
+
+	(void) memset(f, 0x00, sizeof *f);
+}
+
+static void
+rwatch_filter_build(void)
+{
+	struct rwatch_filter *const f = &rwatch_filter;
+	char (*literals)[RWATCH_LITERAL_MAX] = NULL;
+	size_t *literal_lens = NULL;
+	unsigned int entries = 0;
+	unsigned int states = 1;
+	unsigned int literal_count = 0;
+	mowgli_node_t *n;
+
+	(void) rwatch_filter_clear();
+
+	rwatch_filter_dirty = false;
+
+	if (! (entries = MOWGLI_LIST_LENGTH(&rwatch_list)))
+		return;
+
+	literals = smalloc(entries * sizeof *literals);
+	literal_lens = smalloc(entries * sizeof *literal_lens);
+
+	// Number the entries, extract their literals, and assign byte classes
+	MOWGLI_ITER_FOREACH(n, rwatch_list.head)
+	{
+		struct rwatch *const rw = n->data;
+		const unsigned int id = literal_count++;
+
+		rw->filter_id = id;
+		literal_lens[id] = rwatch_extract_literal(rw->regex, rw->reflags, literals[id]);
+		rw->filter_always = (literal_lens[id] == 0);
+
+		for (size_t i = 0; i < literal_lens[id]; i++)
+		{
+			const unsigned char c = (unsigned char) literals[id][i];
+
+			if (! f->class_of[c])
+			{
+				f->class_of[c] = (unsigned char) ++f->classes;
+				f->class_of[toupper(c)] = f->class_of[c];
+			}
+		}
+
+		states += literal_lens[id];
+	}
+
+	// Class 0 is every byte that occurs in no literal
+	f->classes++;
+	f->entries = entries;
+	f->delta = smalloc(states * f->classes * sizeof *f->delta);
+	f->out = smalloc(states * sizeof *f->out);
+	f->dict = smalloc(states * sizeof *f->dict);
+	f->outs = smalloc(entries * sizeof *f->outs);
+	f->seen = smalloc(entries * sizeof *f->seen);
+	f->seen_old = smalloc(entries * sizeof *f->seen_old);
+
+	// Build the trie; state 0 is the root, so 0 also means "no edge" here
+	unsigned int used = 1;
+
+	for (unsigned int id = 0; id < entries; id++)
+	{
+		unsigned int state = 0;
+
+		if (! literal_lens[id])
+			continue;
+
+		for (size_t i = 0; i < literal_lens[id]; i++)
+		{
+			unsigned int *const edge = &f->delta[state * f->classes + f->class_of[(unsigned char) literals[id][i]]];
+
+			if (! *edge)
+				*edge = used++;
+
+			state = *edge;
+		}
+
+		f->outs[id].id = id;
+		f->outs[id].next = f->out[state];
+		f->out[state] = id + 1;
+	}
+
+	// Breadth-first, compute failure links and fill in the missing transitions
+	unsigned int *const fail = smalloc(used * sizeof *fail);
+	unsigned int *const queue = smalloc(used * sizeof *queue);
+	unsigned int qhead = 0;
+	unsigned int qtail = 0;
+
+	for (unsigned int c = 1; c < f->classes; c++)
+		if (f->delta[c])
+			queue[qtail++] = f->delta[c];
+
+	while (qhead < qtail)
+	{
+		const unsigned int state = queue[qhead++];
+
+		for (unsigned int c = 1; c < f->classes; c++)
+		{
+			unsigned int *const edge = &f->delta[state * f->classes + c];
+			const unsigned int fallback = f->delta[fail[state] * f->classes + c];
+
+			if (! *edge)
+			{
+				*edge = fallback;
+				continue;
+			}
+
+			fail[*edge] = fallback;
+			f->dict[*edge] = f->out[fallback] ? fallback : f->dict[fallback];
+			queue[qtail++] = *edge;
+		}
+	}
+
+	sfree(queue);
+	sfree(fail);
+	sfree(literal_lens);
+	sfree(literals);
+}
+
+/* Marks (in `seen') every entry whose literal occurs in `mask'. Entries
+ * without a literal are not marked; callers check filter_always instead.
+ */
+static void
+rwatch_filter_scan(const char *const restrict mask, const size_t masklen, unsigned int *const restrict seen)
+{
+	const struct rwatch_filter *const f = &rwatch_filter;
+	unsigned int state = 0;
+
+	if (! f->entries)
+		return;
+
+	for (size_t i = 0; i < masklen; i++)
+	{
+		state = f->delta[state * f->classes + f->class_of[(unsigned char) mask[i]]];
+
+		for (unsigned int s = (f->out[state] ? state : f->dict[state]); s != 0; s = f->dict[s])
+			for (unsigned int o = f->out[s]; o != 0; o = f->outs[o - 1].next)
+				seen[f->outs[o - 1].id] = f->gen;
+	}
+}
+
+static inline bool
+rwatch_filter_candidate(const struct rwatch *const restrict rw, const unsigned int *const restrict seen)
+{
+	return rw->filter_always || seen[rw->filter_id] == rwatch_filter.gen;
+}
+
+// Starts a new scan generation, rebuilding the automaton first if needed
+static void
+rwatch_filter_begin(void)
+{
+	struct rwatch_filter *const f = &rwatch_filter;
+
+	if (rwatch_filter_dirty)
+		(void) rwatch_filter_build();
+
+	if (++f->gen == 0)
+	{
+		// Wrapped around; forget all the old marks
+		if (f->entries)
+		{
+			(void) memset(f->seen, 0x00, f->entries * sizeof *f->seen);
+			(void) memset(f->seen_old, 0x00, f->entries * sizeof *f->seen_old);
+		}
+
+		f->gen = 1;
+	}
+}
+
+// Builds the string patterns are matched against with a nick other than the current one; returns its length
+static size_t
+rwatch_usermask(char *const restrict buf, const size_t bufsz, const char *const restrict nick,
+                const struct user *const restrict u)
+{
+	const int len = snprintf(buf, bufsz, "%s!%s@%s %s", nick, u->user, u->host, u->gecos);
+
+	if (len < 0)
+	{
+		*buf = '\0';
+		return 0;
+	}
+
+	return ((size_t) len < bufsz) ? (size_t) len : (bufsz - 1);
+}
+
 static void
 rwatch_newuser(struct hook_user_nick *data)
 {
 	struct user *u = data->u;
-	char usermask[NICKLEN + 1 + USERLEN + 1 + HOSTLEN + 1 + GECOSLEN + 1];
 	mowgli_node_t *n;
 	struct rwatch *rw;
+	size_t masklen;
 
 	// If the user has been killed, don't do anything.
 	if (!u)
@@ -450,14 +892,17 @@ rwatch_newuser(struct hook_user_nick *data)
 	if (is_internal_client(u))
 		return;
 
-	snprintf(usermask, sizeof usermask, "%s!%s@%s %s", u->nick, u->user, u->host, u->gecos);
+	const char *const usermask = user_matchstr(u, &masklen);
+
+	(void) rwatch_filter_begin();
+	(void) rwatch_filter_scan(usermask, masklen, rwatch_filter.seen);
 
 	MOWGLI_ITER_FOREACH(n, rwatch_list.head)
 	{
 		rw = n->data;
-		if (!rw->re)
+		if (!rw->re || !rwatch_filter_candidate(rw, rwatch_filter.seen))
 			continue;
-		if (regex_match(rw->re, usermask))
+		if (regex_match_len(rw->re, usermask, masklen))
 		{
 			if (rw->actions & RWACT_SNOOP)
 			{
@@ -504,10 +949,10 @@ static void
 rwatch_nickchange(struct hook_user_nick *data)
 {
 	struct user *u = data->u;
-	char usermask[NICKLEN + 1 + USERLEN + 1 + HOSTLEN + 1 + GECOSLEN + 1];
-	char oldusermask[NICKLEN + 1 + USERLEN + 1 + HOSTLEN + 1 + GECOSLEN + 1];
+	char oldusermask[BUFSIZE];
 	mowgli_node_t *n;
 	struct rwatch *rw;
+	size_t masklen;
 
 	// If the user has been killed, don't do anything.
 	if (!u)
@@ -516,18 +961,23 @@ rwatch_nickchange(struct hook_user_nick *data)
 	if (is_internal_client(u))
 		return;
 
-	snprintf(usermask, sizeof usermask, "%s!%s@%s %s", u->nick, u->user, u->host, u->gecos);
-	snprintf(oldusermask, sizeof oldusermask, "%s!%s@%s %s", data->oldnick, u->user, u->host, u->gecos);
+	const char *const usermask = user_matchstr(u, &masklen);
+	const size_t oldmasklen = rwatch_usermask(oldusermask, sizeof oldusermask, data->oldnick, u);
+
+	(void) rwatch_filter_begin();
+	(void) rwatch_filter_scan(usermask, masklen, rwatch_filter.seen);
+	(void) rwatch_filter_scan(oldusermask, oldmasklen, rwatch_filter.seen_old);
 
 	MOWGLI_ITER_FOREACH(n, rwatch_list.head)
 	{
 		rw = n->data;
-		if (!rw->re)
+		if (!rw->re || !rwatch_filter_candidate(rw, rwatch_filter.seen))
 			continue;
-		if (regex_match(rw->re, usermask))
+		if (regex_match_len(rw->re, usermask, masklen))
 		{
 			// Only process if they did not match before.
-			if (regex_match(rw->re, oldusermask))
+			if (rwatch_filter_candidate(rw, rwatch_filter.seen_old) &&
+			    regex_match_len(rw->re, oldusermask, oldmasklen))
 				continue;
 			if (rw->actions & RWACT_SNOOP)
 			{
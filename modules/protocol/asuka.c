@@ -192,6 +192,7 @@ m_nick(struct sourceinfo *si, int parc, char *parv[])
 
 					strshare_unref(u->user);
 					u->user = strshare_get(userbuf);
+					user_matchstr_invalidate(u);
 				}
 				i++;
 			}
@@ -280,6 +281,7 @@ m_mode(struct sourceinfo *si, int parc, char *parv[])
 
 					strshare_unref(u->user);
 					u->user = strshare_get(userbuf);
+					user_matchstr_invalidate(u);
 				}
 				slog(LG_DEBUG, "m_mode(): user %s setting vhost %s@%s", u->nick, u->user, u->vhost);
 			}
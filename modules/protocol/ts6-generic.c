@@ -1328,6 +1328,7 @@ m_encap(struct sourceinfo *si, int parc, char *parv[])
 
 		strshare_unref(u->host);
 		u->host = strshare_get(parv[2]);
+		user_matchstr_invalidate(u);
 	}
 	else if (!irccasecmp(parv[1], "CHGHOST"))
 	{
@@ -1418,6 +1419,7 @@ m_signon(struct sourceinfo *si, int parc, char *parv[])
 	// USER
 	strshare_unref(u->user);
 	u->user = strshare_get(parv[1]);
+	user_matchstr_invalidate(u);
 
 	// HOST
 	strshare_unref(u->vhost);
@@ -54,6 +54,9 @@
 #define DNSBL_ELIST_PERSIST_MDNAME "atheme.proxyscan.dnsbl.elist"
 #define IRCD_RES_HOSTLEN 255
 
+// How often expired entries are removed from the result cache
+#define DNSBL_CACHE_SWEEP_INTERVAL 60
+
 // A configured DNSBL
 struct Blacklist {
 	struct atheme_object parent;
@@ -64,12 +67,30 @@ struct Blacklist {
 	mowgli_node_t node;
 };
 
-// A lookup in progress for a particular DNSBL for a particular client
-struct BlacklistClient {
+/* A query in progress (or waiting for a free slot) for a particular DNSBL
+ * and a particular IP address; every client using that address waits on it.
+ */
+struct BlacklistLookup {
+	char name[IRCD_RES_HOSTLEN + 1];
 	struct Blacklist *blacklist;
-	struct user *u;
 	mowgli_dns_query_t dns_query;
-	mowgli_node_t node;
+	mowgli_list_t waiters;
+	bool started;
+	mowgli_node_t node;             // in dnsbl_pending, until started
+};
+
+// A client waiting on a lookup
+struct BlacklistClient {
+	struct BlacklistLookup *lookup;
+	struct user *u;
+	mowgli_node_t lnode;            // in lookup->waiters
+	mowgli_node_t unode;            // in the client's "dnsbl:queries" list
+};
+
+// The outcome of an earlier lookup, kept for dnsbl_cache_time
+struct BlacklistCacheEntry {
+	bool listed;
+	time_t expires;
 };
 
 struct dnsbl_exemption
@@ -108,6 +129,24 @@ static struct service *proxyscan = NULL;
 static mowgli_list_t *dnsbl_elist = NULL;
 static mowgli_dns_t *dns_base = NULL;
 
+static mowgli_patricia_t *dnsbl_lookups = NULL;
+static mowgli_patricia_t *dnsbl_cache = NULL;
+static mowgli_list_t dnsbl_pending = { NULL, NULL, 0 };
+static mowgli_eventloop_timer_t *dnsbl_cache_timer = NULL;
+static unsigned int dnsbl_running = 0;
+
+static unsigned int dnsbl_cache_time = 0;
+static unsigned int dnsbl_negative_cache_time = 0;
+static unsigned int dnsbl_max_queries = 0;
+
+static struct {
+	unsigned long hits;
+	unsigned long misses;
+	unsigned long coalesced;
+	unsigned long queries;
+	unsigned long throttled;
+} dnsbl_stats;
+
 static inline mowgli_list_t *
 dnsbl_queries(struct user *u)
 {
@@ -260,12 +299,15 @@ abort_blacklist_queries(struct user *u)
 	mowgli_node_t *n, *tn;
 	mowgli_list_t *l = dnsbl_queries(u);
 
+	/* The lookups themselves carry on even if nobody waits on them any
+	 * more, so that their results are cached for the next client.
+	 */
 	MOWGLI_ITER_FOREACH_SAFE(n, tn, l->head)
 	{
 		struct BlacklistClient *blcptr = n->data;
 
-		mowgli_dns_delete_query(dns_base, &blcptr->dns_query);
-		mowgli_node_delete(n, l);
+		mowgli_node_delete(&blcptr->lnode, &blcptr->lookup->waiters);
+		mowgli_node_delete(&blcptr->unode, l);
 		sfree(blcptr);
 	}
 }
@@ -304,45 +346,131 @@ dnsbl_hit(struct user *u, struct Blacklist *blptr)
 }
 
 static void
-blacklist_dns_callback(mowgli_dns_reply_t *reply, int result, void *vptr)
+dnsbl_report(struct BlacklistLookup *lookup, bool listed)
 {
-	struct BlacklistClient *blcptr = (struct BlacklistClient *) vptr;
-	int listed = 0;
-	mowgli_list_t *l;
-
-	if (blcptr == NULL)
-		return;
+	mowgli_node_t *n;
 
-	if (blcptr->u == NULL)
+	/* Detach waiters one at a time; dnsbl_hit() aborts all of the queries
+	 * of the client it is given, which may include others on this lookup.
+	 */
+	while ((n = lookup->waiters.head) != NULL)
 	{
+		struct BlacklistClient *blcptr = n->data;
+		struct user *u = blcptr->u;
+
+		mowgli_node_delete(&blcptr->lnode, &lookup->waiters);
+		mowgli_node_delete(&blcptr->unode, dnsbl_queries(u));
 		sfree(blcptr);
+
+		if (listed)
+			dnsbl_hit(u, lookup->blacklist);
+	}
+}
+
+static void
+dnsbl_lookup_free(struct BlacklistLookup *lookup)
+{
+	mowgli_patricia_delete(dnsbl_lookups, lookup->name);
+	atheme_object_unref(lookup->blacklist);
+	sfree(lookup);
+}
+
+static void blacklist_dns_callback(mowgli_dns_reply_t *reply, int result, void *vptr);
+
+static void
+dnsbl_lookup_start(struct BlacklistLookup *lookup)
+{
+	lookup->started = true;
+	lookup->dns_query.callback = blacklist_dns_callback;
+	lookup->dns_query.ptr = lookup;
+
+	dnsbl_running++;
+	dnsbl_stats.queries++;
+
+	mowgli_dns_gethost_byname(dns_base, lookup->name, &lookup->dns_query, MOWGLI_DNS_T_A);
+}
+
+// Start waiting lookups, as far as dnsbl_max_queries allows
+static void
+dnsbl_start_pending(void)
+{
+	mowgli_node_t *n;
+
+	while ((n = dnsbl_pending.head) != NULL && (! dnsbl_max_queries || dnsbl_running < dnsbl_max_queries))
+	{
+		struct BlacklistLookup *lookup = n->data;
+
+		mowgli_node_delete(&lookup->node, &dnsbl_pending);
+
+		// Nobody is interested in it any more, and it has not cost anything yet
+		if (! MOWGLI_LIST_LENGTH(&lookup->waiters))
+		{
+			dnsbl_lookup_free(lookup);
+			continue;
+		}
+
+		dnsbl_lookup_start(lookup);
+	}
+}
+
+static void
+dnsbl_cache_store(const char *name, bool listed, unsigned int duration)
+{
+	struct BlacklistCacheEntry *entry;
+
+	if (! duration)
 		return;
+
+	if ((entry = mowgli_patricia_retrieve(dnsbl_cache, name)) == NULL)
+	{
+		entry = smalloc(sizeof *entry);
+		mowgli_patricia_add(dnsbl_cache, name, entry);
 	}
 
-	l = dnsbl_queries(blcptr->u);
-	mowgli_node_delete(&blcptr->node, l);
+	entry->listed = listed;
+	entry->expires = CURRTIME + duration;
+}
+
+static void
+blacklist_dns_callback(mowgli_dns_reply_t *reply, int result, void *vptr)
+{
+	struct BlacklistLookup *lookup = (struct BlacklistLookup *) vptr;
+	bool listed = false;
+
+	if (lookup == NULL)
+		return;
+
+	dnsbl_running--;
 
 	if (reply != NULL)
 	{
 		// only accept 127.x.y.z as a listing
 		if (reply->addr.addr.ss_family == AF_INET &&
 				!memcmp(&((struct sockaddr_in *)&reply->addr.addr)->sin_addr, "\177", 1))
-			listed++;
-		else if (blcptr->blacklist->lastwarning + SECONDS_PER_HOUR < CURRTIME)
+			listed = true;
+		else if (lookup->blacklist->lastwarning + SECONDS_PER_HOUR < CURRTIME)
 		{
 			slog(LG_DEBUG,
 					"Garbage reply from blacklist %s",
-					blcptr->blacklist->host);
-			blcptr->blacklist->lastwarning = CURRTIME;
+					lookup->blacklist->host);
+			lookup->blacklist->lastwarning = CURRTIME;
 		}
 	}
 
+	/* The resolver does not tell us the TTL of the reply, so answers are
+	 * kept for the configured time. Failures (timeouts, SERVFAIL) are not
+	 * cached at all.
+	 */
+	if (result == MOWGLI_DNS_RES_SUCCESS && reply != NULL)
+		dnsbl_cache_store(lookup->name, listed, dnsbl_cache_time);
+	else if (result == MOWGLI_DNS_RES_NXDOMAIN)
+		dnsbl_cache_store(lookup->name, false, dnsbl_negative_cache_time);
+
 	// they have a blacklist entry for this client
-	if (listed)
-		dnsbl_hit(blcptr->u, blcptr->blacklist);
+	dnsbl_report(lookup, listed);
+	dnsbl_lookup_free(lookup);
 
-	atheme_object_unref(blcptr->blacklist);
-	sfree(blcptr);
+	dnsbl_start_pending();
 }
 
 static void
@@ -384,17 +512,89 @@ initiate_blacklist_dnsquery(struct Blacklist *blptr, struct user *u)
 	else
 		return;
 
-	struct BlacklistClient *const blcptr = smalloc(sizeof *blcptr);
+	(void) mowgli_strlcat(buf, blptr->host, sizeof buf);
+
+	const struct BlacklistCacheEntry *const entry = mowgli_patricia_retrieve(dnsbl_cache, buf);
+
+	if (entry != NULL && entry->expires > CURRTIME)
+	{
+		dnsbl_stats.hits++;
+
+		if (entry->listed)
+			dnsbl_hit(u, blptr);
+
+		return;
+	}
+
+	dnsbl_stats.misses++;
+
 	mowgli_list_t *const uql = dnsbl_queries(u);
+	bool start = false;
+	struct BlacklistLookup *lookup = mowgli_patricia_retrieve(dnsbl_lookups, buf);
+
+	if (lookup != NULL)
+	{
+		mowgli_node_t *n;
+
+		dnsbl_stats.coalesced++;
+
+		// e.g. DNSBLSCAN on a client whose lookup is still running
+		MOWGLI_ITER_FOREACH(n, lookup->waiters.head)
+			if (((struct BlacklistClient *) n->data)->u == u)
+				return;
+	}
+	else
+	{
+		lookup = smalloc(sizeof *lookup);
+		lookup->blacklist = atheme_object_ref(blptr);
+		(void) mowgli_strlcpy(lookup->name, buf, sizeof lookup->name);
+		(void) mowgli_patricia_add(dnsbl_lookups, lookup->name, lookup);
 
-	blcptr->blacklist = atheme_object_ref(blptr);
-	blcptr->dns_query.callback = blacklist_dns_callback;
-	blcptr->dns_query.ptr = blcptr;
+		if (dnsbl_max_queries && dnsbl_running >= dnsbl_max_queries)
+		{
+			dnsbl_stats.throttled++;
+			(void) mowgli_node_add(lookup, &lookup->node, &dnsbl_pending);
+		}
+		else
+			start = true;
+	}
+
+	struct BlacklistClient *const blcptr = smalloc(sizeof *blcptr);
+
+	blcptr->lookup = lookup;
 	blcptr->u = u;
 
-	(void) mowgli_strlcat(buf, blptr->host, sizeof buf);
-	(void) mowgli_dns_gethost_byname(dns_base, buf, &blcptr->dns_query, MOWGLI_DNS_T_A);
-	(void) mowgli_node_add(blcptr, &blcptr->node, uql);
+	(void) mowgli_node_add(blcptr, &blcptr->lnode, &lookup->waiters);
+	(void) mowgli_node_add(blcptr, &blcptr->unode, uql);
+
+	if (start)
+		dnsbl_lookup_start(lookup);
+}
+
+static int
+dnsbl_cache_expire_cb(const char *key, void *data, void *privdata)
+{
+	struct BlacklistCacheEntry *entry = data;
+
+	if (entry->expires <= CURRTIME)
+	{
+		mowgli_patricia_delete(dnsbl_cache, key);
+		sfree(entry);
+	}
+
+	return 0;
+}
+
+static void
+dnsbl_cache_sweep(void *unused)
+{
+	mowgli_patricia_foreach(dnsbl_cache, dnsbl_cache_expire_cb, NULL);
+}
+
+static void
+dnsbl_cache_free_cb(const char *key, void *data, void *privdata)
+{
+	sfree(data);
 }
 
 static void
@@ -581,6 +781,13 @@ osinfo_hook(struct sourceinfo *si)
 
 		command_success_nodata(si, _("Using DNSBL: %s"), blptr->host);
 	}
+
+	command_success_nodata(si, _("DNSBL cache: %u entries, %lu hits, %lu misses (%lu joined a running query)"),
+	                       mowgli_patricia_size(dnsbl_cache), dnsbl_stats.hits, dnsbl_stats.misses,
+	                       dnsbl_stats.coalesced);
+	command_success_nodata(si, _("DNSBL queries: %lu sent, %u running, %zu waiting (%lu had to wait)"),
+	                       dnsbl_stats.queries, dnsbl_running, MOWGLI_LIST_LENGTH(&dnsbl_pending),
+	                       dnsbl_stats.throttled);
 }
 
 static void
@@ -685,6 +892,11 @@ mod_init(struct module *const restrict m)
 		return;
 	}
 
+	dnsbl_lookups = mowgli_patricia_create(&strcasecanon);
+	dnsbl_cache = mowgli_patricia_create(&strcasecanon);
+	dnsbl_cache_timer = mowgli_timer_add(base_eventloop, "dnsbl_cache_sweep", &dnsbl_cache_sweep, NULL,
+	                                     DNSBL_CACHE_SWEEP_INTERVAL);
+
 	hook_add_config_purge(dnsbl_config_purge);
 	hook_add_db_write(write_dnsbl_exempt_db);
 	hook_add_operserv_info(osinfo_hook);
@@ -700,6 +912,9 @@ mod_init(struct module *const restrict m)
 
 	add_conf_item("DNSBL_ACTION", &proxyscan->conf_table, dnsbl_action_config_handler);
 	add_conf_item("BLACKLISTS", &proxyscan->conf_table, dnsbl_config_handler);
+	add_duration_conf_item("DNSBL_CACHE_TIME", &proxyscan->conf_table, 0, &dnsbl_cache_time, "s", 10 * SECONDS_PER_MINUTE);
+	add_duration_conf_item("DNSBL_NEGATIVE_CACHE_TIME", &proxyscan->conf_table, 0, &dnsbl_negative_cache_time, "s", 5 * SECONDS_PER_MINUTE);
+	add_uint_conf_item("DNSBL_MAX_QUERIES", &proxyscan->conf_table, 0, &dnsbl_max_queries, 0, INT_MAX, 64);
 
 	m->mflags |= MODFLAG_DBHANDLER;
 }
@@ -707,7 +922,35 @@ mod_init(struct module *const restrict m)
 static void
 mod_deinit(const enum module_unload_intent ATHEME_VATTR_UNUSED intent)
 {
+	mowgli_node_t *n, *tn;
+	mowgli_patricia_iteration_state_t state;
+	struct BlacklistLookup *lookup;
+
 	mowgli_global_storage_put(DNSBL_ELIST_PERSIST_MDNAME, dnsbl_elist);
+
+	/* Clients keep their (now empty) query lists; those are freed with
+	 * their privatedata.
+	 */
+	MOWGLI_PATRICIA_FOREACH(lookup, &state, dnsbl_lookups)
+	{
+		MOWGLI_ITER_FOREACH_SAFE(n, tn, lookup->waiters.head)
+		{
+			struct BlacklistClient *blcptr = n->data;
+
+			mowgli_node_delete(&blcptr->unode, dnsbl_queries(blcptr->u));
+			sfree(blcptr);
+		}
+
+		if (lookup->started)
+			mowgli_dns_delete_query(dns_base, &lookup->dns_query);
+
+		atheme_object_unref(lookup->blacklist);
+		sfree(lookup);
+	}
+
+	mowgli_patricia_destroy(dnsbl_lookups, NULL, NULL);
+	mowgli_patricia_destroy(dnsbl_cache, dnsbl_cache_free_cb, NULL);
+	mowgli_timer_destroy(base_eventloop, dnsbl_cache_timer);
 	mowgli_dns_destroy(dns_base);
 
 	hook_del_config_purge(dnsbl_config_purge);
@@ -725,6 +968,9 @@ mod_deinit(const enum module_unload_intent ATHEME_VATTR_UNUSED intent)
 
 	del_conf_item("DNSBL_ACTION", &proxyscan->conf_table);
 	del_conf_item("BLACKLISTS", &proxyscan->conf_table);
+	del_conf_item("DNSBL_CACHE_TIME", &proxyscan->conf_table);
+	del_conf_item("DNSBL_NEGATIVE_CACHE_TIME", &proxyscan->conf_table);
+	del_conf_item("DNSBL_MAX_QUERIES", &proxyscan->conf_table);
 }
 
 SIMPLE_DECLARE_MODULE_V1("proxyscan/dnsbl", MODULE_UNLOAD_CAPABILITY_RELOAD_ONLY)
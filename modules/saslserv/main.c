@@ -17,6 +17,13 @@
 #define ASASL_OUTFLAGS_WIPE_FREE_BUF    (ASASL_OUTFLAG_WIPE_BUF | ASASL_OUTFLAG_FREE_BUF)
 #define LOGIN_CANCELLED_STR             "There was a problem logging you in; login cancelled"
 
+// A message received for a session while its mechanism is busy
+struct sasl_pending_msg
+{
+	mowgli_node_t           node;
+	struct sasl_message     smsg;
+};
+
 static mowgli_list_t sasl_sessions;
 static mowgli_list_t sasl_mechanisms;
 static char sasl_mechlist_string[SASL_S2S_MAXLEN_ATONCE_B64];
@@ -313,12 +320,65 @@ sasl_user_can_login(struct sasl_session *const restrict p)
 	return target_mu;
 }
 
+static void
+sasl_pending_msg_free(struct sasl_pending_msg *const restrict m)
+{
+	// Client data may well contain a password
+	for (int i = 0; i < m->smsg.parc; i++)
+		(void) smemzerofree(m->smsg.parv[i], strlen(m->smsg.parv[i]));
+
+	(void) sfree(m->smsg.uid);
+	(void) sfree(m);
+}
+
+static void
+sasl_pending_input_clear(struct sasl_session *const restrict p)
+{
+	mowgli_node_t *n, *tn;
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, p->pending_input.head)
+	{
+		struct sasl_pending_msg *const m = n->data;
+
+		(void) mowgli_node_delete(&m->node, &p->pending_input);
+		(void) sasl_pending_msg_free(m);
+	}
+}
+
+static bool ATHEME_FATTR_WUR
+sasl_pending_input_add(struct sasl_session *const restrict p, const struct sasl_message *const restrict smsg)
+{
+	if (MOWGLI_LIST_LENGTH(&p->pending_input) >= SASL_PENDING_INPUT_MAX)
+	{
+		(void) slog(LG_DEBUG, "%s: client %s has sent too much data while its mechanism is busy",
+		                      MOWGLI_FUNC_NAME, p->uid);
+		return false;
+	}
+
+	struct sasl_pending_msg *const m = smalloc(sizeof *m);
+
+	m->smsg.server = smsg->server;
+	m->smsg.uid = sstrdup(smsg->uid);
+	m->smsg.parc = smsg->parc;
+	m->smsg.mode = smsg->mode;
+
+	for (int i = 0; i < smsg->parc; i++)
+		m->smsg.parv[i] = sstrdup(smsg->parv[i]);
+
+	(void) mowgli_node_add(m, &m->node, &p->pending_input);
+	return true;
+}
+
 static void
 sasl_session_reset(struct sasl_session *const restrict p)
 {
+	// This also cancels whatever the mechanism is busy with, if ASASL_SFLAG_PENDING is set
 	if (p->mechptr && p->mechptr->mech_finish)
 		(void) p->mechptr->mech_finish(p);
 	p->mechptr = NULL;
+	p->flags &= ~ASASL_SFLAG_PENDING;
+
+	(void) sasl_pending_input_clear(p);
 
 	struct user *const u = user_find(p->uid);
 	if (u)
@@ -577,6 +637,9 @@ sasl_process_output(struct sasl_session *const restrict p, struct sasl_output_bu
 	return true;
 }
 
+static bool ATHEME_FATTR_WUR sasl_process_result(struct sasl_session *, enum sasl_mechanism_result,
+                                                  struct sasl_output_buf *);
+
 /* given an entire sasl message, advance session by passing data to mechanism
  * and feeding returned data back to client.
  */
@@ -590,7 +653,6 @@ sasl_process_packet(struct sasl_session *const restrict p, char *const restrict
 	};
 
 	enum sasl_mechanism_result rc;
-	bool have_responded = false;
 
 	if (! p->mechptr && ! len)
 	{
@@ -618,9 +680,21 @@ sasl_process_packet(struct sasl_session *const restrict p, char *const restrict
 		rc = sasl_process_input(p, buf, len, &outbuf);
 	}
 
-	if (outbuf.buf && outbuf.len)
+	return sasl_process_result(p, rc, &outbuf);
+}
+
+/* send the mechanism's output (if any) to the client, and act on its result;
+ * called straight from sasl_process_packet(), or by sasl_mech_complete().
+ */
+static bool ATHEME_FATTR_WUR
+sasl_process_result(struct sasl_session *const restrict p, const enum sasl_mechanism_result rc,
+                    struct sasl_output_buf *const restrict outbuf)
+{
+	bool have_responded = false;
+
+	if (outbuf->buf && outbuf->len)
 	{
-		if (! sasl_process_output(p, &outbuf))
+		if (! sasl_process_output(p, outbuf))
 			return false;
 
 		have_responded = true;
@@ -691,6 +765,15 @@ sasl_process_packet(struct sasl_session *const restrict p, char *const restrict
 			return false;
 		}
 
+		case ASASL_MRESULT_PENDING:
+		{
+			/* The mechanism will tell us the result later; until then, further messages
+			 * from the client are set aside (see sasl_input()).
+			 */
+			p->flags |= ASASL_SFLAG_PENDING;
+			return true;
+		}
+
 		case ASASL_MRESULT_ERROR:
 			return false;
 	}
@@ -857,6 +940,15 @@ sasl_input(struct sasl_message *const restrict smsg)
 
 	bool ret = true;
 
+	if ((p->flags & ASASL_SFLAG_PENDING) && smsg->mode != 'D')
+	{
+		// Processed in order once the mechanism has finished; see sasl_mech_complete()
+		if (! sasl_pending_input_add(p, smsg))
+			(void) sasl_session_abort(p);
+
+		return;
+	}
+
 	switch (smsg->mode)
 	{
 		case 'H':
@@ -884,6 +976,54 @@ sasl_input(struct sasl_message *const restrict smsg)
 		(void) sasl_session_abort(p);
 }
 
+static void
+sasl_mech_complete(struct sasl_session *const restrict p, const enum sasl_mechanism_result rc,
+                   struct sasl_output_buf *restrict outbuf)
+{
+	struct sasl_output_buf nooutbuf = {
+		.buf    = NULL,
+		.len    = 0,
+		.flags  = ASASL_OUTFLAG_NONE,
+	};
+
+	return_if_fail(p != NULL);
+
+	if (! (p->flags & ASASL_SFLAG_PENDING))
+	{
+		(void) slog(LG_ERROR, "%s: session %s is not waiting for its mechanism (BUG)", MOWGLI_FUNC_NAME, p->uid);
+		return;
+	}
+
+	p->flags &= ~ASASL_SFLAG_PENDING;
+
+	if (! outbuf)
+		outbuf = &nooutbuf;
+
+	// The session may be gone once its result has been processed
+	char uid[sizeof p->uid];
+	(void) mowgli_strlcpy(uid, p->uid, sizeof uid);
+
+	if (! sasl_process_result(p, rc, outbuf))
+	{
+		(void) sasl_session_abort(p);
+		return;
+	}
+
+	/* Now process whatever the client sent in the meantime, in the order it was received,
+	 * until the mechanism is busy again or the session has finished.
+	 */
+	struct sasl_session *s;
+
+	while ((s = sasl_session_find(uid)) && ! (s->flags & ASASL_SFLAG_PENDING) && s->pending_input.head)
+	{
+		struct sasl_pending_msg *const m = s->pending_input.head->data;
+
+		(void) mowgli_node_delete(&m->node, &s->pending_input);
+		(void) sasl_input(&m->smsg);
+		(void) sasl_pending_msg_free(m);
+	}
+}
+
 static void
 sasl_user_add(struct hook_user_nick *const restrict data)
 {
@@ -911,7 +1051,13 @@ sasl_delete_stale(void ATHEME_VATTR_UNUSED *const restrict vptr)
 		struct sasl_session *const p = n->data;
 
 		if (p->flags & ASASL_SFLAG_MARKED_FOR_DELETION)
+		{
+			if (p->flags & ASASL_SFLAG_PENDING)
+				// The mechanism has taken too long; the client is still waiting for an answer
+				(void) sasl_sts(p->uid, 'D', "F");
+
 			(void) sasl_session_destroy(p);
+		}
 		else
 			p->flags |= ASASL_SFLAG_MARKED_FOR_DELETION;
 	}
@@ -1061,6 +1207,7 @@ const struct sasl_core_functions sasl_core_functions = {
 	.authcid_can_login  = &sasl_authcid_can_login,
 	.authzid_can_login  = &sasl_authzid_can_login,
 	.recalc_mechlist    = &sasl_mechlist_string_build,
+	.mech_complete      = &sasl_mech_complete,
 };
 
 static void
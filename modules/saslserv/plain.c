@@ -12,6 +12,23 @@
 
 static const struct sasl_core_functions *sasl_core_functions = NULL;
 
+static void
+sasl_mech_plain_verified(struct myuser *const restrict mu, const bool verified, void *const restrict priv)
+{
+	struct sasl_session *const p = priv;
+
+	// Our request handle is no longer valid
+	p->mechdata = NULL;
+
+	if (! mu)
+		// The account was dropped while we were verifying the password
+		(void) sasl_core_functions->mech_complete(p, ASASL_MRESULT_ERROR, NULL);
+	else if (! verified)
+		(void) sasl_core_functions->mech_complete(p, ASASL_MRESULT_FAILURE, NULL);
+	else
+		(void) sasl_core_functions->mech_complete(p, ASASL_MRESULT_SUCCESS, NULL);
+}
+
 static enum sasl_mechanism_result ATHEME_FATTR_WUR
 sasl_mech_plain_step(struct sasl_session *const restrict p, const struct sasl_input_buf *const restrict in,
                      struct sasl_output_buf ATHEME_VATTR_UNUSED *const restrict out)
@@ -56,10 +73,22 @@ sasl_mech_plain_step(struct sasl_session *const restrict p, const struct sasl_in
 	if (! sasl_core_functions->authcid_can_login(p, HULM_PASSWORD, authcid, &mu))
 		return ASASL_MRESULT_ERROR;
 
-	if (! verify_password(mu, secret))
-		return ASASL_MRESULT_FAILURE;
+	// The result is passed to sasl_mech_plain_verified() later, so that slow hashes don't hold up services
+	if (! (p->mechdata = verify_password_async(mu, secret, &sasl_mech_plain_verified, p)))
+		return ASASL_MRESULT_ERROR;
+
+	return ASASL_MRESULT_PENDING;
+}
+
+static void
+sasl_mech_plain_finish(struct sasl_session *const restrict p)
+{
+	if (! (p && p->mechdata))
+		return;
+
+	(void) verify_password_cancel(p->mechdata);
 
-	return ASASL_MRESULT_SUCCESS;
+	p->mechdata = NULL;
 }
 
 static const struct sasl_mechanism sasl_mech_plain = {
@@ -67,7 +96,7 @@ static const struct sasl_mechanism sasl_mech_plain = {
 	.name           = "PLAIN",
 	.mech_start     = NULL,
 	.mech_step      = &sasl_mech_plain_step,
-	.mech_finish    = NULL,
+	.mech_finish    = &sasl_mech_plain_finish,
 };
 
 static void
@@ -80,6 +80,7 @@ struct scram_session
 	size_t                      s_msg_len;  // Server's first message (length)
 	size_t                      nonce_len;  // Length of combined (client + server) nonce below
 	bool                        complete;   // Authentication is complete, waiting for client to confirm
+	bool                        cacheable;  // 'db' was not cached yet, and is still the account's password hash
 
 	// Client's GS2 header (base64-encoded)
 	char                        c_gs2_b64[BASE64_SIZE_STR(SCRAM_GS2HDR_LENGTH_MAX)];
@@ -91,14 +92,110 @@ struct scram_session
 	char                        nonce[SCRAM_NONCE_LENGTH_MAX_COMBINED + 1];
 };
 
+/* The decoded SCRAM credentials of an account, attached to it as private data
+ * the first time it is successfully authenticated, so that later
+ * authentications do not have to parse and base64-decode its password hash
+ * again. Only accounts whose password someone has proven to know are cached,
+ * so the cache cannot be grown by merely naming accounts. It is dropped when
+ * the account's password hash changes or the account is deleted.
+ */
+struct scram_credcache
+{
+	mowgli_node_t               node;       // For entry into mowgli_list_t scram_credcaches
+	struct myuser              *mu;         // Account these credentials belong to
+	struct pbkdf2v2_dbentry     db;         // Parsed credentials from database
+};
+
+#define SCRAM_CREDCACHE_PDKEY           "scram:credentials"
+
 typedef struct scram_attribute scram_attr_list[128];
 
 static mowgli_list_t scram_sessions;
+static mowgli_list_t scram_credcaches;
 
 static mowgli_list_t **crypto_conf_table = NULL;
 static const struct sasl_core_functions *sasl_core_functions = NULL;
 static const struct pbkdf2v2_scram_functions *pbkdf2v2_scram_functions = NULL;
 
+static void
+scram_credcache_drop(struct myuser *const restrict mu)
+{
+	struct scram_credcache *const cc = privatedata_delete(mu, SCRAM_CREDCACHE_PDKEY);
+
+	if (! cc)
+		return;
+
+	(void) mowgli_node_delete(&cc->node, &scram_credcaches);
+	(void) smemzerofree(cc, sizeof *cc);
+}
+
+static void
+scram_credcache_drop_all(void)
+{
+	mowgli_node_t *n, *tn;
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, scram_credcaches.head)
+	{
+		struct scram_credcache *const cc = n->data;
+
+		(void) scram_credcache_drop(cc->mu);
+	}
+}
+
+/* Fills in 'db' from the cache, or from the account's password hash; 'cached'
+ * says which. The latter is only cached by scram_credcache_store() once the
+ * client has proven that it knows the password.
+ */
+static bool ATHEME_FATTR_WUR
+scram_credcache_lookup(struct myuser *const restrict mu, struct pbkdf2v2_dbentry *const restrict db,
+                       bool *const restrict cached)
+{
+	const struct scram_credcache *const cc = privatedata_get(mu, SCRAM_CREDCACHE_PDKEY);
+
+	if (cc)
+	{
+		(void) memcpy(db, &cc->db, sizeof *db);
+		*cached = true;
+		return true;
+	}
+
+	*cached = false;
+
+	return pbkdf2v2_scram_functions->dbextract(mu->pass, db);
+}
+
+static void
+scram_credcache_store(struct myuser *const restrict mu, const struct pbkdf2v2_dbentry *const restrict db)
+{
+	if (privatedata_get(mu, SCRAM_CREDCACHE_PDKEY))
+		return;
+
+	struct scram_credcache *const cc = smalloc(sizeof *cc);
+
+	cc->mu = mu;
+
+	(void) memcpy(&cc->db, db, sizeof *db);
+	(void) mowgli_node_add(cc, &cc->node, &scram_credcaches);
+	(void) privatedata_set(mu, SCRAM_CREDCACHE_PDKEY, cc);
+}
+
+static void
+scram_myuser_changed_password_or_hash(struct myuser *const restrict mu)
+{
+	mowgli_node_t *n;
+
+	// Sessions in progress still use the old credentials, which must not be cached now
+	MOWGLI_ITER_FOREACH(n, scram_sessions.head)
+	{
+		struct scram_session *const s = n->data;
+
+		if (s->mu == mu)
+			s->cacheable = false;
+	}
+
+	(void) scram_credcache_drop(mu);
+}
+
 static void
 scram_myuser_delete(struct myuser *const restrict mu)
 {
@@ -111,6 +208,18 @@ scram_myuser_delete(struct myuser *const restrict mu)
 		if (s->mu == mu)
 			s->mu = NULL;
 	}
+
+	(void) scram_credcache_drop(mu);
+}
+
+static void
+scram_operserv_info(struct sourceinfo *const restrict si)
+{
+	const size_t count = MOWGLI_LIST_LENGTH(&scram_credcaches);
+	const size_t bytes = count * sizeof(struct scram_credcache);
+
+	(void) command_success_nodata(si, _("SCRAM credential cache: %zu accounts, %zu KiB"),
+	                              count, (bytes + 1023U) / 1024U);
 }
 
 static bool ATHEME_FATTR_WUR
@@ -248,6 +357,7 @@ scram_step_clientfirst(struct sasl_session *const restrict p, const struct sasl_
 
 	scram_attr_list attributes;
 	struct pbkdf2v2_dbentry db;
+	bool cached;
 
 	switch (*message++)
 	{
@@ -410,7 +520,7 @@ scram_step_clientfirst(struct sasl_session *const restrict p, const struct sasl_
 		(void) scram_error("other-error", out);
 		goto error;
 	}
-	if (! pbkdf2v2_scram_functions->dbextract(mu->pass, &db))
+	if (! scram_credcache_lookup(mu, &db, &cached))
 	{
 		// User's password hash is not in a compatible (PBKDF2 v2) format
 		(void) scram_error("other-error", out);
@@ -432,6 +542,7 @@ scram_step_clientfirst(struct sasl_session *const restrict p, const struct sasl_
 	s->c_msg_len = (in->len - header_len);
 	s->c_msg_buf = sstrndup(message, s->c_msg_len);
 	s->mu = mu;
+	s->cacheable = ! cached;
 
 	(void) mowgli_node_add(s, &s->node, &scram_sessions);
 	(void) memcpy(&s->db, &db, sizeof db);
@@ -598,6 +709,9 @@ scram_step_clientproof(struct sasl_session *const restrict p, const struct sasl_
 	 * ******************************************************** */
 	(void) slog(LG_DEBUG, "%s: authentication successful", MOWGLI_FUNC_NAME);
 
+	if (s->cacheable)
+		(void) scram_credcache_store(s->mu, &s->db);
+
 	// Calculate ServerSignature
 	if (! digest_oneshot_hmac_vector(s->db.md, s->db.ssk, s->db.dl, AuthMessage, AuthMsgLen, ServerSig, NULL))
 	{
@@ -934,6 +1048,10 @@ mod_init(struct module *const restrict m)
 
 	// We need to be told when a user account is deleted in case there is an active SCRAM negotiation for it
 	(void) hook_add_myuser_delete(&scram_myuser_delete);
+
+	// Cached credentials must not outlive the password hash they were decoded from
+	(void) hook_add_myuser_changed_password_or_hash(&scram_myuser_changed_password_or_hash);
+	(void) hook_add_operserv_info(&scram_operserv_info);
 }
 
 static void
@@ -947,6 +1065,10 @@ mod_deinit(const enum module_unload_intent ATHEME_VATTR_UNUSED intent)
 	// We no longer need these
 	(void) hook_del_config_purge(&scram_config_purge);
 	(void) hook_del_myuser_delete(&scram_myuser_delete);
+	(void) hook_del_myuser_changed_password_or_hash(&scram_myuser_changed_password_or_hash);
+	(void) hook_del_operserv_info(&scram_operserv_info);
+
+	(void) scram_credcache_drop_all();
 
 	// Unregister the SASL mechanisms
 	(void) scram_mechanisms_unregister();
@@ -108,6 +108,108 @@ static struct sourceinfo_vtable jsonrpc_vtable = {
 	.cmd_success_nodata = jsonrpc_command_success_nodata
 };
 
+/* A login waiting for its password to be verified. It is also pending on its
+ * connection, so that misc/httpd cancels it if the client goes away before
+ * the reply.
+ */
+struct jsonrpc_login_req
+{
+	mowgli_node_t                   node;
+	struct httpd_pending            pending;
+	struct connection *             cptr;           // NULL once the connection has been closed
+	char *                          sourceip;
+	char *                          id;
+	struct verify_password_req *    vreq;
+};
+
+static mowgli_list_t jsonrpc_login_reqs = { NULL, NULL, 0 };
+
+static void
+jsonrpc_login_req_destroy(struct jsonrpc_login_req *const restrict req)
+{
+	(void) mowgli_node_delete(&req->node, &jsonrpc_login_reqs);
+
+	if (req->cptr)
+	{
+		struct httpddata *const hd = req->cptr->userdata;
+
+		(void) mowgli_node_delete(&req->pending.node, &hd->pending);
+	}
+
+	(void) sfree(req->sourceip);
+	(void) sfree(req->id);
+	(void) sfree(req);
+}
+
+static void
+jsonrpc_login_cancel(void *const restrict vreq)
+{
+	struct jsonrpc_login_req *const req = vreq;
+
+	// misc/httpd has already taken it off the connection
+	req->cptr = NULL;
+
+	(void) verify_password_cancel(req->vreq);
+	(void) jsonrpc_login_req_destroy(req);
+}
+
+static void
+jsonrpc_login_verified(struct myuser *const restrict mu, const bool verified, void *const restrict vreq)
+{
+	struct jsonrpc_login_req *const req = vreq;
+	struct connection *const conn = req->cptr;
+	char *const sourceip = req->sourceip;
+	char *const id = req->id;
+	struct authcookie *ac;
+
+	req->sourceip = NULL;
+	req->id = NULL;
+
+	(void) jsonrpc_login_req_destroy(req);
+
+	if (!mu)
+	{
+		jsonrpc_failure_string(conn, fault_nosuch_source, "The account is not registered.", id);
+	}
+	else if (!verified)
+	{
+		struct sourceinfo *si;
+
+		logcommand_external(nicksvs.me, "jsonrpc", conn, sourceip, NULL, CMDLOG_LOGIN, "failed LOGIN to \2%s\2 (bad password)", entity(mu)->name);
+		jsonrpc_failure_string(conn, fault_authfail, "The password is incorrect.", id);
+
+		si = sourceinfo_create();
+
+		struct jsonrpc_sourceinfo *jsi = (struct jsonrpc_sourceinfo *)si;
+
+		si->service = NULL;
+		si->sourcedesc = sourceip;
+		si->connection = conn;
+		si->v = &jsonrpc_vtable;
+		si->force_language = language_find("en");
+
+		jsi->base = si;
+		jsi->id = id;
+
+		bad_password(si, mu);
+
+		atheme_object_unref(si);
+	}
+	else
+	{
+		mu->lastlogin = CURRTIME;
+
+		ac = authcookie_create(mu);
+
+		logcommand_external(nicksvs.me, "jsonrpc", conn, sourceip, mu, CMDLOG_LOGIN, "LOGIN");
+
+		jsonrpc_success_string(conn, ac->ticket, id);
+	}
+
+	sfree(sourceip);
+	sfree(id);
+}
+
 // These taken from modules/transport/xmlrpc/main.c
 
 /* atheme.login
@@ -129,9 +231,11 @@ static struct sourceinfo_vtable jsonrpc_vtable = {
 static bool
 jsonrpcmethod_login(void *conn, mowgli_list_t *params, char *id)
 {
+	struct connection *const cptr = conn;
+	struct jsonrpc_login_req *req;
 	struct myuser *mu;
-	struct authcookie *ac;
 	char *sourceip, *accountname, *password;
+	struct httpddata *hd;
 
 	size_t len = MOWGLI_LIST_LENGTH(params);
 
@@ -158,41 +262,24 @@ jsonrpcmethod_login(void *conn, mowgli_list_t *params, char *id)
 		return false;
 	}
 
-	if (!verify_password(mu, password))
-	{
-		struct sourceinfo *si;
-
-		logcommand_external(nicksvs.me, "jsonrpc", conn, sourceip, NULL, CMDLOG_LOGIN, "failed LOGIN to \2%s\2 (bad password)", entity(mu)->name);
-		jsonrpc_failure_string(conn, fault_authfail, "The password is incorrect.", id);
-
-		si = sourceinfo_create();
-
-		struct jsonrpc_sourceinfo *jsi = (struct jsonrpc_sourceinfo *)si;
-
-		si->service = NULL;
-		si->sourcedesc = sourceip;
-		si->connection = conn;
-		si->v = &jsonrpc_vtable;
-		si->force_language = language_find("en");
-
-		jsi->base = si;
-		jsi->id = id;
-
-		bad_password(si, mu);
+	// The reply is sent by jsonrpc_login_verified() once the password has been checked
+	hd = cptr->userdata;
+	req = smalloc(sizeof *req);
+	req->cptr = cptr;
+	req->pending.cancel = &jsonrpc_login_cancel;
+	req->sourceip = sourceip != NULL ? sstrdup(sourceip) : NULL;
+	req->id = sstrdup(id);
 
-		atheme_object_unref(si);
+	mowgli_node_add(req, &req->node, &jsonrpc_login_reqs);
+	mowgli_node_add(req, &req->pending.node, &hd->pending);
 
+	if (!(req->vreq = verify_password_async(mu, password, &jsonrpc_login_verified, req)))
+	{
+		(void) jsonrpc_login_req_destroy(req);
+		jsonrpc_failure_string(conn, fault_authfail, "The password is incorrect.", id);
 		return false;
 	}
 
-	mu->lastlogin = CURRTIME;
-
-	ac = authcookie_create(mu);
-
-	logcommand_external(nicksvs.me, "jsonrpc", conn, sourceip, mu, CMDLOG_LOGIN, "LOGIN");
-
-	jsonrpc_success_string(conn, ac->ticket, id);
-
 	return true;
 }
 
@@ -674,7 +761,15 @@ mod_init(struct module *const restrict m)
 static void
 mod_deinit(const enum module_unload_intent ATHEME_VATTR_UNUSED intent)
 {
-	mowgli_node_t *n;
+	mowgli_node_t *n, *tn;
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, jsonrpc_login_reqs.head)
+	{
+		struct jsonrpc_login_req *const req = n->data;
+
+		(void) verify_password_cancel(req->vreq);
+		(void) jsonrpc_login_req_destroy(req);
+	}
 
 	jsonrpc_unregister_method("atheme.login");
 	jsonrpc_unregister_method("atheme.logout");
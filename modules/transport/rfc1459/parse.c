@@ -162,10 +162,7 @@ irc_parse(char *line)
 				slog(LG_INFO, "irc_parse(): insufficient parameters for command %s", pcmd->token);
 				goto cleanup;
 			}
-			if (pcmd->handler)
-			{
-				pcmd->handler(si, parc, parv);
-			}
+			pcommand_exec(pcmd, si, parc, parv);
 		}
 	}
 
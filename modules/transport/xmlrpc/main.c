@@ -150,6 +150,101 @@ static struct sourceinfo_vtable xmlrpc_vtable = {
 	.cmd_success_string = xmlrpc_command_success_string
 };
 
+/* A login waiting for its password to be verified. It is also pending on its
+ * connection, so that misc/httpd cancels it if the client goes away before
+ * the reply.
+ */
+struct xmlrpc_login_req
+{
+	mowgli_node_t                   node;
+	struct httpd_pending            pending;
+	struct connection *             cptr;           // NULL once the connection has been closed
+	char *                          sourceip;
+	struct verify_password_req *    vreq;
+};
+
+static mowgli_list_t xmlrpc_login_reqs = { NULL, NULL, 0 };
+
+static void
+xmlrpc_login_req_destroy(struct xmlrpc_login_req *const restrict req)
+{
+	(void) mowgli_node_delete(&req->node, &xmlrpc_login_reqs);
+
+	if (req->cptr)
+	{
+		struct httpddata *const hd = req->cptr->userdata;
+
+		(void) mowgli_node_delete(&req->pending.node, &hd->pending);
+	}
+
+	(void) sfree(req->sourceip);
+	(void) sfree(req);
+}
+
+static void
+xmlrpc_login_cancel(void *const restrict vreq)
+{
+	struct xmlrpc_login_req *const req = vreq;
+
+	// misc/httpd has already taken it off the connection
+	req->cptr = NULL;
+
+	(void) verify_password_cancel(req->vreq);
+	(void) xmlrpc_login_req_destroy(req);
+}
+
+static void
+xmlrpc_login_verified(struct myuser *const restrict mu, const bool verified, void *const restrict vreq)
+{
+	struct xmlrpc_login_req *const req = vreq;
+	struct connection *const conn = req->cptr;
+	char *const sourceip = req->sourceip;
+	struct authcookie *ac;
+
+	req->sourceip = NULL;
+
+	(void) xmlrpc_login_req_destroy(req);
+
+	current_cptr = conn;
+
+	if (!mu)
+	{
+		xmlrpc_generic_error(fault_nosuch_source, "The account is not registered.");
+	}
+	else if (!verified)
+	{
+		struct sourceinfo *si;
+
+		logcommand_external(nicksvs.me, "xmlrpc", conn, sourceip, NULL, CMDLOG_LOGIN, "failed LOGIN to \2%s\2 (bad password)", entity(mu)->name);
+		xmlrpc_generic_error(fault_authfail, "The password is not valid for this account.");
+
+		si = sourceinfo_create();
+		si->service = NULL;
+		si->sourcedesc = sourceip;
+		si->connection = conn;
+		si->v = &xmlrpc_vtable;
+		si->force_language = language_find("en");
+
+		bad_password(si, mu);
+
+		atheme_object_unref(si);
+	}
+	else
+	{
+		mu->lastlogin = CURRTIME;
+
+		ac = authcookie_create(mu);
+
+		logcommand_external(nicksvs.me, "xmlrpc", conn, sourceip, mu, CMDLOG_LOGIN, "LOGIN");
+
+		xmlrpc_send_string(ac->ticket);
+	}
+
+	current_cptr = NULL;
+
+	sfree(sourceip);
+}
+
 // These taken from the old modules/xmlrpc/account.c
 
 /* atheme.login
@@ -171,9 +266,11 @@ static struct sourceinfo_vtable xmlrpc_vtable = {
 static int
 xmlrpcmethod_login(void *conn, int parc, char *parv[])
 {
+	struct connection *const cptr = conn;
+	struct xmlrpc_login_req *req;
 	struct myuser *mu;
-	struct authcookie *ac;
 	const char *sourceip;
+	struct httpddata *hd;
 
 	if (parc < 2)
 	{
@@ -196,35 +293,22 @@ xmlrpcmethod_login(void *conn, int parc, char *parv[])
 		return 0;
 	}
 
-	if (!verify_password(mu, parv[1]))
-	{
-		struct sourceinfo *si;
-
-		logcommand_external(nicksvs.me, "xmlrpc", conn, sourceip, NULL, CMDLOG_LOGIN, "failed LOGIN to \2%s\2 (bad password)", entity(mu)->name);
-		xmlrpc_generic_error(fault_authfail, "The password is not valid for this account.");
-
-		si = sourceinfo_create();
-		si->service = NULL;
-		si->sourcedesc = parv[2] != NULL && *parv[2] ? parv[2] : NULL;
-		si->connection = conn;
-		si->v = &xmlrpc_vtable;
-		si->force_language = language_find("en");
+	// The reply is sent by xmlrpc_login_verified() once the password has been checked
+	hd = cptr->userdata;
+	req = smalloc(sizeof *req);
+	req->cptr = cptr;
+	req->pending.cancel = &xmlrpc_login_cancel;
+	req->sourceip = sourceip != NULL ? sstrdup(sourceip) : NULL;
 
-		bad_password(si, mu);
+	mowgli_node_add(req, &req->node, &xmlrpc_login_reqs);
+	mowgli_node_add(req, &req->pending.node, &hd->pending);
 
-		atheme_object_unref(si);
-
-		return 0;
+	if (!(req->vreq = verify_password_async(mu, parv[1], &xmlrpc_login_verified, req)))
+	{
+		(void) xmlrpc_login_req_destroy(req);
+		xmlrpc_generic_error(fault_authfail, "The password is not valid for this account.");
 	}
 
-	mu->lastlogin = CURRTIME;
-
-	ac = authcookie_create(mu);
-
-	logcommand_external(nicksvs.me, "xmlrpc", conn, sourceip, mu, CMDLOG_LOGIN, "LOGIN");
-
-	xmlrpc_send_string(ac->ticket);
-
 	return 0;
 }
 
@@ -584,7 +668,15 @@ mod_init(struct module *const restrict m)
 static void
 mod_deinit(const enum module_unload_intent ATHEME_VATTR_UNUSED intent)
 {
-	mowgli_node_t *n;
+	mowgli_node_t *n, *tn;
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, xmlrpc_login_reqs.head)
+	{
+		struct xmlrpc_login_req *const req = n->data;
+
+		(void) verify_password_cancel(req->vreq);
+		(void) xmlrpc_login_req_destroy(req);
+	}
 
 	xmlrpc_unregister_method("atheme.login");
 	xmlrpc_unregister_method("atheme.logout");
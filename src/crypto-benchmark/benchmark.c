@@ -423,3 +423,67 @@ benchmark_pbkdf2(const enum digest_algorithm digest, const size_t itercount, con
 	(void) pbkdf2_print_rowstats(digest, itercount, with_sasl_scram, duration);
 	return true;
 }
+
+void
+random_print_colheaders(void)
+{
+	(void) bench_print(_(""
+		"\n"
+		"Bytes      Mode         Calls/sec\n"
+		"---------- ------------ --------------"
+	));
+}
+
+void
+random_print_rowstats(const size_t len, const bool buffered, const long double rate)
+{
+	(void) bench_print(_("%10zu %12s %14.0LF"), len, (buffered ? _("buffered") : _("unbuffered")), rate);
+}
+
+bool ATHEME_FATTR_WUR
+benchmark_random(const size_t len, const bool buffered, long double *const restrict rate)
+{
+	static const size_t calls = 1000000U;
+
+	struct timespec begin;
+	struct timespec end;
+
+	if (! len || len > sizeof hashbuf)
+	{
+		(void) bench_print("%s: invalid length %zu", MOWGLI_FUNC_NAME, len);
+		return false;
+	}
+
+	(void) memset(&begin, 0x00, sizeof begin);
+	(void) memset(&end, 0x00, sizeof end);
+
+	if (clock_gettime(CLOCK_MONOTONIC, &begin) != 0)
+	{
+		(void) perror("clock_gettime(2)");
+		return false;
+	}
+	for (size_t i = 0; i < calls; i++)
+	{
+		if (buffered)
+			(void) atheme_random_buf(hashbuf, len);
+		else
+			(void) atheme_random_buf_unbuffered(hashbuf, len);
+	}
+	if (clock_gettime(CLOCK_MONOTONIC, &end) != 0)
+	{
+		(void) perror("clock_gettime(2)");
+		return false;
+	}
+
+	const long double begin_ld = ((long double) begin.tv_sec) + (((long double) begin.tv_nsec) / nsec_per_sec);
+	const long double end_ld = ((long double) end.tv_sec) + (((long double) end.tv_nsec) / nsec_per_sec);
+	const long double duration = (end_ld - begin_ld);
+	const long double b_rate = (duration > 0.0L) ? (((long double) calls) / duration) : 0.0L;
+
+	if (rate)
+		*rate = b_rate;
+	else
+		(void) random_print_rowstats(len, buffered, b_rate);
+
+	return true;
+}
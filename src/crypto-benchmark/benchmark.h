@@ -31,6 +31,7 @@
 #define BENCH_RUN_OPTIONS_SCRYPT    0x0008U
 #define BENCH_RUN_OPTIONS_BCRYPT    0x0010U
 #define BENCH_RUN_OPTIONS_PBKDF2    0x0020U
+#define BENCH_RUN_OPTIONS_RANDOM    0x0040U
 
 #if defined(HAVE_LIBARGON2) || defined(HAVE_LIBSODIUM_SCRYPT)
 #  define HAVE_ANY_MEMORY_HARD_ALGORITHM 1
@@ -66,4 +67,8 @@ void pbkdf2_print_colheaders(void);
 void pbkdf2_print_rowstats(enum digest_algorithm, size_t, bool, long double);
 bool benchmark_pbkdf2(enum digest_algorithm, size_t, bool, long double *) ATHEME_FATTR_WUR;
 
+void random_print_colheaders(void);
+void random_print_rowstats(size_t, bool, long double);
+bool benchmark_random(size_t, bool, long double *) ATHEME_FATTR_WUR;
+
 #endif /* !ATHEME_SRC_CRYPTO_BENCHMARK_BENCHMARK_H */
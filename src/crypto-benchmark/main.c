@@ -15,6 +15,7 @@
 #include <atheme/i18n.h>            // _() (gettext)
 #include <atheme/memory.h>          // sreallocarray()
 #include <atheme/pbkdf2.h>          // PBKDF2_*
+#include <atheme/random.h>          // random_get_frontend_info()
 #include <atheme/scrypt.h>          // ATHEME_SCRYPT_*
 #include <atheme/stdheaders.h>      // (everything else)
 #include <atheme/sysconf.h>         // HAVE_*, PACKAGE_*
@@ -25,6 +26,7 @@
 #include "benchmark.h"              // (everything else)
 #include "optimal.h"                // do_optimal_benchmarks()
 #include "selftests.h"              // do_crypto_selftests()
+#include "throughput.h"             // benchmark_throughput()
 
 #define BENCH_ARRAY_SIZE(x)         ((sizeof((x))) / (sizeof((x)[0])))
 
@@ -36,6 +38,13 @@
 #define BENCH_MEMLIMIT_DEF          BENCH_MAX(ATHEME_ARGON2_MEMCOST_DEF, ATHEME_SCRYPT_MEMLIMIT_DEF)
 #define BENCH_MEMLIMIT_MAX          BENCH_MIN(ATHEME_ARGON2_MEMCOST_MAX, ATHEME_SCRYPT_MEMLIMIT_MAX)
 
+#define BENCH_TOTAL_MEMLIMIT_MIN    14U
+#define BENCH_TOTAL_MEMLIMIT_DEF    21U
+#define BENCH_TOTAL_MEMLIMIT_MAX    34U
+
+#define BENCH_LOGIN_RATE_MIN        1U
+#define BENCH_LOGIN_RATE_MAX        1000000U
+
 #ifdef HAVE_LIBARGON2
 
 static argon2_type b_argon2_types_default[] = { Argon2_id };
@@ -87,6 +96,15 @@ static bool with_sasl_scram = false;
 
 static unsigned int run_options = BENCH_RUN_OPTIONS_NONE;
 
+#ifdef HAVE_LIBPTHREAD
+static bool throughput_mode = false;
+static unsigned int throughput_threads = 0;
+static long double throughput_duration = BENCH_THROUGHPUT_DURATION_DEF;
+static unsigned int optimal_login_rate = 0;
+static unsigned int optimal_total_memlimit = BENCH_TOTAL_MEMLIMIT_DEF;
+static unsigned int throughput_pbkdf2_batch = BENCH_PBKDF2_BATCH_MIN;
+#endif
+
 static const mowgli_getopt_option_t bench_long_opts[] = {
 
 	{                     "help",       no_argument, NULL, 'h', 0 },
@@ -118,6 +136,14 @@ static const mowgli_getopt_option_t bench_long_opts[] = {
 	{    "run-pbkdf2-benchmarks",       no_argument, NULL, 'k', 0 },
 	{        "pbkdf2-iterations", required_argument, NULL, 'c', 0 },
 	{ "pbkdf2-digest-algorithms", required_argument, NULL, 'd', 0 },
+	{    "run-random-benchmarks",       no_argument, NULL, 'R', 0 },
+#ifdef HAVE_LIBPTHREAD
+	{       "throughput-threads", required_argument, NULL, 'j', 0 },
+	{      "throughput-duration", required_argument, NULL, 'u', 0 },
+	{       "optimal-login-rate", required_argument, NULL, 'q', 0 },
+	{     "optimal-total-memory", required_argument, NULL, 'L', 0 },
+	{             "pbkdf2-batch", required_argument, NULL, 'B', 0 },
+#endif
 
 	{ NULL, 0, NULL, 0, 0 },
 };
@@ -164,11 +190,32 @@ print_usage(void)
 		"  -c/--pbkdf2-iterations         Comma-separated iteration counts\n"
 		"  -d/--pbkdf2-digests            Comma-separated digest algorithms\n"
 		"\n"
+		"  -R/--run-random-benchmarks   Benchmark the random number generator, with and\n"
+		"                                 without per-thread buffering, for a range of\n"
+		"                                 small request sizes (reports calls per second)\n"
+		"\n"
+		"  -j/--throughput-threads       Instead of timing a single hash for each of the\n"
+		"                                 configurations above, run this many threads\n"
+		"                                 that verify passwords back-to-back, and report\n"
+		"                                 verifies per second, p50/p99 latency and peak\n"
+		"                                 memory use (default: number of online CPUs)\n"
+		"  -u/--throughput-duration      How long to run each configuration for\n"
+		"                                 (in seconds, fractional values accepted)\n"
+		"  -q/--optimal-login-rate       With -o: recommend the strongest parameters that\n"
+		"                                 sustain this many logins per second on the\n"
+		"                                 threads given by -j\n"
+		"  -L/--optimal-total-memory     With -o -q: memory limit for all of those logins\n"
+		"                                 together (as a power of 2, in KiB; default 21)\n"
+		"                                 For example, '-L 21' means 2^21 KiB; 2 GiB\n"
+		"  -B/--pbkdf2-batch             With -k: have each thread derive this many PBKDF2\n"
+		"                                 keys at once, as services' password verification\n"
+		"                                 threads do when logins arrive together (1 to 16)\n"
+		"\n"
 		"  Valid Argon2 types are: Argon2d, Argon2i, Argon2id (case-insensitive)\n"
 		"  Valid PBKDF2 digests are: MD5, SHA1, SHA2-256, SHA2-512 (case-insensitive)\n"
 		"\n"
 		"  If one of the above customisable options are not given, defaults are used.\n"
-		"  One of -h/-v/-o/-a/-s/-k MUST be given. They are all mutually-exclusive.\n"
+		"  One of -h/-v/-o/-a/-s/-b/-k/-R MUST be given. They are all mutually-exclusive.\n"
 	));
 }
 
@@ -415,6 +462,10 @@ process_options(int argc, char *argv[])
 				run_options |= BENCH_RUN_OPTIONS_PBKDF2;
 				break;
 
+			case 'R':
+				run_options |= BENCH_RUN_OPTIONS_RANDOM;
+				break;
+
 			case 'c':
 				if (! process_uint_option(c, mowgli_optarg, &b_pbkdf2_itercounts,
 				                          &b_pbkdf2_itercounts_count, PBKDF2_ITERCNT_MIN,
@@ -450,6 +501,88 @@ process_options(int argc, char *argv[])
 				break;
 			}
 
+#ifdef HAVE_LIBPTHREAD
+			case 'j':
+				if (! string_to_uint(mowgli_optarg, &throughput_threads) ||
+				    throughput_threads < BENCH_THROUGHPUT_THREADS_MIN ||
+				    throughput_threads > BENCH_THROUGHPUT_THREADS_MAX)
+				{
+					(void) bench_print(_(""
+						"'%s' is not a valid value for integer option '%c'\n"
+						"range of valid values: %u to %u (inclusive)\n"
+					), mowgli_optarg, c, BENCH_THROUGHPUT_THREADS_MIN, BENCH_THROUGHPUT_THREADS_MAX);
+
+					return false;
+				}
+				throughput_mode = true;
+				break;
+
+			case 'u':
+			{
+				errno = 0;
+
+				char *end = NULL;
+				const long double ret = strtold(mowgli_optarg, &end);
+
+				if (! ret || (end && *end) || errno != 0 ||
+				    ret < BENCH_THROUGHPUT_DURATION_MIN || ret > BENCH_THROUGHPUT_DURATION_MAX)
+				{
+					(void) bench_print(_(""
+						"'%s' is not a valid value for decimal option '%c'\n"
+						"range of valid values: %LF to %LF (inclusive)\n"
+					), mowgli_optarg, c, BENCH_THROUGHPUT_DURATION_MIN, BENCH_THROUGHPUT_DURATION_MAX);
+
+					return false;
+				}
+
+				throughput_duration = ret;
+				throughput_mode = true;
+				break;
+			}
+
+			case 'q':
+				if (! string_to_uint(mowgli_optarg, &optimal_login_rate) ||
+				    optimal_login_rate < BENCH_LOGIN_RATE_MIN || optimal_login_rate > BENCH_LOGIN_RATE_MAX)
+				{
+					(void) bench_print(_(""
+						"'%s' is not a valid value for integer option '%c'\n"
+						"range of valid values: %u to %u (inclusive)\n"
+					), mowgli_optarg, c, BENCH_LOGIN_RATE_MIN, BENCH_LOGIN_RATE_MAX);
+
+					return false;
+				}
+				break;
+
+			case 'L':
+				if (! string_to_uint(mowgli_optarg, &optimal_total_memlimit) ||
+				    optimal_total_memlimit < BENCH_TOTAL_MEMLIMIT_MIN ||
+				    optimal_total_memlimit > BENCH_TOTAL_MEMLIMIT_MAX)
+				{
+					(void) bench_print(_(""
+						"'%s' is not a valid value for integer option '%c'\n"
+						"range of valid values: %u to %u (inclusive)\n"
+					), mowgli_optarg, c, BENCH_TOTAL_MEMLIMIT_MIN, BENCH_TOTAL_MEMLIMIT_MAX);
+
+					return false;
+				}
+				break;
+
+			case 'B':
+				if (! string_to_uint(mowgli_optarg, &throughput_pbkdf2_batch) ||
+				    throughput_pbkdf2_batch < BENCH_PBKDF2_BATCH_MIN ||
+				    throughput_pbkdf2_batch > BENCH_PBKDF2_BATCH_MAX)
+				{
+					(void) bench_print(_(""
+						"'%s' is not a valid value for integer option '%c'\n"
+						"range of valid values: %u to %u (inclusive)\n"
+					), mowgli_optarg, c, BENCH_PBKDF2_BATCH_MIN, BENCH_PBKDF2_BATCH_MAX);
+
+					return false;
+				}
+				throughput_mode = true;
+				break;
+#endif /* HAVE_LIBPTHREAD */
+
 			default:
 				(void) print_usage();
 				return false;
@@ -517,9 +650,28 @@ process_options(int argc, char *argv[])
 		b_pbkdf2_digests_count = BENCH_ARRAY_SIZE(b_pbkdf2_digests_default);
 	}
 
+#ifdef HAVE_LIBPTHREAD
+	if (! throughput_threads)
+		throughput_threads = throughput_default_threads();
+#endif
+
 	return true;
 }
 
+#ifdef HAVE_LIBPTHREAD
+
+static void
+throughput_begin(const char *const restrict name)
+{
+	(void) bench_print("");
+	(void) bench_print("");
+	(void) bench_print(_("Beginning customizable %s throughput benchmark ..."), name);
+
+	(void) throughput_print_colheaders(throughput_threads, throughput_duration);
+}
+
+#endif /* HAVE_LIBPTHREAD */
+
 #ifdef HAVE_LIBARGON2
 
 static bool ATHEME_FATTR_WUR
@@ -543,6 +695,36 @@ do_argon2_benchmarks(void)
 	return true;
 }
 
+#ifdef HAVE_LIBPTHREAD
+
+static bool ATHEME_FATTR_WUR
+do_argon2_throughput_benchmarks(void)
+{
+	struct bench_throughput_params params = { .algorithm = BENCH_RUN_OPTIONS_ARGON2 };
+	struct bench_throughput_result result;
+
+	(void) throughput_begin("Argon2");
+
+	for (size_t b_argon2_type = 0; b_argon2_type < b_argon2_types_count; b_argon2_type++)
+	  for (size_t b_argon2_memcost = 0; b_argon2_memcost < b_argon2_memcosts_count; b_argon2_memcost++)
+	    for (size_t b_argon2_timecost = 0; b_argon2_timecost < b_argon2_timecosts_count; b_argon2_timecost++)
+	      for (size_t b_argon2_thread = 0; b_argon2_thread < b_argon2_threads_count; b_argon2_thread++)
+	      {
+	        params.argon2_type = b_argon2_types[b_argon2_type];
+	        params.argon2_memcost = b_argon2_memcosts[b_argon2_memcost];
+	        params.argon2_timecost = b_argon2_timecosts[b_argon2_timecost];
+	        params.argon2_threads = b_argon2_threads[b_argon2_thread];
+
+	        if (! benchmark_throughput(&params, throughput_threads, throughput_duration, &result))
+	          // This function logs error messages on failure
+	          return false;
+	      }
+
+	return true;
+}
+
+#endif /* HAVE_LIBPTHREAD */
+
 #endif /* HAVE_LIBARGON2 */
 
 #ifdef HAVE_LIBSODIUM_SCRYPT
@@ -565,6 +747,32 @@ do_scrypt_benchmarks(void)
 	return true;
 }
 
+#ifdef HAVE_LIBPTHREAD
+
+static bool ATHEME_FATTR_WUR
+do_scrypt_throughput_benchmarks(void)
+{
+	struct bench_throughput_params params = { .algorithm = BENCH_RUN_OPTIONS_SCRYPT };
+	struct bench_throughput_result result;
+
+	(void) throughput_begin("scrypt");
+
+	for (size_t b_scrypt_memlimit = 0; b_scrypt_memlimit < b_scrypt_memlimits_count; b_scrypt_memlimit++)
+	  for (size_t b_scrypt_opslimit = 0; b_scrypt_opslimit < b_scrypt_opslimits_count; b_scrypt_opslimit++)
+	  {
+	    params.scrypt_memlimit = b_scrypt_memlimits[b_scrypt_memlimit];
+	    params.scrypt_opslimit = b_scrypt_opslimits[b_scrypt_opslimit];
+
+	    if (! benchmark_throughput(&params, throughput_threads, throughput_duration, &result))
+	      // This function logs error messages on failure
+	      return false;
+	  }
+
+	return true;
+}
+
+#endif /* HAVE_LIBPTHREAD */
+
 #endif /* HAVE_LIBSODIUM_SCRYPT */
 
 static bool ATHEME_FATTR_WUR
@@ -584,6 +792,30 @@ do_bcrypt_benchmarks(void)
 	return true;
 }
 
+#ifdef HAVE_LIBPTHREAD
+
+static bool ATHEME_FATTR_WUR
+do_bcrypt_throughput_benchmarks(void)
+{
+	struct bench_throughput_params params = { .algorithm = BENCH_RUN_OPTIONS_BCRYPT };
+	struct bench_throughput_result result;
+
+	(void) throughput_begin("bcrypt");
+
+	for (size_t b_bcrypt_cost = 0; b_bcrypt_cost < b_bcrypt_costs_count; b_bcrypt_cost++)
+	{
+	  params.bcrypt_cost = (unsigned int) b_bcrypt_costs[b_bcrypt_cost];
+
+	  if (! benchmark_throughput(&params, throughput_threads, throughput_duration, &result))
+	    // This function logs error messages on failure
+	    return false;
+	}
+
+	return true;
+}
+
+#endif /* HAVE_LIBPTHREAD */
+
 static bool ATHEME_FATTR_WUR
 do_pbkdf2_benchmarks(void)
 {
@@ -617,6 +849,62 @@ do_pbkdf2_benchmarks(void)
 	return true;
 }
 
+static bool ATHEME_FATTR_WUR
+do_random_benchmarks(void)
+{
+	static const size_t b_random_lengths[] = { 4U, 8U, 16U, 32U, 64U, 256U };
+
+	(void) bench_print("");
+	(void) bench_print("");
+	(void) bench_print(_("Beginning random number generator benchmark ..."));
+	(void) bench_print(_("Using RNG frontend: %s"), random_get_frontend_info());
+
+	(void) random_print_colheaders();
+
+	for (size_t b_random_length = 0; b_random_length < BENCH_ARRAY_SIZE(b_random_lengths); b_random_length++)
+	{
+		if (! benchmark_random(b_random_lengths[b_random_length], false, NULL))
+			// This function logs error messages on failure
+			return false;
+
+		if (! benchmark_random(b_random_lengths[b_random_length], true, NULL))
+			// This function logs error messages on failure
+			return false;
+	}
+
+	return true;
+}
+
+#ifdef HAVE_LIBPTHREAD
+
+static bool ATHEME_FATTR_WUR
+do_pbkdf2_throughput_benchmarks(void)
+{
+	struct bench_throughput_params params = {
+		.algorithm          = BENCH_RUN_OPTIONS_PBKDF2,
+		.pbkdf2_batch       = throughput_pbkdf2_batch,
+		.with_sasl_scram    = with_sasl_scram,
+	};
+	struct bench_throughput_result result;
+
+	(void) throughput_begin("PBKDF2");
+
+	for (size_t b_pbkdf2_digest = 0; b_pbkdf2_digest < b_pbkdf2_digests_count; b_pbkdf2_digest++)
+	  for (size_t b_pbkdf2_itercount = 0; b_pbkdf2_itercount < b_pbkdf2_itercounts_count; b_pbkdf2_itercount++)
+	  {
+	    params.pbkdf2_digest = b_pbkdf2_digests[b_pbkdf2_digest];
+	    params.pbkdf2_itercount = b_pbkdf2_itercounts[b_pbkdf2_itercount];
+
+	    if (! benchmark_throughput(&params, throughput_threads, throughput_duration, &result))
+	      // This function logs error messages on failure
+	      return false;
+	  }
+
+	return true;
+}
+
+#endif /* HAVE_LIBPTHREAD */
+
 int
 main(int argc, char *argv[])
 {
@@ -632,6 +920,7 @@ main(int argc, char *argv[])
 
 	(void) bench_print("");
 	(void) bench_print(_("Using digest frontend: %s"), digest_get_frontend_info());
+	(void) bench_print(_("Using batched PBKDF2 kernel: %s"), digest_get_pbkdf2_batch_info());
 
 	if (! do_crypto_selftests())
 	{
@@ -643,6 +932,43 @@ main(int argc, char *argv[])
 	if ((run_options & BENCH_RUN_OPTIONS_TESTONLY))
 		return EXIT_SUCCESS;
 
+#ifdef HAVE_LIBPTHREAD
+	if ((run_options & BENCH_RUN_OPTIONS_OPTIMAL) && optimal_login_rate)
+	{
+		if (! do_optimal_throughput_benchmarks(throughput_threads, throughput_duration, optimal_login_rate,
+		                                       optimal_total_memlimit, optimal_memlimit, with_sasl_scram))
+			// This function logs error messages on failure
+			return EXIT_FAILURE;
+
+		return EXIT_SUCCESS;
+	}
+
+	if (throughput_mode && ! (run_options & BENCH_RUN_OPTIONS_OPTIMAL))
+	{
+#ifdef HAVE_LIBARGON2
+		if ((run_options & BENCH_RUN_OPTIONS_ARGON2) && ! do_argon2_throughput_benchmarks())
+			// This function logs error messages on failure
+			return EXIT_FAILURE;
+#endif /* HAVE_LIBARGON2 */
+
+#ifdef HAVE_LIBSODIUM_SCRYPT
+		if ((run_options & BENCH_RUN_OPTIONS_SCRYPT) && ! do_scrypt_throughput_benchmarks())
+			// This function logs error messages on failure
+			return EXIT_FAILURE;
+#endif /* HAVE_LIBSODIUM_SCRYPT */
+
+		if ((run_options & BENCH_RUN_OPTIONS_BCRYPT) && ! do_bcrypt_throughput_benchmarks())
+			// This function logs error messages on failure
+			return EXIT_FAILURE;
+
+		if ((run_options & BENCH_RUN_OPTIONS_PBKDF2) && ! do_pbkdf2_throughput_benchmarks())
+			// This function logs error messages on failure
+			return EXIT_FAILURE;
+
+		return EXIT_SUCCESS;
+	}
+#endif /* HAVE_LIBPTHREAD */
+
 	if ((run_options & BENCH_RUN_OPTIONS_OPTIMAL) &&
 	    ! do_optimal_benchmarks(optimal_clocklimit, optimal_memlimit, optimal_memlimit_given, with_sasl_scram))
 		// This function logs error messages on failure
@@ -668,5 +994,9 @@ main(int argc, char *argv[])
 		// This function logs error messages on failure
 		return EXIT_FAILURE;
 
+	if ((run_options & BENCH_RUN_OPTIONS_RANDOM) && ! do_random_benchmarks())
+		// This function logs error messages on failure
+		return EXIT_FAILURE;
+
 	return EXIT_SUCCESS;
 }
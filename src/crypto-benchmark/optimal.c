@@ -25,6 +25,7 @@
 
 #include "benchmark.h"              // (everything else)
 #include "optimal.h"                // self-declarations
+#include "throughput.h"             // benchmark_throughput()
 
 #ifdef HAVE_LIBARGON2
 
@@ -426,3 +427,421 @@ do_optimal_benchmarks(const long double optimal_clocklimit, const size_t ATHEME_
 	(void) fsync(fileno(stdout));
 	return true;
 }
+
+#ifdef HAVE_LIBPTHREAD
+
+/* The throughput tuning below works towards a sustained login rate on a given
+ * number of threads, rather than the latency of a single login. Each candidate
+ * configuration is run with benchmark_throughput(), and it passes if it keeps
+ * up with the target rate and the process stays within the total memory limit.
+ * Every parameter here except the Argon2/scrypt memory size scales the cost of
+ * a login (close to) linearly, so the first candidate is extrapolated from an
+ * initial run, and then stepped down until it passes.
+ */
+
+struct optimal_throughput_target
+{
+	unsigned int    threads;
+	long double     duration;
+	unsigned int    rate;
+	size_t          total_kib;
+};
+
+static bool ATHEME_FATTR_WUR
+optimal_throughput_run(const struct optimal_throughput_target *const restrict target,
+                       const struct bench_throughput_params *const restrict params,
+                       struct bench_throughput_result *const restrict result, bool *const restrict passed)
+{
+	if (! benchmark_throughput(params, target->threads, target->duration, result))
+		// This function logs error messages on failure
+		return false;
+
+	*passed = (result->rate >= (long double) target->rate &&
+	           (! result->peak_rss || result->peak_rss <= target->total_kib));
+
+	return true;
+}
+
+static void
+optimal_throughput_print_target(const struct optimal_throughput_target *const restrict target,
+                                const struct bench_throughput_result *const restrict result)
+{
+	(void) fprintf(stdout, _("\t/* Target: %u logins/s on %u threads within %s;"), target->rate,
+	                       target->threads, throughput_rss_to_str(target->total_kib));
+	(void) fprintf(stdout, _(" Benchmarked: %.1LF logins/s, p99 %.4LFs, peak RSS %s */\n"), result->rate,
+	                       result->latency_p99, throughput_rss_to_str(result->peak_rss));
+}
+
+static void
+optimal_throughput_giving_up(void)
+{
+	(void) bench_print("");
+	(void) bench_print(_("Reached minimum parameters without meeting the target!"));
+	(void) bench_print(_("Algorithm is too slow for this rate; giving up."));
+}
+
+#ifdef HAVE_LIBARGON2
+
+static bool ATHEME_FATTR_WUR
+do_optimal_argon2_throughput(const struct optimal_throughput_target *const restrict target,
+                             const size_t optimal_memlimit)
+{
+	(void) bench_print("");
+	(void) bench_print("");
+	(void) bench_print(_("Beginning automatic optimal Argon2 throughput benchmark ..."));
+
+	(void) throughput_print_colheaders(target->threads, target->duration);
+
+	struct bench_throughput_params params = {
+		.algorithm          = BENCH_RUN_OPTIONS_ARGON2,
+		.argon2_type        = Argon2_id,
+		.argon2_memcost     = optimal_memlimit,
+		.argon2_timecost    = ATHEME_ARGON2_TIMECOST_MIN,
+		.argon2_threads     = 1U,
+	};
+	struct bench_throughput_result result;
+	bool passed = false;
+
+	// Every thread can be hashing at once; leave half of the limit for the rest of services
+	while (params.argon2_memcost > ATHEME_ARGON2_MEMCOST_MIN &&
+	       ((((size_t) 1U) << params.argon2_memcost) * target->threads) > (target->total_kib / 2U))
+		params.argon2_memcost--;
+
+	// First find a memory size that works at the minimum time cost
+	for (;;)
+	{
+		if (! optimal_throughput_run(target, &params, &result, &passed))
+			// This function logs error messages on failure
+			return false;
+
+		if (passed)
+			break;
+
+		if (params.argon2_memcost <= ATHEME_ARGON2_MEMCOST_MIN)
+		{
+			(void) optimal_throughput_giving_up();
+			return true;
+		}
+
+		params.argon2_memcost--;
+	}
+
+	// Then spend any headroom on the time cost
+	const size_t timecost = (size_t) ((result.rate / target->rate) * params.argon2_timecost);
+
+	if (timecost > params.argon2_timecost)
+	{
+		struct bench_throughput_result candidate;
+		struct bench_throughput_params raised = params;
+
+		raised.argon2_timecost = BENCH_MIN(timecost, ATHEME_ARGON2_TIMECOST_MAX);
+
+		while (raised.argon2_timecost > params.argon2_timecost)
+		{
+			if (! optimal_throughput_run(target, &raised, &candidate, &passed))
+				// This function logs error messages on failure
+				return false;
+
+			if (passed)
+			{
+				params = raised;
+				result = candidate;
+				break;
+			}
+
+			raised.argon2_timecost--;
+		}
+	}
+
+	(void) bench_print("");
+	(void) bench_print(_("Recommended parameters:"));
+	(void) bench_print("");
+
+	(void) fprintf(stdout, "crypto {\n");
+	(void) optimal_throughput_print_target(target, &result);
+	(void) fprintf(stdout, "\targon2_type = \"%s\";\n", argon2_type2string(params.argon2_type, 0));
+	(void) fprintf(stdout, "\targon2_memcost = %zu; /* %s */ \n", params.argon2_memcost,
+	                       memory_power2k_to_str(params.argon2_memcost));
+	(void) fprintf(stdout, "\targon2_timecost = %zu;\n", params.argon2_timecost);
+	(void) fprintf(stdout, "\targon2_threads = %zu;\n", params.argon2_threads);
+	(void) fprintf(stdout, "};\n");
+	(void) fflush(stdout);
+
+	return true;
+}
+
+#endif /* HAVE_LIBARGON2 */
+
+#ifdef HAVE_LIBSODIUM_SCRYPT
+
+static bool ATHEME_FATTR_WUR
+do_optimal_scrypt_throughput(const struct optimal_throughput_target *const restrict target,
+                             const size_t optimal_memlimit)
+{
+	(void) bench_print("");
+	(void) bench_print("");
+	(void) bench_print(_("Beginning automatic optimal scrypt throughput benchmark ..."));
+
+	(void) throughput_print_colheaders(target->threads, target->duration);
+
+	struct bench_throughput_params params = {
+		.algorithm          = BENCH_RUN_OPTIONS_SCRYPT,
+		.scrypt_memlimit    = BENCH_MAX(optimal_memlimit, ATHEME_SCRYPT_MEMLIMIT_MIN),
+	};
+	struct bench_throughput_result result;
+	bool passed = false;
+
+	while (params.scrypt_memlimit > ATHEME_SCRYPT_MEMLIMIT_MIN &&
+	       ((((size_t) 1U) << params.scrypt_memlimit) * target->threads) > (target->total_kib / 2U))
+		params.scrypt_memlimit--;
+
+	// See do_optimal_scrypt_benchmark() for the relationship between these two
+	for (;;)
+	{
+		params.scrypt_opslimit = ((1ULL << params.scrypt_memlimit) * 32ULL);
+
+		if (! optimal_throughput_run(target, &params, &result, &passed))
+			// This function logs error messages on failure
+			return false;
+
+		if (passed)
+			break;
+
+		if (params.scrypt_memlimit <= ATHEME_SCRYPT_MEMLIMIT_MIN)
+		{
+			(void) optimal_throughput_giving_up();
+			return true;
+		}
+
+		params.scrypt_memlimit--;
+	}
+
+	// Then raise the opslimit, in powers of two, while there is headroom for it
+	while ((result.rate / 2.0L) >= (long double) target->rate && params.scrypt_opslimit <= (SIZE_MAX / 2U) &&
+	       (params.scrypt_opslimit * 2U) <= ATHEME_SCRYPT_OPSLIMIT_MAX)
+	{
+		struct bench_throughput_result candidate;
+		struct bench_throughput_params raised = params;
+
+		raised.scrypt_opslimit *= 2U;
+
+		if (! optimal_throughput_run(target, &raised, &candidate, &passed))
+			// This function logs error messages on failure
+			return false;
+
+		if (! passed)
+			break;
+
+		params = raised;
+		result = candidate;
+	}
+
+	(void) bench_print("");
+	(void) bench_print(_("Recommended parameters:"));
+	(void) bench_print("");
+
+	(void) fprintf(stdout, "crypto {\n");
+	(void) optimal_throughput_print_target(target, &result);
+	(void) fprintf(stdout, "\tscrypt_memlimit = %zu; /* %s */ \n", params.scrypt_memlimit,
+	                       memory_power2k_to_str(params.scrypt_memlimit));
+	(void) fprintf(stdout, "\tscrypt_opslimit = %zu;\n", params.scrypt_opslimit);
+	(void) fprintf(stdout, "};\n");
+	(void) fflush(stdout);
+
+	return true;
+}
+
+#endif /* HAVE_LIBSODIUM_SCRYPT */
+
+static bool ATHEME_FATTR_WUR
+do_optimal_bcrypt_throughput(const struct optimal_throughput_target *const restrict target)
+{
+	(void) bench_print("");
+	(void) bench_print("");
+	(void) bench_print(_("Beginning automatic optimal bcrypt throughput benchmark ..."));
+
+	(void) throughput_print_colheaders(target->threads, target->duration);
+
+	struct bench_throughput_params params = {
+		.algorithm          = BENCH_RUN_OPTIONS_BCRYPT,
+		.bcrypt_cost        = ATHEME_BCRYPT_ROUNDS_MIN,
+	};
+	struct bench_throughput_result result;
+	bool passed = false;
+
+	if (! optimal_throughput_run(target, &params, &result, &passed))
+		// This function logs error messages on failure
+		return false;
+
+	if (! passed)
+	{
+		(void) optimal_throughput_giving_up();
+		return true;
+	}
+
+	// Each extra round doubles the cost
+	unsigned int cost = params.bcrypt_cost;
+
+	for (long double headroom = result.rate / target->rate; headroom >= 2.0L; headroom /= 2.0L)
+		cost++;
+
+	struct bench_throughput_params raised = params;
+
+	raised.bcrypt_cost = BENCH_MIN(cost, ATHEME_BCRYPT_ROUNDS_MAX);
+
+	while (raised.bcrypt_cost > params.bcrypt_cost)
+	{
+		struct bench_throughput_result candidate;
+
+		if (! optimal_throughput_run(target, &raised, &candidate, &passed))
+			// This function logs error messages on failure
+			return false;
+
+		if (passed)
+		{
+			params = raised;
+			result = candidate;
+			break;
+		}
+
+		raised.bcrypt_cost--;
+	}
+
+	(void) bench_print("");
+	(void) bench_print(_("Recommended parameters:"));
+	(void) bench_print("");
+
+	(void) fprintf(stdout, "crypto {\n");
+	(void) optimal_throughput_print_target(target, &result);
+	(void) fprintf(stdout, "\tbcrypt_cost = %u;\n", params.bcrypt_cost);
+	(void) fprintf(stdout, "};\n");
+	(void) fflush(stdout);
+
+	return true;
+}
+
+static bool ATHEME_FATTR_WUR
+do_optimal_pbkdf2_throughput(const struct optimal_throughput_target *const restrict target,
+                             const bool with_sasl_scram)
+{
+	(void) bench_print("");
+	(void) bench_print("");
+	(void) bench_print(_("Beginning automatic optimal PBKDF2 throughput benchmark ..."));
+
+	(void) throughput_print_colheaders(target->threads, target->duration);
+
+	// See do_optimal_pbkdf2_benchmark() for the choice of digest
+	struct bench_throughput_params params = {
+		.algorithm          = BENCH_RUN_OPTIONS_PBKDF2,
+		.pbkdf2_digest      = DIGALG_SHA2_256,
+		.pbkdf2_itercount   = PBKDF2_ITERCNT_MIN,
+		.with_sasl_scram    = with_sasl_scram,
+	};
+	struct bench_throughput_result result;
+	bool passed = false;
+
+	if (! optimal_throughput_run(target, &params, &result, &passed))
+		// This function logs error messages on failure
+		return false;
+
+	if (! passed)
+	{
+		(void) optimal_throughput_giving_up();
+		return true;
+	}
+
+	const size_t maximum = ((with_sasl_scram) ? CYRUS_SASL_ITERCNT_MAX : PBKDF2_ITERCNT_MAX);
+	size_t iterations = (size_t) ((result.rate / target->rate) * params.pbkdf2_itercount);
+
+	iterations -= (iterations % 1000U);
+	iterations = BENCH_MIN(maximum, iterations);
+
+	struct bench_throughput_params raised = params;
+
+	raised.pbkdf2_itercount = iterations;
+
+	while (raised.pbkdf2_itercount > params.pbkdf2_itercount)
+	{
+		struct bench_throughput_result candidate;
+
+		if (! optimal_throughput_run(target, &raised, &candidate, &passed))
+			// This function logs error messages on failure
+			return false;
+
+		if (passed)
+		{
+			params = raised;
+			result = candidate;
+			break;
+		}
+
+		// Step down by 10%, keeping it a multiple of a thousand
+		raised.pbkdf2_itercount -= BENCH_MAX(1000U, (raised.pbkdf2_itercount / 10U));
+		raised.pbkdf2_itercount -= (raised.pbkdf2_itercount % 1000U);
+	}
+
+	(void) bench_print("");
+	(void) bench_print(_("Recommended parameters:"));
+	(void) bench_print("");
+
+	(void) fprintf(stdout, "crypto {\n");
+	(void) optimal_throughput_print_target(target, &result);
+	(void) fprintf(stdout, "\tpbkdf2v2_digest = \"%s\";\n", md_digest_to_name(params.pbkdf2_digest,
+	                                                                           with_sasl_scram));
+	(void) fprintf(stdout, "\tpbkdf2v2_rounds = %zu;\n", params.pbkdf2_itercount);
+	(void) fprintf(stdout, "};\n");
+	(void) fflush(stdout);
+
+	return true;
+}
+
+bool ATHEME_FATTR_WUR
+do_optimal_throughput_benchmarks(const unsigned int threads, const long double duration, const unsigned int rate,
+                                 const size_t total_memlimit, const size_t ATHEME_VATTR_MAYBE_UNUSED optimal_memlimit,
+                                 const bool with_sasl_scram)
+{
+	const struct optimal_throughput_target target = {
+		.threads    = threads,
+		.duration   = duration,
+		.rate       = rate,
+		.total_kib  = (((size_t) 1U) << total_memlimit),
+	};
+
+	(void) bench_print("");
+	(void) bench_print("");
+	(void) bench_print(_(""
+		"NOTICE: Tuning for %u logins per second on %u threads, within %s of memory.\n"
+		"        Every candidate configuration is run for %.2LFs; this may take a while."
+	), rate, threads, throughput_rss_to_str(target.total_kib), duration);
+
+#ifdef HAVE_LIBARGON2
+	if (! do_optimal_argon2_throughput(&target, optimal_memlimit))
+		// This function logs error messages on failure
+		return false;
+#endif
+
+#ifdef HAVE_LIBSODIUM_SCRYPT
+	if (! do_optimal_scrypt_throughput(&target, optimal_memlimit))
+		// This function logs error messages on failure
+		return false;
+#endif
+
+	if (! do_optimal_bcrypt_throughput(&target))
+		// This function logs error messages on failure
+		return false;
+
+	if (! do_optimal_pbkdf2_throughput(&target, with_sasl_scram))
+		// This function logs error messages on failure
+		return false;
+
+	// Verifying on the same number of threads in services is what makes the rates above achievable
+	(void) fprintf(stdout, "general {\n");
+	(void) fprintf(stdout, "\tpassword_verify_threads = %u;\n", threads);
+	(void) fprintf(stdout, "};\n");
+	(void) fflush(stdout);
+
+	(void) fsync(fileno(stdout));
+	return true;
+}
+
+#endif /* HAVE_LIBPTHREAD */
@@ -14,7 +14,12 @@
 
 #include <atheme/attributes.h>      // ATHEME_FATTR_WUR
 #include <atheme/stdheaders.h>      // bool
+#include <atheme/sysconf.h>         // HAVE_*
 
 bool do_optimal_benchmarks(long double, size_t, bool, bool) ATHEME_FATTR_WUR;
 
+#ifdef HAVE_LIBPTHREAD
+bool do_optimal_throughput_benchmarks(unsigned int, long double, unsigned int, size_t, size_t, bool) ATHEME_FATTR_WUR;
+#endif
+
 #endif /* !ATHEME_SRC_CRYPTO_BENCHMARK_OPTIMAL_H */
@@ -0,0 +1,491 @@
+/*
+ * SPDX-License-Identifier: ISC
+ * SPDX-URL: https://spdx.org/licenses/ISC.html
+ *
+ * Copyright (C) 2026 Atheme Development Group (https://atheme.github.io/)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ */
+
+#include <atheme/attributes.h>      // ATHEME_FATTR_WUR
+#include <atheme/argon2.h>          // ATHEME_ARGON2_*
+#include <atheme/bcrypt.h>          // ATHEME_BCRYPT_*, atheme_eks_bf_compute()
+#include <atheme/constants.h>       // BUFSIZE, PASSLEN
+#include <atheme/digest.h>          // digest_oneshot_pbkdf2(), digest_oneshot_pbkdf2_batch()
+#include <atheme/i18n.h>            // _() (gettext)
+#include <atheme/memory.h>          // smalloc(), sreallocarray(), sfree()
+#include <atheme/pbkdf2.h>          // PBKDF2_*
+#include <atheme/random.h>          // atheme_random_*()
+#include <atheme/stdheaders.h>      // (everything else)
+#include <atheme/sysconf.h>         // HAVE_*
+
+#include "benchmark.h"              // bench_print(), memory_power2k_to_str(), md_digest_to_name()
+#include "throughput.h"             // self-declarations
+
+#ifdef HAVE_LIBPTHREAD
+
+#include <pthread.h>                // pthread_*()
+#include <sys/resource.h>           // getrusage()
+
+#ifdef HAVE_LIBARGON2
+#  include <argon2.h>               // argon2_context, argon2_ctx(), ARGON2_VERSION_NUMBER
+#endif
+
+#ifdef HAVE_LIBSODIUM_SCRYPT
+#  include <sodium/crypto_pwhash_scryptsalsa208sha256.h> // crypto_pwhash_scryptsalsa208sha256_str()
+#endif
+
+// How often the main thread samples the resident set size while the workers run
+#define BENCH_THROUGHPUT_SAMPLE_NSEC    10000000L
+
+static const long double nsec_per_sec = 1000000000.0L;
+
+struct bench_throughput_shared
+{
+	pthread_mutex_t                         lock;
+	bool                                    stop;
+	bool                                    failed;
+	const struct bench_throughput_params *  params;
+};
+
+struct bench_throughput_worker
+{
+	pthread_t                               thread;
+	struct bench_throughput_shared *        shared;
+	long double *                           latencies;
+	size_t                                  latencies_count;
+	size_t                                  latencies_alloc;
+	unsigned char                           salt[BUFSIZE];
+	unsigned char                           hash[BUFSIZE];
+	unsigned char                           hashes[BENCH_PBKDF2_BATCH_MAX][DIGEST_MDLEN_MAX];
+	char                                    pass[PASSLEN + 1];
+};
+
+static inline long double
+throughput_now(void)
+{
+	struct timespec ts;
+
+	(void) memset(&ts, 0x00, sizeof ts);
+	(void) clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ((long double) ts.tv_sec) + (((long double) ts.tv_nsec) / nsec_per_sec);
+}
+
+/* The resident set size of the whole process right now, in KiB. Where that is
+ * not available, this falls back to the (monotonic) peak since the program
+ * started, which overstates the peak of any one run but never understates it.
+ */
+static size_t
+throughput_current_rss(void)
+{
+	FILE *const fp = fopen("/proc/self/statm", "r");
+
+	if (fp)
+	{
+		unsigned long long pages_total = 0;
+		unsigned long long pages_resident = 0;
+		const int ret = fscanf(fp, "%llu %llu", &pages_total, &pages_resident);
+
+		(void) fclose(fp);
+
+		if (ret == 2)
+			return (size_t) ((pages_resident * (unsigned long long) sysconf(_SC_PAGESIZE)) / 1024ULL);
+	}
+
+	struct rusage ru;
+
+	(void) memset(&ru, 0x00, sizeof ru);
+
+	if (getrusage(RUSAGE_SELF, &ru) != 0)
+		return 0;
+
+#ifdef __APPLE__
+	// Reported in bytes here, and in KiB everywhere else
+	return (size_t) (ru.ru_maxrss / 1024L);
+#else
+	return (size_t) ru.ru_maxrss;
+#endif
+}
+
+// Performs the same work as verifying a batch of PBKDF2 passwords would; returns how many
+static size_t
+throughput_verify_pbkdf2_batch(struct bench_throughput_worker *const restrict w)
+{
+	const struct bench_throughput_params *const p = w->shared->params;
+	const size_t mdlen = digest_size_alg(p->pbkdf2_digest);
+	struct digest_pbkdf2_job jobs[BENCH_PBKDF2_BATCH_MAX];
+
+	for (unsigned int i = 0; i < p->pbkdf2_batch; i++)
+	{
+		jobs[i].pass = w->pass;
+		jobs[i].passLen = PASSLEN;
+		jobs[i].salt = w->salt;
+		jobs[i].saltLen = PBKDF2_SALTLEN_DEF;
+		jobs[i].dk = w->hashes[i];
+		jobs[i].dkLen = mdlen;
+	}
+
+	if (! digest_oneshot_pbkdf2_batch(p->pbkdf2_digest, p->pbkdf2_itercount, jobs, p->pbkdf2_batch))
+		return 0;
+
+	if (p->with_sasl_scram)
+	{
+		unsigned char ClientKey[DIGEST_MDLEN_MAX];
+		unsigned char StoredKey[DIGEST_MDLEN_MAX];
+
+		for (unsigned int i = 0; i < p->pbkdf2_batch; i++)
+		{
+			if (! digest_oneshot_hmac(p->pbkdf2_digest, w->hashes[i], mdlen, "Client Key", 10U, ClientKey, NULL))
+				return 0;
+
+			if (! digest_oneshot(p->pbkdf2_digest, ClientKey, mdlen, StoredKey, NULL))
+				return 0;
+		}
+	}
+
+	return p->pbkdf2_batch;
+}
+
+// Performs the same work as verifying one password would
+static bool
+throughput_verify_one(struct bench_throughput_worker *const restrict w)
+{
+	const struct bench_throughput_params *const p = w->shared->params;
+
+	switch (p->algorithm)
+	{
+#ifdef HAVE_LIBARGON2
+		case BENCH_RUN_OPTIONS_ARGON2:
+		{
+			argon2_context ctx = {
+				.out            = w->hash,
+				.outlen         = ATHEME_ARGON2_HASHLEN_DEF,
+				.pwd            = (void *) w->pass,
+				.pwdlen         = PASSLEN,
+				.salt           = w->salt,
+				.saltlen        = ATHEME_ARGON2_SALTLEN_DEF,
+				.t_cost         = p->argon2_timecost,
+				.m_cost         = (1U << p->argon2_memcost),
+				.lanes          = p->argon2_threads,
+				.threads        = p->argon2_threads,
+				.version        = ARGON2_VERSION_NUMBER,
+			};
+
+			return (argon2_ctx(&ctx, p->argon2_type) == (int) ARGON2_OK);
+		}
+#endif /* HAVE_LIBARGON2 */
+
+#ifdef HAVE_LIBSODIUM_SCRYPT
+		case BENCH_RUN_OPTIONS_SCRYPT:
+		{
+			const size_t memlimit_real = ((1ULL << p->scrypt_memlimit) * 1024ULL);
+
+			return (crypto_pwhash_scryptsalsa208sha256_str((void *) w->hash, w->pass, PASSLEN,
+			                                               p->scrypt_opslimit, memlimit_real) == 0);
+		}
+#endif /* HAVE_LIBSODIUM_SCRYPT */
+
+		case BENCH_RUN_OPTIONS_BCRYPT:
+			return atheme_eks_bf_compute(w->pass, ATHEME_BCRYPT_VERSION_MINOR, p->bcrypt_cost, w->salt, w->hash);
+
+		case BENCH_RUN_OPTIONS_PBKDF2:
+		{
+			const size_t mdlen = digest_size_alg(p->pbkdf2_digest);
+
+			if (! digest_oneshot_pbkdf2(p->pbkdf2_digest, w->pass, PASSLEN, w->salt, PBKDF2_SALTLEN_DEF,
+			                            p->pbkdf2_itercount, w->hash, mdlen))
+				return false;
+
+			if (! p->with_sasl_scram)
+				return true;
+
+			unsigned char ClientKey[DIGEST_MDLEN_MAX];
+			unsigned char StoredKey[DIGEST_MDLEN_MAX];
+
+			if (! digest_oneshot_hmac(p->pbkdf2_digest, w->hash, mdlen, "Client Key", 10U, ClientKey, NULL))
+				return false;
+
+			return digest_oneshot(p->pbkdf2_digest, ClientKey, mdlen, StoredKey, NULL);
+		}
+	}
+
+	return false;
+}
+
+static void *
+throughput_worker(void *const restrict vw)
+{
+	struct bench_throughput_worker *const w = vw;
+	struct bench_throughput_shared *const shared = w->shared;
+
+	for (;;)
+	{
+		(void) pthread_mutex_lock(&shared->lock);
+		const bool stop = shared->stop;
+		(void) pthread_mutex_unlock(&shared->lock);
+
+		if (stop)
+			break;
+
+		const struct bench_throughput_params *const p = shared->params;
+		const long double begin = throughput_now();
+		size_t done;
+
+		if (p->algorithm == BENCH_RUN_OPTIONS_PBKDF2 && p->pbkdf2_batch > 1U)
+			done = throughput_verify_pbkdf2_batch(w);
+		else
+			done = throughput_verify_one(w) ? 1U : 0U;
+
+		if (! done)
+		{
+			(void) pthread_mutex_lock(&shared->lock);
+			shared->failed = true;
+			shared->stop = true;
+			(void) pthread_mutex_unlock(&shared->lock);
+			break;
+		}
+
+		// Every password in a batch waits for the whole batch
+		const long double latency = throughput_now() - begin;
+
+		for (size_t i = 0; i < done; i++)
+		{
+			if (w->latencies_count == w->latencies_alloc)
+			{
+				w->latencies_alloc = BENCH_MAX(w->latencies_alloc * 2U, 64U);
+				w->latencies = sreallocarray(w->latencies, w->latencies_alloc, sizeof *w->latencies);
+			}
+
+			w->latencies[w->latencies_count++] = latency;
+		}
+	}
+
+	return NULL;
+}
+
+static int
+throughput_latency_cmp(const void *const restrict a, const void *const restrict b)
+{
+	const long double la = *((const long double *) a);
+	const long double lb = *((const long double *) b);
+
+	return (la < lb) ? -1 : ((la > lb) ? 1 : 0);
+}
+
+// Nearest-rank percentile of a sorted, non-empty array
+static long double
+throughput_percentile(const long double *const restrict sorted, const size_t count, const unsigned int pct)
+{
+	size_t rank = ((count * pct) + 99U) / 100U;
+
+	if (rank < 1U)
+		rank = 1U;
+
+	return sorted[rank - 1U];
+}
+
+unsigned int ATHEME_FATTR_WUR
+throughput_default_threads(void)
+{
+	const long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+	if (ncpus < (long) BENCH_THROUGHPUT_THREADS_MIN)
+		return BENCH_THROUGHPUT_THREADS_MIN;
+
+	if (ncpus > (long) BENCH_THROUGHPUT_THREADS_MAX)
+		return BENCH_THROUGHPUT_THREADS_MAX;
+
+	return (unsigned int) ncpus;
+}
+
+const char *
+throughput_rss_to_str(const size_t kib)
+{
+	static char result[BUFSIZE];
+
+	if (! kib)
+		(void) snprintf(result, sizeof result, "%s", _("unknown"));
+	else if (kib >= (1024U * 1024U))
+		(void) snprintf(result, sizeof result, "%.2Lf GiB", ((long double) kib) / (1024.0L * 1024.0L));
+	else if (kib >= 1024U)
+		(void) snprintf(result, sizeof result, "%.1Lf MiB", ((long double) kib) / 1024.0L);
+	else
+		(void) snprintf(result, sizeof result, "%zu KiB", kib);
+
+	return result;
+}
+
+void
+throughput_print_colheaders(const unsigned int threads, const long double duration)
+{
+	(void) bench_print("");
+	(void) bench_print(_("Running %u worker thread(s) for %.2LFs per configuration"), threads, duration);
+	(void) bench_print(_(""
+		"\n"
+		"Parameters                          Verifies   Verifies/s   p50 Latency   p99 Latency   Peak RSS\n"
+		"---------------------------------- ---------- ------------ ------------- ------------- ------------"
+	));
+}
+
+void
+throughput_print_rowstats(const struct bench_throughput_params *const restrict p,
+                          const struct bench_throughput_result *const restrict r)
+{
+	char label[BUFSIZE];
+
+	(void) memset(label, 0x00, sizeof label);
+
+	switch (p->algorithm)
+	{
+#ifdef HAVE_LIBARGON2
+		case BENCH_RUN_OPTIONS_ARGON2:
+			(void) snprintf(label, sizeof label, "%s m=%s t=%zu p=%zu", argon2_type2string(p->argon2_type, 1),
+			                memory_power2k_to_str(p->argon2_memcost), p->argon2_timecost, p->argon2_threads);
+			break;
+#endif
+#ifdef HAVE_LIBSODIUM_SCRYPT
+		case BENCH_RUN_OPTIONS_SCRYPT:
+			(void) snprintf(label, sizeof label, "scrypt mem=%s ops=%zu",
+			                memory_power2k_to_str(p->scrypt_memlimit), p->scrypt_opslimit);
+			break;
+#endif
+		case BENCH_RUN_OPTIONS_BCRYPT:
+			(void) snprintf(label, sizeof label, "bcrypt cost=%u", p->bcrypt_cost);
+			break;
+
+		case BENCH_RUN_OPTIONS_PBKDF2:
+			if (p->pbkdf2_batch > 1U)
+				(void) snprintf(label, sizeof label, "%s i=%zu batch=%u",
+				                md_digest_to_name(p->pbkdf2_digest, p->with_sasl_scram), p->pbkdf2_itercount,
+				                p->pbkdf2_batch);
+			else
+				(void) snprintf(label, sizeof label, "%s i=%zu",
+				                md_digest_to_name(p->pbkdf2_digest, p->with_sasl_scram), p->pbkdf2_itercount);
+			break;
+	}
+
+	(void) bench_print(_("%-34s %10zu %12.2LF %12.4LFs %12.4LFs %12s"), label, r->verifies, r->rate,
+	                       r->latency_p50, r->latency_p99, throughput_rss_to_str(r->peak_rss));
+}
+
+/* Runs 'threads' workers that verify passwords back-to-back with the given
+ * parameters for 'duration' seconds, while this thread watches the resident
+ * set size of the process. Verifications still running when the time is up
+ * are allowed to finish and are counted.
+ */
+bool ATHEME_FATTR_WUR
+benchmark_throughput(const struct bench_throughput_params *const restrict params, const unsigned int threads,
+                     const long double duration, struct bench_throughput_result *const restrict result)
+{
+	struct bench_throughput_shared shared = {
+		.stop           = false,
+		.failed         = false,
+		.params         = params,
+	};
+
+	struct bench_throughput_worker *const workers = smalloc(threads * sizeof *workers);
+	unsigned int started = 0;
+	bool ret = true;
+
+	(void) pthread_mutex_init(&shared.lock, NULL);
+
+	for (unsigned int i = 0; i < threads; i++)
+	{
+		workers[i].shared = &shared;
+
+		(void) atheme_random_buf(workers[i].salt, sizeof workers[i].salt);
+		(void) atheme_random_str(workers[i].pass, PASSLEN);
+	}
+
+	size_t peak_rss = throughput_current_rss();
+	const long double begin = throughput_now();
+
+	for (started = 0; started < threads; started++)
+	{
+		if (pthread_create(&workers[started].thread, NULL, &throughput_worker, &workers[started]) != 0)
+		{
+			(void) perror("pthread_create(3)");
+			ret = false;
+			break;
+		}
+	}
+
+	while (ret && (throughput_now() - begin) < duration)
+	{
+		const struct timespec ts = { .tv_sec = 0, .tv_nsec = BENCH_THROUGHPUT_SAMPLE_NSEC };
+
+		(void) nanosleep(&ts, NULL);
+
+		peak_rss = BENCH_MAX(peak_rss, throughput_current_rss());
+
+		(void) pthread_mutex_lock(&shared.lock);
+		const bool failed = shared.failed;
+		(void) pthread_mutex_unlock(&shared.lock);
+
+		if (failed)
+			break;
+	}
+
+	(void) pthread_mutex_lock(&shared.lock);
+	shared.stop = true;
+	(void) pthread_mutex_unlock(&shared.lock);
+
+	for (unsigned int i = 0; i < started; i++)
+		(void) pthread_join(workers[i].thread, NULL);
+
+	const long double elapsed = throughput_now() - begin;
+
+	if (shared.failed)
+	{
+		(void) bench_print(_("A worker thread failed to compute a password hash"));
+		ret = false;
+	}
+
+	size_t count = 0;
+
+	for (unsigned int i = 0; i < started; i++)
+		count += workers[i].latencies_count;
+
+	if (ret && ! count)
+	{
+		(void) bench_print(_("No verification finished; is the run duration too short?"));
+		ret = false;
+	}
+
+	if (ret)
+	{
+		long double *const all = smalloc(count * sizeof *all);
+		size_t pos = 0;
+
+		for (unsigned int i = 0; i < started; i++)
+		{
+			(void) memcpy(all + pos, workers[i].latencies, workers[i].latencies_count * sizeof *all);
+			pos += workers[i].latencies_count;
+		}
+
+		(void) qsort(all, count, sizeof *all, &throughput_latency_cmp);
+
+		result->verifies = count;
+		result->elapsed = elapsed;
+		result->rate = ((long double) count) / elapsed;
+		result->latency_p50 = throughput_percentile(all, count, 50U);
+		result->latency_p99 = throughput_percentile(all, count, 99U);
+		result->peak_rss = peak_rss;
+
+		(void) sfree(all);
+		(void) throughput_print_rowstats(params, result);
+	}
+
+	for (unsigned int i = 0; i < threads; i++)
+		(void) sfree(workers[i].latencies);
+
+	(void) smemzerofree(workers, threads * sizeof *workers);
+	(void) pthread_mutex_destroy(&shared.lock);
+
+	return ret;
+}
+
+#endif /* HAVE_LIBPTHREAD */
@@ -0,0 +1,77 @@
+/*
+ * SPDX-License-Identifier: ISC
+ * SPDX-URL: https://spdx.org/licenses/ISC.html
+ *
+ * Copyright (C) 2026 Atheme Development Group (https://atheme.github.io/)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ */
+
+#ifndef ATHEME_SRC_CRYPTO_BENCHMARK_THROUGHPUT_H
+#define ATHEME_SRC_CRYPTO_BENCHMARK_THROUGHPUT_H 1
+
+#include <atheme/attributes.h>      // ATHEME_FATTR_WUR
+#include <atheme/digest.h>          // enum digest_algorithm
+#include <atheme/stdheaders.h>      // bool, size_t
+#include <atheme/sysconf.h>         // HAVE_*
+
+#ifdef HAVE_LIBARGON2
+#  include <argon2.h>               // argon2_type
+#endif
+
+#ifdef HAVE_LIBPTHREAD
+
+#define BENCH_THROUGHPUT_DURATION_MIN   1.00L
+#define BENCH_THROUGHPUT_DURATION_DEF   5.00L
+#define BENCH_THROUGHPUT_DURATION_MAX   600.00L
+
+#define BENCH_THROUGHPUT_THREADS_MIN    1U
+#define BENCH_THROUGHPUT_THREADS_MAX    1024U
+
+// PBKDF2 derivations done at once by each thread; the most services' verify pool hands a thread
+#define BENCH_PBKDF2_BATCH_MIN          1U
+#define BENCH_PBKDF2_BATCH_MAX          16U
+
+// One algorithm and its parameters; only the members for 'algorithm' are used
+struct bench_throughput_params
+{
+	unsigned int            algorithm;      // BENCH_RUN_OPTIONS_{ARGON2,SCRYPT,BCRYPT,PBKDF2}
+#ifdef HAVE_LIBARGON2
+	argon2_type             argon2_type;
+	size_t                  argon2_memcost;
+	size_t                  argon2_timecost;
+	size_t                  argon2_threads;
+#endif
+#ifdef HAVE_LIBSODIUM_SCRYPT
+	size_t                  scrypt_memlimit;
+	size_t                  scrypt_opslimit;
+#endif
+	unsigned int            bcrypt_cost;
+	enum digest_algorithm   pbkdf2_digest;
+	size_t                  pbkdf2_itercount;
+	unsigned int            pbkdf2_batch;   // derivations per call to digest_oneshot_pbkdf2_batch()
+	bool                    with_sasl_scram;
+};
+
+struct bench_throughput_result
+{
+	size_t                  verifies;       // completed in the run
+	long double             elapsed;        // wall clock time of the run
+	long double             rate;           // verifies per second, over all threads
+	long double             latency_p50;
+	long double             latency_p99;
+	size_t                  peak_rss;       // in KiB; 0 if it could not be determined
+};
+
+unsigned int throughput_default_threads(void) ATHEME_FATTR_WUR;
+const char *throughput_rss_to_str(size_t);
+void throughput_print_colheaders(unsigned int, long double);
+void throughput_print_rowstats(const struct bench_throughput_params *, const struct bench_throughput_result *);
+bool benchmark_throughput(const struct bench_throughput_params *, unsigned int, long double,
+                          struct bench_throughput_result *) ATHEME_FATTR_WUR;
+
+#endif /* HAVE_LIBPTHREAD */
+
+#endif /* !ATHEME_SRC_CRYPTO_BENCHMARK_THROUGHPUT_H */
@@ -81,6 +81,38 @@ verify_channel_registrations(void)
 	}
 }
 
+static void
+print_load_profile(void)
+{
+	size_t count = 0;
+	struct database_row_profile **const profs = db_profile_sort(DB_READ, &count);
+	struct database_row_stats total = { 0, 0, 0 };
+
+	for (size_t i = 0; i < count; i++)
+	{
+		total.rows += profs[i]->stats[DB_READ].rows;
+		total.bytes += profs[i]->stats[DB_READ].bytes;
+		total.usec += profs[i]->stats[DB_READ].usec;
+	}
+
+	(void) printf("%-6s %10s %12s %6s %10s\n", "Type", "Rows", "Bytes", "%", "Parse (ms)");
+	(void) printf("------ ---------- ------------ ------ ----------\n");
+
+	for (size_t i = 0; i < count; i++)
+	{
+		const struct database_row_stats *const stats = &profs[i]->stats[DB_READ];
+
+		(void) printf("%-6s %10llu %12llu %5.1f%% %10.1f\n", profs[i]->type, stats->rows, stats->bytes,
+		              total.bytes ? (100.0 * stats->bytes / total.bytes) : 0.0, stats->usec / 1000.0);
+	}
+
+	(void) printf("------ ---------- ------------ ------ ----------\n");
+	(void) printf("%-6s %10llu %12llu %5.1f%% %10.1f\n", "Total", total.rows, total.bytes, 100.0,
+	              total.usec / 1000.0);
+
+	(void) sfree(profs);
+}
+
 static void
 handle_mdep(struct database_handle *db, const char *type)
 {
@@ -105,6 +137,15 @@ main(int argc, char *argv[])
 	strict_mode = false;
 	offline_mode = true;
 
+	// With --profile, only load the database and report where its size and parse time go
+	bool profile = false;
+
+	if (argv[1] && strcmp(argv[1], "--profile") == 0)
+	{
+		profile = true;
+		argv++;
+	}
+
 	char *filename = argv[1] ? argv[1] : "services.db";
 	slog(LG_INFO, "dbverify is operating on %s", filename);
 
@@ -120,6 +161,12 @@ main(int argc, char *argv[])
 	db_load(filename);
 	runflags |= RF_LIVE;
 
+	if (profile)
+	{
+		print_load_profile();
+		return EXIT_SUCCESS;
+	}
+
 	slog(LG_INFO, "*** phase 2: doing basic atheme database consistency check");
 
 	db_check();
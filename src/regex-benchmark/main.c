@@ -0,0 +1,154 @@
+/*
+ * SPDX-License-Identifier: ISC
+ * SPDX-URL: https://spdx.org/licenses/ISC.html
+ *
+ * Copyright (C) 2026 Atheme Development Group (https://atheme.github.io/)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * Compares the regex engines available to RWATCH / RMATCH / RAKILL on
+ * synthetic nick!user@host gecos strings.
+ */
+
+#include <atheme.h>
+#include <atheme/libathemecore.h>
+
+#define BENCH_SUBJECTS          10000U
+#define BENCH_ROUNDS            20U
+
+static const char *const nick_words[] = {
+	"alice", "bob", "carol", "dave", "eve", "mallory", "trent", "peggy",
+	"victor", "walter", "guest", "user", "anon", "Sleepy", "zz", "Dark",
+};
+
+static const char *const host_suffixes[] = {
+	"res.example.net", "dsl.example.org", "cable.example.com", "dyn.example.de",
+	"users.example.chat", "cloud.example.io", "mobile.example.net", "vpn.example.org",
+};
+
+static const char *const gecos_words[] = {
+	"realname", "Free downloads", "I like turtles", "https://example.com/",
+	"...", "Bot", "win prizes now", "Just Me",
+};
+
+static const char *const patterns[] = {
+	"^guest[0-9]+!",
+	"^[a-z]{3,5}[0-9]{2,4}![a-z]+@",
+	"@.*\\.(dsl|dyn)\\.example\\.(org|de) ",
+	" .*(free|win|prize).*$",
+	"^[^!]*!~?[a-z]{8}@[0-9.]+ [A-Z][a-z]+$",
+};
+
+static char **subjects = NULL;
+static size_t *subject_lens = NULL;
+
+static void
+make_subjects(void)
+{
+	subjects = smalloc(BENCH_SUBJECTS * sizeof *subjects);
+	subject_lens = smalloc(BENCH_SUBJECTS * sizeof *subject_lens);
+
+	for (size_t i = 0; i < BENCH_SUBJECTS; i++)
+	{
+		char buf[NICKLEN + 1 + USERLEN + 1 + HOSTLEN + 1 + GECOSLEN + 1];
+		char user[USERLEN + 1];
+		char host[HOSTLEN + 1];
+
+		(void) atheme_random_str(user, 8);
+		for (char *p = user; *p != '\0'; p++)
+			*p = (char) tolower((unsigned char) *p);
+
+		if (atheme_random_uniform(2))
+			(void) snprintf(host, sizeof host, "%u.%u.%u.%u", 192U + atheme_random_uniform(32),
+			                atheme_random_uniform(256), atheme_random_uniform(256), atheme_random_uniform(256));
+		else
+			(void) snprintf(host, sizeof host, "cpe-%u-%u.%s", atheme_random_uniform(65536),
+			                atheme_random_uniform(65536),
+			                host_suffixes[atheme_random_uniform(ARRAY_SIZE(host_suffixes))]);
+
+		const int len = snprintf(buf, sizeof buf, "%s%u!%s%s@%s %s",
+		                         nick_words[atheme_random_uniform(ARRAY_SIZE(nick_words))],
+		                         atheme_random_uniform(10000), (atheme_random_uniform(2) ? "~" : ""), user, host,
+		                         gecos_words[atheme_random_uniform(ARRAY_SIZE(gecos_words))]);
+
+		subjects[i] = sstrdup(buf);
+		subject_lens[i] = (size_t) len;
+	}
+}
+
+static bool
+run_engine(const char *const restrict name, const int flags)
+{
+	struct atheme_regex *regs[ARRAY_SIZE(patterns)];
+	struct timespec begin;
+	struct timespec end;
+	unsigned long long matches = 0;
+	bool jit = true;
+
+	for (size_t p = 0; p < ARRAY_SIZE(patterns); p++)
+	{
+		if (! (regs[p] = regex_create((char *) patterns[p], flags)))
+		{
+			(void) printf("%-10s  (not available)\n", name);
+
+			while (p--)
+				(void) regex_destroy(regs[p]);
+
+			return false;
+		}
+
+		jit &= regex_is_jit(regs[p]);
+	}
+
+	if ((flags & AREGEX_PCRE) && ! (flags & AREGEX_NOJIT) && ! jit)
+		(void) printf("%-10s  (warning: not all patterns were JIT-compiled)\n", name);
+
+	(void) clock_gettime(CLOCK_MONOTONIC, &begin);
+
+	for (unsigned int r = 0; r < BENCH_ROUNDS; r++)
+		for (size_t s = 0; s < BENCH_SUBJECTS; s++)
+			for (size_t p = 0; p < ARRAY_SIZE(patterns); p++)
+				if (regex_match_len(regs[p], subjects[s], subject_lens[s]))
+					matches++;
+
+	(void) clock_gettime(CLOCK_MONOTONIC, &end);
+
+	const double elapsed = (double) (end.tv_sec - begin.tv_sec) + ((double) (end.tv_nsec - begin.tv_nsec) / 1e9);
+	const double total = (double) BENCH_ROUNDS * BENCH_SUBJECTS * ARRAY_SIZE(patterns);
+
+	(void) printf("%-10s  %10.3fs  %14.0f  %10llu\n", name, elapsed, (elapsed > 0) ? (total / elapsed) : 0.0,
+	              matches / BENCH_ROUNDS);
+
+	for (size_t p = 0; p < ARRAY_SIZE(patterns); p++)
+		(void) regex_destroy(regs[p]);
+
+	return true;
+}
+
+int
+main(int argc, char *argv[])
+{
+	if (! libathemecore_early_init())
+		return EXIT_FAILURE;
+
+	(void) make_subjects();
+
+	(void) printf("regex benchmark for atheme %s (%s)\n", PACKAGE_VERSION, SERNO);
+	(void) printf("%u subjects, %zu patterns, %u rounds\n\n", BENCH_SUBJECTS, ARRAY_SIZE(patterns), BENCH_ROUNDS);
+	(void) printf("Engine      Elapsed      Matches/sec     Hits\n");
+	(void) printf("----------  -----------  --------------  ----------\n");
+
+	(void) run_engine("POSIX", AREGEX_ICASE);
+	(void) run_engine("PCRE", AREGEX_ICASE | AREGEX_PCRE | AREGEX_NOJIT);
+	(void) run_engine("PCRE-JIT", AREGEX_ICASE | AREGEX_PCRE);
+
+	for (size_t i = 0; i < BENCH_SUBJECTS; i++)
+		sfree(subjects[i]);
+
+	sfree(subjects);
+	sfree(subject_lens);
+
+	return EXIT_SUCCESS;
+}